@@ -0,0 +1,240 @@
+//---------------------------------------------------------------------------------
+// alloc.c
+// Allocation counting. The linker routes calls to the heap functions through
+// the __wrap_ functions here (see --wrap in the Makefile), which count and
+// pass them on to newlib's. Totals are atomic counters that alloc_frame()
+// turns into per-frame figures; tags and call sites go in small open-
+// addressed tables keyed by pointer, whose slots are claimed by compare-and-
+// swap, so any thread can count without taking a lock inside malloc.
+// Allocations newlib makes internally, such as stdio buffers, are not seen.
+//---------------------------------------------------------------------------------
+
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "prof.h"
+
+#ifdef __3DS__
+#include <malloc.h>
+#endif
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+static AllocTag s_tags[ALLOC_TAGS];
+static AllocTag s_other = { "other", 0, 0 };
+static u32 s_allocs = 0;
+static u32 s_bytes = 0;
+static u32 s_live = 0;
+
+#ifdef ALLOC_CALLERS
+static AllocSite s_sites[ALLOC_SITES];
+static AllocSite s_otherSites = { 0, 0, 0 };
+#endif
+
+// Owned by the main thread
+static AllocStats s_stats;
+static u32 s_lastAllocs = 0;
+static u32 s_lastBytes = 0;
+static bool s_started = false;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+#ifdef __3DS__
+static u32 slot_hash(uintptr_t key) {
+    return (u32)(key >> 2) * 2654435761u;
+}
+
+static AllocTag* find_tag(const char* name) {
+    u32 hash = slot_hash((uintptr_t)name);
+    for (int i = 0; i < ALLOC_TAGS; i++) {
+        AllocTag* tag = &s_tags[(hash + i) & (ALLOC_TAGS - 1)];
+        const char* seen = __atomic_load_n(&tag->name, __ATOMIC_ACQUIRE);
+        if (!seen) {
+            // Free: claim it. On failure `seen` is whoever claimed it first.
+            if (__atomic_compare_exchange_n(&tag->name, &seen, name, false, __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                return tag;
+            }
+        }
+        if (seen == name) return tag;
+    }
+    return &s_other;
+}
+
+static void count_alloc(size_t bytes) {
+    const char* name = prof_current();
+    AllocTag* tag = find_tag(name ? name : "untagged");
+    __atomic_add_fetch(&tag->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&tag->bytes, (u32)bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_bytes, (u32)bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_live, (u32)bytes, __ATOMIC_RELAXED);
+}
+
+#ifdef ALLOC_CALLERS
+static void count_site(void* caller, size_t bytes) {
+    u32 address = (u32)(uintptr_t)caller;
+    u32 hash = slot_hash(address);
+    AllocSite* site = &s_otherSites;
+    for (int i = 0; i < ALLOC_SITES; i++) {
+        AllocSite* slot = &s_sites[(hash + i) & (ALLOC_SITES - 1)];
+        u32 seen = __atomic_load_n(&slot->address, __ATOMIC_ACQUIRE);
+        if (seen == 0 && __atomic_compare_exchange_n(&slot->address, &seen, address, false,
+                                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            site = slot;
+            break;
+        }
+        if (seen == address) {
+            site = slot;
+            break;
+        }
+    }
+    __atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&site->bytes, (u32)bytes, __ATOMIC_RELAXED);
+}
+#define COUNT_SITE(bytes) count_site(__builtin_return_address(0), bytes)
+#else
+#define COUNT_SITE(bytes) ((void)0)
+#endif
+#endif // __3DS__
+
+//---------------------------------------------------------------------------------
+// Heap wrappers
+//---------------------------------------------------------------------------------
+#ifdef __3DS__
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void* __real_memalign(size_t align, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    if (ptr) {
+        count_alloc(malloc_usable_size(ptr));
+        COUNT_SITE(size);
+    }
+    return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    void* ptr = __real_calloc(count, size);
+    if (ptr) {
+        count_alloc(malloc_usable_size(ptr));
+        COUNT_SITE(count * size);
+    }
+    return ptr;
+}
+
+// Counted as a free of the old block and an allocation of the new one, even
+// when it grows in place: the caller asked for more memory either way
+void* __wrap_realloc(void* ptr, size_t size) {
+    size_t old = ptr ? malloc_usable_size(ptr) : 0;
+    void* grown = __real_realloc(ptr, size);
+    if (grown || size == 0) __atomic_sub_fetch(&s_live, (u32)old, __ATOMIC_RELAXED);
+    if (grown) {
+        count_alloc(malloc_usable_size(grown));
+        COUNT_SITE(size);
+    }
+    return grown;
+}
+
+void* __wrap_memalign(size_t align, size_t size) {
+    void* ptr = __real_memalign(align, size);
+    if (ptr) {
+        count_alloc(malloc_usable_size(ptr));
+        COUNT_SITE(size);
+    }
+    return ptr;
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr) __atomic_sub_fetch(&s_live, (u32)malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    __real_free(ptr);
+}
+#endif // __3DS__
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void alloc_frame(void) {
+    u32 allocs = __atomic_load_n(&s_allocs, __ATOMIC_RELAXED);
+    u32 bytes = __atomic_load_n(&s_bytes, __ATOMIC_RELAXED);
+
+    // The first call only sets the baseline, so start-up is not a frame
+    if (s_started) {
+        s_stats.frames++;
+        s_stats.frameAllocs = allocs - s_lastAllocs;
+        s_stats.frameBytes = bytes - s_lastBytes;
+        if (s_stats.frameAllocs > 0) s_stats.allocatingFrames++;
+        if (s_stats.frameAllocs > s_stats.peakAllocs) s_stats.peakAllocs = s_stats.frameAllocs;
+    }
+    s_lastAllocs = allocs;
+    s_lastBytes = bytes;
+    s_started = true;
+}
+
+void alloc_stats(AllocStats* out) {
+    *out = s_stats;
+    out->totalAllocs = __atomic_load_n(&s_allocs, __ATOMIC_RELAXED);
+    out->liveBytes = __atomic_load_n(&s_live, __ATOMIC_RELAXED);
+}
+
+int alloc_tags(AllocTag* out, int max) {
+    AllocTag tags[ALLOC_TAGS + 1];
+    int count = 0;
+
+    // The same span name can be separate literals in separate files
+    for (int i = 0; i <= ALLOC_TAGS; i++) {
+        const AllocTag* tag = i < ALLOC_TAGS ? &s_tags[i] : &s_other;
+        const char* name = __atomic_load_n(&tag->name, __ATOMIC_ACQUIRE);
+        u32 calls = __atomic_load_n(&tag->count, __ATOMIC_RELAXED);
+        if (!name || calls == 0) continue;
+        int j = 0;
+        while (j < count && strcmp(tags[j].name, name) != 0) j++;
+        if (j == count) tags[count++] = (AllocTag){ name, 0, 0 };
+        tags[j].count += calls;
+        tags[j].bytes += __atomic_load_n(&tag->bytes, __ATOMIC_RELAXED);
+    }
+
+    // Most allocations first
+    for (int i = 1; i < count; i++) {
+        AllocTag tag = tags[i];
+        int j = i;
+        for (; j > 0 && tags[j - 1].count < tag.count; j--) tags[j] = tags[j - 1];
+        tags[j] = tag;
+    }
+    if (count > max) count = max;
+    memcpy(out, tags, count * sizeof(AllocTag));
+    return count;
+}
+
+int alloc_sites(AllocSite* out, int max) {
+#ifdef ALLOC_CALLERS
+    AllocSite sites[ALLOC_SITES + 1];
+    int count = 0;
+    for (int i = 0; i <= ALLOC_SITES; i++) {
+        const AllocSite* site = i < ALLOC_SITES ? &s_sites[i] : &s_otherSites;
+        AllocSite copy = { __atomic_load_n(&site->address, __ATOMIC_ACQUIRE),
+                           __atomic_load_n(&site->count, __ATOMIC_RELAXED),
+                           __atomic_load_n(&site->bytes, __ATOMIC_RELAXED) };
+        if (copy.count == 0) continue;
+
+        int j = count++;
+        for (; j > 0 && sites[j - 1].count < copy.count; j--) sites[j] = sites[j - 1];
+        sites[j] = copy;
+    }
+    if (count > max) count = max;
+    memcpy(out, sites, count * sizeof(AllocSite));
+    return count;
+#else
+    (void)out;
+    (void)max;
+    return 0;
+#endif
+}
@@ -0,0 +1,50 @@
+//---------------------------------------------------------------------------------
+// alloc.h
+// Heap allocation tracking. Every call to malloc, calloc, realloc and
+// memalign, the app's and the libraries', is counted per frame and per tag,
+// where the tag is the innermost profiler span open on the allocating
+// thread, so the subsystems that allocate in steady-state frames stand out.
+// Debug builds (make DEBUG=1) also count allocations by call site.
+//---------------------------------------------------------------------------------
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <3ds.h>
+
+#define ALLOC_TAGS  32     // Distinct tags counted; later ones are counted as "other"
+#define ALLOC_SITES 64     // Call sites counted in debug builds
+
+typedef struct {
+    u32 frames;            // Frames since start
+    u32 allocatingFrames;  // Frames that allocated at all
+    u32 frameAllocs;       // In the last frame
+    u32 frameBytes;
+    u32 peakAllocs;        // Most in one frame
+    u32 totalAllocs;
+    u32 liveBytes;
+} AllocStats;
+
+typedef struct {
+    const char* name;      // A profiler span name, or "untagged" or "other"
+    u32 count;
+    u32 bytes;
+} AllocTag;
+
+typedef struct {
+    u32 address;           // Return address of the call; resolve with addr2line
+    u32 count;
+    u32 bytes;
+} AllocSite;
+
+// Once a frame, after it is presented: close the frame's counts
+void alloc_frame(void);
+
+void alloc_stats(AllocStats* out);
+
+// Copy up to `max` tags, or debug-build call sites, with the most
+// allocations first. Returns the number copied.
+int alloc_tags(AllocTag* out, int max);
+int alloc_sites(AllocSite* out, int max);
+
+#endif // ALLOC_H
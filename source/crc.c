@@ -0,0 +1,34 @@
+//---------------------------------------------------------------------------------
+// crc.c
+// Table-driven CRC-32, four bits at a time: a 64-byte table is fast enough
+// for the block sizes involved and stays in cache.
+//---------------------------------------------------------------------------------
+
+#include "crc.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+static const u32 s_crcNibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+u32 crc_compute(const void* data, size_t len) {
+    return crc_update(0, data, len);
+}
+
+u32 crc_update(u32 crc, const void* data, size_t len) {
+    const u8* p = data;
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ s_crcNibble[crc & 15];
+        crc = (crc >> 4) ^ s_crcNibble[crc & 15];
+    }
+    return ~crc;
+}
@@ -0,0 +1,20 @@
+//---------------------------------------------------------------------------------
+// crc.h
+// CRC-32 for the checksums that guard files against being cut short or
+// corrupted.
+//---------------------------------------------------------------------------------
+
+#ifndef CRC_H
+#define CRC_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+// CRC-32 (reflected polynomial 0xEDB88320, as in zip and PNG) of `len` bytes
+u32 crc_compute(const void* data, size_t len);
+
+// CRC-32 of data given in pieces: start from 0 and pass each result back in,
+// as with zlib's crc32()
+u32 crc_update(u32 crc, const void* data, size_t len);
+
+#endif // CRC_H
@@ -0,0 +1,31 @@
+//---------------------------------------------------------------------------------
+// dawg.h
+// On-disk layout of the spelling dictionary, shared with tools/mkdawg.c.
+//
+// The image is a minimized word graph stored as a flat array of 32-bit edges
+// with no pointers, so it can be read in one go and queried in place:
+//
+//   u32 magic, u32 version, u32 edge_count, u32 root     (little-endian)
+//   u32 edges[edge_count]
+//
+// The children of a node are a contiguous run of edges sorted by label, the
+// last one flagged DAWG_LAST. Edge 0 is reserved so that a child index of 0
+// means "no children".
+//---------------------------------------------------------------------------------
+
+#ifndef DAWG_H
+#define DAWG_H
+
+#define DAWG_MAGIC          0x47574144u   // "DAWG"
+#define DAWG_VERSION        1u
+#define DAWG_HEADER_WORDS   4
+#define DAWG_MAX_EDGES      (1u << 22)
+
+#define DAWG_LABEL(e)       ((e) & 0xFFu)
+#define DAWG_TERMINAL       0x100u        // A word ends after this edge
+#define DAWG_LAST           0x200u        // Last edge of its sibling run
+#define DAWG_CHILD(e)       ((e) >> 10)
+#define DAWG_EDGE(label, flags, child) \
+    ((unsigned)(label) | (unsigned)(flags) | ((unsigned)(child) << 10))
+
+#endif // DAWG_H
@@ -0,0 +1,181 @@
+//---------------------------------------------------------------------------------
+// highlight.c
+// Table-driven lexers for code blocks. The DFA tables are generated at build
+// time by tools/mklexer.c; lexing is maximal munch over those tables, with
+// the mode at the end of a line carried into the next one.
+//
+// The line cache is set-associative: a line's hash picks a set of
+// HL_CACHE_WAYS entries, and the least recently used one is replaced. Each
+// entry keeps a copy of its line, so a hit is only taken on identical text.
+//---------------------------------------------------------------------------------
+
+#include "highlight.h"
+
+#include <string.h>
+
+#include "util.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define LEX_STAY 0xFF
+
+typedef struct {
+    u8 kind;
+    u8 next;         // Mode to switch to, LEX_STAY to keep the current one
+} LexRule;
+
+typedef struct {
+    u16 start;       // DFA start state
+    u8 multiline;    // If 0, the next line starts in mode 0 again
+} LexMode;
+
+typedef struct {
+    const u8* cls;
+    const u16* next;     // [state][class], state 0 is dead
+    u16 classCount;
+    const u8* accept;    // Rule index per state, 0 if not accepting
+    const LexRule* rules;
+    const LexMode* modes;
+} LexTables;
+
+#include "lexer_tables.h"
+
+#define HL_CACHE_SETS (HL_CACHE_SIZE / HL_CACHE_WAYS)
+
+typedef struct {
+    u32 hash;
+    u32 used;        // s_clock when last returned, 0 while empty
+    u16 len;
+    u8 lang;
+    u8 mode;
+    char text[HL_CACHE_LINE];
+    HlLine line;
+} CacheEntry;
+
+typedef struct {
+    const char* name;
+    HlLang lang;
+} LangName;
+
+static const LangName s_langNames[] = {
+    { "c", HL_LANG_C }, { "h", HL_LANG_C }, { "cpp", HL_LANG_C }, { "c++", HL_LANG_C },
+    { "python", HL_LANG_PYTHON }, { "py", HL_LANG_PYTHON },
+    { "sh", HL_LANG_SHELL }, { "bash", HL_LANG_SHELL }, { "shell", HL_LANG_SHELL },
+    { "zsh", HL_LANG_SHELL }, { "console", HL_LANG_SHELL },
+    { "json", HL_LANG_JSON },
+};
+
+static CacheEntry s_cache[HL_CACHE_SIZE];
+static u32 s_clock = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static void push_span(HlLine* out, size_t start, size_t len, u8 kind) {
+    if (out->count > 0) {
+        HlSpan* last = &out->spans[out->count - 1];
+        // Merge with the previous span if it has the same color, or if we
+        // ran out of spans (the tail then keeps the last color)
+        if (last->kind == kind || out->count == HL_MAX_SPANS) {
+            last->len = start + len - last->start;
+            return;
+        }
+    }
+    HlSpan* span = &out->spans[out->count++];
+    span->start = start;
+    span->len = len;
+    span->kind = kind;
+}
+
+static void lex_line(const LexTables* t, u8 mode, const char* text, size_t len, HlLine* out) {
+    size_t pos = 0;
+    out->count = 0;
+
+    while (pos < len) {
+        u32 state = t->modes[mode].start;
+        size_t end = pos;
+        u8 rule = 0;
+
+        // Maximal munch: run until the DFA dies, remember the last accept
+        for (size_t i = pos; i < len; i++) {
+            state = t->next[state * t->classCount + t->cls[(u8)text[i]]];
+            if (state == 0) break;
+            if (t->accept[state]) {
+                end = i + 1;
+                rule = t->accept[state];
+            }
+        }
+
+        if (rule == 0) {
+            // Nothing matches here: one byte of plain text
+            push_span(out, pos, 1, HL_TEXT);
+            pos++;
+            continue;
+        }
+
+        push_span(out, pos, end - pos, t->rules[rule].kind);
+        if (t->rules[rule].next != LEX_STAY) mode = t->rules[rule].next;
+        pos = end;
+    }
+
+    out->outMode = t->modes[mode].multiline ? mode : 0;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+HlLang hl_language(const char* info, size_t len) {
+    for (size_t i = 0; i < sizeof(s_langNames) / sizeof(s_langNames[0]); i++) {
+        const char* name = s_langNames[i].name;
+        size_t n = strlen(name);
+        if (n != len) continue;
+
+        size_t k = 0;
+        while (k < n && (info[k] | 0x20) == name[k]) k++;
+        if (k == n) return s_langNames[i].lang;
+    }
+    return HL_LANG_NONE;
+}
+
+const HlLine* hl_line(HlLang lang, u8 mode, const char* text, size_t len) {
+    static HlLine s_uncached;
+
+    if (lang >= HL_LANG_COUNT) {
+        s_uncached.outMode = 0;
+        s_uncached.count = 0;
+        if (len > 0) push_span(&s_uncached, 0, len, HL_TEXT);
+        return &s_uncached;
+    }
+
+    // Long lines are lexed every time, up to what a span offset can describe
+    if (len > HL_CACHE_LINE) {
+        lex_line(&lex_tables[lang], mode, text, len < 0xFFFF ? len : 0xFFFF, &s_uncached);
+        return &s_uncached;
+    }
+
+    u32 hash = fnv1a(FNV_OFFSET, text, len);
+    u32 key = hash ^ (lang * 0x9E3779B9u) ^ (mode * 0x85EBCA6Bu);
+    CacheEntry* set = &s_cache[(key & (HL_CACHE_SETS - 1)) * HL_CACHE_WAYS];
+    CacheEntry* entry = &set[0];
+
+    for (int way = 0; way < HL_CACHE_WAYS; way++) {
+        CacheEntry* e = &set[way];
+        if (e->used && e->hash == hash && e->len == len && e->lang == lang && e->mode == mode &&
+            memcmp(e->text, text, len) == 0) {
+            e->used = ++s_clock;
+            return &e->line;
+        }
+        if (e->used < entry->used) entry = e;
+    }
+
+    entry->used = ++s_clock;
+    entry->hash = hash;
+    entry->len = len;
+    entry->lang = lang;
+    entry->mode = mode;
+    memcpy(entry->text, text, len);
+    lex_line(&lex_tables[lang], mode, text, len, &entry->line);
+    return &entry->line;
+}
@@ -0,0 +1,61 @@
+//---------------------------------------------------------------------------------
+// highlight.h
+// Syntax highlighting for fenced code blocks, one line at a time.
+//---------------------------------------------------------------------------------
+
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+#define HL_MAX_SPANS  24
+#define HL_CACHE_SIZE 512    // Lexed lines kept; must be a power of two
+#define HL_CACHE_WAYS 4      // Lines that can share a hash bucket
+#define HL_CACHE_LINE 96     // Longest line cached, in bytes
+
+// Token kinds; must match the K_* names in tools/mklexer.c
+typedef enum {
+    HL_TEXT,
+    HL_KEYWORD,
+    HL_STRING,
+    HL_NUMBER,
+    HL_COMMENT,
+    HL_PREPROC,
+    HL_VARIABLE,
+    HL_LITERAL,
+    HL_KIND_COUNT
+} HlKind;
+
+// Languages; must match the order of s_languages in tools/mklexer.c
+typedef enum {
+    HL_LANG_C,
+    HL_LANG_PYTHON,
+    HL_LANG_SHELL,
+    HL_LANG_JSON,
+    HL_LANG_COUNT,
+    HL_LANG_NONE = 0xFF
+} HlLang;
+
+typedef struct {
+    u16 start;
+    u16 len;
+    u8 kind;
+} HlSpan;
+
+typedef struct {
+    u8 outMode;      // Lexer mode the next line starts in
+    u8 count;
+    HlSpan spans[HL_MAX_SPANS];
+} HlLine;
+
+// Language named by a fence info string ("c", "py", "bash", ...)
+HlLang hl_language(const char* info, size_t len);
+
+// Highlight one line of a code block, starting in lexer mode `mode` (0 for
+// the first line). Lines of up to HL_CACHE_LINE bytes whose text and entry
+// mode are unchanged come from a cache, so an edit only re-lexes the lines it
+// actually affects. The result stays valid until the next call.
+const HlLine* hl_line(HlLang lang, u8 mode, const char* text, size_t len);
+
+#endif // HIGHLIGHT_H
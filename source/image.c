@@ -0,0 +1,656 @@
+//---------------------------------------------------------------------------------
+// image.c
+// Inline images. PNG and JPEG files are decoded on the worker one row at a
+// time and box-filtered down to at most IMAGE_MAX_W x IMAGE_MAX_H while they
+// stream in, so a full-size photo never has to fit in memory. The result is
+// swizzled into the GPU's tiled layout and saved under .thumbs/, keyed by the
+// source's path, size and modification time, so the next view of the image
+// skips decoding without reading the source at all. Files are read and written
+// through storage.h. Textures are created on the main thread, in VRAM while
+// the budget allows.
+//---------------------------------------------------------------------------------
+
+#include "image.h"
+#include "memory.h"
+#include "prof.h"
+#include "storage.h"
+#include "worker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <setjmp.h>
+#include <png.h>
+#include <jpeglib.h>
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define THUMB_DIR      ".thumbs"
+#define THUMB_MAGIC    0x424D4854   // "THMB"
+#define THUMB_VERSION  2
+#define READ_CHUNK     16384
+
+typedef enum {
+    ENTRY_EMPTY,
+    ENTRY_QUEUED,    // Owned by the worker until it sets DECODED or FAILED
+    ENTRY_DECODED,   // Swizzled pixels waiting for image_poll()
+    ENTRY_READY,
+    ENTRY_FAILED
+} EntryState;
+
+typedef struct {
+    EntryState state;
+    u32 lastUse;
+    char path[IMAGE_PATH_LEN];
+    u16 width, height;
+    u16 texW, texH;
+    u32* pixels;
+    MemPool pool;
+    C3D_Tex tex;
+    Tex3DS_SubTexture subtex;
+} ImageEntry;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u64 size;        // Of the source file, checked against its current size
+    u64 mtime;       // and modification time
+    u16 width, height;
+    u16 texW, texH;
+} ThumbHeader;
+
+// The source file, read READ_CHUNK bytes at a time for either decoder
+typedef struct {
+    StorageFile* file;
+    u8* buf;
+    size_t pos, len;
+} Source;
+
+typedef struct {
+    struct jpeg_source_mgr mgr;
+    Source* src;
+} JpegSource;
+
+// Box filter fed one source row at a time
+typedef struct {
+    u32 srcW, srcH;
+    u32 dstW, dstH;
+    u32 y;           // Source rows consumed
+    u32 dy;          // Destination row being accumulated
+    u32 rows;        // Source rows summed into `acc`
+    u32* acc;        // dstW * 4 channel sums
+    u32* cols;       // Source columns landing in each destination column
+    u8* out;         // dstW * dstH RGBA
+    u8* row;         // Decoder's row buffer
+} Downsampler;
+
+typedef struct {
+    struct jpeg_error_mgr mgr;
+    jmp_buf jump;
+} JpegError;
+
+static bool s_thumbs = false;   // .thumbs/ exists
+static LightLock s_lock;
+static ImageEntry s_entries[IMAGE_CACHE_SIZE];
+static u32 s_frame = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static bool ends_with(const char* name, const char* ext) {
+    size_t len = strlen(name), extLen = strlen(ext);
+    return len > extLen && strcasecmp(name + len - extLen, ext) == 0;
+}
+
+static u32 next_pow2(u32 v) {
+    u32 p = 8;   // Smallest texture the GPU accepts
+    while (p < v) p <<= 1;
+    return p;
+}
+
+static void fit_size(u32 w, u32 h, u32* dw, u32* dh) {
+    *dw = w;
+    *dh = h;
+    if (*dw > IMAGE_MAX_W) {
+        *dh = (u64)*dh * IMAGE_MAX_W / *dw;
+        *dw = IMAGE_MAX_W;
+    }
+    if (*dh > IMAGE_MAX_H) {
+        *dw = (u64)*dw * IMAGE_MAX_H / *dh;
+        *dh = IMAGE_MAX_H;
+    }
+    if (*dw == 0) *dw = 1;
+    if (*dh == 0) *dh = 1;
+}
+
+static u64 fnv(u64 hash, const void* data, size_t len) {
+    const u8* p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static bool source_fill(Source* src) {
+    s32 got = storage_file_read(src->file, src->buf, READ_CHUNK);
+    src->pos = 0;
+    src->len = got > 0 ? got : 0;
+    return src->len > 0;
+}
+
+//---------------------------------------------------------------------------------
+// Downsampling
+//---------------------------------------------------------------------------------
+static bool ds_begin(Downsampler* ds, u32 srcW, u32 srcH, u32 dstW, u32 dstH, size_t rowBytes) {
+    ds->srcW = srcW;
+    ds->srcH = srcH;
+    ds->dstW = dstW;
+    ds->dstH = dstH;
+    ds->y = 0;
+    ds->dy = 0;
+    ds->rows = 0;
+    ds->acc = calloc(dstW * 4, sizeof(u32));
+    ds->cols = calloc(dstW, sizeof(u32));
+    ds->out = malloc(dstW * dstH * 4);
+    ds->row = malloc(rowBytes);
+    if (!ds->acc || !ds->cols || !ds->out || !ds->row) {
+        free(ds->out);
+        ds->out = NULL;
+        return false;
+    }
+
+    mem_track(MEM_HEAP, dstW * dstH * 4);
+    for (u32 x = 0; x < srcW; x++) {
+        ds->cols[(u64)x * dstW / srcW]++;
+    }
+    return true;
+}
+
+static void ds_free(Downsampler* ds) {
+    if (ds->out) mem_track(MEM_HEAP, -(s32)(ds->dstW * ds->dstH * 4));
+    free(ds->acc);
+    free(ds->cols);
+    free(ds->out);
+    free(ds->row);
+    ds->acc = ds->cols = NULL;
+    ds->out = ds->row = NULL;
+}
+
+static void ds_flush(Downsampler* ds) {
+    if (ds->rows == 0) return;
+    u8* out = ds->out + ds->dy * ds->dstW * 4;
+    for (u32 x = 0; x < ds->dstW; x++) {
+        u32 n = ds->cols[x] * ds->rows;
+        for (int c = 0; c < 4; c++) {
+            out[x * 4 + c] = n ? ds->acc[x * 4 + c] / n : 0;
+            ds->acc[x * 4 + c] = 0;
+        }
+    }
+    ds->rows = 0;
+}
+
+static void ds_push_row(Downsampler* ds, const u8* row, int channels) {
+    u32 dy = (u64)ds->y * ds->dstH / ds->srcH;
+    if (dy != ds->dy) {
+        ds_flush(ds);
+        ds->dy = dy;
+    }
+
+    for (u32 x = 0; x < ds->srcW; x++) {
+        u32* acc = ds->acc + ((u64)x * ds->dstW / ds->srcW) * 4;
+        const u8* px = row + x * channels;
+        acc[0] += px[0];
+        acc[1] += px[1];
+        acc[2] += px[2];
+        acc[3] += channels == 4 ? px[3] : 0xFF;
+    }
+    ds->rows++;
+    ds->y++;
+}
+
+//---------------------------------------------------------------------------------
+// Decoders
+//---------------------------------------------------------------------------------
+static void png_read(png_structp png, png_bytep out, png_size_t len) {
+    Source* src = png_get_io_ptr(png);
+    while (len > 0) {
+        if (src->pos == src->len && !source_fill(src)) png_error(png, "truncated");
+        size_t n = src->len - src->pos < len ? src->len - src->pos : len;
+        memcpy(out, src->buf + src->pos, n);
+        src->pos += n;
+        out += n;
+        len -= n;
+    }
+}
+
+static bool decode_png(Source* src, Downsampler* ds) {
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (!info) {
+        png_destroy_read_struct(&png, NULL, NULL);
+        return false;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        return false;
+    }
+
+    png_set_read_fn(png, src, png_read);
+    png_read_info(png, info);
+
+    // Adam7 passes revisit every row, which defeats row streaming
+    u32 w = png_get_image_width(png, info);
+    u32 h = png_get_image_height(png, info);
+    if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+        png_destroy_read_struct(&png, &info, NULL);
+        return false;
+    }
+
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_set_add_alpha(png, 0xFF, PNG_FILLER_AFTER);
+    png_read_update_info(png, info);
+
+    u32 dw, dh;
+    fit_size(w, h, &dw, &dh);
+    bool ok = ds_begin(ds, w, h, dw, dh, png_get_rowbytes(png, info));
+    if (ok) {
+        for (u32 y = 0; y < h; y++) {
+            png_read_row(png, ds->row, NULL);
+            ds_push_row(ds, ds->row, 4);
+        }
+        ds_flush(ds);
+    }
+    png_destroy_read_struct(&png, &info, NULL);
+    return ok;
+}
+
+static void jpeg_fail(j_common_ptr cinfo) {
+    longjmp(((JpegError*)cinfo->err)->jump, 1);
+}
+
+static void jpeg_src_init(j_decompress_ptr cinfo) {
+    (void)cinfo;
+}
+
+// At the end of the file, an EOI marker ends the image as jpeg_stdio_src does
+static boolean jpeg_src_fill(j_decompress_ptr cinfo) {
+    static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+    JpegSource* js = (JpegSource*)cinfo->src;
+    if (source_fill(js->src)) {
+        js->mgr.next_input_byte = js->src->buf;
+        js->mgr.bytes_in_buffer = js->src->len;
+    } else {
+        js->mgr.next_input_byte = eoi;
+        js->mgr.bytes_in_buffer = sizeof(eoi);
+    }
+    return TRUE;
+}
+
+static void jpeg_src_skip(j_decompress_ptr cinfo, long count) {
+    struct jpeg_source_mgr* mgr = cinfo->src;
+    if (count <= 0) return;
+    while (count > (long)mgr->bytes_in_buffer) {
+        count -= mgr->bytes_in_buffer;
+        jpeg_src_fill(cinfo);
+    }
+    mgr->next_input_byte += count;
+    mgr->bytes_in_buffer -= count;
+}
+
+static void jpeg_src_term(j_decompress_ptr cinfo) {
+    (void)cinfo;
+}
+
+static bool decode_jpeg(Source* src, Downsampler* ds) {
+    struct jpeg_decompress_struct cinfo;
+    JpegError err;
+    JpegSource js;
+
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpeg_fail;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    js.mgr.init_source = jpeg_src_init;
+    js.mgr.fill_input_buffer = jpeg_src_fill;
+    js.mgr.skip_input_data = jpeg_src_skip;
+    js.mgr.resync_to_restart = jpeg_resync_to_restart;
+    js.mgr.term_source = jpeg_src_term;
+    js.mgr.next_input_byte = src->buf + src->pos;
+    js.mgr.bytes_in_buffer = src->len - src->pos;
+    js.src = src;
+    cinfo.src = &js.mgr;
+    jpeg_read_header(&cinfo, TRUE);
+
+    // Let the IDCT do most of the reduction: pick the largest 1/2^n scale
+    // that still leaves at least the target size for the box filter
+    u32 dw, dh;
+    fit_size(cinfo.image_width, cinfo.image_height, &dw, &dh);
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    while (cinfo.scale_denom < 8 &&
+           cinfo.image_width / (cinfo.scale_denom * 2) >= dw &&
+           cinfo.image_height / (cinfo.scale_denom * 2) >= dh) {
+        cinfo.scale_denom *= 2;
+    }
+    jpeg_start_decompress(&cinfo);
+
+    bool ok = ds_begin(ds, cinfo.output_width, cinfo.output_height, dw, dh,
+                       cinfo.output_width * cinfo.output_components);
+    if (ok) {
+        JSAMPROW row = ds->row;
+        while (cinfo.output_scanline < cinfo.output_height) {
+            jpeg_read_scanlines(&cinfo, &row, 1);
+            ds_push_row(ds, ds->row, 3);
+        }
+        ds_flush(ds);
+        jpeg_finish_decompress(&cinfo);
+    }
+    jpeg_destroy_decompress(&cinfo);
+    return ok;
+}
+
+//---------------------------------------------------------------------------------
+// Thumbnails
+//---------------------------------------------------------------------------------
+
+// Reorder RGBA rows into 8x8 Morton-ordered tiles of ABGR texels
+static u32* swizzle(const u8* rgba, u32 w, u32 h, u32 texW, u32 texH) {
+    u32* tex = calloc(texW * texH, sizeof(u32));
+    if (!tex) return NULL;
+
+    for (u32 y = 0; y < h; y++) {
+        for (u32 x = 0; x < w; x++) {
+            u32 tile = ((y >> 3) * (texW >> 3) + (x >> 3)) << 6;
+            u32 morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) |
+                         ((y & 2) << 2) | ((x & 4) << 2) | ((y & 4) << 3);
+            const u8* px = rgba + (y * w + x) * 4;
+            tex[tile + morton] = ((u32)px[0] << 24) | ((u32)px[1] << 16) | ((u32)px[2] << 8) | px[3];
+        }
+    }
+    return tex;
+}
+
+static bool load_thumb(const char* name, u64 size, u64 mtime, ImageEntry* entry) {
+    StorageFile* file = storage_open(name, false);
+    if (!file) return false;
+
+    ThumbHeader header;
+    bool ok = storage_file_read(file, &header, sizeof(header)) == sizeof(header) &&
+              header.magic == THUMB_MAGIC && header.version == THUMB_VERSION &&
+              header.size == size && header.mtime == mtime &&
+              header.width && header.width <= header.texW && header.texW == next_pow2(header.texW) &&
+              header.height && header.height <= header.texH && header.texH == next_pow2(header.texH) &&
+              header.texW <= next_pow2(IMAGE_MAX_W) && header.texH <= next_pow2(IMAGE_MAX_H);
+    if (ok) {
+        size_t count = header.texW * header.texH;
+        entry->pixels = malloc(count * sizeof(u32));
+        ok = entry->pixels && storage_file_read(file, entry->pixels, count * sizeof(u32)) == (s32)(count * sizeof(u32));
+        if (ok) {
+            entry->width = header.width;
+            entry->height = header.height;
+            entry->texW = header.texW;
+            entry->texH = header.texH;
+        } else {
+            free(entry->pixels);
+            entry->pixels = NULL;
+        }
+    }
+    storage_close(file);
+    return ok;
+}
+
+static void save_thumb(const char* name, u64 size, u64 mtime, const ImageEntry* entry) {
+    StorageFile* file = storage_open(name, true);
+    if (!file) return;
+
+    ThumbHeader header = { THUMB_MAGIC, THUMB_VERSION, size, mtime, entry->width, entry->height,
+                           entry->texW, entry->texH };
+    bool ok = storage_file_write(file, &header, sizeof(header)) &&
+              storage_file_write(file, entry->pixels, entry->texW * entry->texH * sizeof(u32));
+    if (!storage_close(file) || !ok) storage_remove(name);
+}
+
+//---------------------------------------------------------------------------------
+// Worker job
+//---------------------------------------------------------------------------------
+static bool decode_entry(ImageEntry* entry) {
+    static u8 chunk[READ_CHUNK];   // Only the worker decodes
+    u64 size, mtime;
+    if (!storage_stat(entry->path, &size, &mtime)) return false;
+
+    // The key names the thumbnail; the header's size and time confirm it
+    char thumb[32];
+    u64 key = fnv(0xCBF29CE484222325ULL, entry->path, strlen(entry->path));
+    key = fnv(fnv(key, &size, sizeof(size)), &mtime, sizeof(mtime));
+    snprintf(thumb, sizeof(thumb), THUMB_DIR "/%016llx", (unsigned long long)key);
+    if (s_thumbs && load_thumb(thumb, size, mtime, entry)) return true;
+
+    Source src = { storage_open(entry->path, false), chunk, 0, 0 };
+    if (!src.file) return false;
+    source_fill(&src);
+
+    const u8* magic = src.buf;
+    Downsampler ds = {0};
+    bool ok = false;
+    if (src.len >= 4 && magic[0] == 0x89 && magic[1] == 'P' && magic[2] == 'N' && magic[3] == 'G') {
+        ok = decode_png(&src, &ds);
+    } else if (src.len >= 2 && magic[0] == 0xFF && magic[1] == 0xD8) {
+        ok = decode_jpeg(&src, &ds);
+    }
+    storage_close(src.file);
+
+    if (ok) {
+        entry->width = ds.dstW;
+        entry->height = ds.dstH;
+        entry->texW = next_pow2(ds.dstW);
+        entry->texH = next_pow2(ds.dstH);
+        entry->pixels = swizzle(ds.out, ds.dstW, ds.dstH, entry->texW, entry->texH);
+        ok = entry->pixels != NULL;
+        if (ok && s_thumbs) save_thumb(thumb, size, mtime, entry);
+    }
+    ds_free(&ds);
+    return ok;
+}
+
+static void image_job(void* arg) {
+    ImageEntry* entry = arg;
+    prof_begin("decode image");
+    bool ok = decode_entry(entry);
+    prof_end();
+    if (ok) mem_track(MEM_HEAP, entry->texW * entry->texH * 4);
+
+    LightLock_Lock(&s_lock);
+    entry->state = ok ? ENTRY_DECODED : ENTRY_FAILED;
+    LightLock_Unlock(&s_lock);
+}
+
+//---------------------------------------------------------------------------------
+// Textures
+//---------------------------------------------------------------------------------
+static void release_pixels(ImageEntry* entry) {
+    if (!entry->pixels) return;
+    mem_track(MEM_HEAP, -(s32)(entry->texW * entry->texH * 4));
+    free(entry->pixels);
+    entry->pixels = NULL;
+}
+
+static void release_texture(ImageEntry* entry) {
+    C3D_TexDelete(&entry->tex);
+    mem_track(entry->pool, -(s32)(entry->texW * entry->texH * 4));
+}
+
+// Evict least recently drawn textures until `bytes` fit in VRAM or linear
+// memory. Textures drawn in the last two frames may still be in flight.
+static void make_room(u32 bytes) {
+    while (!mem_fits(MEM_VRAM, bytes) && !mem_fits(MEM_LINEAR, bytes)) {
+        ImageEntry* victim = NULL;
+        for (int i = 0; i < IMAGE_CACHE_SIZE; i++) {
+            ImageEntry* entry = &s_entries[i];
+            if (entry->state == ENTRY_READY && entry->lastUse + 2 <= s_frame &&
+                (!victim || entry->lastUse < victim->lastUse)) {
+                victim = entry;
+            }
+        }
+        if (!victim) return;
+        release_texture(victim);
+        victim->state = ENTRY_EMPTY;
+    }
+}
+
+static bool upload(ImageEntry* entry) {
+    u32 bytes = entry->texW * entry->texH * 4;
+    make_room(bytes);
+
+    if (mem_fits(MEM_VRAM, bytes) && C3D_TexInitVRAM(&entry->tex, entry->texW, entry->texH, GPU_RGBA8)) {
+        // VRAM is filled by DMA, which needs a linear source
+        void* staging = linearAlloc(bytes);
+        if (!staging) {
+            C3D_TexDelete(&entry->tex);
+            return false;
+        }
+        memcpy(staging, entry->pixels, bytes);
+        GSPGPU_FlushDataCache(staging, bytes);
+        C3D_TexUpload(&entry->tex, staging);
+        linearFree(staging);
+        entry->pool = MEM_VRAM;
+    } else if (mem_fits(MEM_LINEAR, bytes) && C3D_TexInit(&entry->tex, entry->texW, entry->texH, GPU_RGBA8)) {
+        C3D_TexUpload(&entry->tex, entry->pixels);
+        C3D_TexFlush(&entry->tex);
+        entry->pool = MEM_LINEAR;
+    } else {
+        return false;
+    }
+    mem_track(entry->pool, bytes);
+
+    C3D_TexSetFilter(&entry->tex, GPU_LINEAR, GPU_LINEAR);
+    entry->subtex.width = entry->width;
+    entry->subtex.height = entry->height;
+    entry->subtex.left = 0.0f;
+    entry->subtex.top = 1.0f;
+    entry->subtex.right = entry->width / (float)entry->texW;
+    entry->subtex.bottom = 1.0f - entry->height / (float)entry->texH;
+    return true;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void image_init(void) {
+    LightLock_Init(&s_lock);
+    memset(s_entries, 0, sizeof(s_entries));
+    s_thumbs = storage_make_dir(THUMB_DIR);
+}
+
+void image_exit(void) {
+    for (int i = 0; i < IMAGE_CACHE_SIZE; i++) {
+        ImageEntry* entry = &s_entries[i];
+        if (entry->state == ENTRY_READY) release_texture(entry);
+        release_pixels(entry);
+        entry->state = ENTRY_EMPTY;
+    }
+}
+
+bool image_is_file(const char* name) {
+    return ends_with(name, ".png") || ends_with(name, ".jpg") || ends_with(name, ".jpeg");
+}
+
+bool image_parse_line(const char* line, size_t len, char* path, size_t size) {
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\r')) len--;
+    while (len > 0 && *line == ' ') {
+        line++;
+        len--;
+    }
+    if (len < 5 || line[0] != '!' || line[1] != '[' || line[len - 1] != ')') return false;
+
+    const char* open = memchr(line, ']', len);
+    if (!open || open + 1 >= line + len || open[1] != '(') return false;
+
+    // Stop at an optional "title"
+    const char* start = open + 2;
+    const char* end = start;
+    while (end < line + len - 1 && *end != ' ') end++;
+
+    size_t pathLen = end - start;
+    if (pathLen == 0 || pathLen >= size || pathLen >= IMAGE_PATH_LEN) return false;
+
+    // Only files inside the notes directory
+    if (*start == '/' || memchr(start, ':', pathLen)) return false;
+    for (size_t i = 0; i + 1 < pathLen; i++) {
+        if (start[i] == '.' && start[i + 1] == '.') return false;
+    }
+
+    memcpy(path, start, pathLen);
+    path[pathLen] = '\0';
+    return true;
+}
+
+ImageState image_get(const char* path, C2D_Image* out) {
+    ImageEntry* victim = NULL;
+    ImageState state = IMAGE_LOADING;
+
+    LightLock_Lock(&s_lock);
+    for (int i = 0; i < IMAGE_CACHE_SIZE; i++) {
+        ImageEntry* entry = &s_entries[i];
+        if (entry->state != ENTRY_EMPTY && strcmp(entry->path, path) == 0) {
+            entry->lastUse = s_frame;
+            if (entry->state == ENTRY_READY) {
+                out->tex = &entry->tex;
+                out->subtex = &entry->subtex;
+                state = IMAGE_READY;
+            } else if (entry->state == ENTRY_FAILED) {
+                state = IMAGE_FAILED;
+            }
+            LightLock_Unlock(&s_lock);
+            return state;
+        }
+
+        // Reuse an empty or failed slot, else the least recently drawn texture
+        // that is no longer in flight. Queued and decoded slots are busy.
+        bool spare = entry->state == ENTRY_EMPTY || entry->state == ENTRY_FAILED;
+        bool idle = entry->state == ENTRY_READY && entry->lastUse + 2 <= s_frame;
+        if (spare && (!victim || victim->state == ENTRY_READY)) {
+            victim = entry;
+        } else if (idle && (!victim || (victim->state == ENTRY_READY && entry->lastUse < victim->lastUse))) {
+            victim = entry;
+        }
+    }
+
+    if (!victim) {
+        LightLock_Unlock(&s_lock);
+        return IMAGE_LOADING;
+    }
+    if (victim->state == ENTRY_READY) release_texture(victim);
+
+    snprintf(victim->path, sizeof(victim->path), "%s", path);
+    victim->lastUse = s_frame;
+    victim->state = worker_submit(image_job, victim) ? ENTRY_QUEUED : ENTRY_EMPTY;
+    LightLock_Unlock(&s_lock);
+    return IMAGE_LOADING;
+}
+
+void image_poll(void) {
+    s_frame++;
+
+    // One upload per frame keeps a page full of images from stalling a frame
+    ImageEntry* decoded = NULL;
+    LightLock_Lock(&s_lock);
+    for (int i = 0; i < IMAGE_CACHE_SIZE && !decoded; i++) {
+        if (s_entries[i].state == ENTRY_DECODED) decoded = &s_entries[i];
+    }
+    LightLock_Unlock(&s_lock);
+    if (!decoded) return;
+
+    bool ok = upload(decoded);
+    release_pixels(decoded);
+    decoded->state = ok ? ENTRY_READY : ENTRY_FAILED;
+}
@@ -0,0 +1,46 @@
+//---------------------------------------------------------------------------------
+// image.h
+// Inline images referenced from notes as ![alt](file.png), decoded in the
+// background and kept as GPU textures.
+//---------------------------------------------------------------------------------
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <stddef.h>
+
+#define IMAGE_CACHE_SIZE 16
+#define IMAGE_PATH_LEN   128
+#define IMAGE_MAX_W      256   // Decoded images are downsampled to fit
+#define IMAGE_MAX_H      128
+
+typedef enum {
+    IMAGE_LOADING,
+    IMAGE_READY,
+    IMAGE_FAILED
+} ImageState;
+
+// Call after storage_init(): image paths are relative to the storage root,
+// and decoded thumbnails are cached in its .thumbs/ subdirectory.
+void image_init(void);
+
+// Call after worker_exit(); frees every texture and pending buffer
+void image_exit(void);
+
+// True for file names the note list should skip (.png, .jpg, .jpeg)
+bool image_is_file(const char* name);
+
+// If the line is a markdown image and nothing else, copy its path to `path`
+bool image_parse_line(const char* line, size_t len, char* path, size_t size);
+
+// Look up an image, queueing it for decoding on first use. `out` is only
+// filled in for IMAGE_READY and stays valid until the next image_poll().
+ImageState image_get(const char* path, C2D_Image* out);
+
+// Upload finished decodes and apply the texture budget. Call once per frame
+// on the main thread, before C3D_FrameBegin().
+void image_poll(void);
+
+#endif // IMAGE_H
@@ -0,0 +1,235 @@
+//---------------------------------------------------------------------------------
+// import.c
+// Encoding detection and normalization of imported notes. A byte order mark
+// decides the encoding when there is one; otherwise NUL bytes in the first
+// few hundred bytes point to UTF-16, valid UTF-8 is taken as UTF-8 and
+// anything else as Windows-1252. UTF-8 is cleaned up in place; the other
+// encodings are decoded, line endings folded and re-encoded in one loop into
+// a scratch buffer.
+//---------------------------------------------------------------------------------
+
+#include "import.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utf8.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define IMPORT_SAMPLE 512       // Bytes checked for the NULs of BOM-less UTF-16
+#define REPLACEMENT 0xFFFD
+
+// Output of the transcoding loop. A CR becomes LF and swallows the LF after it.
+typedef struct {
+    char* out;
+    size_t len;
+    size_t cap;         // Excluding the NUL
+    bool cr;
+    bool full;
+} Writer;
+
+// Windows-1252 0x80-0x9F; the five unassigned bytes map to the C1 controls
+static const u16 s_cp1252[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+};
+
+static char* s_scratch = NULL;
+static size_t s_scratchCap = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+
+// True if the `n` bytes at `p` are the start of a sequence cut off by the end
+// of the buffer, as when a file is read up to the buffer size
+static bool cut_off(const u8* p, size_t n) {
+    if (n == 0 || n >= UTF8_MAX_LEN || p[0] < 0xC2 || p[0] > 0xF4) return false;
+    size_t need = p[0] >= 0xF0 ? 4 : p[0] >= 0xE0 ? 3 : 2;
+    if (n >= need) return false;
+    for (size_t i = 1; i < n; i++) {
+        if ((p[i] & 0xC0) != 0x80) return false;
+    }
+    return true;
+}
+
+// UTF-16 without a byte order mark is mostly ASCII with a NUL in every other
+// byte; the side the NULs are on gives the byte order
+static bool guess_utf16(const u8* p, size_t len, bool* bigEndian) {
+    size_t sample = len < IMPORT_SAMPLE ? len & ~(size_t)1 : IMPORT_SAMPLE;
+    if (sample < 2 || !memchr(p, 0, sample)) return false;
+
+    size_t even = 0, odd = 0;
+    for (size_t i = 0; i < sample; i += 2) {
+        even += p[i] == 0;
+        odd += p[i + 1] == 0;
+    }
+    size_t pairs = sample / 2;
+    if (odd >= pairs / 4 && even * 4 <= odd) {
+        *bigEndian = false;
+        return true;
+    }
+    if (even >= pairs / 4 && odd * 4 <= even) {
+        *bigEndian = true;
+        return true;
+    }
+    return false;
+}
+
+// Detect the encoding. For UTF-8, *start skips the byte order mark and *end
+// drops a sequence cut off at the end; for UTF-16 *start skips the mark.
+static ImportEncoding detect(const char* buf, size_t len, size_t* start, size_t* end) {
+    const u8* p = (const u8*)buf;
+    bool bigEndian;
+    *start = 0;
+    *end = len;
+
+    if (len >= 2 && ((p[0] == 0xFF && p[1] == 0xFE) || (p[0] == 0xFE && p[1] == 0xFF))) {
+        *start = 2;
+        return p[0] == 0xFF ? IMPORT_UTF16LE : IMPORT_UTF16BE;
+    }
+    if (len >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF) {
+        *start = 3;
+    } else if (guess_utf16(p, len, &bigEndian)) {
+        return bigEndian ? IMPORT_UTF16BE : IMPORT_UTF16LE;
+    }
+
+    size_t valid = *start + utf8_valid_prefix(buf + *start, len - *start);
+    if (valid == len || cut_off(p + valid, len - valid)) {
+        *end = valid;
+        return IMPORT_UTF8;
+    }
+    *start = 0;
+    return IMPORT_CP1252;
+}
+
+// Copy bytes start..end of `buf` to its beginning, turning CRLF and CR into LF
+static size_t normalize_lines(char* buf, size_t start, size_t end) {
+    size_t out = 0;
+    size_t at = start;
+    while (at < end) {
+        const char* cr = memchr(buf + at, '\r', end - at);
+        size_t run = (cr ? (size_t)(cr - buf) : end) - at;
+        memmove(buf + out, buf + at, run);
+        out += run;
+        at += run;
+        if (!cr) break;
+
+        buf[out++] = '\n';
+        at += at + 1 < end && buf[at + 1] == '\n' ? 2 : 1;
+    }
+    return out;
+}
+
+static void put(Writer* w, u32 cp) {
+    char enc[UTF8_MAX_LEN];
+    if (cp == '\n' && w->cr) {
+        w->cr = false;
+        return;
+    }
+    w->cr = cp == '\r';
+    if (w->cr) cp = '\n';
+    if (cp == 0) return;   // Would end the note early
+
+    size_t n = utf8_encode(cp, enc);
+    if (n == 0) n = utf8_encode(REPLACEMENT, enc);
+    if (w->len + n > w->cap) {
+        w->full = true;
+        return;
+    }
+    memcpy(w->out + w->len, enc, n);
+    w->len += n;
+}
+
+static u32 utf16_unit(const u8* p, bool bigEndian) {
+    return bigEndian ? (u32)p[0] << 8 | p[1] : (u32)p[1] << 8 | p[0];
+}
+
+static void decode_utf16(Writer* w, const u8* p, size_t len, bool bigEndian) {
+    for (size_t i = 0; i + 1 < len && !w->full; i += 2) {
+        u32 cp = utf16_unit(p + i, bigEndian);
+        if (cp >= 0xD800 && cp < 0xDC00 && i + 3 < len) {
+            u32 low = utf16_unit(p + i + 2, bigEndian);
+            if (low >= 0xDC00 && low < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+        }
+        put(w, cp >= 0xD800 && cp < 0xE000 ? REPLACEMENT : cp);
+    }
+}
+
+static void decode_cp1252(Writer* w, const u8* p, size_t len) {
+    for (size_t i = 0; i < len && !w->full; i++) {
+        put(w, p[i] >= 0x80 && p[i] < 0xA0 ? s_cp1252[p[i] - 0x80] : p[i]);
+    }
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+
+ImportEncoding import_detect(const char* buf, size_t len) {
+    size_t start, end;
+    return detect(buf, len, &start, &end);
+}
+
+size_t import_text(char* buf, size_t len, size_t cap, ImportResult* result) {
+    ImportResult r = { IMPORT_UTF8, false, false };
+    size_t start, end;
+    if (cap == 0) return 0;
+    if (len >= cap) {
+        len = cap - 1;
+        r.truncated = true;
+    }
+
+    r.encoding = detect(buf, len, &start, &end);
+    if (r.encoding == IMPORT_UTF8) {
+        // The common case: nothing to do once the text is known to be clean
+        if (start > 0 || end < len || memchr(buf, '\r', len)) {
+            r.truncated |= end < len;
+            len = normalize_lines(buf, start, end);
+            r.changed = true;
+        }
+        buf[len] = '\0';
+        if (result) *result = r;
+        return len;
+    }
+
+    if (s_scratchCap < cap) {
+        char* scratch = realloc(s_scratch, cap);
+        if (!scratch) {
+            // Leave the text as it is rather than lose it
+            buf[len] = '\0';
+            if (result) *result = r;
+            return len;
+        }
+        s_scratch = scratch;
+        s_scratchCap = cap;
+    }
+
+    Writer w = { s_scratch, 0, cap - 1, false, false };
+    const u8* p = (const u8*)buf + start;
+    if (r.encoding == IMPORT_CP1252) {
+        decode_cp1252(&w, p, len - start);
+    } else {
+        decode_utf16(&w, p, len - start, r.encoding == IMPORT_UTF16BE);
+    }
+    s_scratch[w.len] = '\0';
+    if (w.full) {
+        // Cut at a character boundary, not just a code point
+        w.len = utf8_truncate(s_scratch, w.len);
+        r.truncated = true;
+    }
+
+    memcpy(buf, s_scratch, w.len);
+    buf[w.len] = '\0';
+    r.changed = true;
+    if (result) *result = r;
+    return w.len;
+}
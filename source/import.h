@@ -0,0 +1,35 @@
+//---------------------------------------------------------------------------------
+// import.h
+// Normalization of notes copied from other machines. Text that arrives as
+// UTF-16 or Latin-1 is transcoded to UTF-8, and CRLF and CR line endings
+// become LF, in one pass over the bytes. Clean UTF-8 is only validated.
+//---------------------------------------------------------------------------------
+
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+typedef enum {
+    IMPORT_UTF8,        // Possibly with a byte order mark
+    IMPORT_UTF16LE,
+    IMPORT_UTF16BE,
+    IMPORT_CP1252       // Anything else: Latin-1 with the Windows additions
+} ImportEncoding;
+
+typedef struct {
+    ImportEncoding encoding;
+    bool changed;       // The text was rewritten
+    bool truncated;     // Part of it did not fit
+} ImportResult;
+
+// Guess the encoding of the `len` bytes at `buf`
+ImportEncoding import_detect(const char* buf, size_t len);
+
+// Normalize the `len` bytes at `buf`, which holds `cap` bytes, in place and
+// NUL-terminate them. Text that does not fit is cut at a character boundary.
+// Returns the new length.
+size_t import_text(char* buf, size_t len, size_t cap, ImportResult* result);
+
+#endif // IMPORT_H
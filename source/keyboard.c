@@ -0,0 +1,466 @@
+//---------------------------------------------------------------------------------
+// keyboard.c
+// In-app touchscreen keyboard. Key geometry, hit-test tables and key-cap text
+// are all built once in kbd_init(), so a frame costs two table lookups for
+// input and a fixed list of rectangles and pre-parsed text for drawing.
+//---------------------------------------------------------------------------------
+
+#include "keyboard.h"
+
+#include <citro2d.h>
+#include <string.h>
+
+#include "utf8.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define KBD_LAYERS      3
+#define KBD_MAX_KEYS    48
+#define KBD_HIT_STEP    2      // Horizontal resolution of the hit-test table
+#define KBD_HIT_COLS    (KBD_SCREEN_W / KBD_HIT_STEP)
+#define KBD_HIT_ROWS    (KBD_CHAR_ROWS + 1)
+#define KBD_NO_KEY      0xFF
+#define KBD_CAP_SCALE   0.55f
+
+#define REPEAT_DELAY_MS 400.0f
+#define REPEAT_RATE_MS  50.0f
+
+// Keyboard colors
+#define COLOR_KBD_BG      C2D_Color32(0x10, 0x10, 0x10, 0xFF)
+#define COLOR_KEY         C2D_Color32(0x30, 0x30, 0x30, 0xFF)
+#define COLOR_KEY_SPECIAL C2D_Color32(0x24, 0x24, 0x24, 0xFF)
+#define COLOR_KEY_DOWN    C2D_Color32(0x60, 0x60, 0x60, 0xFF)
+#define COLOR_KEY_TEXT    C2D_Color32(0xE0, 0xE0, 0xE0, 0xFF)
+
+typedef enum {
+    LAYER_LOWER,
+    LAYER_UPPER,
+    LAYER_SYMBOL
+} KbdLayer;
+
+typedef enum {
+    KIND_CHAR,
+    KIND_SPACE,
+    KIND_ENTER,
+    KIND_DELETE,
+    KIND_SHIFT,
+    KIND_SYMBOL,
+    KIND_DONE,
+    KIND_CANCEL,
+    KIND_SUGGEST
+} KeyKind;
+
+typedef struct {
+    u16 x, y, w, h;
+    u8 kind;
+    u8 charIndex;   // Index into the layer's character table for KIND_CHAR,
+                    // or the completion slot for KIND_SUGGEST
+} KbdKey;
+
+// Cached key cap: pre-parsed label plus its final, centered draw position
+typedef struct {
+    C2D_Text text;
+    float x, y;
+} KbdCap;
+
+// Characters of every KIND_CHAR key, in key order, for each layer
+static const char* const s_layerChars[KBD_LAYERS] = {
+    "1234567890" "qwertyuiop" "asdfghjkl-" "zxcvbnm" ",.",
+    "1234567890" "QWERTYUIOP" "ASDFGHJKL_" "ZXCVBNM" "!?",
+    "!@#$%^&*()" "`~<>[]{}|\\" "+=/:;'\"?_-" "*#>-+=/" ",.",
+};
+
+static KbdKey s_keys[KBD_MAX_KEYS];
+static int s_keyCount = 0;
+
+// Hit-test tables: screen y -> hit row, then (row, x / KBD_HIT_STEP) -> key
+static u8 s_hitRow[KBD_SCREEN_H];
+static u8 s_hitKey[KBD_HIT_ROWS][KBD_HIT_COLS];
+
+// Key-cap draw list
+static C2D_TextBuf s_capBuf;
+static KbdCap s_caps[KBD_LAYERS][KBD_MAX_KEYS];
+
+// Completions, re-parsed only when they change
+static C2D_TextBuf s_sugBuf;
+static char s_sug[KBD_SUGGESTIONS][KBD_SUGGEST_LEN];
+static KbdCap s_sugCaps[KBD_SUGGESTIONS];
+static float s_sugScale[KBD_SUGGESTIONS];
+static int s_sugCount = 0;
+static size_t s_sugPrefixLen = 0;
+
+// Edit state
+static char* s_buf = NULL;
+static size_t s_cap = 0;
+static size_t s_len = 0;
+static size_t s_cursor = 0;
+static KbdLayer s_layer = LAYER_LOWER;
+static int s_pressed = -1;
+static u64 s_pressTick = 0;
+static u64 s_lastRepeatTick = 0;
+
+// Latency instrumentation
+static u64 s_pendingTick = 0;
+static KbdLatency s_latency;
+
+//---------------------------------------------------------------------------------
+// Layout
+//---------------------------------------------------------------------------------
+static void add_key(KeyKind kind, int x, int y, int w, int h, int hitRow, int* charIndex) {
+    if (s_keyCount >= KBD_MAX_KEYS) return;
+
+    KbdKey* key = &s_keys[s_keyCount];
+    key->x = x;
+    key->y = y;
+    key->w = w;
+    key->h = h;
+    key->kind = kind;
+    key->charIndex = 0;
+    if (kind == KIND_CHAR) {
+        key->charIndex = (*charIndex)++;
+    }
+
+    for (int col = x / KBD_HIT_STEP; col < (x + w) / KBD_HIT_STEP && col < KBD_HIT_COLS; col++) {
+        s_hitKey[hitRow][col] = s_keyCount;
+    }
+    s_keyCount++;
+}
+
+static void build_layout(void) {
+    int charIndex = 0;
+    int y = KBD_TOP;
+
+    s_keyCount = 0;
+    memset(s_hitRow, KBD_NO_KEY, sizeof(s_hitRow));
+    memset(s_hitKey, KBD_NO_KEY, sizeof(s_hitKey));
+
+    // Row 0: action bar with the completion slots between Cancel and Done
+    add_key(KIND_CANCEL, 0, y, 64, KBD_BAR_H, 0, &charIndex);
+    for (int i = 0; i < KBD_SUGGESTIONS; i++) {
+        add_key(KIND_SUGGEST, 64 + i * 64, y, 64, KBD_BAR_H, 0, &charIndex);
+        s_keys[s_keyCount - 1].charIndex = i;
+    }
+    add_key(KIND_DONE, 256, y, 64, KBD_BAR_H, 0, &charIndex);
+    for (int py = y; py < y + KBD_BAR_H; py++) s_hitRow[py] = 0;
+    y += KBD_BAR_H;
+
+    // Rows 1-3: ten character keys each
+    for (int row = 1; row <= 3; row++) {
+        for (int i = 0; i < 10; i++) {
+            add_key(KIND_CHAR, i * 32, y, 32, KBD_ROW_H, row, &charIndex);
+        }
+        for (int py = y; py < y + KBD_ROW_H; py++) s_hitRow[py] = row;
+        y += KBD_ROW_H;
+    }
+
+    // Row 4: Shift, seven character keys, Delete
+    add_key(KIND_SHIFT, 0, y, 48, KBD_ROW_H, 4, &charIndex);
+    for (int i = 0; i < 7; i++) {
+        add_key(KIND_CHAR, 48 + i * 32, y, 32, KBD_ROW_H, 4, &charIndex);
+    }
+    add_key(KIND_DELETE, 272, y, 48, KBD_ROW_H, 4, &charIndex);
+    for (int py = y; py < y + KBD_ROW_H; py++) s_hitRow[py] = 4;
+    y += KBD_ROW_H;
+
+    // Row 5: Symbols, comma, Space, period, Enter
+    add_key(KIND_SYMBOL, 0, y, 48, KBD_ROW_H, 5, &charIndex);
+    add_key(KIND_CHAR, 48, y, 32, KBD_ROW_H, 5, &charIndex);
+    add_key(KIND_SPACE, 80, y, 144, KBD_ROW_H, 5, &charIndex);
+    add_key(KIND_CHAR, 224, y, 32, KBD_ROW_H, 5, &charIndex);
+    add_key(KIND_ENTER, 256, y, 64, KBD_ROW_H, 5, &charIndex);
+    for (int py = y; py < y + KBD_ROW_H && py < KBD_SCREEN_H; py++) s_hitRow[py] = 5;
+}
+
+static const char* key_label(const KbdKey* key, int layer, char* scratch) {
+    switch (key->kind) {
+        case KIND_CHAR:
+            scratch[0] = s_layerChars[layer][key->charIndex];
+            scratch[1] = '\0';
+            return scratch;
+        case KIND_SPACE:  return "space";
+        case KIND_ENTER:  return "Enter";
+        case KIND_DELETE: return "Del";
+        case KIND_SHIFT:  return layer == LAYER_UPPER ? "SHIFT" : "Shift";
+        case KIND_SYMBOL: return layer == LAYER_SYMBOL ? "abc" : "#+=";
+        case KIND_DONE:   return "Done";
+        case KIND_CANCEL: return "Cancel";
+        case KIND_SUGGEST: return "";
+    }
+    return "";
+}
+
+static void build_caps(void) {
+    char scratch[2];
+    for (int layer = 0; layer < KBD_LAYERS; layer++) {
+        for (int i = 0; i < s_keyCount; i++) {
+            const KbdKey* key = &s_keys[i];
+            KbdCap* cap = &s_caps[layer][i];
+            float w = 0.0f, h = 0.0f;
+
+            C2D_TextParse(&cap->text, s_capBuf, key_label(key, layer, scratch));
+            C2D_TextOptimize(&cap->text);
+            C2D_TextGetDimensions(&cap->text, KBD_CAP_SCALE, KBD_CAP_SCALE, &w, &h);
+            cap->x = key->x + (key->w - w) * 0.5f;
+            cap->y = key->y + (key->h - h) * 0.5f;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------
+// Init and cleanup
+//---------------------------------------------------------------------------------
+bool kbd_init(void) {
+    s_capBuf = C2D_TextBufNew(1024);
+    s_sugBuf = C2D_TextBufNew(KBD_SUGGESTIONS * KBD_SUGGEST_LEN);
+    if (!s_capBuf || !s_sugBuf) return false;
+
+    build_layout();
+    build_caps();
+
+    memset(&s_latency, 0, sizeof(s_latency));
+    return true;
+}
+
+void kbd_exit(void) {
+    if (s_capBuf) {
+        C2D_TextBufDelete(s_capBuf);
+        s_capBuf = NULL;
+    }
+    if (s_sugBuf) {
+        C2D_TextBufDelete(s_sugBuf);
+        s_sugBuf = NULL;
+    }
+}
+
+//---------------------------------------------------------------------------------
+// Editing
+//---------------------------------------------------------------------------------
+void kbd_attach(char* buf, size_t cap) {
+    s_buf = buf;
+    s_cap = cap;
+    s_len = buf ? strlen(buf) : 0;
+    s_cursor = s_len;
+    s_layer = LAYER_LOWER;
+    s_pressed = -1;
+    s_sugCount = 0;
+}
+
+size_t kbd_cursor(void) {
+    return s_cursor;
+}
+
+static bool insert_char(char c) {
+    if (!s_buf || s_len + 1 >= s_cap) return false;
+    memmove(s_buf + s_cursor + 1, s_buf + s_cursor, s_len - s_cursor + 1);
+    s_buf[s_cursor] = c;
+    s_cursor++;
+    s_len++;
+    return true;
+}
+
+// Delete the character (grapheme cluster) before the cursor
+static bool delete_char(void) {
+    if (!s_buf || s_cursor == 0) return false;
+    size_t start = utf8_prev_grapheme(s_buf, s_cursor);
+    memmove(s_buf + start, s_buf + s_cursor, s_len - s_cursor + 1);
+    s_len -= s_cursor - start;
+    s_cursor = start;
+    return true;
+}
+
+static bool insert_string(const char* str) {
+    bool edited = false;
+    while (*str && insert_char(*str++)) edited = true;
+    return edited;
+}
+
+static KbdAction press_key(int index) {
+    const KbdKey* key = &s_keys[index];
+    bool edited = false;
+
+    switch (key->kind) {
+        case KIND_CHAR:
+            edited = insert_char(s_layerChars[s_layer][key->charIndex]);
+            if (s_layer == LAYER_UPPER) s_layer = LAYER_LOWER;  // One-shot shift
+            break;
+        case KIND_SPACE:  edited = insert_char(' '); break;
+        case KIND_ENTER:  edited = insert_char('\n'); break;
+        case KIND_DELETE: edited = delete_char(); break;
+        case KIND_SHIFT:
+            s_layer = (s_layer == LAYER_UPPER) ? LAYER_LOWER : LAYER_UPPER;
+            break;
+        case KIND_SYMBOL:
+            s_layer = (s_layer == LAYER_SYMBOL) ? LAYER_LOWER : LAYER_SYMBOL;
+            break;
+        case KIND_DONE:   return KBD_DONE;
+        case KIND_CANCEL: return KBD_CANCEL;
+        case KIND_SUGGEST:
+            if (key->charIndex < s_sugCount) {
+                edited = insert_string(s_sug[key->charIndex] + s_sugPrefixLen);
+                edited |= insert_char(' ');
+                s_sugCount = 0;
+            }
+            break;
+    }
+    return edited ? KBD_EDITED : KBD_NONE;
+}
+
+static int hit_test(const touchPosition* touch) {
+    if (touch->py >= KBD_SCREEN_H || touch->px >= KBD_SCREEN_W) return -1;
+    u8 row = s_hitRow[touch->py];
+    if (row == KBD_NO_KEY) return -1;
+    u8 key = s_hitKey[row][touch->px / KBD_HIT_STEP];
+    return key == KBD_NO_KEY ? -1 : key;
+}
+
+KbdAction kbd_update(u32 kDown, u32 kHeld) {
+    if (!s_buf) return KBD_NONE;
+
+    KbdAction action = KBD_NONE;
+    u64 now = svcGetSystemTick();
+
+    if (kDown & KEY_TOUCH) {
+        touchPosition touch;
+        hidTouchRead(&touch);
+        s_pressed = hit_test(&touch);
+        if (s_pressed >= 0) {
+            s_pressTick = now;
+            s_lastRepeatTick = now;
+            action = press_key(s_pressed);
+        }
+    } else if ((kHeld & KEY_TOUCH) && s_pressed >= 0) {
+        // Auto-repeat for Delete only; a held character key should not spam
+        if (s_keys[s_pressed].kind == KIND_DELETE) {
+            float heldMs = (now - s_pressTick) / CPU_TICKS_PER_MSEC;
+            float sinceRepeatMs = (now - s_lastRepeatTick) / CPU_TICKS_PER_MSEC;
+            if (heldMs >= REPEAT_DELAY_MS && sinceRepeatMs >= REPEAT_RATE_MS) {
+                s_lastRepeatTick = now;
+                action = press_key(s_pressed);
+            }
+        }
+    } else {
+        s_pressed = -1;
+    }
+
+    if (action == KBD_EDITED && s_pendingTick == 0) {
+        s_pendingTick = now;
+    }
+
+    // Physical buttons
+    if (action == KBD_NONE) {
+        if ((kDown & KEY_LEFT) && s_cursor > 0) {
+            s_cursor = utf8_prev_grapheme(s_buf, s_cursor);
+            action = KBD_EDITED;
+        }
+        if ((kDown & KEY_RIGHT) && s_cursor < s_len) {
+            s_cursor = utf8_next_grapheme(s_buf, s_len, s_cursor);
+            action = KBD_EDITED;
+        }
+        if ((kDown & KEY_Y) && delete_char()) {
+            action = KBD_EDITED;
+        }
+        if (kDown & KEY_START) {
+            action = KBD_DONE;
+        }
+    }
+    return action;
+}
+
+void kbd_set_suggestions(const char* const* words, int count, size_t prefix_len) {
+    // Words that add nothing to the prefix, such as the typed word itself,
+    // are left out before comparing with what is shown
+    const char* shown[KBD_SUGGESTIONS];
+    int shownCount = 0;
+    for (int i = 0; i < count && shownCount < KBD_SUGGESTIONS; i++) {
+        if (strlen(words[i]) > prefix_len) shown[shownCount++] = words[i];
+    }
+
+    bool changed = shownCount != s_sugCount || prefix_len != s_sugPrefixLen;
+    for (int i = 0; i < shownCount && !changed; i++) {
+        changed = strncmp(s_sug[i], shown[i], KBD_SUGGEST_LEN - 1) != 0;
+    }
+    if (!changed) return;
+
+    C2D_TextBufClear(s_sugBuf);
+    s_sugCount = 0;
+    s_sugPrefixLen = prefix_len;
+    for (int i = 0; i < shownCount; i++) {
+        int slot = s_sugCount;
+        const KbdKey* key = NULL;
+        for (int k = 0; k < s_keyCount; k++) {
+            if (s_keys[k].kind == KIND_SUGGEST && s_keys[k].charIndex == slot) key = &s_keys[k];
+        }
+        if (!key) break;
+
+        strncpy(s_sug[slot], shown[i], KBD_SUGGEST_LEN - 1);
+        s_sug[slot][KBD_SUGGEST_LEN - 1] = '\0';
+
+        // Shrink long words to fit their slot instead of clipping them
+        KbdCap* cap = &s_sugCaps[slot];
+        float w = 0.0f, h = 0.0f;
+        float scale = KBD_CAP_SCALE;
+        C2D_TextParse(&cap->text, s_sugBuf, s_sug[slot]);
+        C2D_TextOptimize(&cap->text);
+        C2D_TextGetDimensions(&cap->text, scale, scale, &w, &h);
+        if (w > key->w - 4) {
+            scale *= (key->w - 4) / w;
+            C2D_TextGetDimensions(&cap->text, scale, scale, &w, &h);
+        }
+        s_sugScale[slot] = scale;
+        cap->x = key->x + (key->w - w) * 0.5f;
+        cap->y = key->y + (key->h - h) * 0.5f;
+        s_sugCount++;
+    }
+}
+
+//---------------------------------------------------------------------------------
+// Drawing
+//---------------------------------------------------------------------------------
+void kbd_draw(void) {
+    C2D_DrawRectSolid(0.0f, KBD_TOP, 0.5f, KBD_SCREEN_W, KBD_SCREEN_H - KBD_TOP, COLOR_KBD_BG);
+
+    for (int i = 0; i < s_keyCount; i++) {
+        const KbdKey* key = &s_keys[i];
+        const KbdCap* cap = &s_caps[s_layer][i];
+        float scale = KBD_CAP_SCALE;
+        u32 color = COLOR_KEY;
+
+        if (key->kind == KIND_SUGGEST) {
+            if (key->charIndex >= s_sugCount) continue;
+            cap = &s_sugCaps[key->charIndex];
+            scale = s_sugScale[key->charIndex];
+        }
+        if (i == s_pressed) {
+            color = COLOR_KEY_DOWN;
+        } else if (key->kind != KIND_CHAR) {
+            color = COLOR_KEY_SPECIAL;
+        }
+
+        // One pixel inset gives the grid lines for free
+        C2D_DrawRectSolid(key->x + 1, key->y + 1, 0.5f, key->w - 2, key->h - 2, color);
+        C2D_DrawText(&cap->text, C2D_WithColor, cap->x, cap->y, 0.5f,
+                     scale, scale, COLOR_KEY_TEXT);
+    }
+}
+
+//---------------------------------------------------------------------------------
+// Latency instrumentation
+//---------------------------------------------------------------------------------
+void kbd_frame_presented(void) {
+    if (s_pendingTick == 0) return;
+
+    float ms = (svcGetSystemTick() - s_pendingTick) / CPU_TICKS_PER_MSEC;
+    s_pendingTick = 0;
+
+    s_latency.last_ms = ms;
+    if (s_latency.samples == 0 || ms < s_latency.min_ms) s_latency.min_ms = ms;
+    if (ms > s_latency.max_ms) s_latency.max_ms = ms;
+    s_latency.avg_ms += (ms - s_latency.avg_ms) / (float)(s_latency.samples + 1);
+    s_latency.samples++;
+}
+
+const KbdLatency* kbd_latency(void) {
+    return &s_latency;
+}
@@ -0,0 +1,66 @@
+//---------------------------------------------------------------------------------
+// keyboard.h
+// In-app touchscreen keyboard drawn with Citro2D on the bottom screen.
+//---------------------------------------------------------------------------------
+
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+// Vertical layout of the keyboard on the bottom screen (320x240)
+#define KBD_SCREEN_W   320
+#define KBD_SCREEN_H   240
+#define KBD_BAR_H      24    // Action bar: Cancel | completions | Done
+#define KBD_ROW_H      28    // Height of one row of character keys
+#define KBD_CHAR_ROWS  5
+#define KBD_TOP        (KBD_SCREEN_H - KBD_BAR_H - KBD_CHAR_ROWS * KBD_ROW_H)
+
+// Completion slots in the middle of the action bar
+#define KBD_SUGGESTIONS   3
+#define KBD_SUGGEST_LEN   32
+
+// Result of feeding one frame of input to the keyboard
+typedef enum {
+    KBD_NONE,        // Nothing happened
+    KBD_EDITED,      // Buffer or cursor changed
+    KBD_DONE,        // "Done" pressed: caller should commit the buffer
+    KBD_CANCEL       // "Cancel" pressed: caller should discard the buffer
+} KbdAction;
+
+// Touch-to-glyph latency, from the touch sample that produced a character
+// to the submission of the first frame showing it.
+typedef struct {
+    float last_ms;
+    float min_ms;
+    float max_ms;
+    float avg_ms;
+    u32 samples;
+} KbdLatency;
+
+bool kbd_init(void);
+void kbd_exit(void);
+
+// Attach an edit buffer of `cap` bytes (including the terminator). The
+// cursor is placed at the end of the existing text.
+void kbd_attach(char* buf, size_t cap);
+size_t kbd_cursor(void);
+
+// Handle touch and button input for this frame. Must be called after
+// hidScanInput().
+KbdAction kbd_update(u32 kDown, u32 kHeld);
+
+// Show up to KBD_SUGGESTIONS completions for the word before the cursor.
+// Tapping one inserts the rest of the word after the `prefix_len` bytes
+// already typed, followed by a space.
+void kbd_set_suggestions(const char* const* words, int count, size_t prefix_len);
+
+// Draw the keyboard; the bottom scene must already be active.
+void kbd_draw(void);
+
+// Call right after C3D_FrameEnd() to close any pending latency sample.
+void kbd_frame_presented(void);
+const KbdLatency* kbd_latency(void);
+
+#endif // KEYBOARD_H
@@ -0,0 +1,419 @@
+//---------------------------------------------------------------------------------
+// kv.c
+// Log-structured key-value store. The whole table lives in memory as an
+// array of entries sorted by key, so lookups are a binary search and scans a
+// walk along the array. Each commit is appended to the log as one block of
+// records behind a header with its length and CRC-32; replaying the log at
+// startup stops at the first block that is cut short or damaged, which is
+// what makes a commit all or nothing. When most of the log is superseded
+// records, the live table is written to a new log that replaces the old one.
+//---------------------------------------------------------------------------------
+
+#include "kv.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc.h"
+#include "storage.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define KV_MAGIC       0x314C564B     // "KVL1"
+#define KV_TEMP        ".kv-new"      // Log being rewritten
+#define KV_COMPACT_MIN (16 * 1024)    // Smaller logs are never rewritten
+#define KV_BLOCK_MAX   (16 * 1024 * 1024)
+
+enum {
+    OP_PUT,
+    OP_DELETE
+};
+
+typedef struct {
+    u32 magic;
+    u32 len;            // Bytes of records that follow
+    u32 checksum;       // CRC-32 of the records
+} BlockHeader;
+
+typedef struct {
+    u8 op;
+    u8 reserved;
+    u16 keyLen;         // Key bytes, then value bytes, follow
+    u16 valueLen;
+} RecordHeader;
+
+typedef struct {
+    char* key;          // NUL-terminated, followed by the value in the same allocation
+    u16 keyLen;
+    u16 len;
+} Entry;
+
+struct KvTxn {
+    u8* data;           // A block header, then the records
+    size_t len;
+    size_t cap;
+    bool failed;
+};
+
+// Entries a commit will add, allocated before anything changes
+typedef struct {
+    char** fresh;
+    u32 count;
+} Batch;
+
+static Entry* s_entries = NULL;    // Sorted by key; guarded by s_lock
+static u32 s_count = 0;
+static u32 s_cap = 0;
+static u32 s_liveBytes = 0;        // Records a rewritten log would hold
+static u32 s_logBytes = 0;
+static bool s_torn = false;        // The log ends in a partial block
+static LightLock s_lock;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static const char* value_of(const Entry* e) {
+    return e->key + e->keyLen + 1;
+}
+
+static u32 record_size(u32 keyLen, u32 len) {
+    return sizeof(RecordHeader) + keyLen + len;
+}
+
+// First entry whose key is not less than the `len` bytes at `key`
+static u32 lower_bound(const char* key, size_t len, bool* found) {
+    u32 lo = 0, hi = s_count;
+    *found = false;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        const Entry* e = &s_entries[mid];
+        int cmp = memcmp(e->key, key, e->keyLen < len ? e->keyLen : len);
+        if (cmp == 0) cmp = e->keyLen < len ? -1 : e->keyLen > len;
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            *found = *found || cmp == 0;
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void discard(Batch* batch) {
+    for (u32 i = 0; i < batch->count; i++) free(batch->fresh[i]);
+    free(batch->fresh);
+}
+
+// Check the records in `data` and allocate the entries they put, so that
+// install() cannot fail halfway
+static bool prepare(const u8* data, size_t len, Batch* batch) {
+    u32 puts = 0;
+    batch->fresh = NULL;
+    batch->count = 0;
+
+    for (size_t at = 0; at < len;) {
+        RecordHeader r;
+        if (len - at < sizeof(r)) return false;
+        memcpy(&r, data + at, sizeof(r));
+        if (r.op > OP_DELETE || r.keyLen == 0 || r.keyLen >= KV_KEY_LEN || r.valueLen > KV_VALUE_LEN ||
+            len - at - sizeof(r) < (size_t)r.keyLen + r.valueLen ||
+            memchr(data + at + sizeof(r), 0, r.keyLen)) {
+            return false;
+        }
+        puts += r.op == OP_PUT;
+        at += record_size(r.keyLen, r.valueLen);
+    }
+
+    if (s_count + puts > s_cap) {
+        u32 cap = s_cap ? s_cap : 64;
+        while (cap < s_count + puts) cap *= 2;
+        Entry* bigger = realloc(s_entries, cap * sizeof(Entry));
+        if (!bigger) return false;
+        s_entries = bigger;
+        s_cap = cap;
+    }
+    if (puts == 0) return true;
+
+    batch->fresh = malloc(puts * sizeof(char*));
+    if (!batch->fresh) return false;
+    for (size_t at = 0; at < len;) {
+        RecordHeader r;
+        memcpy(&r, data + at, sizeof(r));
+        if (r.op == OP_PUT) {
+            char* key = malloc(r.keyLen + 1 + r.valueLen);
+            if (!key) {
+                discard(batch);
+                return false;
+            }
+            memcpy(key, data + at + sizeof(r), r.keyLen);
+            key[r.keyLen] = '\0';
+            memcpy(key + r.keyLen + 1, data + at + sizeof(r) + r.keyLen, r.valueLen);
+            batch->fresh[batch->count++] = key;
+        }
+        at += record_size(r.keyLen, r.valueLen);
+    }
+    return true;
+}
+
+// Apply records checked by prepare(), in order
+static void install(const u8* data, size_t len, Batch* batch) {
+    u32 next = 0;
+    for (size_t at = 0; at < len;) {
+        RecordHeader r;
+        bool found;
+        memcpy(&r, data + at, sizeof(r));
+        const char* key = (const char*)data + at + sizeof(r);
+        u32 i = lower_bound(key, r.keyLen, &found);
+        at += record_size(r.keyLen, r.valueLen);
+
+        if (found) {
+            s_liveBytes -= record_size(s_entries[i].keyLen, s_entries[i].len);
+            free(s_entries[i].key);
+            if (r.op == OP_DELETE) {
+                memmove(&s_entries[i], &s_entries[i + 1], (s_count - i - 1) * sizeof(Entry));
+                s_count--;
+            }
+        } else if (r.op == OP_PUT) {
+            memmove(&s_entries[i + 1], &s_entries[i], (s_count - i) * sizeof(Entry));
+            s_count++;
+        }
+        if (r.op == OP_PUT) {
+            s_entries[i].key = batch->fresh[next++];
+            s_entries[i].keyLen = r.keyLen;
+            s_entries[i].len = r.valueLen;
+            s_liveBytes += record_size(r.keyLen, r.valueLen);
+        }
+    }
+    free(batch->fresh);
+}
+
+// Write the live table as a new log and swap it in. The new log is complete
+// before the old one goes, so kv_open() can finish an interrupted swap.
+static bool rewrite(void) {
+    size_t size = sizeof(BlockHeader) + s_liveBytes;
+    u8* data = malloc(size);
+    if (!data) return false;
+
+    u8* p = data + sizeof(BlockHeader);
+    for (u32 i = 0; i < s_count; i++) {
+        const Entry* e = &s_entries[i];
+        RecordHeader r = { OP_PUT, 0, e->keyLen, e->len };
+        memcpy(p, &r, sizeof(r));
+        memcpy(p + sizeof(r), e->key, e->keyLen);
+        memcpy(p + sizeof(r) + e->keyLen, value_of(e), e->len);
+        p += record_size(e->keyLen, e->len);
+    }
+    BlockHeader h = { KV_MAGIC, s_liveBytes, crc_compute(data + sizeof(h), s_liveBytes) };
+    memcpy(data, &h, sizeof(h));
+
+    bool ok = storage_write(KV_TEMP, data, size);
+    free(data);
+    if (ok) {
+        storage_remove(KV_FILE);
+        ok = storage_rename(KV_TEMP, KV_FILE);
+    }
+    if (ok) {
+        s_logBytes = size;
+        s_torn = false;
+    }
+    return ok;
+}
+
+static void add_record(KvTxn* txn, u8 op, const char* key, const void* value, size_t len) {
+    if (!txn || txn->failed) return;
+    size_t keyLen = strlen(key);
+    if (keyLen == 0 || keyLen >= KV_KEY_LEN || len > KV_VALUE_LEN) {
+        txn->failed = true;
+        return;
+    }
+
+    size_t need = txn->len + record_size(keyLen, len);
+    if (need > txn->cap) {
+        size_t cap = txn->cap * 2;
+        while (cap < need) cap *= 2;
+        u8* bigger = realloc(txn->data, cap);
+        if (!bigger) {
+            txn->failed = true;
+            return;
+        }
+        txn->data = bigger;
+        txn->cap = cap;
+    }
+
+    RecordHeader r = { op, 0, keyLen, len };
+    memcpy(txn->data + txn->len, &r, sizeof(r));
+    memcpy(txn->data + txn->len + sizeof(r), key, keyLen);
+    if (len > 0) memcpy(txn->data + txn->len + sizeof(r) + keyLen, value, len);
+    txn->len = need;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+bool kv_open(void) {
+    LightLock_Init(&s_lock);
+
+    // A rewrite that stopped before removing the old log left both; the new
+    // one may be incomplete. One that stopped after left only the new one.
+    if (storage_exists(KV_TEMP)) {
+        if (storage_exists(KV_FILE)) storage_remove(KV_TEMP);
+        else storage_rename(KV_TEMP, KV_FILE);
+    }
+
+    StorageFile* file = storage_open(KV_FILE, false);
+    if (!file) return true;
+    for (;;) {
+        BlockHeader h;
+        Batch batch;
+        s32 got = storage_file_read(file, &h, sizeof(h));
+        if (got == 0) break;
+        if (got != sizeof(h) || h.magic != KV_MAGIC || h.len > KV_BLOCK_MAX) {
+            s_torn = true;
+            break;
+        }
+
+        u8* data = malloc(h.len ? h.len : 1);
+        if (!data || storage_file_read(file, data, h.len) != (s32)h.len ||
+            crc_compute(data, h.len) != h.checksum || !prepare(data, h.len, &batch)) {
+            free(data);
+            s_torn = true;
+            break;
+        }
+        install(data, h.len, &batch);
+        free(data);
+        s_logBytes += sizeof(h) + h.len;
+    }
+    storage_close(file);
+
+    // Later commits would land after the damage, where replay never reaches
+    return !s_torn || rewrite();
+}
+
+void kv_close(void) {
+    for (u32 i = 0; i < s_count; i++) free(s_entries[i].key);
+    free(s_entries);
+    s_entries = NULL;
+    s_count = 0;
+    s_cap = 0;
+    s_liveBytes = 0;
+    s_logBytes = 0;
+    s_torn = false;
+}
+
+s32 kv_get(const char* key, void* buf, size_t cap) {
+    bool found;
+    s32 len = -1;
+    LightLock_Lock(&s_lock);
+    u32 i = lower_bound(key, strlen(key), &found);
+    if (found) {
+        len = s_entries[i].len;
+        if (cap > 0) memcpy(buf, value_of(&s_entries[i]), (size_t)len < cap ? (size_t)len : cap);
+    }
+    LightLock_Unlock(&s_lock);
+    return len;
+}
+
+int kv_scan(const char* from, const char* to, KvScanFn fn, void* arg) {
+    bool found;
+    int visited = 0;
+    LightLock_Lock(&s_lock);
+    for (u32 i = from ? lower_bound(from, strlen(from), &found) : 0; i < s_count; i++) {
+        const Entry* e = &s_entries[i];
+        if (to && strcmp(e->key, to) >= 0) break;
+        visited++;
+        if (!fn(e->key, value_of(e), e->len, arg)) break;
+    }
+    LightLock_Unlock(&s_lock);
+    return visited;
+}
+
+int kv_scan_prefix(const char* prefix, KvScanFn fn, void* arg) {
+    bool found;
+    int visited = 0;
+    size_t len = strlen(prefix);
+    LightLock_Lock(&s_lock);
+    for (u32 i = lower_bound(prefix, len, &found); i < s_count; i++) {
+        const Entry* e = &s_entries[i];
+        if (e->keyLen < len || memcmp(e->key, prefix, len) != 0) break;
+        visited++;
+        if (!fn(e->key, value_of(e), e->len, arg)) break;
+    }
+    LightLock_Unlock(&s_lock);
+    return visited;
+}
+
+KvTxn* kv_begin(void) {
+    KvTxn* txn = malloc(sizeof(KvTxn));
+    if (!txn) return NULL;
+    txn->cap = 256;
+    txn->data = malloc(txn->cap);
+    txn->len = sizeof(BlockHeader);
+    txn->failed = txn->data == NULL;
+    return txn;
+}
+
+void kv_put(KvTxn* txn, const char* key, const void* value, size_t len) {
+    add_record(txn, OP_PUT, key, value, len);
+}
+
+void kv_delete(KvTxn* txn, const char* key) {
+    add_record(txn, OP_DELETE, key, NULL, 0);
+}
+
+bool kv_commit(KvTxn* txn) {
+    Batch batch;
+    if (!txn) return false;
+    size_t len = txn->len - sizeof(BlockHeader);
+    bool ok = !txn->failed;
+    if (ok && len == 0) {
+        kv_abort(txn);
+        return true;
+    }
+
+    LightLock_Lock(&s_lock);
+    if (ok) ok = prepare(txn->data + sizeof(BlockHeader), len, &batch);
+    if (ok) {
+        BlockHeader h = { KV_MAGIC, len, crc_compute(txn->data + sizeof(h), len) };
+        memcpy(txn->data, &h, sizeof(h));
+        ok = (!s_torn || rewrite()) && storage_append(KV_FILE, txn->data, txn->len);
+        if (ok) {
+            install(txn->data + sizeof(BlockHeader), len, &batch);
+            s_logBytes += txn->len;
+        } else {
+            // The append may have left part of the block behind
+            discard(&batch);
+            s_torn = true;
+        }
+    }
+    if (ok && s_logBytes > KV_COMPACT_MIN && s_logBytes > 2 * (s_liveBytes + sizeof(BlockHeader))) {
+        rewrite();
+    }
+    LightLock_Unlock(&s_lock);
+
+    kv_abort(txn);
+    return ok;
+}
+
+void kv_abort(KvTxn* txn) {
+    if (!txn) return;
+    free(txn->data);
+    free(txn);
+}
+
+bool kv_set(const char* key, const void* value, size_t len) {
+    KvTxn* txn = kv_begin();
+    kv_put(txn, key, value, len);
+    return kv_commit(txn);
+}
+
+bool kv_remove(const char* key) {
+    KvTxn* txn = kv_begin();
+    kv_delete(txn, key);
+    return kv_commit(txn);
+}
+
+bool kv_is_file(const char* name) {
+    return strcmp(name, KV_FILE) == 0 || strcmp(name, KV_TEMP) == 0;
+}
@@ -0,0 +1,59 @@
+//---------------------------------------------------------------------------------
+// kv.h
+// Key-value store for app metadata, so each new kind of state does not need
+// its own file format in the notes directory. Keys are strings kept in order,
+// for range and prefix scans; values are small byte strings. Changes are
+// grouped into transactions, and a transaction is committed whole or not at
+// all, even across a power cut.
+//---------------------------------------------------------------------------------
+
+#ifndef KV_H
+#define KV_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+#define KV_FILE      ".kv"     // The log in the notes directory
+#define KV_KEY_LEN   320       // Longest key, with terminator: room for a prefix and a note name
+#define KV_VALUE_LEN 4096      // Longest value
+
+typedef struct KvTxn KvTxn;
+
+// Called for each key in a scan, in order; return false to stop. The store is
+// locked meanwhile, so `fn` must not call kv_get() or commit, but it may add
+// to a transaction.
+typedef bool (*KvScanFn)(const char* key, const void* value, size_t len, void* arg);
+
+// Load the store, after storage_init(). A commit that was cut short is
+// dropped. Returns false if the log was damaged and could not be rewritten;
+// what could be read is still loaded.
+bool kv_open(void);
+void kv_close(void);
+
+// Copy up to `cap` bytes of the value of `key` to `buf`. Returns the full
+// length of the value, or -1 if there is no such key.
+s32 kv_get(const char* key, void* buf, size_t cap);
+
+// Visit the keys from `from` (inclusive) to `to` (exclusive; NULL for no
+// limit), or the keys starting with `prefix`. Returns the number visited.
+int kv_scan(const char* from, const char* to, KvScanFn fn, void* arg);
+int kv_scan_prefix(const char* prefix, KvScanFn fn, void* arg);
+
+// Transactions. Puts and deletes are only recorded until kv_commit(), which
+// applies them in order and frees the transaction. kv_commit() returns false,
+// with nothing changed, if a key or value was too long, memory ran out or
+// the log could not be written.
+KvTxn* kv_begin(void);
+void kv_put(KvTxn* txn, const char* key, const void* value, size_t len);
+void kv_delete(KvTxn* txn, const char* key);
+bool kv_commit(KvTxn* txn);
+void kv_abort(KvTxn* txn);
+
+// One-key transactions
+bool kv_set(const char* key, const void* value, size_t len);
+bool kv_remove(const char* key);
+
+// True for the store's files, which are not notes
+bool kv_is_file(const char* name);
+
+#endif // KV_H
@@ -0,0 +1,126 @@
+//---------------------------------------------------------------------------------
+// loader.c
+// Loading pipeline. The directory is listed first, STORAGE_DIR_BATCH entries
+// per request, and the files are then read in the order the directory lists
+// them, which is the order they were written to the card. The reader runs
+// one priority above the caller, so it issues the next request as soon as
+// the last one completes and the caller indexes while the card is busy.
+//---------------------------------------------------------------------------------
+
+#include "loader.h"
+
+#include <string.h>
+
+#include "prof.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define LOADER_STACK_SIZE (16 * 1024)
+
+typedef struct {
+    LoadItem* items;
+    int count;
+    volatile int done;   // Items read so far
+    LightEvent ready;
+    u64 ticks;           // Reader's wall clock
+} ReadAhead;
+
+static LoadStats s_stats;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static float ticks_ms(u64 ticks) {
+    return ticks / (float)CPU_TICKS_PER_MSEC;
+}
+
+static void read_items(ReadAhead* ra) {
+    u64 start = svcGetSystemTick();
+    for (int i = 0; i < ra->count; i++) {
+        LoadItem* item = &ra->items[i];
+        prof_begin("read note");
+        item->len = storage_read(item->name, item->buf, item->cap);
+        prof_end();
+        __atomic_store_n(&ra->done, i + 1, __ATOMIC_RELEASE);
+        LightEvent_Signal(&ra->ready);
+    }
+    ra->ticks = svcGetSystemTick() - start;
+}
+
+static void reader_main(void* arg) {
+    prof_thread(PROF_TRACK_IO);
+    read_items(arg);
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+int loader_list(LoadItem* items, int max, LoadAccept accept) {
+    u64 start = svcGetSystemTick();
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    int count = 0;
+    StorageDir* dir = storage_dir_open();
+    if (dir) {
+        StorageEntry entry;
+        while (count < max && storage_dir_next(dir, &entry)) {
+            s_stats.entries++;
+            if (!accept(&entry)) continue;
+            memcpy(items[count].name, entry.name, STORAGE_NAME_LEN);
+            items[count].buf = NULL;
+            items[count].cap = 0;
+            items[count].len = -1;
+            count++;
+        }
+        storage_dir_close(dir);
+    }
+
+    s_stats.list_ms = ticks_ms(svcGetSystemTick() - start);
+    s_stats.total_ms = s_stats.list_ms;
+    return count;
+}
+
+void loader_read(LoadItem* items, int count, LoadIndex index, void* arg) {
+    u64 start = svcGetSystemTick();
+    u64 indexTicks = 0, waitTicks = 0;
+    ReadAhead ra = { items, count, 0, {0}, 0 };
+    LightEvent_Init(&ra.ready, RESET_ONESHOT);
+
+    // Without a thread the same loop runs inline, just without the overlap
+    s32 prio = 0x30;
+    svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+    Thread reader = threadCreate(reader_main, &ra, LOADER_STACK_SIZE, prio - 1, -2, false);
+    if (!reader) read_items(&ra);
+
+    for (int i = 0; i < count; i++) {
+        u64 waitStart = svcGetSystemTick();
+        while (__atomic_load_n(&ra.done, __ATOMIC_ACQUIRE) <= i) {
+            LightEvent_Wait(&ra.ready);
+        }
+        u64 indexStart = svcGetSystemTick();
+        waitTicks += indexStart - waitStart;
+
+        if (items[i].len >= 0) {
+            s_stats.files++;
+            s_stats.bytes += items[i].len;
+        }
+        index(&items[i], arg);
+        indexTicks += svcGetSystemTick() - indexStart;
+    }
+
+    if (reader) {
+        threadJoin(reader, U64_MAX);
+        threadFree(reader);
+    }
+
+    s_stats.read_ms = ticks_ms(ra.ticks);
+    s_stats.index_ms = ticks_ms(indexTicks);
+    s_stats.wait_ms = ticks_ms(waitTicks);
+    s_stats.total_ms += ticks_ms(svcGetSystemTick() - start);
+}
+
+const LoadStats* loader_stats(void) {
+    return &s_stats;
+}
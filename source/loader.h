@@ -0,0 +1,48 @@
+//---------------------------------------------------------------------------------
+// loader.h
+// Cold-start loading pipeline: list the notes directory, read the files on a
+// read-ahead thread, and index each one on the calling thread as it arrives.
+//---------------------------------------------------------------------------------
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+#include "storage.h"
+
+typedef struct {
+    char name[STORAGE_NAME_LEN];
+    char* buf;       // Destination, supplied by the caller
+    size_t cap;
+    s32 len;         // Bytes read, -1 if the file could not be read
+} LoadItem;
+
+// Where the time went in the last load. Read time is the reader thread's
+// wall clock; index time is the caller's time in the index callback, and
+// wait time is how long the caller sat idle waiting for the reader.
+typedef struct {
+    u32 entries;     // Directory entries seen
+    u32 files;       // Files read
+    u32 bytes;
+    float list_ms;
+    float read_ms;
+    float index_ms;
+    float wait_ms;
+    float total_ms;
+} LoadStats;
+
+typedef bool (*LoadAccept)(const StorageEntry* entry);
+typedef void (*LoadIndex)(LoadItem* item, void* arg);
+
+// Stage 1: fill `items` with up to `max` accepted entries, in directory order
+int loader_list(LoadItem* items, int max, LoadAccept accept);
+
+// Stages 2 and 3: read every item into its buffer on a reader thread while
+// calling `index` for each one, in order, on this thread as soon as it is in
+void loader_read(LoadItem* items, int count, LoadIndex index, void* arg);
+
+const LoadStats* loader_stats(void);
+
+#endif // LOADER_H
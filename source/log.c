@@ -0,0 +1,169 @@
+//---------------------------------------------------------------------------------
+// log.c
+// Lock-free logging. The ring buffer is a bounded multi-producer queue: each
+// slot carries a turn number, a producer claims a position by compare-and-
+// swap on the head once the slot's turn says it is free, fills it and then
+// publishes it by bumping the turn. The single consumer is the flush, which
+// runs on the worker (or on the main thread at exit), copies the published
+// records out in order and appends them to the log file in one write. When
+// the file passes LOG_FILE_MAX it becomes .log-1 and a new one is started.
+//---------------------------------------------------------------------------------
+
+#include "log.h"
+
+#include <string.h>
+
+#include "prof.h"
+#include "storage.h"
+#include "worker.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define LOG_OLD         ".log-1"
+#define LOG_RING        256           // Records the ring holds; a power of two
+#define LOG_FLUSH_COUNT 64            // Waiting records that trigger a flush
+#define LOG_FLUSH_MS    2000          // Longest a record waits for one otherwise
+#define LOG_FILE_MAX    (64 * 1024)
+
+typedef struct {
+    u32 turn;           // Position it can be claimed at; that plus one once filled
+    LogRecord record;
+} Slot;
+
+static Slot s_ring[LOG_RING];
+static u32 s_head = 0;               // Next position to claim
+static u32 s_tail = 0;               // Next position to flush; moved by the flush only
+static u32 s_dropped = 0;
+static u32 s_flushing = 0;           // A flush is queued or running
+static bool s_ready = false;
+
+// Owned by the flush
+static u32 s_reported = 0;           // Drops already logged
+static u32 s_fileBytes = 0;
+static struct {
+    LogFileHeader header;            // Written when a file is started
+    LogRecord records[LOG_RING + 1]; // Room for a drop report too
+} s_out;
+
+// Owned by the main thread
+static u64 s_lastFlush = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static void rotate(void) {
+    storage_remove(LOG_OLD);
+    storage_rename(LOG_FILE, LOG_OLD);
+    s_fileBytes = 0;
+}
+
+// Copy the published records out of the ring, oldest first
+static u32 drain(void) {
+    u32 count = 0;
+    u32 dropped = __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+    if (dropped != s_reported) {
+        s_out.records[count++] = (LogRecord){ svcGetSystemTick(), s_tail, LOG_DROPPED, 0,
+                                              { dropped - s_reported, 0, 0, 0 } };
+        s_reported = dropped;
+    }
+
+    for (;;) {
+        Slot* slot = &s_ring[s_tail & (LOG_RING - 1)];
+        if (__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) != s_tail + 1) break;
+        s_out.records[count++] = slot->record;
+        __atomic_store_n(&slot->turn, s_tail + LOG_RING, __ATOMIC_RELEASE);
+        __atomic_store_n(&s_tail, s_tail + 1, __ATOMIC_RELEASE);
+    }
+    return count;
+}
+
+static void flush(void) {
+    u32 count = drain();
+    if (count == 0) return;
+
+    size_t size = count * sizeof(LogRecord);
+    if (s_fileBytes > 0 && s_fileBytes + size > LOG_FILE_MAX) rotate();
+    const void* data = s_out.records;
+    if (s_fileBytes == 0) {
+        data = &s_out.header;
+        size += sizeof(LogFileHeader);
+    }
+    if (storage_append(LOG_FILE, data, size)) s_fileBytes += size;
+}
+
+static void flush_job(void* unused) {
+    (void)unused;
+    prof_begin("log flush");
+    flush();
+    prof_end();
+    __atomic_store_n(&s_flushing, 0, __ATOMIC_RELEASE);
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void log_init(void) {
+    for (u32 i = 0; i < LOG_RING; i++) s_ring[i].turn = i;
+    s_head = s_tail = 0;
+    s_dropped = s_reported = 0;
+    s_out.header = (LogFileHeader){ LOG_MAGIC, sizeof(LogRecord), SYSCLOCK_ARM11, 0 };
+    s_lastFlush = svcGetSystemTick();
+
+    // One session per file, so the previous one survives a crash of this one
+    if (storage_exists(LOG_FILE)) rotate();
+    s_fileBytes = 0;
+    __atomic_store_n(&s_ready, true, __ATOMIC_RELEASE);
+}
+
+void log_exit(void) {
+    if (!s_ready) return;
+    flush();
+    s_ready = false;
+}
+
+void log_event(LogEvent event, s32 a, s32 b, s32 c, s32 d) {
+    if (!__atomic_load_n(&s_ready, __ATOMIC_ACQUIRE)) return;
+
+    u32 pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+    Slot* slot;
+    for (;;) {
+        slot = &s_ring[pos & (LOG_RING - 1)];
+        s32 lag = (s32)(__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) - pos);
+        if (lag == 0) {
+            // Free: claim it. On failure `pos` is reloaded with the new head.
+            if (__atomic_compare_exchange_n(&s_head, &pos, pos + 1, true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (lag < 0) {
+            // Still holds the record from a lap ago: the ring is full
+            __atomic_add_fetch(&s_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->record = (LogRecord){ svcGetSystemTick(), pos, event, 0, { a, b, c, d } };
+    __atomic_store_n(&slot->turn, pos + 1, __ATOMIC_RELEASE);
+}
+
+void log_tick(void) {
+    if (!s_ready || __atomic_load_n(&s_flushing, __ATOMIC_ACQUIRE)) return;
+
+    u32 waiting = __atomic_load_n(&s_head, __ATOMIC_RELAXED) - __atomic_load_n(&s_tail, __ATOMIC_ACQUIRE);
+    bool dropped = __atomic_load_n(&s_dropped, __ATOMIC_RELAXED) != s_reported;
+    u64 now = svcGetSystemTick();
+    if (waiting == 0 && !dropped) return;
+    if (waiting < LOG_FLUSH_COUNT && now - s_lastFlush < (u64)(LOG_FLUSH_MS * CPU_TICKS_PER_MSEC)) return;
+
+    s_lastFlush = now;
+    s_flushing = 1;
+    if (!worker_submit(flush_job, NULL)) s_flushing = 0;
+}
+
+bool log_is_file(const char* name) {
+    return strcmp(name, LOG_FILE) == 0 || strcmp(name, LOG_OLD) == 0;
+}
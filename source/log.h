@@ -0,0 +1,82 @@
+//---------------------------------------------------------------------------------
+// log.h
+// Structured binary log. An event is a fixed-size record: a timestamp, an
+// event id and four integer arguments. Any thread can log without taking a
+// lock; records wait in a ring buffer until a flush on the worker appends
+// them to the log file in the notes directory. tools/logdump.c turns the
+// file back into text using the formats below.
+//---------------------------------------------------------------------------------
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <3ds.h>
+
+#define LOG_FILE     ".log-0"    // Current log; the one before is .log-1
+#define LOG_MAGIC    0x31474F4C  // "LOG1"
+#define LOG_ARGS     4
+
+typedef enum {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+} LogLevel;
+
+// Every event: its id, level and the printf format of its arguments, which
+// are always passed as ints
+#define LOG_EVENTS(X) \
+    X(LOG_START,   LOG_INFO,  "start: storage %d, metadata store %d") \
+    X(LOG_EXIT,    LOG_INFO,  "exit after %d frames") \
+    X(LOG_DROPPED, LOG_WARN,  "%d records dropped, ring buffer full") \
+    X(LOG_LOAD,    LOG_INFO,  "loaded %d notes, %d bytes in %d ms, %d converted") \
+    X(LOG_IMPORT,  LOG_INFO,  "note %d converted from encoding %d, truncated %d") \
+    X(LOG_SAVE,    LOG_INFO,  "saved %d bytes in %d us, ok %d") \
+    X(LOG_REPLACE, LOG_INFO,  "replace ok %d: %d notes, %d replacements") \
+    X(LOG_TRACE,   LOG_INFO,  "trace dump: %d spans, ok %d") \
+    X(LOG_ALLOC,   LOG_INFO,  "allocations: %d of %d frames allocated, peak %d in a frame, %d in all") \
+    X(LOG_ALLOC_SITE, LOG_DEBUG, "allocation site %08x: %d calls, %d bytes") \
+    X(LOG_TITLE,   LOG_WARN,  "note not loaded: its title is note %d's, or the title index is full")
+
+typedef enum {
+#define LOG_ENUM(id, level, format) id,
+    LOG_EVENTS(LOG_ENUM)
+#undef LOG_ENUM
+    LOG_EVENT_COUNT
+} LogEvent;
+
+// As stored, after a LogFileHeader
+typedef struct {
+    u64 tick;           // svcGetSystemTick() when logged
+    u32 seq;            // Order within the session
+    u16 event;
+    u16 reserved;
+    s32 args[LOG_ARGS];
+} LogRecord;
+
+typedef struct {
+    u32 magic;
+    u32 recordSize;
+    u32 ticksPerSecond;
+    u32 reserved;
+} LogFileHeader;
+
+// Start logging, after storage_init(). The previous session's log becomes
+// .log-1.
+void log_init(void);
+
+// Flush what is left. Call after worker_exit(), before storage_exit().
+void log_exit(void);
+
+// Record an event from any thread. Never blocks; if the ring buffer is full
+// the record is dropped and counted.
+void log_event(LogEvent event, s32 a, s32 b, s32 c, s32 d);
+
+// Once a frame: queue a flush on the worker when enough records are waiting
+// or the oldest has waited long enough
+void log_tick(void);
+
+// True for the log files, which are not notes
+bool log_is_file(const char* name);
+
+#endif // LOG_H
@@ -8,7 +8,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "image.h"
+#include "import.h"
+#include "keyboard.h"
+#include "kv.h"
+#include "loader.h"
+#include "log.h"
+#include "predict.h"
+#include "prof.h"
+#include "rank.h"
+#include "replace.h"
+#include "search.h"
+#include "snippet.h"
+#include "spell.h"
+#include "storage.h"
+#include "telemetry.h"
+#include "titles.h"
+#include "trigram.h"
+#include "utf8.h"
+#include "view.h"
+#include "worker.h"
 
 //---------------------------------------------------------------------------------
 // Definitions and globals
@@ -19,7 +41,12 @@ typedef enum {
     MODE_MENU,       // Main menu: New Note or View Notes
     MODE_NOTE_LIST,  // List of existing notes
     MODE_VIEW_NOTE,  // Viewing a note's content
-    MODE_EDIT_NOTE   // Editing note content
+    MODE_EDIT_NOTE,  // Editing note content
+    MODE_NEW_NOTE,   // Entering the title of a new note
+    MODE_SEARCH,     // Searching note titles and contents
+    MODE_REPLACE,    // Entering find and replacement text
+    MODE_REPLACING,  // Replace running on the worker
+    MODE_HISTORY     // Charts of earlier sessions' performance
 } AppMode;
 
 // Structure for note storage
@@ -39,7 +66,9 @@ typedef struct {
     char content[NOTE_CONTENT_LEN];
 } Note;
 
-static Note notes[MAX_NOTES];
+// Aligned so every title and content buffer starts on a 32-byte boundary,
+// which lets the SD card transfer straight into them
+static Note notes[MAX_NOTES] ALIGN(32);
 static int note_count = 0;
 static int selectedMenu = 0;
 static int selectedNote = -1;
@@ -52,6 +81,46 @@ static char currentNoteTitle[TITLE_LEN];
 // Global text resources
 static C2D_TextBuf g_staticBuf;
 
+// Find and replace: the texts, the one being typed, and the notes covered
+static char g_replaceFind[REPLACE_TEXT_LEN];
+static char g_replaceWith[REPLACE_TEXT_LEN];
+static char* g_replaceField = g_replaceFind;
+static u16 g_replaceIds[MAX_NOTES];
+static int g_replaceCount = 0;
+static bool g_replaceApplied = false;
+
+// Bumped whenever a note's text changes, so cached snippets are not reused
+static u32 g_noteRevision[MAX_NOTES];
+static u32 g_revisionClock = 0;
+
+// Edit buffer with a caret inserted, for display
+static char g_caretBuf[NOTE_CONTENT_LEN + 1];
+
+// Directory listing handed to the loader at startup
+static LoadItem g_loadItems[MAX_NOTES];
+
+// Notes the import stage converted during the load, stored back after it
+static const char* g_importNames[MAX_NOTES];
+static u16 g_importIds[MAX_NOTES];
+static int g_importCount = 0;
+
+// Frames drawn this session
+static u32 g_frames = 0;
+
+// Performance history: the metric charted and the highlighted session,
+// where the one past the last stored is this session
+static TelemetryMetric g_historyMetric = TELEMETRY_COLD_START;
+static int g_historySelected = 0;
+
+// Search query being typed and the highlighted result
+static char g_searchQuery[SEARCH_MAX_QUERY];
+static int g_searchSelected = 0;
+
+// Search results in display order, or -1 until matching completes
+static u16 g_searchOrder[MAX_NOTES];
+static int g_searchOrderCount = -1;
+static bool g_indexStale = true;   // No trigram index for the notes as loaded
+
 //---------------------------------------------------------------------------------
 // Function prototypes
 //---------------------------------------------------------------------------------
@@ -60,36 +129,234 @@ static void save_note(const char* title, const char* content);
 static void initText(void);
 static void exitText(void);
 static void safe_string_copy(char* dest, const char* src, size_t dest_size);
-static void append_to_note(Note* note, const char* new_content);
+static const char* with_caret(const char* text, size_t cursor);
+static void refresh_completions(const char* text);
+static void note_doc(int id, SearchDoc* out, void* arg);
+static void rank_results(void);
+static int ordered_results(const u16** ids);
+static void draw_snippet(const Snippet* snippet, float x, float y);
+static void begin_replace(const u16* ids, int count, const char* find);
+static bool start_replace(void);
+static void apply_replace(void);
+static void note_changed(int id);
+static void log_allocations(void);
+static void draw_session(const TelemetrySession* session, bool current);
+static void draw_history(const TelemetrySession* current);
 
 //---------------------------------------------------------------------------------
 // Helper functions
 //---------------------------------------------------------------------------------
+// Truncates at a character boundary, never inside a UTF-8 sequence
 static void safe_string_copy(char* dest, const char* src, size_t dest_size) {
     if (!dest || !src || dest_size == 0) return;
-    size_t src_len = strlen(src);
-    size_t copy_len = src_len < (dest_size - 1) ? src_len : (dest_size - 1);
+    size_t copy_len = utf8_truncate(src, dest_size - 1);
     memcpy(dest, src, copy_len);
     dest[copy_len] = '\0';
 }
 
-static void append_to_note(Note* note, const char* new_content) {
-    if (!note || !new_content) return;
+// Returns `text` with a caret inserted at byte offset `cursor`
+static const char* with_caret(const char* text, size_t cursor) {
+    size_t len = strlen(text);
+    if (cursor > len) cursor = len;
+    if (len + 2 > sizeof(g_caretBuf)) len = sizeof(g_caretBuf) - 2;
+    if (cursor > len) cursor = len;
+
+    memcpy(g_caretBuf, text, cursor);
+    g_caretBuf[cursor] = '|';
+    memcpy(g_caretBuf + cursor + 1, text + cursor, len - cursor);
+    g_caretBuf[len + 1] = '\0';
+    return g_caretBuf;
+}
+
+// Offer completions for the word ending at the keyboard cursor
+static void refresh_completions(const char* text) {
+    char prefix[PREDICT_MAX_WORD];
+    char words[PREDICT_MAX_RESULTS][PREDICT_MAX_WORD];
+    const char* list[PREDICT_MAX_RESULTS];
     
-    size_t current_len = strlen(note->content);
-    size_t new_len = strlen(new_content);
+    size_t len = predict_prefix_at(text, kbd_cursor(), prefix, sizeof(prefix));
+    int count = len > 0 ? predict_complete(prefix, words, PREDICT_MAX_RESULTS) : 0;
+    for (int i = 0; i < count; i++) {
+        list[i] = words[i];
+    }
+    kbd_set_suggestions(list, count, len);
+}
+
+// Hands note text to the search module
+static bool note_may_contain(int id, const char* term, size_t len, void* arg) {
+    (void)arg;
+    return rank_may_contain(id, term, len);
+}
+
+static void note_doc(int id, SearchDoc* out, void* arg) {
+    (void)arg;
+    out->title = notes[id].title;
+    out->body = notes[id].content;
+}
+
+// Order the finished result set: the best BM25 matches first, then the rest
+// (substring matches inside longer words) in note order. Regex results are
+// not ranked.
+static void rank_results(void) {
+    const u16* ids;
+    int count = search_results(&ids);
+    int ranked = 0;
+    if (!search_is_regex(g_searchQuery)) {
+        ranked = rank_top(g_searchQuery, ids, count, g_searchOrder, NULL,
+                          MAX_NOTES < RANK_TOP_K ? MAX_NOTES : RANK_TOP_K);
+    }
+    int total = ranked;
+    for (int i = 0; i < count && total < MAX_NOTES; i++) {
+        bool seen = false;
+        for (int j = 0; j < ranked && !seen; j++) seen = g_searchOrder[j] == ids[i];
+        if (!seen) g_searchOrder[total++] = ids[i];
+    }
+    g_searchOrderCount = total;
+}
+
+// Ranked results once matching is complete, raw matches while it streams
+static int ordered_results(const u16** ids) {
+    if (g_searchOrderCount < 0) return search_results(ids);
+    *ids = g_searchOrder;
+    return g_searchOrderCount;
+}
+
+// Draw a result snippet with the matched terms picked out
+static void draw_snippet(const Snippet* snippet, float x, float y) {
+    char run[sizeof(snippet->text)];
+    for (int i = 0; i < snippet->count; i++) {
+        const SnippetSpan* span = &snippet->spans[i];
+        C2D_Text text;
+        float w = 0.0f;
+        
+        memcpy(run, snippet->text + span->start, span->len);
+        run[span->len] = '\0';
+        C2D_TextParse(&text, g_staticBuf, run);
+        C2D_TextOptimize(&text);
+        C2D_TextGetDimensions(&text, 0.5f, 0.5f, &w, NULL);
+        C2D_DrawText(&text, C2D_WithColor, x, y, 0.5f, 0.5f, 0.5f,
+                     span->match ? COLOR_HIGHLIGHT : COLOR_TITLE);
+        x += w;
+    }
+}
+
+//---------------------------------------------------------------------------------
+// Performance history
+//---------------------------------------------------------------------------------
+
+// Details of the highlighted session on the top screen
+static void draw_session(const TelemetrySession* session, bool current) {
+    char lines[5][80];
+    time_t started = session->started;
+    struct tm* date = gmtime(&started);
+    C2D_Text text;
     
-    // Check if we have room for new content + newline + null terminator
-    if (current_len + new_len + 2 >= NOTE_CONTENT_LEN) return;
+    if (current) {
+        snprintf(lines[0], sizeof(lines[0]), "This session, %lu s so far", (unsigned long)session->seconds);
+    } else {
+        snprintf(lines[0], sizeof(lines[0]), "%04d-%02d-%02d %02d:%02d, %lu s",
+                 date ? date->tm_year + 1900 : 0, date ? date->tm_mon + 1 : 0, date ? date->tm_mday : 0,
+                 date ? date->tm_hour : 0, date ? date->tm_min : 0, (unsigned long)session->seconds);
+    }
+    snprintf(lines[1], sizeof(lines[1]), "start %.0f ms: init %u, storage %u, load %u, first frame %u",
+             telemetry_value(session, TELEMETRY_COLD_START), session->bootMs[TELEMETRY_BOOT_INIT],
+             session->bootMs[TELEMETRY_BOOT_STORAGE], session->bootMs[TELEMETRY_BOOT_LOAD],
+             session->bootMs[TELEMETRY_BOOT_FIRST_FRAME]);
+    snprintf(lines[2], sizeof(lines[2]), "%lu frames: p50 %.1f ms, p99 %.1f ms, max %.1f ms",
+             (unsigned long)session->frames, session->frameP50 / 1000.0f, session->frameP99 / 1000.0f,
+             session->frameMax / 1000.0f);
+    snprintf(lines[3], sizeof(lines[3]), "%lu saves: avg %.1f ms, max %.1f ms",
+             (unsigned long)session->saves, session->saveAvg / 1000.0f, session->saveMax / 1000.0f);
+    snprintf(lines[4], sizeof(lines[4]), "%lu notes, %.1f KB, read in %.2f ms each",
+             (unsigned long)session->notes, session->bytes / 1024.0f, session->readAvg / 1000.0f);
+    for (int i = 0; i < 5; i++) {
+        C2D_TextParse(&text, g_staticBuf, lines[i]);
+        C2D_TextOptimize(&text);
+        C2D_DrawText(&text, C2D_WithColor, 20.0f, 80.0f + i * 20.0f, 0.5f, 0.55f, 0.55f,
+                     i == 0 ? COLOR_HIGHLIGHT : COLOR_TEXT);
+    }
+}
+
+// A bar per session on the bottom screen, scaled to the largest
+static void draw_history(const TelemetrySession* current) {
+    const TelemetrySession* sessions;
+    int count = telemetry_history(&sessions);
+    const float left = 20.0f, top = 40.0f, width = 280.0f, height = 150.0f;
+    float slot = width / (count + 1);
+    float peak = telemetry_value(current, g_historyMetric);
+    char label[48];
+    C2D_Text text;
+    
+    for (int i = 0; i < count; i++) {
+        float value = telemetry_value(&sessions[i], g_historyMetric);
+        if (value > peak) peak = value;
+    }
+    
+    C2D_TextParse(&text, g_staticBuf, telemetry_label(g_historyMetric));
+    C2D_TextOptimize(&text);
+    C2D_DrawText(&text, C2D_WithColor, 8.0f, 8.0f, 0.5f, 0.5f, 0.5f, COLOR_TITLE);
+    snprintf(label, sizeof(label), "%.1f", peak);
+    C2D_TextParse(&text, g_staticBuf, label);
+    C2D_TextOptimize(&text);
+    C2D_DrawText(&text, C2D_WithColor, left, top - 14.0f, 0.5f, 0.45f, 0.45f, COLOR_TITLE);
+    C2D_DrawRectSolid(left, top + height, 0.5f, width, 1.0f, COLOR_TITLE);
+    
+    for (int i = 0; i <= count; i++) {
+        const TelemetrySession* session = i < count ? &sessions[i] : current;
+        float value = telemetry_value(session, g_historyMetric);
+        float h = peak > 0.0f ? height * value / peak : 0.0f;
+        float gap = slot > 4.0f ? 1.0f : 0.0f;
+        C2D_DrawRectSolid(left + i * slot + gap, top + height - h, 0.5f, slot - 2 * gap, h,
+                          i == g_historySelected ? COLOR_HIGHLIGHT : COLOR_TITLE);
+    }
     
-    // If this isn't the first line, add a newline
-    if (current_len > 0) {
-        note->content[current_len] = '\n';
-        current_len++;
+    C2D_TextParse(&text, g_staticBuf, "Left/Right: Session  Up/Down: Metric  B: Back");
+    C2D_TextOptimize(&text);
+    C2D_DrawText(&text, C2D_WithColor | C2D_AlignCenter, 160.0f, 220.0f, 0.5f, 0.6f, 0.6f, COLOR_TEXT);
+}
+
+//---------------------------------------------------------------------------------
+// Find and replace
+//---------------------------------------------------------------------------------
+
+// Ask for the find and replacement text for the notes in `ids`
+static void begin_replace(const u16* ids, int count, const char* find) {
+    g_replaceCount = count < MAX_NOTES ? count : MAX_NOTES;
+    memcpy(g_replaceIds, ids, g_replaceCount * sizeof(u16));
+    safe_string_copy(g_replaceFind, find, sizeof(g_replaceFind));
+    g_replaceWith[0] = '\0';
+    g_replaceField = g_replaceFind;
+    kbd_attach(g_replaceField, sizeof(g_replaceFind));
+    mode = MODE_REPLACE;
+}
+
+static bool start_replace(void) {
+    const char* names[MAX_NOTES];
+    for (int i = 0; i < g_replaceCount; i++) {
+        names[i] = notes[g_replaceIds[i]].title;
     }
+    g_replaceApplied = false;
+    return replace_start(names, g_replaceCount, g_replaceFind, g_replaceWith);
+}
+
+// Reload the notes a finished replace changed; the rest are untouched
+static void apply_replace(void) {
+    for (int i = 0; i < g_replaceCount; i++) {
+        if (!replace_changed(i)) continue;
+        
+        int id = g_replaceIds[i];
+        Note* note = &notes[id];
+        predict_remove_text(note->content);
+        s32 len = storage_read(note->title, note->content, NOTE_CONTENT_LEN - 1);
+        note->content[len > 0 ? len : 0] = '\0';
+        predict_add_text(note->content);
+        note_changed(id);
+    }
+    g_replaceApplied = true;
     
-    // Append the new content
-    safe_string_copy(note->content + current_len, new_content, NOTE_CONTENT_LEN - current_len);
+    ReplaceProgress progress;
+    replace_progress(&progress);
+    log_event(LOG_REPLACE, progress.state == REPLACE_DONE, progress.changed, progress.replacements, 0);
 }
 
 //---------------------------------------------------------------------------------
@@ -106,58 +373,103 @@ static void exitText(void) {
 //---------------------------------------------------------------------------------
 // File operations
 //---------------------------------------------------------------------------------
-static void ensure_notes_directory(void) {
-    DIR* dir = opendir(NOTES_DIR);
-    if (!dir) {
-        mkdir(NOTES_DIR, 0777);
-    } else {
-        closedir(dir);
+static bool is_note_entry(const StorageEntry* entry) {
+    // Regular files are notes, except the images they embed, the search
+    // index, the metadata store, the log, the trace and files left by an
+    // interrupted replace
+    return !entry->isDir && !image_is_file(entry->name) && !rank_is_file(entry->name) &&
+           !replace_is_temp(entry->name) && !kv_is_file(entry->name) && !log_is_file(entry->name) &&
+           !prof_is_file(entry->name);
+}
+
+// Runs for each note as soon as the reader has it, while the next one loads
+static void index_note(LoadItem* item, void* unused) {
+    (void)unused;
+    if (item->len < 0) return;
+    prof_begin("index note");
+    
+    // Copy filename (without extension) as title. A note whose title is
+    // taken would be saved over the other note's file, so it is left out
+    // like a file that could not be read.
+    Note* note = &notes[note_count];
+    safe_string_copy(note->title, item->name, TITLE_LEN);
+    if (!titles_insert(note->title, note_count)) {
+        log_event(LOG_TITLE, titles_find(note->title), 0, 0, 0);
+        prof_end();
+        return;
+    }
+    
+    // Close the gap left by any file that could not be read
+    if (note->content != item->buf) memmove(note->content, item->buf, item->len);
+    
+    // Bring text from other machines to UTF-8 with LF line endings. Only a
+    // note read in full is stored back, so nothing past the buffer is lost.
+    ImportResult import;
+    import_text(note->content, item->len, NOTE_CONTENT_LEN, &import);
+    if (import.changed && !import.truncated && (size_t)item->len < item->cap) {
+        g_importNames[g_importCount] = item->name;
+        g_importIds[g_importCount++] = note_count;
     }
+    if (import.changed) log_event(LOG_IMPORT, note_count, import.encoding, import.truncated, 0);
+    
+    predict_add_text(note->content);
+    g_noteRevision[note_count] = ++g_revisionClock;
+    note_count++;
+    prof_end();
 }
 
 static void load_notes(void) {
-    ensure_notes_directory();
+    prof_begin("load notes");
     note_count = 0;
+    g_importCount = 0;
+    titles_clear();
     
-    DIR* dir = opendir(NOTES_DIR);
-    if (!dir) return;
+    int count = loader_list(g_loadItems, MAX_NOTES, is_note_entry);
+    for (int i = 0; i < count; i++) {
+        g_loadItems[i].buf = notes[i].content;
+        g_loadItems[i].cap = NOTE_CONTENT_LEN - 1;
+    }
+    loader_read(g_loadItems, count, index_note, NULL);
     
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL && note_count < MAX_NOTES) {
-        if (entry->d_type == DT_REG) {  // Regular file
-            char filepath[256];
-            snprintf(filepath, sizeof(filepath), "%s%s", NOTES_DIR, entry->d_name);
-            
-            FILE* file = fopen(filepath, "rb");
-            if (file) {
-                // Copy filename (without extension) as title
-                safe_string_copy(notes[note_count].title, entry->d_name, TITLE_LEN);
-                
-                // Read content
-                size_t len = fread(notes[note_count].content, 1, NOTE_CONTENT_LEN - 1, file);
-                notes[note_count].content[len] = '\0';
-                
-                note_count++;
-                fclose(file);
-            }
-        }
+    // Converted once: from now on these notes take the clean UTF-8 fast path
+    for (int i = 0; i < g_importCount; i++) {
+        const char* text = notes[g_importIds[i]].content;
+        storage_write(g_importNames[i], text, strlen(text));
     }
-    closedir(dir);
+    prof_begin("sync index");
+    rank_sync(note_count, note_doc, NULL);
+    prof_end();
+    g_indexStale = true;
+    
+    const LoadStats* stats = loader_stats();
+    log_event(LOG_LOAD, note_count, stats->bytes, (s32)stats->total_ms, g_importCount);
+    prof_end();
 }
 
 static void save_note(const char* title, const char* content) {
-    ensure_notes_directory();
-    
-    char filepath[256];
-    snprintf(filepath, sizeof(filepath), "%s%s", NOTES_DIR, title);
-    
-    FILE* file = fopen(filepath, "wb");
-    if (file) {
-        size_t len = strlen(content);
-        if (len > 0) {
-            fwrite(content, 1, len, file);
-        }
-        fclose(file);
+    u64 start = svcGetSystemTick();
+    size_t len = strlen(content);
+    bool ok = storage_write(title, content, len);
+    telemetry_save(svcGetSystemTick() - start);
+    log_event(LOG_SAVE, len, (s32)((svcGetSystemTick() - start) * 1000 / CPU_TICKS_PER_MSEC), ok, 0);
+}
+
+// The text of note `id` changed: drop its cached snippets and reindex it
+static void note_changed(int id) {
+    g_noteRevision[id] = ++g_revisionClock;
+    rank_update(id);
+    if (!g_indexStale) g_indexStale = !trigram_update(id);
+}
+
+// Session allocation summary, and the top call sites in debug builds
+static void log_allocations(void) {
+    AllocStats allocs;
+    AllocSite sites[8];
+    alloc_stats(&allocs);
+    log_event(LOG_ALLOC, allocs.allocatingFrames, allocs.frames, allocs.peakAllocs, allocs.totalAllocs);
+    int siteCount = alloc_sites(sites, 8);
+    for (int i = 0; i < siteCount; i++) {
+        log_event(LOG_ALLOC_SITE, sites[i].address, sites[i].count, sites[i].bytes, 0);
     }
 }
 
@@ -165,6 +477,8 @@ static void save_note(const char* title, const char* content) {
 // Main function
 //---------------------------------------------------------------------------------
 int main(void) {
+    telemetry_start();
+    
     // Initialize services
     gfxInitDefault();
     romfsInit();
@@ -176,9 +490,24 @@ int main(void) {
     
     // Initialize text resources
     initText();
-    if (!g_staticBuf) {
+    if (!g_staticBuf || !kbd_init() || !predict_init() || !view_init() || !worker_init() ||
+        !search_init()) {
         goto cleanup;
     }
+    telemetry_boot(TELEMETRY_BOOT_INIT);
+    
+    // Without an SD card notes simply are not loaded or saved
+    bool stored = storage_init(NOTES_DIR);
+    bool kvOk = kv_open();
+    telemetry_open();
+    log_init();
+    log_event(LOG_START, stored, kvOk, 0, 0);
+    replace_recover();
+    search_set_filter(note_may_contain, NULL);
+    
+    // Spell checking is optional; it stays off if the dictionary is missing
+    spell_init(SPELL_DICT_PATH);
+    telemetry_boot(TELEMETRY_BOOT_STORAGE);
     
     // Create render targets for both screens
     C3D_RenderTarget* top = C2D_CreateScreenTarget(GFX_TOP, GFX_LEFT);
@@ -189,57 +518,78 @@ int main(void) {
     
     // Load existing notes
     load_notes();
+    image_init();
+    const LoadStats* loaded = loader_stats();
+    telemetry_library(note_count, loaded->bytes, loaded->read_ms);
+    telemetry_boot(TELEMETRY_BOOT_LOAD);
     
     // Main loop
     while (aptMainLoop()) {
+        prof_begin("frame");
+        prof_begin("input");
         hidScanInput();
         u32 kDown = hidKeysDown();
         
-        if (mode == MODE_MENU && (kDown & KEY_START))
+        // Close "input" and "frame" so the profile never holds open spans
+        if (mode == MODE_MENU && (kDown & KEY_START)) {
+            prof_end();
+            prof_end();
             break;
+        }
+        
+        // SELECT in the menu writes the recent profile as a Chrome trace
+        if (mode == MODE_MENU && (kDown & KEY_SELECT))
+            prof_dump();
             
         //-------------- Menu mode input --------------
         if (mode == MODE_MENU) {
             if (kDown & KEY_UP) {
-                selectedMenu = (selectedMenu - 1 + 2) % 2;
+                selectedMenu = (selectedMenu - 1 + 3) % 3;
             }
             if (kDown & KEY_DOWN) {
-                selectedMenu = (selectedMenu + 1) % 2;
+                selectedMenu = (selectedMenu + 1) % 3;
             }
             if (kDown & KEY_A) {
                 if (selectedMenu == 0) {
-                    // New Note
+                    // New Note: enter the title on the in-app keyboard
                     memset(currentNoteContent, 0, sizeof(currentNoteContent));
                     memset(currentNoteTitle, 0, sizeof(currentNoteTitle));
-                    
-                    // Get note title first
-                    SwkbdState swkbd;
-                    swkbdInit(&swkbd, SWKBD_TYPE_NORMAL, 2, TITLE_LEN-1);
-                    swkbdSetHintText(&swkbd, "Enter note title");
-                    swkbdSetButton(&swkbd, SWKBD_BUTTON_LEFT, "Cancel", false);
-                    swkbdSetButton(&swkbd, SWKBD_BUTTON_RIGHT, "OK", true);
-                    SwkbdButton button = swkbdInputText(&swkbd, currentNoteTitle, sizeof(currentNoteTitle));
-                    
-                    if (button == SWKBD_BUTTON_RIGHT && strlen(currentNoteTitle) > 0 && note_count < MAX_NOTES) {
-                        // Create new note
-                        safe_string_copy(notes[note_count].title, currentNoteTitle, TITLE_LEN);
-                        notes[note_count].content[0] = '\0';  // Empty content
-                        save_note(currentNoteTitle, "");  // Save empty note
-                        
-                        // Switch to view mode for the new note
-                        selectedNote = note_count;
-                        note_count++;
-                        mode = MODE_VIEW_NOTE;
-                    }
-                } else {
+                    kbd_attach(currentNoteTitle, sizeof(currentNoteTitle));
+                    mode = MODE_NEW_NOTE;
+                } else if (selectedMenu == 1) {
                     // View Notes
                     if (note_count > 0) {
                         mode = MODE_NOTE_LIST;
                         selectedNote = 0;
                     }
+                } else {
+                    // History, starting from this session
+                    const TelemetrySession* sessions;
+                    g_historySelected = telemetry_history(&sessions);
+                    mode = MODE_HISTORY;
                 }
             }
         }
+        //-------------- History mode input --------------
+        else if (mode == MODE_HISTORY) {
+            const TelemetrySession* sessions;
+            int count = telemetry_history(&sessions) + 1;
+            if (kDown & KEY_B) {
+                mode = MODE_MENU;
+            }
+            if (kDown & KEY_LEFT) {
+                g_historySelected = (g_historySelected - 1 + count) % count;
+            }
+            if (kDown & KEY_RIGHT) {
+                g_historySelected = (g_historySelected + 1) % count;
+            }
+            if (kDown & KEY_UP) {
+                g_historyMetric = (g_historyMetric - 1 + TELEMETRY_METRIC_COUNT) % TELEMETRY_METRIC_COUNT;
+            }
+            if (kDown & KEY_DOWN) {
+                g_historyMetric = (g_historyMetric + 1) % TELEMETRY_METRIC_COUNT;
+            }
+        }
         //-------------- Note List mode input --------------
         else if (mode == MODE_NOTE_LIST) {
             if (kDown & KEY_B) {
@@ -252,8 +602,119 @@ int main(void) {
                 selectedNote = (selectedNote + 1) % note_count;
             }
             if (kDown & KEY_A && selectedNote >= 0) {
+                view_set_text(notes[selectedNote].content);
                 mode = MODE_VIEW_NOTE;
             }
+            if (kDown & KEY_X) {
+                // Notes may have been added since the last search. The trigram
+                // index follows edits itself, so it is only built once.
+                search_reset(note_count, note_doc, NULL);
+                if (g_indexStale) {
+                    g_indexStale = !trigram_build(note_count, note_doc, NULL);
+                }
+                g_searchQuery[0] = '\0';
+                g_searchSelected = 0;
+                g_searchOrderCount = -1;
+                search_set_query(g_searchQuery);
+                kbd_attach(g_searchQuery, sizeof(g_searchQuery));
+                mode = MODE_SEARCH;
+            }
+            if ((kDown & KEY_R) && note_count > 0) {
+                u16 all[MAX_NOTES];
+                for (int i = 0; i < note_count; i++) all[i] = i;
+                begin_replace(all, note_count, "");
+            }
+        }
+        //-------------- Search mode input --------------
+        else if (mode == MODE_SEARCH) {
+            KbdAction action = kbd_update(kDown, hidKeysHeld());
+            const u16* ids;
+            int count = ordered_results(&ids);
+            
+            if (action == KBD_EDITED) {
+                // Each keystroke narrows or widens the query; results
+                // stream in over the next frames
+                search_set_query(g_searchQuery);
+                g_searchSelected = 0;
+                g_searchOrderCount = -1;
+            }
+            else if (action == KBD_CANCEL) {
+                mode = MODE_NOTE_LIST;
+            }
+            else if (action == KBD_DONE && count > 0) {
+                selectedNote = ids[g_searchSelected < count ? g_searchSelected : 0];
+                view_set_text(notes[selectedNote].content);
+                mode = MODE_VIEW_NOTE;
+            }
+            
+            if (count > 0 && (kDown & KEY_UP)) {
+                g_searchSelected = (g_searchSelected - 1 + count) % count;
+            }
+            if (count > 0 && (kDown & KEY_DOWN)) {
+                g_searchSelected = (g_searchSelected + 1) % count;
+            }
+            if ((kDown & KEY_R) && count > 0 && g_searchOrderCount >= 0) {
+                // Replace within the results, starting from the query text
+                begin_replace(ids, count, search_is_regex(g_searchQuery) ? "" : g_searchQuery);
+            }
+        }
+        //-------------- Replace mode input --------------
+        else if (mode == MODE_REPLACE) {
+            KbdAction action = kbd_update(kDown, hidKeysHeld());
+            if (action == KBD_CANCEL) {
+                mode = MODE_NOTE_LIST;
+            }
+            else if (action == KBD_DONE && g_replaceField == g_replaceFind && g_replaceFind[0]) {
+                g_replaceField = g_replaceWith;
+                kbd_attach(g_replaceField, sizeof(g_replaceWith));
+            }
+            else if (action == KBD_DONE && g_replaceField == g_replaceWith) {
+                mode = start_replace() ? MODE_REPLACING : MODE_NOTE_LIST;
+            }
+        }
+        //-------------- Replacing mode input --------------
+        else if (mode == MODE_REPLACING) {
+            ReplaceProgress progress;
+            replace_progress(&progress);
+            if (progress.state != REPLACE_RUNNING && !g_replaceApplied) {
+                apply_replace();
+            }
+            else if (progress.state != REPLACE_RUNNING && (kDown & (KEY_A | KEY_B))) {
+                replace_finish();
+                mode = MODE_NOTE_LIST;
+            }
+        }
+        //-------------- New Note mode input --------------
+        else if (mode == MODE_NEW_NOTE) {
+            KbdAction action = kbd_update(kDown, hidKeysHeld());
+            if (action == KBD_EDITED) {
+                refresh_completions(currentNoteTitle);
+            }
+            else if (action == KBD_CANCEL) {
+                mode = MODE_MENU;
+            }
+            else if (action == KBD_DONE && strlen(currentNoteTitle) > 0) {
+                // An existing title jumps to that note instead of overwriting it
+                int existing = titles_find(currentNoteTitle);
+                if (existing >= 0) {
+                    selectedNote = existing;
+                    view_set_text(notes[selectedNote].content);
+                    mode = MODE_VIEW_NOTE;
+                }
+                else if (note_count < MAX_NOTES && titles_insert(currentNoteTitle, note_count)) {
+                    // Create new note
+                    safe_string_copy(notes[note_count].title, currentNoteTitle, TITLE_LEN);
+                    notes[note_count].content[0] = '\0';  // Empty content
+                    save_note(currentNoteTitle, "");  // Save empty note
+                    
+                    // Switch to view mode for the new note
+                    selectedNote = note_count;
+                    note_changed(note_count);
+                    note_count++;
+                    view_set_text(notes[selectedNote].content);
+                    mode = MODE_VIEW_NOTE;
+                }
+            }
         }
         //-------------- View Note mode input --------------
         else if (mode == MODE_VIEW_NOTE) {
@@ -263,23 +724,65 @@ int main(void) {
                     mode = MODE_MENU;
                 }
             }
+            if (kDown & KEY_UP) {
+                view_scroll(-1);
+            }
+            if (kDown & KEY_DOWN) {
+                view_scroll(1);
+            }
+            if (kDown & KEY_LEFT) {
+                view_hscroll(-40.0f);
+            }
+            if (kDown & KEY_RIGHT) {
+                view_hscroll(40.0f);
+            }
             if (kDown & KEY_A) {
-                // Add line to note
-                SwkbdState swkbd;
-                swkbdInit(&swkbd, SWKBD_TYPE_NORMAL, 3, NOTE_CONTENT_LEN-1);
-                swkbdSetHintText(&swkbd, "Add a line to note");
-                swkbdSetButton(&swkbd, SWKBD_BUTTON_LEFT, "Cancel", false);
-                swkbdSetButton(&swkbd, SWKBD_BUTTON_RIGHT, "Add", true);
-                SwkbdButton button = swkbdInputText(&swkbd, currentNoteContent, sizeof(currentNoteContent));
-                
-                if (button == SWKBD_BUTTON_RIGHT) {
-                    append_to_note(&notes[selectedNote], currentNoteContent);
-                    save_note(notes[selectedNote].title, notes[selectedNote].content);
-                }
+                // Edit the whole note in place on the in-app keyboard
+                safe_string_copy(currentNoteContent, notes[selectedNote].content, NOTE_CONTENT_LEN);
+                kbd_attach(currentNoteContent, sizeof(currentNoteContent));
+                refresh_completions(currentNoteContent);
+                mode = MODE_EDIT_NOTE;
             }
         }
+        //-------------- Edit Note mode input --------------
+        else if (mode == MODE_EDIT_NOTE) {
+            KbdAction action = kbd_update(kDown, hidKeysHeld());
+            if (action == KBD_EDITED) {
+                refresh_completions(currentNoteContent);
+            }
+            else if (action == KBD_DONE) {
+                // Keep the completion model in step with the saved text
+                predict_remove_text(notes[selectedNote].content);
+                predict_add_text(currentNoteContent);
+                safe_string_copy(notes[selectedNote].content, currentNoteContent, NOTE_CONTENT_LEN);
+                save_note(notes[selectedNote].title, notes[selectedNote].content);
+                note_changed(selectedNote);
+                view_set_text(notes[selectedNote].content);
+                mode = MODE_VIEW_NOTE;
+            }
+            else if (action == KBD_CANCEL) {
+                mode = MODE_VIEW_NOTE;
+            }
+        }
+        
+        prof_end();
+        
+        // Spend a slice of the frame on pending search candidates
+        prof_begin("search");
+        bool searchDone = mode != MODE_SEARCH || search_step(4000);
+        if (mode == MODE_SEARCH && searchDone && g_searchOrderCount < 0) {
+            rank_results();
+        }
         
+        prof_end();
+        
+        image_poll();
+        rank_poll();
+        prof_begin("draw");
         C3D_FrameBegin(C3D_FRAME_SYNCDRAW);
+        if (mode == MODE_VIEW_NOTE) {
+            view_prepare(20.0f, 80.0f, 240.0f, COLOR_BG);
+        }
         
         // Draw top screen
         C2D_TargetClear(top, COLOR_BG);
@@ -294,16 +797,131 @@ int main(void) {
         C2D_DrawText(&text, C2D_WithColor | C2D_AlignCenter, 200.0f, 20.0f, 0.5f, 1.0f, 1.0f, COLOR_TITLE);
         
         // Show note title and content if viewing a note
-        if (mode == MODE_VIEW_NOTE && selectedNote >= 0) {
+        if ((mode == MODE_VIEW_NOTE || mode == MODE_EDIT_NOTE) && selectedNote >= 0) {
             // Draw note title
             C2D_TextParse(&text, g_staticBuf, notes[selectedNote].title);
             C2D_TextOptimize(&text);
             C2D_DrawText(&text, C2D_WithColor, 20.0f, 50.0f, 0.5f, 0.85f, 0.85f, COLOR_HIGHLIGHT);
             
-            // Draw note content
-            C2D_TextParse(&text, g_staticBuf, notes[selectedNote].content);
+            // Draw note content, or the edit buffer with its caret
+            if (mode == MODE_EDIT_NOTE) {
+                C2D_TextParse(&text, g_staticBuf, with_caret(currentNoteContent, kbd_cursor()));
+                C2D_TextOptimize(&text);
+                C2D_DrawText(&text, C2D_WithColor, 20.0f, 80.0f, 0.5f, 0.75f, 0.75f, COLOR_TEXT);
+            } else {
+                view_draw();
+            }
+        }
+        else if (mode == MODE_NEW_NOTE) {
+            C2D_TextParse(&text, g_staticBuf, "New note title:");
             C2D_TextOptimize(&text);
-            C2D_DrawText(&text, C2D_WithColor, 20.0f, 80.0f, 0.5f, 0.75f, 0.75f, COLOR_TEXT);
+            C2D_DrawText(&text, C2D_WithColor, 20.0f, 50.0f, 0.5f, 0.75f, 0.75f, COLOR_TEXT);
+            
+            C2D_TextParse(&text, g_staticBuf, with_caret(currentNoteTitle, kbd_cursor()));
+            C2D_TextOptimize(&text);
+            C2D_DrawText(&text, C2D_WithColor, 20.0f, 80.0f, 0.5f, 0.85f, 0.85f, COLOR_HIGHLIGHT);
+            
+            if (titles_find(currentNoteTitle) >= 0) {
+                C2D_TextParse(&text, g_staticBuf, "Note exists: Done opens it");
+                C2D_TextOptimize(&text);
+                C2D_DrawText(&text, C2D_WithColor, 20.0f, 110.0f, 0.5f, 0.6f, 0.6f, COLOR_TITLE);
+            }
+        }
+        else if (mode == MODE_SEARCH) {
+            C2D_TextParse(&text, g_staticBuf, with_caret(g_searchQuery, kbd_cursor()));
+            C2D_TextOptimize(&text);
+            C2D_DrawText(&text, C2D_WithColor, 20.0f, 50.0f, 0.5f, 0.85f, 0.85f, COLOR_HIGHLIGHT);
+            
+            const u16* ids;
+            int count = ordered_results(&ids);
+            char status[48];
+            if (search_error()) {
+                snprintf(status, sizeof(status), "Pattern: %s", search_error());
+            } else {
+                snprintf(status, sizeof(status), "%d result%s%s", count, count == 1 ? "" : "s",
+                         searchDone ? "" : " (searching...)");
+            }
+            C2D_TextParse(&text, g_staticBuf, status);
+            C2D_TextOptimize(&text);
+            C2D_DrawText(&text, C2D_WithColor, 20.0f, 75.0f, 0.5f, 0.6f, 0.6f, COLOR_TITLE);
+            
+            // Keep the highlighted result inside the visible window. Snippets
+            // are only built for the results on screen.
+            const int visible = 4;
+            int first = g_searchSelected - visible + 1;
+            if (first < 0) first = 0;
+            for (int i = first; i < count && i < first + visible; i++) {
+                float y = 95.0f + (i - first) * 34.0f;
+                C2D_TextParse(&text, g_staticBuf, notes[ids[i]].title);
+                C2D_TextOptimize(&text);
+                u32 color = (g_searchSelected == i) ? COLOR_HIGHLIGHT : COLOR_TEXT;
+                C2D_DrawText(&text, C2D_WithColor, 20.0f, y, 0.5f, 0.7f, 0.7f, color);
+                
+                const Snippet* snippet = snippet_get(ids[i], g_noteRevision[ids[i]], g_searchQuery,
+                                                     notes[ids[i]].content);
+                draw_snippet(snippet, 20.0f, y + 16.0f);
+            }
+        }
+        else if (mode == MODE_REPLACE) {
+            const char* labels[2] = { "Find:", "Replace with:" };
+            char* fields[2] = { g_replaceFind, g_replaceWith };
+            for (int i = 0; i < 2; i++) {
+                float y = 50.0f + i * 50.0f;
+                C2D_TextParse(&text, g_staticBuf, labels[i]);
+                C2D_TextOptimize(&text);
+                C2D_DrawText(&text, C2D_WithColor, 20.0f, y, 0.5f, 0.6f, 0.6f, COLOR_TITLE);
+                
+                bool active = fields[i] == g_replaceField;
+                C2D_TextParse(&text, g_staticBuf, active ? with_caret(fields[i], kbd_cursor()) : fields[i]);
+                C2D_TextOptimize(&text);
+                C2D_DrawText(&text, C2D_WithColor, 20.0f, y + 18.0f, 0.5f, 0.85f, 0.85f,
+                             active ? COLOR_HIGHLIGHT : COLOR_TEXT);
+            }
+            
+            char scope[32];
+            snprintf(scope, sizeof(scope), "In %d note%s", g_replaceCount, g_replaceCount == 1 ? "" : "s");
+            C2D_TextParse(&text, g_staticBuf, scope);
+            C2D_TextOptimize(&text);
+            C2D_DrawText(&text, C2D_WithColor, 20.0f, 150.0f, 0.5f, 0.6f, 0.6f, COLOR_TITLE);
+        }
+        else if (mode == MODE_REPLACING) {
+            ReplaceProgress progress;
+            replace_progress(&progress);
+            
+            // Progress bar over the notes scanned so far
+            float done = progress.total > 0 ? (float)progress.scanned / progress.total : 0.0f;
+            C2D_DrawRectSolid(20.0f, 60.0f, 0.5f, 360.0f, 12.0f, COLOR_TITLE);
+            C2D_DrawRectSolid(20.0f, 60.0f, 0.5f, 360.0f * done, 12.0f, COLOR_HIGHLIGHT);
+            
+            char lines[3][48];
+            snprintf(lines[0], sizeof(lines[0]), "%d of %d notes scanned", progress.scanned, progress.total);
+            snprintf(lines[1], sizeof(lines[1]), "%lu replacement%s in %d note%s",
+                     (unsigned long)progress.replacements, progress.replacements == 1 ? "" : "s",
+                     progress.changed, progress.changed == 1 ? "" : "s");
+            snprintf(lines[2], sizeof(lines[2]), "%s",
+                     progress.state == REPLACE_FAILED ? "Failed: no notes were changed" :
+                     progress.state == REPLACE_DONE ? "Done" : "Replacing...");
+            for (int i = 0; i < 3; i++) {
+                C2D_TextParse(&text, g_staticBuf, lines[i]);
+                C2D_TextOptimize(&text);
+                C2D_DrawText(&text, C2D_WithColor, 20.0f, 85.0f + i * 20.0f, 0.5f, 0.6f, 0.6f,
+                             i == 2 ? COLOR_HIGHLIGHT : COLOR_TEXT);
+            }
+        }
+        else if (mode == MODE_HISTORY) {
+            const TelemetrySession* sessions;
+            TelemetrySession current;
+            int count = telemetry_history(&sessions);
+            telemetry_current(&current);
+            
+            char heading[48];
+            snprintf(heading, sizeof(heading), "Performance history: %d session%s stored", count,
+                     count == 1 ? "" : "s");
+            C2D_TextParse(&text, g_staticBuf, heading);
+            C2D_TextOptimize(&text);
+            C2D_DrawText(&text, C2D_WithColor, 20.0f, 50.0f, 0.5f, 0.75f, 0.75f, COLOR_TEXT);
+            draw_session(g_historySelected < count ? &sessions[g_historySelected] : &current,
+                         g_historySelected >= count);
         }
         
         // Draw bottom screen
@@ -314,14 +932,54 @@ int main(void) {
         
         if (mode == MODE_MENU) {
             // Draw main menu options
-            const char* options[] = {"New Note", "View Notes"};
-            for (int i = 0; i < 2; i++) {
+            const char* options[] = {"New Note", "View Notes", "History"};
+            for (int i = 0; i < 3; i++) {
                 C2D_TextParse(&text, g_staticBuf, options[i]);
                 C2D_TextOptimize(&text);
                 float y = 100.0f + i * 40.0f;  // Increased spacing between options
                 u32 color = (selectedMenu == i) ? COLOR_HIGHLIGHT : COLOR_TEXT;
                 C2D_DrawText(&text, C2D_WithColor | C2D_AlignCenter, 160.0f, y, 0.5f, 1.0f, 1.0f, color);
             }
+            
+            // Startup load throughput: SD card bound if the index stage
+            // waited, CPU bound if the reader ran ahead
+            const LoadStats* load = loader_stats();
+            float kb = load->bytes / 1024.0f;
+            char status[5][80];
+            snprintf(status[0], sizeof(status[0]), "loaded %lu notes, %.1f KB in %.1f ms",
+                     (unsigned long)load->files, kb, load->total_ms);
+            snprintf(status[1], sizeof(status[1]), "SD %.0f KB/s  index %.0f KB/s  waited %.1f ms",
+                     load->read_ms > 0.0f ? kb * 1000.0f / load->read_ms : 0.0f,
+                     load->index_ms > 0.0f ? kb * 1000.0f / load->index_ms : 0.0f,
+                     load->wait_ms);
+            u32 spans = 0;
+            ProfDumpState dump = prof_dump_state(&spans);
+            if (dump == PROF_DUMP_DONE) {
+                snprintf(status[2], sizeof(status[2]), "trace: %lu spans written to " PROF_TRACE_FILE,
+                         (unsigned long)spans);
+            } else {
+                snprintf(status[2], sizeof(status[2]), "%s", dump == PROF_DUMP_RUNNING ? "trace: writing..." :
+                         dump == PROF_DUMP_FAILED ? "trace: could not be written" : "SELECT: write trace");
+            }
+            
+            // Heap allocations: a steady-state frame should make none
+            AllocStats allocs;
+            AllocTag tags[3];
+            alloc_stats(&allocs);
+            snprintf(status[3], sizeof(status[3]), "alloc %lu in frame, peak %lu, %lu of %lu frames",
+                     (unsigned long)allocs.frameAllocs, (unsigned long)allocs.peakAllocs,
+                     (unsigned long)allocs.allocatingFrames, (unsigned long)allocs.frames);
+            int tagCount = alloc_tags(tags, 3);
+            int len = snprintf(status[4], sizeof(status[4]), "%lu KB live", (unsigned long)(allocs.liveBytes / 1024));
+            for (int i = 0; i < tagCount && len < (int)sizeof(status[4]); i++) {
+                len += snprintf(status[4] + len, sizeof(status[4]) - len, ", %s %lu", tags[i].name,
+                                (unsigned long)tags[i].count);
+            }
+            for (int i = 0; i < 5; i++) {
+                C2D_TextParse(&text, g_staticBuf, status[i]);
+                C2D_TextOptimize(&text);
+                C2D_DrawText(&text, C2D_WithColor, 8.0f, 8.0f + i * 14.0f, 0.5f, 0.5f, 0.5f, COLOR_TITLE);
+            }
         }
         else if (mode == MODE_NOTE_LIST) {
             // Draw note list
@@ -334,22 +992,98 @@ int main(void) {
             }
             
             // Draw instructions
-            C2D_TextParse(&text, g_staticBuf, "A: View  B: Back");
+            C2D_TextParse(&text, g_staticBuf, "A: View  B: Back  X: Search  R: Replace");
             C2D_TextOptimize(&text);
             C2D_DrawText(&text, C2D_WithColor | C2D_AlignCenter, 160.0f, 220.0f, 0.5f, 0.75f, 0.75f, COLOR_TEXT);
         }
         else if (mode == MODE_VIEW_NOTE) {
             // Draw view controls
-            C2D_TextParse(&text, g_staticBuf, "A: Add Line  B: Back");
+            // List misspellings in the visible paragraphs
+            const ViewNotice* notices;
+            int noticeCount = view_notices(&notices);
+            for (int i = 0; i < noticeCount; i++) {
+                char line[2 * SPELL_MAX_WORD + 8];
+                snprintf(line, sizeof(line), "%s -> %s", notices[i].word,
+                         notices[i].suggestion[0] ? notices[i].suggestion : "?");
+                C2D_TextParse(&text, g_staticBuf, line);
+                C2D_TextOptimize(&text);
+                C2D_DrawText(&text, C2D_WithColor, 20.0f, 20.0f + i * 22.0f, 0.5f, 0.6f, 0.6f, COLOR_TEXT);
+            }
+            
+            C2D_TextParse(&text, g_staticBuf, "A: Edit  B: Back  D-Pad: Scroll");
             C2D_TextOptimize(&text);
             C2D_DrawText(&text, C2D_WithColor | C2D_AlignCenter, 160.0f, 220.0f, 0.5f, 0.75f, 0.75f, COLOR_TEXT);
         }
+        else if (mode == MODE_REPLACING) {
+            ReplaceProgress progress;
+            replace_progress(&progress);
+            if (progress.state != REPLACE_RUNNING) {
+                C2D_TextParse(&text, g_staticBuf, "A: OK");
+                C2D_TextOptimize(&text);
+                C2D_DrawText(&text, C2D_WithColor | C2D_AlignCenter, 160.0f, 220.0f, 0.5f, 0.75f, 0.75f, COLOR_TEXT);
+            }
+        }
+        else if (mode == MODE_HISTORY) {
+            TelemetrySession current;
+            telemetry_current(&current);
+            draw_history(&current);
+        }
+        else if (mode == MODE_EDIT_NOTE || mode == MODE_NEW_NOTE || mode == MODE_SEARCH ||
+                 mode == MODE_REPLACE) {
+            // Draw touch-to-glyph latency above the keyboard
+            const KbdLatency* lat = kbd_latency();
+            char status[64];
+            snprintf(status, sizeof(status), "latency %.1f ms (avg %.1f, max %.1f)",
+                     lat->last_ms, lat->avg_ms, lat->max_ms);
+            C2D_TextParse(&text, g_staticBuf, status);
+            C2D_TextOptimize(&text);
+            C2D_DrawText(&text, C2D_WithColor, 8.0f, 8.0f, 0.5f, 0.5f, 0.5f, COLOR_TITLE);
+            
+            if (mode == MODE_SEARCH) {
+                // Bodies the Bloom filters spared, and how often they let
+                // through one that did not match
+                const SearchFilterStats* filter = search_filter_stats();
+                u32 negatives = filter->rejected + filter->falsePositives;
+                snprintf(status, sizeof(status), "filter skipped %lu of %lu  fp %.1f%%",
+                         (unsigned long)filter->rejected, (unsigned long)filter->checks,
+                         negatives > 0 ? 100.0f * filter->falsePositives / negatives : 0.0f);
+                C2D_TextParse(&text, g_staticBuf, status);
+                C2D_TextOptimize(&text);
+                C2D_DrawText(&text, C2D_WithColor, 8.0f, 22.0f, 0.5f, 0.5f, 0.5f, COLOR_TITLE);
+            }
+            
+            kbd_draw();
+        }
         
         C3D_FrameEnd(0);
+        prof_end();
+        kbd_frame_presented();
+        g_frames++;
+        alloc_frame();
+        telemetry_frame();
+        log_tick();
+        prof_end();
     }
     
 cleanup:
     // Cleanup resources
+    worker_exit();
+    log_event(LOG_EXIT, g_frames, 0, 0, 0);
+    log_allocations();
+    telemetry_record();
+    log_exit();
+    replace_finish();
+    image_exit();
+    search_exit();
+    rank_exit();
+    trigram_exit();
+    snippet_exit();
+    spell_exit();
+    view_exit();
+    predict_exit();
+    kbd_exit();
+    kv_close();
+    storage_exit();
     exitText();
     C2D_Fini();
     C3D_Fini();
@@ -0,0 +1,38 @@
+//---------------------------------------------------------------------------------
+// memory.c
+// Memory budget. The limits are what the caches may take on an Old 3DS after
+// the framebuffers, command buffers and note store are accounted for.
+//---------------------------------------------------------------------------------
+
+#include "memory.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+static const u32 s_limits[MEM_POOL_COUNT] = {
+    8 * 1024 * 1024,    // MEM_HEAP
+    4 * 1024 * 1024,    // MEM_LINEAR
+    4 * 1024 * 1024,    // MEM_VRAM, what the screen targets leave of 6 MiB
+};
+
+static u32 s_used[MEM_POOL_COUNT];
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void mem_track(MemPool pool, s32 bytes) {
+    __atomic_add_fetch(&s_used[pool], (u32)bytes, __ATOMIC_RELAXED);
+}
+
+u32 mem_used(MemPool pool) {
+    return __atomic_load_n(&s_used[pool], __ATOMIC_RELAXED);
+}
+
+u32 mem_limit(MemPool pool) {
+    return s_limits[pool];
+}
+
+bool mem_fits(MemPool pool, u32 bytes) {
+    return mem_used(pool) + bytes <= s_limits[pool];
+}
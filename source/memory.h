@@ -0,0 +1,27 @@
+//---------------------------------------------------------------------------------
+// memory.h
+// Memory budget: running totals of what the app's caches hold in each pool.
+//---------------------------------------------------------------------------------
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <3ds.h>
+
+typedef enum {
+    MEM_HEAP,        // malloc'd buffers (decoded pixels, caches)
+    MEM_LINEAR,      // GPU-visible FCRAM (textures that did not fit in VRAM)
+    MEM_VRAM,        // Textures and render targets in VRAM
+    MEM_POOL_COUNT
+} MemPool;
+
+// Record an allocation (positive) or release (negative). Safe from any thread.
+void mem_track(MemPool pool, s32 bytes);
+
+u32 mem_used(MemPool pool);
+u32 mem_limit(MemPool pool);
+
+// True if `bytes` more would still fit within the pool's budget
+bool mem_fits(MemPool pool, u32 bytes);
+
+#endif // MEMORY_H
@@ -0,0 +1,243 @@
+//---------------------------------------------------------------------------------
+// predict.c
+// Word-frequency trie for completions. Nodes live in one flat array and are
+// addressed by index, 16 bytes each, with the edge label packed next to the
+// sibling link. Each node also stores the highest count in its subtree, so a
+// top-k query can skip every branch that cannot beat the current k-th result.
+//---------------------------------------------------------------------------------
+
+#include "predict.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define TRIE_INITIAL_NODES 4096
+#define TRIE_ROOT          0
+#define TRIE_NONE          0   // The root is never anyone's child or sibling
+
+typedef struct {
+    u32 child;     // First child, TRIE_NONE if leaf
+    u32 link;      // (next sibling << 8) | edge label; siblings sorted by label
+    u32 count;     // Occurrences of the word ending at this node
+    u32 best;      // Highest count anywhere in this subtree, this node included
+} TrieNode;
+
+typedef struct {
+    u32 count;
+    char word[PREDICT_MAX_WORD];
+} Completion;
+
+static TrieNode* s_nodes = NULL;
+static u32 s_nodeCount = 0;
+static u32 s_nodeCap = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static inline u32 node_sibling(const TrieNode* node) { return node->link >> 8; }
+static inline u8 node_label(const TrieNode* node) { return node->link & 0xFF; }
+
+static inline bool is_word_char(u8 c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '\'' || c == '_' || c >= 0x80;
+}
+
+static u32 new_node(u8 label, u32 sibling) {
+    if (s_nodeCount == s_nodeCap) {
+        u32 cap = s_nodeCap ? s_nodeCap * 2 : TRIE_INITIAL_NODES;
+        TrieNode* nodes = realloc(s_nodes, cap * sizeof(TrieNode));
+        if (!nodes) return TRIE_NONE;
+        s_nodes = nodes;
+        s_nodeCap = cap;
+    }
+
+    TrieNode* node = &s_nodes[s_nodeCount];
+    node->child = TRIE_NONE;
+    node->link = (sibling << 8) | label;
+    node->count = 0;
+    node->best = 0;
+    return s_nodeCount++;
+}
+
+// Find the child of `parent` with edge `label`, optionally creating it
+static u32 find_child(u32 parent, u8 label, bool create) {
+    u32 prev = TRIE_NONE;
+    u32 cur = s_nodes[parent].child;
+
+    while (cur != TRIE_NONE && node_label(&s_nodes[cur]) < label) {
+        prev = cur;
+        cur = node_sibling(&s_nodes[cur]);
+    }
+    if (cur != TRIE_NONE && node_label(&s_nodes[cur]) == label) return cur;
+    if (!create) return TRIE_NONE;
+
+    // new_node() may move the array, so only keep indices across it
+    u32 node = new_node(label, cur);
+    if (node == TRIE_NONE) return TRIE_NONE;
+    if (prev == TRIE_NONE) {
+        s_nodes[parent].child = node;
+    } else {
+        s_nodes[prev].link = (node << 8) | node_label(&s_nodes[prev]);
+    }
+    return node;
+}
+
+static void recompute_best(u32 index) {
+    TrieNode* node = &s_nodes[index];
+    u32 best = node->count;
+    for (u32 c = node->child; c != TRIE_NONE; c = node_sibling(&s_nodes[c])) {
+        if (s_nodes[c].best > best) best = s_nodes[c].best;
+    }
+    node->best = best;
+}
+
+static void update_word(const char* word, size_t len, bool add) {
+    u32 path[PREDICT_MAX_WORD + 1];
+    u32 node = TRIE_ROOT;
+
+    path[0] = TRIE_ROOT;
+    for (size_t i = 0; i < len; i++) {
+        node = find_child(node, (u8)word[i], add);
+        if (node == TRIE_NONE) return;
+        path[i + 1] = node;
+    }
+
+    if (add) {
+        u32 count = ++s_nodes[node].count;
+        for (size_t i = 0; i <= len; i++) {
+            if (s_nodes[path[i]].best < count) s_nodes[path[i]].best = count;
+        }
+    } else if (s_nodes[node].count > 0) {
+        s_nodes[node].count--;
+        // Counts only went down, so refresh the maxima from the leaf upwards.
+        // Emptied nodes stay in the pool; they are reused if the word returns.
+        for (size_t i = len + 1; i-- > 0;) {
+            recompute_best(path[i]);
+        }
+    }
+}
+
+static void update_text(const char* text, bool add) {
+    if (!s_nodes || !text) return;
+
+    char word[PREDICT_MAX_WORD];
+    size_t len = 0;
+    bool tooLong = false;
+
+    for (const u8* p = (const u8*)text;; p++) {
+        if (*p && is_word_char(*p)) {
+            if (len < PREDICT_MAX_WORD - 1) {
+                word[len++] = ascii_fold(*p);
+            } else {
+                tooLong = true;
+            }
+            continue;
+        }
+        if (!tooLong && len >= PREDICT_MIN_WORD) {
+            update_word(word, len, add);
+        }
+        len = 0;
+        tooLong = false;
+        if (!*p) break;
+    }
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+bool predict_init(void) {
+    s_nodeCount = 0;
+    s_nodeCap = 0;
+    return new_node(0, TRIE_NONE) == TRIE_ROOT && s_nodes != NULL;
+}
+
+void predict_exit(void) {
+    free(s_nodes);
+    s_nodes = NULL;
+    s_nodeCount = 0;
+    s_nodeCap = 0;
+}
+
+void predict_add_text(const char* text) {
+    update_text(text, true);
+}
+
+void predict_remove_text(const char* text) {
+    update_text(text, false);
+}
+
+size_t predict_prefix_at(const char* text, size_t cursor, char* out, size_t out_size) {
+    size_t start = cursor;
+    while (start > 0 && is_word_char((u8)text[start - 1])) start--;
+
+    size_t len = cursor - start;
+    if (len == 0 || len >= out_size) return 0;
+    for (size_t i = 0; i < len; i++) {
+        out[i] = ascii_fold((u8)text[start + i]);
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static void collect(u32 index, char* word, size_t depth, size_t prefixLen,
+                    Completion* results, int* found, int max) {
+    const TrieNode* node = &s_nodes[index];
+
+    // Nothing below here can displace the weakest result we already have
+    if (*found == max && node->best <= results[max - 1].count) return;
+
+    if (node->count > 0 && depth > prefixLen &&
+        (*found < max || node->count > results[max - 1].count)) {
+        int pos = *found < max ? (*found)++ : max - 1;
+        while (pos > 0 && results[pos - 1].count < node->count) {
+            results[pos] = results[pos - 1];
+            pos--;
+        }
+        results[pos].count = node->count;
+        memcpy(results[pos].word, word, depth);
+        results[pos].word[depth] = '\0';
+    }
+
+    if (depth >= PREDICT_MAX_WORD - 1) return;
+    for (u32 c = node->child; c != TRIE_NONE; c = node_sibling(&s_nodes[c])) {
+        word[depth] = node_label(&s_nodes[c]);
+        collect(c, word, depth + 1, prefixLen, results, found, max);
+        node = &s_nodes[index];
+    }
+}
+
+int predict_complete(const char* prefix, char out[][PREDICT_MAX_WORD], int max) {
+    if (!s_nodes || !prefix || max <= 0) return 0;
+    if (max > PREDICT_MAX_RESULTS) max = PREDICT_MAX_RESULTS;
+
+    size_t len = strlen(prefix);
+    if (len == 0 || len >= PREDICT_MAX_WORD - 1) return 0;
+
+    char word[PREDICT_MAX_WORD];
+    u32 node = TRIE_ROOT;
+    for (size_t i = 0; i < len; i++) {
+        word[i] = ascii_fold((u8)prefix[i]);
+        node = find_child(node, (u8)word[i], false);
+        if (node == TRIE_NONE) return 0;
+    }
+
+    Completion results[PREDICT_MAX_RESULTS];
+    int found = 0;
+
+    collect(node, word, len, len, results, &found, max);
+
+    for (int i = 0; i < found; i++) {
+        memcpy(out[i], results[i].word, PREDICT_MAX_WORD);
+    }
+    return found;
+}
+
+u32 predict_node_count(void) {
+    return s_nodeCount;
+}
@@ -0,0 +1,33 @@
+//---------------------------------------------------------------------------------
+// predict.h
+// Word-frequency model built from the user's notes, used for completions.
+//---------------------------------------------------------------------------------
+
+#ifndef PREDICT_H
+#define PREDICT_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+#define PREDICT_MAX_WORD    32   // Longest word kept, including the terminator
+#define PREDICT_MIN_WORD    3    // Shorter words are not worth completing
+#define PREDICT_MAX_RESULTS 3
+
+bool predict_init(void);
+void predict_exit(void);
+
+// Add or remove every word of `text` to/from the frequency model
+void predict_add_text(const char* text);
+void predict_remove_text(const char* text);
+
+// Copy the (case-folded) word that ends at byte offset `cursor` of `text`
+// into `out`. Returns its length in bytes, 0 if the cursor is not in a word.
+size_t predict_prefix_at(const char* text, size_t cursor, char* out, size_t out_size);
+
+// Fill `out` with up to `max` of the most frequent words starting with
+// `prefix`, most frequent first. The prefix itself is never returned.
+int predict_complete(const char* prefix, char out[][PREDICT_MAX_WORD], int max);
+
+u32 predict_node_count(void);
+
+#endif // PREDICT_H
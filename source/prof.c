@@ -0,0 +1,200 @@
+//---------------------------------------------------------------------------------
+// prof.c
+// Span recording and Chrome trace export. A track has a single writer, the
+// thread it belongs to, which records a span when it closes and then
+// publishes it by bumping the track's head. The export copies each ring and
+// re-reads the head afterwards; spans in slots the writer may have reached
+// meanwhile are dropped rather than written half-updated. Spans become
+// "X" (complete) events, timed in microseconds from the earliest one.
+//---------------------------------------------------------------------------------
+
+#include "prof.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "storage.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define PROF_CHUNK 4096        // Trace text written per request
+
+typedef struct {
+    u64 start;
+    u32 ticks;
+    const char* name;
+} Span;
+
+typedef struct {
+    Span spans[PROF_RING];
+    u32 head;                        // Spans recorded
+    int depth;                       // Open spans; owned by the writer
+    u64 openStart[PROF_DEPTH];
+    const char* openName[PROF_DEPTH];
+} Track;
+
+typedef struct {
+    StorageFile* file;
+    char buf[PROF_CHUNK];
+    size_t len;
+} Output;
+
+static Track s_tracks[PROF_TRACK_COUNT];
+static __thread u8 s_track = PROF_TRACK_UI;
+static u32 s_dumpState = PROF_DUMP_IDLE;
+static u32 s_dumpSpans = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+
+// Copy the spans still in `track`'s ring to `out`, oldest first
+static u32 copy_track(const Track* track, Span* out) {
+    u32 head = __atomic_load_n(&track->head, __ATOMIC_ACQUIRE);
+    u32 first = head > PROF_RING ? head - PROF_RING : 0;
+    for (u32 i = first; i < head; i++) {
+        out[i - first] = track->spans[i & (PROF_RING - 1)];
+    }
+
+    // The writer may have overwritten the oldest slots while they were copied
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    u32 now = __atomic_load_n(&track->head, __ATOMIC_RELAXED);
+    u32 safe = now + 1 > PROF_RING ? now + 1 - PROF_RING : 0;
+    if (safe <= first) return head - first;
+    if (safe >= head) return 0;
+    memmove(out, out + (safe - first), (head - safe) * sizeof(Span));
+    return head - safe;
+}
+
+static void emit(Output* out, const char* format, ...) {
+    va_list args;
+    if (out->len > PROF_CHUNK - 256) {
+        storage_file_write(out->file, out->buf, out->len);
+        out->len = 0;
+    }
+    va_start(args, format);
+    int n = vsnprintf(out->buf + out->len, PROF_CHUNK - out->len, format, args);
+    va_end(args);
+    if (n > 0) out->len += (size_t)n < PROF_CHUNK - out->len ? (size_t)n : PROF_CHUNK - out->len - 1;
+}
+
+static double ticks_us(u64 ticks) {
+    return ticks / (SYSCLOCK_ARM11 / 1000000.0);
+}
+
+static bool write_trace(Span* spans, const u32* counts, u32* written) {
+    Output out = { storage_open(PROF_TRACE_FILE, true), { 0 }, 0 };
+    if (!out.file) return false;
+
+    u64 base = U64_MAX;
+    for (int t = 0; t < PROF_TRACK_COUNT; t++) {
+        for (u32 i = 0; i < counts[t]; i++) {
+            if (spans[t * PROF_RING + i].start < base) base = spans[t * PROF_RING + i].start;
+        }
+    }
+
+    static const char* names[] = { "UI", "I/O", "worker" };
+    emit(&out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int t = 0; t < PROF_TRACK_COUNT; t++) {
+        char job[16];
+        snprintf(job, sizeof(job), "job %d", t - PROF_TRACK_JOB + 1);
+        emit(&out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+             t > 0 ? ",\n" : "", t, t < PROF_TRACK_JOB ? names[t] : job);
+    }
+
+    *written = 0;
+    for (int t = 0; t < PROF_TRACK_COUNT; t++) {
+        for (u32 i = 0; i < counts[t]; i++) {
+            const Span* span = &spans[t * PROF_RING + i];
+            emit(&out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                 span->name, t, ticks_us(span->start - base), ticks_us(span->ticks));
+            (*written)++;
+        }
+    }
+    emit(&out, "\n]}\n");
+    storage_file_write(out.file, out.buf, out.len);
+    return storage_close(out.file);
+}
+
+static void dump_job(void* unused) {
+    (void)unused;
+    u32 counts[PROF_TRACK_COUNT];
+    u32 written = 0;
+    prof_begin("dump trace");
+
+    Span* spans = malloc(PROF_TRACK_COUNT * PROF_RING * sizeof(Span));
+    bool ok = spans != NULL;
+    if (ok) {
+        for (int t = 0; t < PROF_TRACK_COUNT; t++) {
+            counts[t] = copy_track(&s_tracks[t], spans + t * PROF_RING);
+        }
+        ok = write_trace(spans, counts, &written);
+    }
+    free(spans);
+
+    prof_end();
+    log_event(LOG_TRACE, written, ok, 0, 0);
+    s_dumpSpans = written;
+    __atomic_store_n(&s_dumpState, ok ? PROF_DUMP_DONE : PROF_DUMP_FAILED, __ATOMIC_RELEASE);
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void prof_thread(ProfTrack track) {
+    s_track = track < PROF_TRACK_COUNT ? track : PROF_TRACK_UI;
+}
+
+void prof_begin(const char* name) {
+    Track* track = &s_tracks[s_track];
+    if (track->depth < PROF_DEPTH) {
+        track->openStart[track->depth] = svcGetSystemTick();
+        track->openName[track->depth] = name;
+    }
+    track->depth++;
+}
+
+void prof_end(void) {
+    Track* track = &s_tracks[s_track];
+    if (track->depth == 0) return;
+    if (--track->depth >= PROF_DEPTH) return;
+
+    u32 head = track->head;
+    Span* span = &track->spans[head & (PROF_RING - 1)];
+    span->start = track->openStart[track->depth];
+    span->ticks = svcGetSystemTick() - span->start;
+    span->name = track->openName[track->depth];
+    __atomic_store_n(&track->head, head + 1, __ATOMIC_RELEASE);
+}
+
+const char* prof_current(void) {
+    const Track* track = &s_tracks[s_track];
+    int depth = track->depth;
+    if (depth <= 0) return NULL;
+    return track->openName[(depth < PROF_DEPTH ? depth : PROF_DEPTH) - 1];
+}
+
+bool prof_dump(void) {
+    if (__atomic_load_n(&s_dumpState, __ATOMIC_ACQUIRE) == PROF_DUMP_RUNNING) return false;
+    s_dumpState = PROF_DUMP_RUNNING;
+    if (!worker_submit(dump_job, NULL)) {
+        s_dumpState = PROF_DUMP_IDLE;
+        return false;
+    }
+    return true;
+}
+
+ProfDumpState prof_dump_state(u32* spans) {
+    ProfDumpState state = __atomic_load_n(&s_dumpState, __ATOMIC_ACQUIRE);
+    if (spans) *spans = s_dumpSpans;
+    return state;
+}
+
+bool prof_is_file(const char* name) {
+    return strcmp(name, PROF_TRACE_FILE) == 0;
+}
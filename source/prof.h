@@ -0,0 +1,56 @@
+//---------------------------------------------------------------------------------
+// prof.h
+// Span profiler. Each thread records begin/end spans on its own track into
+// a ring buffer that keeps the last PROF_RING spans, and the lot can be
+// written out as a Chrome trace (chrome://tracing, Perfetto) to see how
+// loading, background jobs and drawing overlap across threads.
+//---------------------------------------------------------------------------------
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <3ds.h>
+
+#include "worker.h"
+
+#define PROF_TRACE_FILE ".trace.json"
+#define PROF_RING       1024     // Spans kept per track
+#define PROF_DEPTH      8        // Deepest nesting recorded
+
+typedef enum {
+    PROF_TRACK_UI,               // The main thread; the default
+    PROF_TRACK_IO,               // The loader's reader
+    PROF_TRACK_WORKER,
+    PROF_TRACK_JOB,              // Helper threads of worker_parallel(), one each
+    PROF_TRACK_COUNT = PROF_TRACK_JOB + WORKER_MAX_THREADS - 1
+} ProfTrack;
+
+typedef enum {
+    PROF_DUMP_IDLE,
+    PROF_DUMP_RUNNING,
+    PROF_DUMP_DONE,
+    PROF_DUMP_FAILED
+} ProfDumpState;
+
+// Record the calling thread's spans on `track`. Call first thing in a thread.
+void prof_thread(ProfTrack track);
+
+// Open and close a span. `name` is kept by pointer, so it must be a string
+// literal. Spans nest; ones deeper than PROF_DEPTH are not recorded.
+void prof_begin(const char* name);
+void prof_end(void);
+
+// Name of the innermost span open on the calling thread, or NULL
+const char* prof_current(void);
+
+// Write the recorded spans of every track to PROF_TRACE_FILE on the worker.
+// Returns false if a dump is already running or cannot be queued.
+bool prof_dump(void);
+
+// State of the last dump and, once done, the spans it wrote
+ProfDumpState prof_dump_state(u32* spans);
+
+// True for the trace file, which is not a note
+bool prof_is_file(const char* name);
+
+#endif // PROF_H
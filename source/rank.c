@@ -0,0 +1,723 @@
+//---------------------------------------------------------------------------------
+// rank.c
+// BM25 ranking over a segmented inverted index. The index is a stack of
+// immutable segments, oldest first. Changed notes are tokenized into a small
+// in-memory segment, the memtable, which is rebuilt on every change; once it
+// holds RANK_FLUSH_DOCS notes it is frozen and written out by the worker, and
+// the worker merges the newest segments whenever they outgrow the one below
+// them, so there are only ever a few. The newest segment that has a note, or
+// a tombstone for it, decides what the index holds for it, so older copies
+// are hidden without touching their segments. Document frequencies still
+// count hidden copies until a merge drops them.
+//
+// Queries are evaluated a word at a time, highest contribution first, into
+// score accumulators. Once the k-th best score so far beats everything the
+// remaining words could add, no unseen document can reach the top k (the
+// MaxScore bound): from then on only existing candidates are looked up in the
+// remaining postings, and candidates that can no longer catch up are dropped.
+//---------------------------------------------------------------------------------
+
+#include "rank.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prof.h"
+#include "segment.h"
+#include "storage.h"
+#include "util.h"
+#include "worker.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define RANK_K1         1.2f
+#define RANK_B          0.75f
+#define RANK_MAX_TERMS  8     // Query words
+#define RANK_MAX_LISTS  32    // Posting lists per query, after prefix expansion
+#define RANK_MAX_LEVELS 12    // Segments, counting the memtable
+#define RANK_NO_NOTE    0xFFFF
+#define RANK_NO_LEVEL   0xFF
+
+typedef struct {
+    Segment* seg;
+    u16* note;       // Note ID of each document, or RANK_NO_NOTE if hidden
+} Level;
+
+// An indexed word matching the query, with its term in each level
+typedef struct {
+    const char* text;
+    float idf;
+    float bound;     // Most it can add to a score
+    s32 term[RANK_MAX_LEVELS];
+} QueryList;
+
+typedef struct {
+    Segment* inputs[RANK_MAX_LEVELS];
+    int first;       // Level of the oldest input
+    int count;
+    bool keepTombs;
+    Segment* output;
+} MergeJob;
+
+// Segments, oldest first. The memtable, if any, is the last.
+static Level s_levels[RANK_MAX_LEVELS];
+static int s_levelCount = 0;
+static bool s_memtable = false;
+static u32 s_nextSeq = 0;
+static bool s_loaded = false;
+
+// Notes and where the index holds each one
+static SearchDocFn s_doc = NULL;
+static void* s_arg = NULL;
+static int s_noteCount = 0;
+static u32 s_noteCap = 0;
+static u8* s_owner = NULL;         // Level, or RANK_NO_LEVEL
+static u16* s_local = NULL;        // Document in that level
+static float* s_norm = NULL;       // k1 * (1 - b + b * length / average length)
+static int s_live = 0;             // Notes in the index
+static float s_average = 1.0f;
+
+// Memtable contents: changed notes and names to drop
+static u8* s_dirty = NULL;
+static int s_dirtyCount = 0;
+static char** s_tombs = NULL;
+static u32 s_tombCount = 0;
+static u32 s_tombCap = 0;
+
+// Query scratch, sized to the note count
+static float* s_acc = NULL;        // 0 for documents that are not candidates
+static u16* s_cand = NULL;
+static u8* s_allowed = NULL;
+
+// Background merge; s_mergeDone is guarded by s_lock
+static MergeJob s_merge;
+static LightLock s_lock;
+static bool s_merging = false;
+static bool s_mergeDone = false;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static bool resize(void** array, size_t size, u32 from, u32 to) {
+    void* bigger = realloc(*array, to * size);
+    if (!bigger) return false;
+    memset((u8*)bigger + from * size, 0, (to - from) * size);
+    *array = bigger;
+    return true;
+}
+
+static bool reserve_notes(u32 need) {
+    if (need <= s_noteCap) return true;
+    u32 cap = s_noteCap ? s_noteCap : 16;
+    while (cap < need) cap *= 2;
+    if (!resize((void**)&s_owner, sizeof(u8), s_noteCap, cap) ||
+        !resize((void**)&s_local, sizeof(u16), s_noteCap, cap) ||
+        !resize((void**)&s_norm, sizeof(float), s_noteCap, cap) ||
+        !resize((void**)&s_dirty, sizeof(u8), s_noteCap, cap) ||
+        !resize((void**)&s_acc, sizeof(float), s_noteCap, cap) ||
+        !resize((void**)&s_cand, sizeof(u16), s_noteCap, cap) ||
+        !resize((void**)&s_allowed, sizeof(u8), s_noteCap, cap)) {
+        return false;
+    }
+    s_noteCap = cap;
+    return true;
+}
+
+static bool add_level(Segment* seg) {
+    u16* note = malloc((seg->header->docCount + 1) * sizeof(u16));
+    if (!note || s_levelCount == RANK_MAX_LEVELS) {
+        free(note);
+        return false;
+    }
+    s_levels[s_levelCount++] = (Level){ seg, note };
+    return true;
+}
+
+static void free_level(Level* level) {
+    segment_free(level->seg);
+    free(level->note);
+    level->seg = NULL;
+    level->note = NULL;
+}
+
+// Level with the newest entry for `name`, or -1. Sets `local` to the
+// document, or -1 if the entry is a tombstone.
+static int resolve(const char* name, s32* local) {
+    for (int l = s_levelCount - 1; l >= 0; l--) {
+        *local = segment_find_doc(s_levels[l].seg, name);
+        if (*local >= 0 || segment_has_tomb(s_levels[l].seg, name)) return l;
+    }
+    *local = -1;
+    return -1;
+}
+
+// Point every note at its newest document, and recompute the length norms
+static void remap(void) {
+    for (int l = 0; l < s_levelCount; l++) {
+        memset(s_levels[l].note, 0xFF, s_levels[l].seg->header->docCount * sizeof(u16));
+    }
+
+    u64 total = 0;
+    s_live = 0;
+    for (int id = 0; id < s_noteCount; id++) {
+        SearchDoc text = { "", "" };
+        s_doc(id, &text, s_arg);
+        s32 local;
+        int l = resolve(text.title, &local);
+        s_owner[id] = RANK_NO_LEVEL;
+        if (l < 0 || local < 0) continue;
+
+        s_owner[id] = l;
+        s_local[id] = local;
+        s_levels[l].note[local] = id;
+        total += s_levels[l].seg->docs[local].length;
+        s_live++;
+    }
+
+    s_average = total ? (float)total / s_live : 1.0f;
+    for (int id = 0; id < s_noteCount; id++) {
+        if (s_owner[id] == RANK_NO_LEVEL) continue;
+        u32 length = s_levels[s_owner[id]].seg->docs[s_local[id]].length;
+        s_norm[id] = RANK_K1 * (1.0f - RANK_B + RANK_B * length / s_average);
+    }
+}
+
+static bool add_tomb(const char* name) {
+    size_t len = strlen(name) + 1;
+    char* copy = malloc(len);
+    if (!copy || !grow_array((void**)&s_tombs, &s_tombCap, s_tombCount + 1, sizeof(char*), 16)) {
+        free(copy);
+        return false;
+    }
+    memcpy(copy, name, len);
+    s_tombs[s_tombCount++] = copy;
+    return true;
+}
+
+static void clear_memtable(void) {
+    for (u32 i = 0; i < s_tombCount; i++) free(s_tombs[i]);
+    s_tombCount = 0;
+    if (s_dirty) memset(s_dirty, 0, s_noteCap);
+    s_dirtyCount = 0;
+}
+
+//---------------------------------------------------------------------------------
+// Flushing and merging
+//---------------------------------------------------------------------------------
+static void write_job(void* arg) {
+    prof_begin("write segment");
+    segment_write(arg);
+    prof_end();
+}
+
+static void merge_job(void* arg) {
+    MergeJob* job = arg;
+    prof_begin("merge segments");
+    Segment* out = segment_merge(job->inputs, job->count, job->keepTombs);
+    if (out && segment_write(out)) {
+        // The merged file covers the inputs' sequence numbers, so inputs
+        // left behind by a crash here are recognized and removed at load
+        for (int i = 0; i < job->count; i++) {
+            char name[STORAGE_NAME_LEN];
+            segment_file_name(job->inputs[i], name, sizeof(name));
+            storage_remove(name);
+        }
+    } else {
+        segment_free(out);
+        out = NULL;
+    }
+    prof_end();
+
+    LightLock_Lock(&s_lock);
+    job->output = out;
+    s_mergeDone = true;
+    LightLock_Unlock(&s_lock);
+}
+
+// Merge the newest segments once they are together at least half the size
+// of the one below them, which keeps sizes growing geometrically and the
+// number of segments logarithmic. A full stack is merged whole.
+static void maybe_merge(void) {
+    int levels = s_levelCount - s_memtable;
+    if (s_merging || levels < 2) return;
+
+    int first = levels - 1;
+    size_t size = s_levels[first].seg->size;
+    while (first > 0 && s_levels[first - 1].seg->size <= 2 * size) {
+        size += s_levels[--first].seg->size;
+    }
+    if (levels >= RANK_MAX_LEVELS - 1) first = 0;
+    if (levels - first < 2) return;
+
+    s_merge.first = first;
+    s_merge.count = levels - first;
+    s_merge.keepTombs = first > 0;
+    s_merge.output = NULL;
+    for (int i = 0; i < s_merge.count; i++) s_merge.inputs[i] = s_levels[first + i].seg;
+    s_mergeDone = false;
+    s_merging = worker_submit(merge_job, &s_merge);
+}
+
+// Freeze the memtable into a regular segment and queue it to be written.
+// If the queue is full it is written at exit instead.
+static void flush(void) {
+    s_memtable = false;
+    s_nextSeq++;
+    clear_memtable();
+    worker_submit(write_job, s_levels[s_levelCount - 1].seg);
+    maybe_merge();
+}
+
+// Rebuild the memtable from the changed notes, flushing it once it is full
+static bool seal(void) {
+    if (s_memtable) {
+        free_level(&s_levels[--s_levelCount]);
+        s_memtable = false;
+    }
+
+    bool ok = true;
+    if (s_dirtyCount > 0 || s_tombCount > 0) {
+        SearchDoc* docs = malloc((s_dirtyCount + 1) * sizeof(SearchDoc));
+        Segment* seg = NULL;
+        if (docs) {
+            int n = 0;
+            for (int id = 0; id < s_noteCount; id++) {
+                if (s_dirty[id]) s_doc(id, &docs[n++], s_arg);
+            }
+            seg = segment_build(docs, n, (const char* const*)s_tombs, s_tombCount, s_nextSeq);
+            free(docs);
+        }
+        ok = seg && add_level(seg);
+        if (!ok) segment_free(seg);
+        s_memtable = ok;
+
+        // Keep a level free for the next memtable
+        if (ok && s_dirtyCount + (int)s_tombCount >= RANK_FLUSH_DOCS && s_levelCount < RANK_MAX_LEVELS) {
+            flush();
+        }
+    }
+    remap();
+    return ok;
+}
+
+static int compare_levels(const void* a, const void* b) {
+    const SegmentHeader* x = (*(Segment* const*)a)->header;
+    const SegmentHeader* y = (*(Segment* const*)b)->header;
+    if (x->lo != y->lo) return x->lo < y->lo ? -1 : 1;
+    return (x->hi < y->hi) - (x->hi > y->hi);
+}
+
+static void discard(Segment* seg) {
+    char name[STORAGE_NAME_LEN];
+    segment_file_name(seg, name, sizeof(name));
+    storage_remove(name);
+    segment_free(seg);
+}
+
+// Load every intact segment. Damaged ones are deleted, along with any that
+// a later merge covers.
+static void load_levels(void) {
+    StorageEntry* found = NULL;
+    u32 count = 0, cap = 0;
+    StorageDir* dir = storage_dir_open();
+    StorageEntry entry;
+    while (dir && storage_dir_next(dir, &entry)) {
+        if (entry.isDir || !rank_is_file(entry.name)) continue;
+        if (!grow_array((void**)&found, &cap, count + 1, sizeof(StorageEntry), 16)) break;
+        found[count++] = entry;
+    }
+    if (dir) storage_dir_close(dir);
+
+    Segment** segs = malloc((count + 1) * sizeof(Segment*));
+    u32 loaded = 0;
+    for (u32 i = 0; segs && i < count; i++) {
+        Segment* seg = segment_load(found[i].name, found[i].size);
+        if (seg) segs[loaded++] = seg;
+        else storage_remove(found[i].name);
+    }
+    free(found);
+    if (!segs) return;
+
+    qsort(segs, loaded, sizeof(Segment*), compare_levels);
+    u32 kept = 0;
+    for (u32 i = 0; i < loaded; i++) {
+        if (kept > 0 && segs[i]->header->hi <= segs[kept - 1]->header->hi) discard(segs[i]);
+        else segs[kept++] = segs[i];
+    }
+
+    // Past the level limit, drop the oldest; rank_sync() reindexes the notes
+    // they held
+    for (u32 i = 0; i < kept; i++) {
+        if (segs[i]->header->hi >= s_nextSeq) s_nextSeq = segs[i]->header->hi + 1;
+        if (kept - i >= RANK_MAX_LEVELS || !add_level(segs[i])) discard(segs[i]);
+    }
+    free(segs);
+}
+
+//---------------------------------------------------------------------------------
+// Query evaluation
+//---------------------------------------------------------------------------------
+
+// True if document a ranks above document b
+static inline bool better(u16 a, u16 b) {
+    return s_acc[a] > s_acc[b] || (s_acc[a] == s_acc[b] && a < b);
+}
+
+// Sift the root of a min-heap (worst document on top) down into place
+static void sift_down(u16* heap, int count, int i) {
+    for (;;) {
+        int worst = i, l = 2 * i + 1, r = l + 1;
+        if (l < count && better(heap[worst], heap[l])) worst = l;
+        if (r < count && better(heap[worst], heap[r])) worst = r;
+        if (worst == i) return;
+        u16 t = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = t;
+        i = worst;
+    }
+}
+
+// Collect the k best candidates into `heap`, a min-heap. Returns how many.
+static int select_top(u16* heap, int k, u32 candCount) {
+    int count = 0;
+    for (u32 i = 0; i < candCount; i++) {
+        u16 doc = s_cand[i];
+        if (count < k) {
+            heap[count++] = doc;
+            if (count == k) {
+                for (int j = k / 2 - 1; j >= 0; j--) sift_down(heap, k, j);
+            }
+        } else if (better(doc, heap[0])) {
+            heap[0] = doc;
+            sift_down(heap, k, 0);
+        }
+    }
+    return count;
+}
+
+// Index of the posting for document `doc`, or of the first one after it
+static u32 seek(const SegmentPosting* post, u32 count, u16 doc) {
+    u32 lo = 0, hi = count;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (post[mid].doc < doc) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static inline float bm25(const QueryList* list, const SegmentPosting* p, u16 note) {
+    return list->idf * p->tf * (RANK_K1 + 1) / (p->tf + s_norm[note]);
+}
+
+// Add `list` unless another query word already matched it, keeping the
+// RANK_MAX_LISTS with the highest bound, ordered by it
+static int add_list(QueryList* lists, int count, QueryList* list, u32 df, u32 maxTf, u32 minLength) {
+    for (int j = 0; j < count; j++) {
+        if (strcmp(lists[j].text, list->text) == 0) return count;
+    }
+
+    if (df > (u32)s_live) df = s_live;
+    list->idf = logf(1.0f + (s_live - df + 0.5f) / (df + 0.5f));
+    list->bound = list->idf * maxTf * (RANK_K1 + 1) /
+                  (maxTf + RANK_K1 * (1.0f - RANK_B + RANK_B * minLength / s_average));
+    if (count == RANK_MAX_LISTS) {
+        if (list->bound <= lists[count - 1].bound) return count;
+        count--;
+    }
+    int j = count++;
+    for (; j > 0 && lists[j - 1].bound < list->bound; j--) lists[j] = lists[j - 1];
+    lists[j] = *list;
+    return count;
+}
+
+// Query lists for the indexed words starting with each query word. Each
+// level's terms are sorted, so the matches are merged across levels in text
+// order and each word's statistics summed as it comes up.
+static int build_lists(const char* query, QueryList* lists) {
+    int count = 0;
+    u32 pos[RANK_MAX_LEVELS];
+    char word[RANK_TERM_LEN];
+    size_t len;
+    for (int words = 0; words < RANK_MAX_TERMS && (len = segment_next_word(&query, word)) > 0; words++) {
+        for (int l = 0; l < s_levelCount; l++) pos[l] = segment_lower_bound(s_levels[l].seg, word);
+
+        for (;;) {
+            const char* text = NULL;
+            for (int l = 0; l < s_levelCount; l++) {
+                const Segment* seg = s_levels[l].seg;
+                if (pos[l] >= seg->header->termCount) continue;
+                const char* t = segment_term_text(seg, pos[l]);
+                if (strncmp(t, word, len) == 0 && (!text || strcmp(t, text) < 0)) text = t;
+            }
+            if (!text) break;
+
+            QueryList list = { text, 0.0f, 0.0f, { 0 } };
+            u32 df = 0, maxTf = 0, minLength = 0xFFFFFFFF;
+            for (int l = 0; l < s_levelCount; l++) {
+                const Segment* seg = s_levels[l].seg;
+                list.term[l] = -1;
+                if (pos[l] >= seg->header->termCount || strcmp(segment_term_text(seg, pos[l]), text) != 0) continue;
+
+                const SegmentPosting* post;
+                const SegmentTerm* term = &seg->terms[pos[l]];
+                df += segment_postings(seg, pos[l], &post);
+                if (term->maxTf > maxTf) maxTf = term->maxTf;
+                if (term->minLength < minLength) minLength = term->minLength;
+                list.term[l] = pos[l]++;
+            }
+            count = add_list(lists, count, &list, df, maxTf, minLength);
+        }
+    }
+    return count;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+bool rank_sync(int count, SearchDocFn doc, void* arg) {
+    if (!s_loaded) {
+        LightLock_Init(&s_lock);
+        load_levels();
+        s_loaded = true;
+    }
+    if (count > SEARCH_MAX_DOCS) count = SEARCH_MAX_DOCS;
+    if (!reserve_notes(count + 1)) return false;
+    s_doc = doc;
+    s_arg = arg;
+    s_noteCount = count;
+    remap();
+
+    // Notes the index lacks, or holds an older text of
+    for (int id = 0; id < count; id++) {
+        SearchDoc text = { "", "" };
+        doc(id, &text, arg);
+        bool current = s_owner[id] != RANK_NO_LEVEL &&
+                       s_levels[s_owner[id]].seg->docs[s_local[id]].hash == segment_hash(&text);
+        if (!current && !s_dirty[id]) {
+            s_dirty[id] = 1;
+            s_dirtyCount++;
+        }
+    }
+
+    // Indexed notes that no longer exist get tombstones, so merges drop them
+    bool ok = true;
+    for (int l = 0; l < s_levelCount - s_memtable && ok; l++) {
+        const Segment* seg = s_levels[l].seg;
+        for (u32 d = 0; d < seg->header->docCount && ok; d++) {
+            if (s_levels[l].note[d] != RANK_NO_NOTE) continue;
+            s32 local;
+            const char* name = seg->pool + seg->docs[d].name;
+            if (resolve(name, &local) == l && local == (s32)d) ok = add_tomb(name);
+        }
+    }
+    return seal() && ok;
+}
+
+bool rank_update(int id) {
+    if (!s_doc || id < 0 || id >= SEARCH_MAX_DOCS || !reserve_notes(id + 1)) return false;
+    if (id >= s_noteCount) s_noteCount = id + 1;
+    if (!s_dirty[id]) {
+        s_dirty[id] = 1;
+        s_dirtyCount++;
+    }
+    return seal();
+}
+
+void rank_poll(void) {
+    if (!s_merging) return;
+    LightLock_Lock(&s_lock);
+    bool done = s_mergeDone;
+    LightLock_Unlock(&s_lock);
+    if (!done) return;
+
+    s_merging = false;
+    Segment* out = s_merge.output;
+    u16* note = out ? malloc((out->header->docCount + 1) * sizeof(u16)) : NULL;
+    if (!note) {
+        // The inputs hold the same documents
+        segment_free(out);
+        return;
+    }
+
+    int first = s_merge.first, count = s_merge.count;
+    for (int i = first; i < first + count; i++) free_level(&s_levels[i]);
+    s_levels[first] = (Level){ out, note };
+    memmove(&s_levels[first + 1], &s_levels[first + count], (s_levelCount - first - count) * sizeof(Level));
+    s_levelCount -= count - 1;
+    remap();
+    maybe_merge();
+}
+
+void rank_exit(void) {
+    // The worker has stopped, so write out what it did not get to,
+    // including the memtable
+    rank_poll();
+    for (int l = 0; l < s_levelCount; l++) {
+        if (!s_levels[l].seg->written) segment_write(s_levels[l].seg);
+        free_level(&s_levels[l]);
+    }
+    s_levelCount = 0;
+    s_memtable = false;
+    s_merging = false;
+    s_nextSeq = 0;
+    s_loaded = false;
+
+    clear_memtable();
+    free(s_tombs);
+    free(s_owner);
+    free(s_local);
+    free(s_norm);
+    free(s_dirty);
+    free(s_acc);
+    free(s_cand);
+    free(s_allowed);
+    s_tombs = NULL;
+    s_owner = s_dirty = s_allowed = NULL;
+    s_local = s_cand = NULL;
+    s_norm = s_acc = NULL;
+    s_tombCap = s_noteCap = 0;
+    s_noteCount = s_live = 0;
+    s_doc = NULL;
+}
+
+bool rank_is_file(const char* name) {
+    return strncmp(name, SEGMENT_PREFIX, sizeof(SEGMENT_PREFIX) - 1) == 0;
+}
+
+int rank_top(const char* query, const u16* filter, int filterCount, u16* ids, float* scores, int k) {
+    if (s_live == 0 || k <= 0) return 0;
+    if (k > RANK_TOP_K) k = RANK_TOP_K;
+
+    // Posting lists to evaluate, by decreasing contribution, and the most
+    // that lists i.. can still add to a score
+    QueryList lists[RANK_MAX_LISTS];
+    float remaining[RANK_MAX_LISTS + 1];
+    int listCount = build_lists(query, lists);
+    remaining[listCount] = 0.0f;
+    for (int i = listCount - 1; i >= 0; i--) remaining[i] = remaining[i + 1] + lists[i].bound;
+
+    if (filter) {
+        memset(s_allowed, 0, s_noteCount);
+        for (int i = 0; i < filterCount; i++) {
+            if (filter[i] < s_noteCount) s_allowed[filter[i]] = 1;
+        }
+    }
+
+    u16 heap[RANK_TOP_K];
+    u32 candCount = 0;
+    float threshold = 0.0f;   // k-th best score so far, once there are k
+    float best = 0.0f;        // Highest score so far, a bound on the threshold
+    bool closed = false;      // No new candidates can reach the top k
+
+    for (int i = 0; i < listCount; i++) {
+        const QueryList* list = &lists[i];
+        if (!closed && candCount >= (u32)k && threshold > remaining[i]) closed = true;
+
+        if (!closed) {
+            for (int l = 0; l < s_levelCount; l++) {
+                if (list->term[l] < 0) continue;
+                const SegmentPosting* post;
+                u32 postCount = segment_postings(s_levels[l].seg, list->term[l], &post);
+                const u16* note = s_levels[l].note;
+                for (u32 p = 0; p < postCount; p++) {
+                    u16 doc = note[post[p].doc];
+                    if (doc == RANK_NO_NOTE || (filter && !s_allowed[doc])) continue;
+                    if (s_acc[doc] == 0.0f) s_cand[candCount++] = doc;
+                    s_acc[doc] += bm25(list, &post[p], doc);
+                    if (s_acc[doc] > best) best = s_acc[doc];
+                }
+            }
+        } else {
+            // Add the list to the remaining candidates only: by walking its
+            // postings if that is cheaper than a binary search per candidate,
+            // else by looking each up in the segment holding it
+            const SegmentPosting* post;
+            u32 postTotal = 0;
+            for (int l = 0; l < s_levelCount; l++) {
+                if (list->term[l] >= 0) postTotal += segment_postings(s_levels[l].seg, list->term[l], &post);
+            }
+            if (postTotal <= candCount * (32 - __builtin_clz(postTotal | 1))) {
+                for (int l = 0; l < s_levelCount; l++) {
+                    if (list->term[l] < 0) continue;
+                    u32 postCount = segment_postings(s_levels[l].seg, list->term[l], &post);
+                    const u16* note = s_levels[l].note;
+                    for (u32 p = 0; p < postCount; p++) {
+                        u16 doc = note[post[p].doc];
+                        if (doc != RANK_NO_NOTE && s_acc[doc] != 0.0f) s_acc[doc] += bm25(list, &post[p], doc);
+                    }
+                }
+            } else {
+                for (u32 c = 0; c < candCount; c++) {
+                    u16 doc = s_cand[c];
+                    s32 term = list->term[s_owner[doc]];
+                    if (term < 0) continue;
+                    u32 postCount = segment_postings(s_levels[s_owner[doc]].seg, term, &post);
+                    u32 pos = seek(post, postCount, s_local[doc]);
+                    if (pos < postCount && post[pos].doc == s_local[doc]) s_acc[doc] += bm25(list, &post[pos], doc);
+                }
+            }
+
+            // Drop candidates that can no longer reach the threshold
+            u32 kept = 0;
+            for (u32 c = 0; c < candCount; c++) {
+                u16 doc = s_cand[c];
+                if (s_acc[doc] + remaining[i + 1] < threshold) s_acc[doc] = 0.0f;
+                else s_cand[kept++] = doc;
+            }
+            candCount = kept;
+        }
+
+        // Until even the best score beats what the remaining words can add,
+        // the threshold cannot close the lists, so it is not worth finding
+        if (candCount >= (u32)k && (closed || best > remaining[i + 1])) {
+            select_top(heap, k, candCount);
+            threshold = s_acc[heap[0]];
+        }
+    }
+
+    // Sort the winners best first
+    int count = select_top(heap, k, candCount);
+    for (int j = count / 2 - 1; j >= 0; j--) sift_down(heap, count, j);
+    for (int n = count; n > 0; n--) {
+        ids[n - 1] = heap[0];
+        if (scores) scores[n - 1] = s_acc[heap[0]];
+        heap[0] = heap[n - 1];
+        sift_down(heap, n - 1, 0);
+    }
+
+    for (u32 i = 0; i < candCount; i++) s_acc[s_cand[i]] = 0.0f;
+    return count;
+}
+
+s32 rank_locate(const char* query, int doc) {
+    if (doc < 0 || doc >= s_noteCount || s_owner[doc] == RANK_NO_LEVEL) return -1;
+    // As in rank_may_contain(): the offsets are from the note's old text
+    if (s_dirty[doc] && !s_memtable) return -1;
+
+    QueryList lists[RANK_MAX_LISTS];
+    int listCount = build_lists(query, lists);
+    int level = s_owner[doc];
+    const Segment* seg = s_levels[level].seg;
+    u16 local = s_local[doc];
+
+    u32 first = RANK_NO_OFFSET;
+    for (int i = 0; i < listCount; i++) {
+        if (lists[i].term[level] < 0) continue;
+        const SegmentPosting* post;
+        u32 postCount = segment_postings(seg, lists[i].term[level], &post);
+        u32 pos = seek(post, postCount, local);
+        if (pos < postCount && post[pos].doc == local && post[pos].first < first) first = post[pos].first;
+    }
+    return first == RANK_NO_OFFSET ? -1 : (s32)first;
+}
+
+bool rank_may_contain(int doc, const char* term, size_t len) {
+    if (doc < 0 || doc >= s_noteCount || s_owner[doc] == RANK_NO_LEVEL) return true;
+    // A changed note the memtable could not take is ahead of its filter
+    if (s_dirty[doc] && !s_memtable) return true;
+    return segment_may_contain(s_levels[s_owner[doc]].seg, s_local[doc], term, len);
+}
@@ -0,0 +1,53 @@
+//---------------------------------------------------------------------------------
+// rank.h
+// BM25 relevance ranking of notes for a search query, over a full-text index
+// kept in the notes directory as segments (see segment.h).
+//---------------------------------------------------------------------------------
+
+#ifndef RANK_H
+#define RANK_H
+
+#include <3ds.h>
+
+#include "search.h"
+
+#define RANK_TOP_K      10    // Results ranked for display
+#define RANK_TERM_LEN   24    // Longer words are indexed by their first 23 bytes
+#define RANK_NO_OFFSET  0xFFFFFFFF
+#define RANK_FLUSH_DOCS 4     // Changed notes held in memory before they are written out
+
+// Load the index and bring it up to date with documents 0..count-1, which
+// are read through `doc` from then on. Titles are the names notes are
+// indexed under, so they must be unique. Only notes whose text differs from
+// what was indexed are tokenized again. Call after storage_init(). Returns
+// false if memory runs out.
+bool rank_sync(int count, SearchDocFn doc, void* arg);
+
+// Document `id` was added or its text changed
+bool rank_update(int id);
+
+// Swap in a segment merge the worker has finished. Call once per frame.
+void rank_poll(void);
+
+// Write out the changes still held in memory and free the index. Call after
+// worker_exit().
+void rank_exit(void);
+
+// True for the index segment files in the notes directory, which are not notes
+bool rank_is_file(const char* name);
+
+// Rank documents for `query`, whose words are matched as prefixes of indexed
+// words. If `filter` is given, only the `filterCount` documents it lists are
+// considered. Writes up to `k` IDs, best first, and returns how many.
+int rank_top(const char* query, const u16* filter, int filterCount, u16* ids, float* scores, int k);
+
+// Byte offset in the body of document `doc` of the first indexed word that
+// a word of `query` is a prefix of, or -1 if there is none in the body
+s32 rank_locate(const char* query, int doc);
+
+// False if the body of document `doc` certainly does not contain `term`,
+// case-folded with utf8_fold(), going by the Bloom filter in its segment.
+// Documents the index does not hold always pass.
+bool rank_may_contain(int doc, const char* term, size_t len);
+
+#endif // RANK_H
@@ -0,0 +1,652 @@
+//---------------------------------------------------------------------------------
+// regexp.c
+// Patterns are parsed into a syntax tree and compiled to a Thompson NFA. The
+// NFA is never simulated directly: DFA states (sets of NFA states) are built
+// on demand as the text is scanned, and their transitions are cached, so
+// each byte usually costs one table lookup. The cache is bounded; when it
+// fills up it is emptied and rebuilt from the current state, which keeps
+// memory fixed without giving up linear time.
+//
+// Bytes that every character set treats alike share one equivalence class,
+// which keeps the transition tables small. A second, reversed NFA is run
+// backwards from the end of a match to find where it starts.
+//---------------------------------------------------------------------------------
+
+#include "regexp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define REGEX_MAX_NODES   128
+#define REGEX_MAX_SETS    64
+#define REGEX_MAX_STATES  256   // NFA states, for both directions
+#define REGEX_MAX_REPEAT  32    // Largest count in {m,n}
+#define REGEX_DFA_STATES  64    // Cached DFA states per direction
+#define REGEX_STATE_WORDS (REGEX_MAX_STATES / 32)
+
+typedef enum {
+    NODE_EMPTY,
+    NODE_SET,        // One byte from `set`
+    NODE_CAT,        // `a` then `b`
+    NODE_ALT,        // `a` or `b`
+    NODE_REPEAT      // `a` between `min` and `max` times; max -1 is unbounded
+} NodeType;
+
+typedef struct {
+    u8 type;
+    u8 set;
+    s16 a, b;
+    s16 min, max;
+} Node;
+
+typedef enum {
+    NFA_SET,         // Consume a byte in `set`, go to `out`
+    NFA_SPLIT,       // Go to both `out` and `out1`
+    NFA_MATCH
+} NfaOp;
+
+typedef struct {
+    u8 op;
+    u8 set;
+    s16 out, out1;
+} NfaState;
+
+typedef struct {
+    u32 bits[REGEX_STATE_WORDS];   // NFA states reached
+    bool match;
+    bool dead;                     // No NFA state left: nothing more can match
+} DfaState;
+
+typedef struct {
+    int nfaStart;
+    bool anchored;   // Unanchored DFAs restart the NFA at every byte
+    int count;
+    int startState;  // DFA state for the NFA start, or -1 after a flush
+    DfaState states[REGEX_DFA_STATES];
+    s16* next;       // [state * classCount + class], -1 until built
+} Dfa;
+
+struct Regex {
+    NfaState nfa[REGEX_MAX_STATES];
+    int nfaCount;
+    u32 sets[REGEX_MAX_SETS][8];
+    int setCount;
+    u8 classOf[256];
+    u8 classByte[256];   // A byte from each class
+    int classCount;
+    Dfa forward, reverse;
+    char literal[REGEX_LITERAL_LEN];
+};
+
+typedef struct {
+    const char* p;
+    const char* error;
+    Node nodes[REGEX_MAX_NODES];
+    int nodeCount;
+    Regex* re;
+} Parser;
+
+// What the literal prefilter knows about a subpattern; see analyze()
+typedef struct {
+    bool exact;                        // Matches only `prefix`
+    char prefix[REGEX_LITERAL_LEN];    // Every match starts with this
+    char suffix[REGEX_LITERAL_LEN];    // Every match ends with this
+    char best[REGEX_LITERAL_LEN];      // Every match contains this
+} Literals;
+
+//---------------------------------------------------------------------------------
+// Parsing
+//---------------------------------------------------------------------------------
+static inline void set_add(u32* set, u8 c) {
+    set[c >> 5] |= 1u << (c & 31);
+}
+
+static inline bool set_has(const u32* set, u8 c) {
+    return set[c >> 5] & (1u << (c & 31));
+}
+
+static void set_add_range(u32* set, u8 lo, u8 hi) {
+    for (int c = lo; c <= hi; c++) set_add(set, c);
+}
+
+static int add_node(Parser* ps, NodeType type, int a, int b) {
+    if (ps->nodeCount == REGEX_MAX_NODES) {
+        ps->error = "pattern too complex";
+        return -1;
+    }
+    Node* node = &ps->nodes[ps->nodeCount];
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    node->a = a;
+    node->b = b;
+    return ps->nodeCount++;
+}
+
+// Node matching one byte of `set`, sharing identical sets
+static int add_set(Parser* ps, const u32* set) {
+    Regex* re = ps->re;
+    int index = 0;
+    while (index < re->setCount && memcmp(re->sets[index], set, sizeof(re->sets[0])) != 0) index++;
+    if (index == re->setCount) {
+        if (re->setCount == REGEX_MAX_SETS) {
+            ps->error = "too many character classes";
+            return -1;
+        }
+        memcpy(re->sets[re->setCount++], set, sizeof(re->sets[0]));
+    }
+    int node = add_node(ps, NODE_SET, -1, -1);
+    if (node >= 0) ps->nodes[node].set = index;
+    return node;
+}
+
+// Add the bytes of a backslash escape to `set`; `c` follows the backslash
+static void escape_set(u32* set, char c) {
+    u32 tmp[8] = { 0 };
+    bool negate = c == 'D' || c == 'W' || c == 'S';
+    switch (c) {
+        case 'd': case 'D':
+            set_add_range(tmp, '0', '9');
+            break;
+        case 'w': case 'W':
+            set_add_range(tmp, '0', '9');
+            set_add_range(tmp, 'a', 'z');
+            set_add_range(tmp, 'A', 'Z');
+            set_add(tmp, '_');
+            break;
+        case 's': case 'S':
+            set_add(tmp, ' ');
+            set_add_range(tmp, '\t', '\r');
+            break;
+        case 'n': set_add(tmp, '\n'); break;
+        case 't': set_add(tmp, '\t'); break;
+        default:  set_add(tmp, c); break;
+    }
+    for (int i = 0; i < 8; i++) set[i] |= negate ? ~tmp[i] : tmp[i];
+}
+
+static int parse_class(Parser* ps) {
+    u32 set[8] = { 0 };
+    bool negate = *ps->p == '^';
+    if (negate) ps->p++;
+
+    // A ] right after [ or [^ is a literal
+    bool first = true;
+    while (*ps->p && (*ps->p != ']' || first)) {
+        first = false;
+        u8 lo = *ps->p++;
+        if (lo == '\\') {
+            if (!*ps->p) break;
+            char e = *ps->p++;
+            if (strchr("dDwWsS", e)) {
+                escape_set(set, e);
+                continue;
+            }
+            lo = e == 'n' ? '\n' : e == 't' ? '\t' : e;
+        }
+        if (ps->p[0] == '-' && ps->p[1] && ps->p[1] != ']') {
+            u8 hi = ps->p[1];
+            ps->p += 2;
+            if (hi == '\\' && *ps->p) hi = *ps->p++;
+            if (hi < lo) {
+                ps->error = "bad range";
+                return -1;
+            }
+            set_add_range(set, lo, hi);
+        } else {
+            set_add(set, lo);
+        }
+    }
+    if (*ps->p != ']') {
+        ps->error = "missing ]";
+        return -1;
+    }
+    ps->p++;
+    if (negate) {
+        for (int i = 0; i < 8; i++) set[i] = ~set[i];
+    }
+    return add_set(ps, set);
+}
+
+static int parse_alt(Parser* ps);
+
+static int parse_atom(Parser* ps) {
+    u32 set[8] = { 0 };
+    char c = *ps->p++;
+    switch (c) {
+        case '(': {
+            int node = parse_alt(ps);
+            if (node < 0) return -1;
+            if (*ps->p != ')') {
+                ps->error = "missing )";
+                return -1;
+            }
+            ps->p++;
+            return node;
+        }
+        case '[':
+            return parse_class(ps);
+        case '.':
+            for (int i = 0; i < 8; i++) set[i] = ~0u;
+            set[0] &= ~(1u << '\n');
+            return add_set(ps, set);
+        case '\\':
+            if (!*ps->p) {
+                ps->error = "trailing \\";
+                return -1;
+            }
+            escape_set(set, *ps->p++);
+            return add_set(ps, set);
+        case '*': case '+': case '?':
+            ps->error = "nothing to repeat";
+            return -1;
+        default:
+            set_add(set, c);
+            return add_set(ps, set);
+    }
+}
+
+static int parse_count(Parser* ps) {
+    int n = 0;
+    while (*ps->p >= '0' && *ps->p <= '9' && n <= REGEX_MAX_REPEAT) n = n * 10 + (*ps->p++ - '0');
+    return n;
+}
+
+static int parse_repeat(Parser* ps) {
+    int node = parse_atom(ps);
+    while (node >= 0) {
+        int min, max;
+        char c = *ps->p;
+        if (c == '*') min = 0, max = -1;
+        else if (c == '+') min = 1, max = -1;
+        else if (c == '?') min = 0, max = 1;
+        else if (c == '{' && ps->p[1] >= '0' && ps->p[1] <= '9') {
+            ps->p++;
+            min = max = parse_count(ps);
+            if (*ps->p == ',') {
+                ps->p++;
+                max = (*ps->p == '}') ? -1 : parse_count(ps);
+            }
+            if (*ps->p != '}') {
+                ps->error = "missing }";
+                return -1;
+            }
+            if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT || (max >= 0 && max < min)) {
+                ps->error = "bad repeat count";
+                return -1;
+            }
+        }
+        else break;
+        ps->p++;
+
+        int repeat = add_node(ps, NODE_REPEAT, node, -1);
+        if (repeat < 0) return -1;
+        ps->nodes[repeat].min = min;
+        ps->nodes[repeat].max = max;
+        node = repeat;
+    }
+    return node;
+}
+
+static int parse_cat(Parser* ps) {
+    int node = -1;
+    while (*ps->p && *ps->p != '|' && *ps->p != ')') {
+        int next = parse_repeat(ps);
+        if (next < 0) return -1;
+        node = node < 0 ? next : add_node(ps, NODE_CAT, node, next);
+        if (node < 0) return -1;
+    }
+    return node < 0 ? add_node(ps, NODE_EMPTY, -1, -1) : node;
+}
+
+static int parse_alt(Parser* ps) {
+    int node = parse_cat(ps);
+    while (node >= 0 && *ps->p == '|') {
+        ps->p++;
+        int next = parse_cat(ps);
+        node = next < 0 ? -1 : add_node(ps, NODE_ALT, node, next);
+    }
+    return node;
+}
+
+//---------------------------------------------------------------------------------
+// Required literals
+//---------------------------------------------------------------------------------
+
+// Keep the longest of the strings offered
+static void offer(char* best, const char* candidate) {
+    if (strlen(candidate) > strlen(best)) strcpy(best, candidate);
+}
+
+// Concatenate into `out`; `tail` keeps the end of an overlong result rather
+// than its start. Any piece of a required literal is itself required.
+static bool join(char* out, const char* a, const char* b, bool tail) {
+    char buf[2 * REGEX_LITERAL_LEN];
+    size_t len = strlen(a) + strlen(b);
+    strcpy(buf, a);
+    strcat(buf, b);
+    bool fits = len < REGEX_LITERAL_LEN;
+    const char* src = (fits || !tail) ? buf : buf + len - (REGEX_LITERAL_LEN - 1);
+    strncpy(out, src, REGEX_LITERAL_LEN - 1);
+    out[REGEX_LITERAL_LEN - 1] = '\0';
+    return fits;
+}
+
+static Literals analyze(const Parser* ps, const Regex* re, int index) {
+    Literals lit;
+    memset(&lit, 0, sizeof(lit));
+    const Node* node = &ps->nodes[index];
+
+    switch (node->type) {
+        case NODE_EMPTY:
+            lit.exact = true;
+            break;
+        case NODE_SET: {
+            int members = 0, last = 0;
+            for (int c = 1; c < 256 && members < 2; c++) {
+                if (set_has(re->sets[node->set], c)) members++, last = c;
+            }
+            if (members == 1) {
+                lit.exact = true;
+                lit.prefix[0] = lit.suffix[0] = lit.best[0] = last;
+            }
+            break;
+        }
+        case NODE_CAT: {
+            // Concatenations nest to the left; fold the chain in order
+            // rather than recursing down it
+            s16 parts[REGEX_MAX_NODES];
+            int count = 0;
+            for (; ps->nodes[index].type == NODE_CAT; index = ps->nodes[index].a) {
+                parts[count++] = ps->nodes[index].b;
+            }
+            lit = analyze(ps, re, index);
+            while (count > 0) {
+                Literals b = analyze(ps, re, parts[--count]);
+                char bridge[REGEX_LITERAL_LEN];
+                join(bridge, lit.suffix, b.prefix, false);
+                offer(lit.best, b.best);
+                offer(lit.best, bridge);
+
+                bool fits = true;
+                if (lit.exact) fits = join(lit.prefix, lit.prefix, b.prefix, false);
+                if (b.exact) join(lit.suffix, lit.suffix, b.suffix, true);
+                else strcpy(lit.suffix, b.suffix);
+                lit.exact = lit.exact && b.exact && fits;
+            }
+            break;
+        }
+        case NODE_ALT: {
+            // Either side could match, so neither side's literals are
+            // required, unless both sides are the same literal
+            Literals a = analyze(ps, re, node->a);
+            Literals b = analyze(ps, re, node->b);
+            if (a.exact && b.exact && strcmp(a.prefix, b.prefix) == 0) lit = a;
+            break;
+        }
+        case NODE_REPEAT:
+            if (node->min > 0) {
+                Literals a = analyze(ps, re, node->a);
+                strcpy(lit.prefix, a.prefix);
+                strcpy(lit.suffix, a.suffix);
+                strcpy(lit.best, a.best);
+                lit.exact = a.exact && node->min == 1 && node->max == 1;
+            }
+            break;
+    }
+    return lit;
+}
+
+//---------------------------------------------------------------------------------
+// NFA construction
+//---------------------------------------------------------------------------------
+static int add_state(Regex* re, NfaOp op, int set, int out, int out1) {
+    if (re->nfaCount == REGEX_MAX_STATES) return -1;
+    re->nfa[re->nfaCount] = (NfaState){ op, set, out, out1 };
+    return re->nfaCount++;
+}
+
+// States matching `index` followed by whatever starts at `next`. Built
+// backwards, so no dangling edges need patching; `reverse` builds the
+// reversed pattern. Returns -1 if the state table is full.
+static int emit(const Parser* ps, Regex* re, int index, int next, bool reverse) {
+    if (next < 0) return -1;
+    const Node* node = &ps->nodes[index];
+
+    switch (node->type) {
+        case NODE_EMPTY:
+            return next;
+        case NODE_SET:
+            return add_state(re, NFA_SET, node->set, next, -1);
+        case NODE_CAT:
+            if (reverse) return emit(ps, re, node->b, emit(ps, re, node->a, next, reverse), reverse);
+            return emit(ps, re, node->a, emit(ps, re, node->b, next, reverse), reverse);
+        case NODE_ALT: {
+            int a = emit(ps, re, node->a, next, reverse);
+            int b = emit(ps, re, node->b, next, reverse);
+            return (a < 0 || b < 0) ? -1 : add_state(re, NFA_SPLIT, 0, a, b);
+        }
+        case NODE_REPEAT: {
+            int tail = next;
+            if (node->max < 0) {
+                // Loop: a split that either enters the body, which leads
+                // back to it, or moves on
+                int loop = add_state(re, NFA_SPLIT, 0, -1, next);
+                int body = emit(ps, re, node->a, loop, reverse);
+                if (loop < 0 || body < 0) return -1;
+                re->nfa[loop].out = body;
+                tail = loop;
+            } else {
+                for (int i = node->min; i < node->max && tail >= 0; i++) {
+                    int body = emit(ps, re, node->a, tail, reverse);
+                    tail = body < 0 ? -1 : add_state(re, NFA_SPLIT, 0, body, tail);
+                }
+            }
+            for (int i = 0; i < node->min && tail >= 0; i++) {
+                tail = emit(ps, re, node->a, tail, reverse);
+            }
+            return tail;
+        }
+    }
+    return -1;
+}
+
+// Group bytes by which sets contain them
+static void build_classes(Regex* re) {
+    u64 signatures[256];
+    re->classCount = 0;
+    for (int c = 0; c < 256; c++) {
+        u64 sig = 0;
+        for (int s = 0; s < re->setCount; s++) {
+            if (set_has(re->sets[s], c)) sig |= 1ull << s;
+        }
+        int k = 0;
+        while (k < re->classCount && signatures[k] != sig) k++;
+        if (k == re->classCount) {
+            signatures[k] = sig;
+            re->classByte[k] = c;
+            re->classCount++;
+        }
+        re->classOf[c] = k;
+    }
+}
+
+//---------------------------------------------------------------------------------
+// Lazy DFA
+//---------------------------------------------------------------------------------
+
+// Add `state` and everything reachable from it without consuming a byte
+static void closure(const Regex* re, u32* bits, int state) {
+    int stack[2 * REGEX_MAX_STATES + 1];   // Each split pushes two states once
+    int depth = 0;
+    stack[depth++] = state;
+    while (depth > 0) {
+        int s = stack[--depth];
+        if (bits[s >> 5] & (1u << (s & 31))) continue;
+        bits[s >> 5] |= 1u << (s & 31);
+        if (re->nfa[s].op == NFA_SPLIT) {
+            stack[depth++] = re->nfa[s].out1;
+            stack[depth++] = re->nfa[s].out;
+        }
+    }
+}
+
+static void dfa_flush(const Regex* re, Dfa* dfa) {
+    dfa->count = 0;
+    dfa->startState = -1;
+    memset(dfa->next, 0xFF, REGEX_DFA_STATES * re->classCount * sizeof(s16));
+}
+
+// DFA state for a set of NFA states, adding it to the cache if new. Returns
+// -1 if the cache is full.
+static int dfa_state(const Regex* re, Dfa* dfa, const u32* bits) {
+    for (int i = 0; i < dfa->count; i++) {
+        if (memcmp(dfa->states[i].bits, bits, sizeof(dfa->states[i].bits)) == 0) return i;
+    }
+    if (dfa->count == REGEX_DFA_STATES) return -1;
+
+    DfaState* state = &dfa->states[dfa->count];
+    memcpy(state->bits, bits, sizeof(state->bits));
+    state->match = false;
+    state->dead = true;
+    for (int s = 0; s < re->nfaCount; s++) {
+        if (!(bits[s >> 5] & (1u << (s & 31)))) continue;
+        state->dead = false;
+        if (re->nfa[s].op == NFA_MATCH) state->match = true;
+    }
+    return dfa->count++;
+}
+
+static int dfa_start(const Regex* re, Dfa* dfa) {
+    if (dfa->startState < 0) {
+        u32 bits[REGEX_STATE_WORDS] = { 0 };
+        closure(re, bits, dfa->nfaStart);
+        dfa->startState = dfa_state(re, dfa, bits);
+    }
+    return dfa->startState;
+}
+
+// Build the transition from `from` on byte class `cls`
+static int dfa_step(const Regex* re, Dfa* dfa, int from, int cls) {
+    u32 bits[REGEX_STATE_WORDS] = { 0 };
+    u8 c = re->classByte[cls];
+    const DfaState* state = &dfa->states[from];
+    for (int s = 0; s < re->nfaCount; s++) {
+        if (!(state->bits[s >> 5] & (1u << (s & 31)))) continue;
+        const NfaState* nfa = &re->nfa[s];
+        if (nfa->op == NFA_SET && set_has(re->sets[nfa->set], c)) closure(re, bits, nfa->out);
+    }
+    if (!dfa->anchored) closure(re, bits, dfa->nfaStart);
+
+    int to = dfa_state(re, dfa, bits);
+    if (to < 0) {
+        // Cache full: start over from the state being entered
+        dfa_flush(re, dfa);
+        return dfa_state(re, dfa, bits);
+    }
+    dfa->next[from * re->classCount + cls] = to;
+    return to;
+}
+
+static bool dfa_init(Regex* re, Dfa* dfa, int start, bool anchored) {
+    dfa->nfaStart = start;
+    dfa->anchored = anchored;
+    dfa->next = malloc(REGEX_DFA_STATES * re->classCount * sizeof(s16));
+    if (!dfa->next) return false;
+    dfa_flush(re, dfa);
+    return true;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+Regex* regex_compile(const char* pattern, const char** error) {
+    Parser* ps = malloc(sizeof(Parser));
+    Regex* re = calloc(1, sizeof(Regex));
+    if (!ps || !re) {
+        free(ps);
+        free(re);
+        *error = "out of memory";
+        return NULL;
+    }
+    ps->p = pattern;
+    ps->error = NULL;
+    ps->nodeCount = 0;
+    ps->re = re;
+
+    int root = parse_alt(ps);
+    if (root >= 0 && *ps->p == ')') ps->error = "unmatched )";
+
+    if (!ps->error) {
+        int match = add_state(re, NFA_MATCH, 0, -1, -1);
+        int forward = emit(ps, re, root, match, false);
+        int reverse = emit(ps, re, root, match, true);
+        if (forward < 0 || reverse < 0) ps->error = "pattern too complex";
+
+        if (!ps->error) {
+            Literals lit = analyze(ps, re, root);
+            strcpy(re->literal, lit.best);
+            build_classes(re);
+            if (!dfa_init(re, &re->forward, forward, false) || !dfa_init(re, &re->reverse, reverse, true)) {
+                ps->error = "out of memory";
+            }
+        }
+    }
+
+    *error = ps->error;
+    free(ps);
+    if (*error) {
+        regex_free(re);
+        return NULL;
+    }
+    return re;
+}
+
+void regex_free(Regex* re) {
+    if (!re) return;
+    free(re->forward.next);
+    free(re->reverse.next);
+    free(re);
+}
+
+bool regex_search(Regex* re, const char* text, size_t len, size_t* start, size_t* end) {
+    Dfa* dfa = &re->forward;
+    const u8* s = (const u8*)text;
+    int state = dfa_start(re, dfa);
+    size_t stop = 0;
+    bool found = dfa->states[state].match;
+
+    for (size_t i = 0; i < len && !found; i++) {
+        int cls = re->classOf[s[i]];
+        int next = dfa->next[state * re->classCount + cls];
+        state = next >= 0 ? next : dfa_step(re, dfa, state, cls);
+        if (dfa->states[state].match) {
+            found = true;
+            stop = i + 1;
+        }
+    }
+    if (!found) return false;
+    if (end) *end = stop;
+    if (!start) return true;
+
+    // Run the reversed pattern back from the end; the last point where it
+    // matches is the leftmost start of a match ending there
+    dfa = &re->reverse;
+    state = dfa_start(re, dfa);
+    size_t first = stop;
+    for (size_t i = stop; i > 0 && !dfa->states[state].dead; i--) {
+        int cls = re->classOf[s[i - 1]];
+        int next = dfa->next[state * re->classCount + cls];
+        state = next >= 0 ? next : dfa_step(re, dfa, state, cls);
+        if (dfa->states[state].match) first = i - 1;
+    }
+    *start = first;
+    return true;
+}
+
+const char* regex_literal(const Regex* re) {
+    return re->literal;
+}
@@ -0,0 +1,34 @@
+//---------------------------------------------------------------------------------
+// regexp.h
+// Regular expressions matched by a lazily built DFA, in time linear in the
+// text whatever the pattern.
+//
+// Supported: literals, ., [classes] with ranges and ^, \d \w \s \D \W \S,
+// \n \t, escaped metacharacters, grouping ( ), alternation |, and the
+// repetitions * + ? {m} {m,} {m,n}. Matching is case-sensitive and works on
+// bytes; there are no anchors, backreferences or captures.
+//---------------------------------------------------------------------------------
+
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+#define REGEX_LITERAL_LEN 32
+
+typedef struct Regex Regex;
+
+// Returns NULL and sets `error` to a short description if the pattern is
+// invalid or too large
+Regex* regex_compile(const char* pattern, const char** error);
+void regex_free(Regex* re);
+
+// Find the match that ends first in `text`. `start` and `end`, if given,
+// receive its bounds; leaving `start` NULL skips the pass that finds it.
+bool regex_search(Regex* re, const char* text, size_t len, size_t* start, size_t* end);
+
+// A literal that every match contains, for prefiltering; "" if there is none
+const char* regex_literal(const Regex* re);
+
+#endif // REGEXP_H
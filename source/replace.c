@@ -0,0 +1,387 @@
+//---------------------------------------------------------------------------------
+// replace.c
+// Find and replace. The job runs in two phases on the worker thread:
+//
+// 1. Each note is streamed through a KMP matcher a chunk at a time and the
+//    result written to .rpl-new-<name>; notes without a match are left
+//    alone. Nothing visible has changed yet, so any failure just deletes
+//    the temporary files.
+// 2. The names of the changed notes are written to the journal, a set of
+//    replace/<name> keys added to the metadata store in one commit. Each
+//    note is then moved to .rpl-old-<name> and its replacement moved into
+//    place. Deleting the keys, again in one commit, commits the replace;
+//    the old copies go after it.
+//
+// If the app stops in phase 2, replace_recover() finds the journal at the
+// next start and puts every old copy back, so a replace is all or nothing.
+// A failed replace is undone the same way. Either way a key is only deleted
+// once its note is back in place, and an old copy is never deleted while a
+// key still names its note.
+//---------------------------------------------------------------------------------
+
+#include "replace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kv.h"
+#include "prof.h"
+#include "storage.h"
+#include "worker.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define REPLACE_PREFIX  ".rpl-"
+#define REPLACE_JOURNAL ".rpl-journal"   // Journal file of older versions
+#define REPLACE_KEY     "replace/"       // Journal keys in the metadata store
+#define REPLACE_CHUNK   512
+
+typedef struct {
+    char* pool;          // The note names, NUL-terminated, back to back
+    u32* names;          // Offset of each name in the pool
+    u8* changed;
+    int count;
+    char find[REPLACE_TEXT_LEN];
+    char with[REPLACE_TEXT_LEN];
+    size_t findLen, withLen;
+    u8 fail[REPLACE_TEXT_LEN];   // KMP failure function of `find`
+} ReplaceJob;
+
+// Output buffer of the note being rewritten
+typedef struct {
+    StorageFile* file;
+    u8 buf[REPLACE_CHUNK];
+    size_t len;
+} Output;
+
+static ReplaceJob s_job;
+static ReplaceProgress s_progress;   // Guarded by s_lock
+static LightLock s_lock;
+static bool s_lockReady = false;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static void temp_name(char* buf, const char* kind, const char* name) {
+    snprintf(buf, STORAGE_NAME_LEN, REPLACE_PREFIX "%s-%s", kind, name);
+}
+
+static const char* job_name(int index) {
+    return s_job.pool + s_job.names[index];
+}
+
+static void set_progress(int scanned, int changed, u32 replacements) {
+    LightLock_Lock(&s_lock);
+    s_progress.scanned = scanned;
+    s_progress.changed = changed;
+    s_progress.replacements = replacements;
+    LightLock_Unlock(&s_lock);
+}
+
+static void set_state(ReplaceState state) {
+    LightLock_Lock(&s_lock);
+    s_progress.state = state;
+    LightLock_Unlock(&s_lock);
+}
+
+static void emit(Output* out, const void* data, size_t len) {
+    const u8* p = data;
+    while (len > 0) {
+        size_t n = REPLACE_CHUNK - out->len;
+        if (n > len) n = len;
+        memcpy(out->buf + out->len, p, n);
+        out->len += n;
+        p += n;
+        len -= n;
+        if (out->len == REPLACE_CHUNK) {
+            storage_file_write(out->file, out->buf, out->len);
+            out->len = 0;
+        }
+    }
+}
+
+// Stream note `name` into `temp` with every match replaced. Returns the
+// number of replacements, or -1 on error.
+static s32 rewrite(const char* name, const char* temp) {
+    StorageFile* in = storage_open(name, false);
+    if (!in) return -1;
+    Output out = { storage_open(temp, true), { 0 }, 0 };
+    if (!out.file) {
+        storage_close(in);
+        return -1;
+    }
+
+    // k bytes of `find` are matched and held back; when a byte breaks the
+    // match, the part of them that can no longer start one is written out
+    u8 chunk[REPLACE_CHUNK];
+    s32 count = 0, got;
+    size_t k = 0;
+    while ((got = storage_file_read(in, chunk, sizeof(chunk))) > 0) {
+        for (s32 i = 0; i < got; i++) {
+            u8 c = chunk[i];
+            while (k > 0 && (u8)s_job.find[k] != c) {
+                emit(&out, s_job.find, k - s_job.fail[k]);
+                k = s_job.fail[k];
+            }
+            if ((u8)s_job.find[k] == c) k++;
+            else emit(&out, &c, 1);
+
+            if (k == s_job.findLen) {
+                emit(&out, s_job.with, s_job.withLen);
+                count++;
+                k = 0;
+            }
+        }
+    }
+    emit(&out, s_job.find, k);
+    storage_file_write(out.file, out.buf, out.len);
+
+    bool ok = got == 0;
+    storage_close(in);
+    ok = storage_close(out.file) && ok;
+    return ok ? count : -1;
+}
+
+// Undo the swap for `name`, whichever step it reached. Returns false if the
+// old copy could not be moved back; it is then still in place for a retry.
+static bool roll_back(const char* name) {
+    char old[STORAGE_NAME_LEN], fresh[STORAGE_NAME_LEN];
+    temp_name(old, "old", name);
+    temp_name(fresh, "new", name);
+    if (storage_exists(old)) {
+        storage_remove(name);
+        if (!storage_rename(old, name)) return false;
+    }
+    storage_remove(fresh);
+    return true;
+}
+
+// Add or remove the journal keys of the changed notes, all in one commit
+static bool write_journal(bool add) {
+    KvTxn* txn = kv_begin();
+    for (int i = 0; i < s_job.count; i++) {
+        char key[KV_KEY_LEN];
+        if (!s_job.changed[i]) continue;
+        snprintf(key, sizeof(key), REPLACE_KEY "%s", job_name(i));
+        if (add) kv_put(txn, key, NULL, 0);
+        else kv_delete(txn, key);
+    }
+    return kv_commit(txn);
+}
+
+static bool recover_note(const char* key, const void* value, size_t len, void* txn) {
+    (void)value;
+    (void)len;
+    if (roll_back(key + strlen(REPLACE_KEY))) kv_delete(txn, key);
+    return true;
+}
+
+// True if the journal still names the note that temporary file `name` is
+// a copy of
+static bool journaled(const char* name) {
+    char key[KV_KEY_LEN];
+    const char* note = strchr(name + sizeof(REPLACE_PREFIX) - 1, '-');
+    if (!note) return false;
+    snprintf(key, sizeof(key), REPLACE_KEY "%s", note + 1);
+    return kv_get(key, NULL, 0) >= 0;
+}
+
+static bool commit(void) {
+    if (!write_journal(true)) return false;
+
+    for (int i = 0; i < s_job.count; i++) {
+        if (!s_job.changed[i]) continue;
+        char old[STORAGE_NAME_LEN], fresh[STORAGE_NAME_LEN];
+        temp_name(old, "old", job_name(i));
+        temp_name(fresh, "new", job_name(i));
+        if (!storage_rename(job_name(i), old) || !storage_rename(fresh, job_name(i))) {
+            return false;
+        }
+    }
+    if (!write_journal(false)) return false;
+
+    // Committed; the old copies are just garbage now
+    for (int i = 0; i < s_job.count; i++) {
+        char old[STORAGE_NAME_LEN];
+        if (!s_job.changed[i]) continue;
+        temp_name(old, "old", job_name(i));
+        storage_remove(old);
+    }
+    return true;
+}
+
+static void replace_job(void* unused) {
+    (void)unused;
+    int changed = 0;
+    u32 replacements = 0;
+    bool ok = true;
+    prof_begin("replace");
+
+    for (int i = 0; i < s_job.count && ok; i++) {
+        char fresh[STORAGE_NAME_LEN];
+        temp_name(fresh, "new", job_name(i));
+        s32 count = rewrite(job_name(i), fresh);
+        if (count > 0) {
+            s_job.changed[i] = 1;
+            changed++;
+            replacements += count;
+        } else {
+            storage_remove(fresh);
+        }
+        ok = count >= 0;
+        set_progress(i + 1, changed, replacements);
+    }
+
+    if (ok && changed > 0) ok = commit();
+    if (!ok) {
+        // Put every note back before the keys go. If one cannot be, the
+        // journal stays and replace_recover() retries at the next start.
+        bool restored = true;
+        for (int i = 0; i < s_job.count; i++) {
+            if (s_job.changed[i]) restored = roll_back(job_name(i)) && restored;
+        }
+        if (restored) write_journal(false);
+        memset(s_job.changed, 0, s_job.count);
+    }
+    prof_end();
+    set_state(ok ? REPLACE_DONE : REPLACE_FAILED);
+}
+
+static void free_job(void) {
+    free(s_job.pool);
+    free(s_job.names);
+    free(s_job.changed);
+    s_job.pool = NULL;
+    s_job.names = NULL;
+    s_job.changed = NULL;
+    s_job.count = 0;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void replace_recover(void) {
+    char line[STORAGE_NAME_LEN];
+    size_t len = 0;
+
+    // Restore every note the journal lists, dropping the keys of the ones
+    // put back. A journal commit cut short by a crash is dropped by the
+    // store, and no note was touched before it.
+    KvTxn* txn = kv_begin();
+    kv_scan_prefix(REPLACE_KEY, recover_note, txn);
+
+    // The same for a journal file left by an older version; a note that
+    // cannot be put back gets a key instead
+    StorageFile* journal = storage_open(REPLACE_JOURNAL, false);
+    if (journal) {
+        char chunk[REPLACE_CHUNK];
+        s32 got;
+        while ((got = storage_file_read(journal, chunk, sizeof(chunk))) > 0) {
+            for (s32 i = 0; i < got; i++) {
+                if (chunk[i] != '\n') {
+                    if (len < sizeof(line) - 1) line[len++] = chunk[i];
+                    continue;
+                }
+                line[len] = '\0';
+                if (len > 0 && !roll_back(line)) {
+                    char key[KV_KEY_LEN];
+                    snprintf(key, sizeof(key), REPLACE_KEY "%s", line);
+                    kv_put(txn, key, NULL, 0);
+                }
+                len = 0;
+            }
+        }
+        storage_close(journal);
+    }
+    if (!kv_commit(txn)) return;   // Keep every copy until the journal is right
+    if (journal) storage_remove(REPLACE_JOURNAL);
+
+    // Anything else left over is from before a commit, or after one, except
+    // the old copies of notes still journaled
+    StorageDir* dir = storage_dir_open();
+    if (!dir) return;
+    StorageEntry entry;
+    while (storage_dir_next(dir, &entry)) {
+        if (!entry.isDir && replace_is_temp(entry.name) && !journaled(entry.name)) {
+            storage_remove(entry.name);
+        }
+    }
+    storage_dir_close(dir);
+}
+
+bool replace_start(const char* const* names, int count, const char* find, const char* with) {
+    if (!s_lockReady) {
+        LightLock_Init(&s_lock);
+        s_lockReady = true;
+    }
+    size_t findLen = strlen(find), withLen = strlen(with);
+    if (s_progress.state != REPLACE_IDLE || findLen == 0 || findLen >= REPLACE_TEXT_LEN ||
+        withLen >= REPLACE_TEXT_LEN || count <= 0) {
+        return false;
+    }
+
+    size_t poolLen = 0;
+    for (int i = 0; i < count; i++) poolLen += strlen(names[i]) + 1;
+    s_job.pool = malloc(poolLen);
+    s_job.names = malloc(count * sizeof(u32));
+    s_job.changed = calloc(count, 1);
+    if (!s_job.pool || !s_job.names || !s_job.changed) {
+        free_job();
+        return false;
+    }
+    poolLen = 0;
+    for (int i = 0; i < count; i++) {
+        s_job.names[i] = poolLen;
+        strcpy(s_job.pool + poolLen, names[i]);
+        poolLen += strlen(names[i]) + 1;
+    }
+    s_job.count = count;
+
+    memcpy(s_job.find, find, findLen + 1);
+    memcpy(s_job.with, with, withLen + 1);
+    s_job.findLen = findLen;
+    s_job.withLen = withLen;
+    s_job.fail[0] = s_job.fail[1] = 0;
+    for (size_t i = 1, k = 0; i < findLen; i++) {
+        while (k > 0 && find[i] != find[k]) k = s_job.fail[k];
+        if (find[i] == find[k]) k++;
+        s_job.fail[i + 1] = k;
+    }
+
+    s_progress = (ReplaceProgress){ REPLACE_RUNNING, count, 0, 0, 0 };
+    if (!worker_submit(replace_job, NULL)) {
+        s_progress.state = REPLACE_IDLE;
+        free_job();
+        return false;
+    }
+    return true;
+}
+
+void replace_progress(ReplaceProgress* out) {
+    if (!s_lockReady) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    LightLock_Lock(&s_lock);
+    *out = s_progress;
+    LightLock_Unlock(&s_lock);
+}
+
+bool replace_changed(int index) {
+    return s_progress.state == REPLACE_DONE && index >= 0 && index < s_job.count && s_job.changed[index];
+}
+
+void replace_finish(void) {
+    ReplaceProgress progress;
+    replace_progress(&progress);
+    if (progress.state == REPLACE_RUNNING) return;
+    free_job();
+    s_progress.state = REPLACE_IDLE;
+}
+
+bool replace_is_temp(const char* name) {
+    return strncmp(name, REPLACE_PREFIX, sizeof(REPLACE_PREFIX) - 1) == 0;
+}
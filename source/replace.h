@@ -0,0 +1,52 @@
+//---------------------------------------------------------------------------------
+// replace.h
+// Find and replace across notes, run on the background worker. Each note is
+// streamed through the replacement into a temporary file, and the changed
+// notes are swapped in together under a journal, so either every note is
+// replaced or none is, even across a power cut.
+//---------------------------------------------------------------------------------
+
+#ifndef REPLACE_H
+#define REPLACE_H
+
+#include <3ds.h>
+
+#define REPLACE_TEXT_LEN 64    // Longest find or replacement text, with terminator
+
+typedef enum {
+    REPLACE_IDLE,
+    REPLACE_RUNNING,
+    REPLACE_DONE,
+    REPLACE_FAILED     // Nothing was changed
+} ReplaceState;
+
+typedef struct {
+    ReplaceState state;
+    int total;         // Notes to scan
+    int scanned;
+    int changed;       // Notes with at least one replacement
+    u32 replacements;
+} ReplaceProgress;
+
+// Roll back a replace that was interrupted before it committed. Call after
+// kv_open() and before the notes are loaded.
+void replace_recover(void);
+
+// Replace every occurrence of `find` (case-sensitive) with `with` in the
+// `count` notes named in `names`, which are copied. Returns false if a
+// replace is already in progress or the job cannot be queued.
+bool replace_start(const char* const* names, int count, const char* find, const char* with);
+
+void replace_progress(ReplaceProgress* out);
+
+// Once REPLACE_DONE: whether names[index] was changed
+bool replace_changed(int index);
+
+// Release a finished replace so another can start
+void replace_finish(void);
+
+// True for the temporary and journal files a replace leaves in the notes
+// directory, which are not notes
+bool replace_is_temp(const char* name);
+
+#endif // REPLACE_H
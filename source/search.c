@@ -0,0 +1,382 @@
+//---------------------------------------------------------------------------------
+// search.c
+// Incremental search. A query matches a document when every space-separated
+// term occurs in its title or body, ignoring case (see utf8_fold()). Appending to a query
+// can only narrow its results, so each prefix typed so far keeps its result
+// set on a stack of levels, all held in one arena: a level is scanned from
+// the results of the level below it rather than from the whole library, and
+// backspacing returns to a cached level without scanning anything.
+//
+// Only the top level is ever scanned, and it appends its matches to the end
+// of the arena as it goes, so results stream in under a time budget.
+//
+// Regex queries cannot reuse the levels, since extending a pattern does not
+// always narrow it. Each pattern gets a single level instead, scanned from
+// the notes the trigram index says contain its required literal.
+//
+// A term missing from a document's title is looked up in the filter, if one
+// is set, before the body is scanned for it.
+//---------------------------------------------------------------------------------
+
+#include "search.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "regexp.h"
+#include "trigram.h"
+#include "utf8.h"
+#include "util.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define SEARCH_MAX_TERMS   8
+#define SEARCH_ARENA_SETS  4    // Full-size result sets the arena can hold
+#define SEARCH_CHECK_EVERY 32   // Documents matched between clock reads
+
+typedef struct {
+    char query[SEARCH_MAX_QUERY];
+    u32 start;       // First result in the arena
+    u32 count;
+    u32 cursor;      // Next candidate of the source to test
+    int firstTerm;   // Terms before this one are known to match every candidate
+    bool complete;
+} SearchLevel;
+
+static int s_docCount = 0;
+static SearchDocFn s_doc = NULL;
+static void* s_docArg = NULL;
+static SearchFilterFn s_filter = NULL;
+static void* s_filterArg = NULL;
+static SearchFilterStats s_filterStats;
+
+static u16* s_arena = NULL;
+static u32 s_arenaCap = 0;
+static SearchLevel s_levels[SEARCH_MAX_QUERY];
+static int s_levelCount = 0;
+
+static char s_terms[SEARCH_MAX_TERMS][SEARCH_MAX_QUERY];
+static u8 s_termLens[SEARCH_MAX_TERMS];
+static bool s_termWide[SEARCH_MAX_TERMS];   // Has non-ASCII bytes
+static int s_termCount = 0;
+
+static u8 s_fold[256];
+static u8 s_rarity[256];   // Higher for bytes less common in prose
+
+// Regex mode: the candidates are at the start of the arena, or every
+// document if the pattern has no usable literal
+static bool s_regexMode = false;
+static Regex* s_regex = NULL;
+static const char* s_regexError = NULL;
+static u32 s_candCount = 0;
+static bool s_candAll = false;
+
+//---------------------------------------------------------------------------------
+// Matching
+//---------------------------------------------------------------------------------
+static int parse_terms(const char* query) {
+    s_termCount = 0;
+    const u8* p = (const u8*)query;
+    while (*p && s_termCount < SEARCH_MAX_TERMS) {
+        while (*p == ' ') p++;
+        size_t len = 0;
+        bool wide = false;
+        while (p[len] && p[len] != ' ') wide |= p[len++] >= 0x80;
+        if (len == 0) break;
+        s_termWide[s_termCount] = wide;
+        s_termLens[s_termCount] = utf8_fold((const char*)p, len, s_terms[s_termCount], SEARCH_MAX_QUERY);
+        s_termCount++;
+        p += len;
+    }
+    return s_termCount;
+}
+
+// Case-insensitive substring test for a term with non-ASCII letters, folding
+// the text a code point at a time
+static bool contains_wide(const char* text, const char* term, size_t len) {
+    for (const char* t = text; *t; utf8_decode(&t, UTF8_MAX_LEN)) {
+        const char* p = t;
+        size_t i = 0;
+        while (i < len && *p) {
+            const char* start = p;
+            u32 cp = utf8_decode(&p, UTF8_MAX_LEN);
+            size_t n = p - start;
+            char folded[UTF8_MAX_LEN];
+            if (cp == UTF8_INVALID) folded[0] = *start;
+            else utf8_encode(utf8_fold_char(cp), folded);
+            if (i + n > len || memcmp(folded, term + i, n) != 0) break;
+            i += n;
+        }
+        if (i == len) return true;
+    }
+    return false;
+}
+
+// Case-insensitive substring test; `term` is already folded. The library's
+// strcspn() skips ahead to each occurrence of the term's rarest letter in
+// either case, which in prose is seldom, and the rest is compared around it.
+static bool contains(const char* text, const char* term, size_t len) {
+    const u8* k = (const u8*)term;
+    size_t anchor = 0;
+    for (size_t i = 1; i < len; i++) {
+        if (s_rarity[k[i]] > s_rarity[k[anchor]]) anchor = i;
+    }
+    char set[3] = { k[anchor], 0, 0 };
+    if (k[anchor] >= 'a' && k[anchor] <= 'z') set[1] = k[anchor] - ('a' - 'A');
+
+    for (const char* t = text + strcspn(text, set); *t; t += 1 + strcspn(t + 1, set)) {
+        if ((size_t)(t - text) < anchor) continue;
+        const char* start = t - anchor;
+        size_t i = 0;
+        while (i < len && start[i] && s_fold[(u8)start[i]] == k[i]) i++;
+        if (i == len) return true;
+    }
+    return false;
+}
+
+static bool matches(int id, int firstTerm) {
+    SearchDoc doc = { "", "" };
+    s_doc(id, &doc, s_docArg);
+    if (s_regex) {
+        return regex_search(s_regex, doc.title, strlen(doc.title), NULL, NULL) ||
+               regex_search(s_regex, doc.body, strlen(doc.body), NULL, NULL);
+    }
+    for (int i = firstTerm; i < s_termCount; i++) {
+        bool (*test)(const char*, const char*, size_t) = s_termWide[i] ? contains_wide : contains;
+        if (test(doc.title, s_terms[i], s_termLens[i])) continue;
+
+        bool checked = false;
+        if (s_filter && s_termLens[i] >= 3) {
+            s_filterStats.checks++;
+            if (!s_filter(id, s_terms[i], s_termLens[i], s_filterArg)) {
+                s_filterStats.rejected++;
+                return false;
+            }
+            checked = true;
+        }
+        if (!test(doc.body, s_terms[i], s_termLens[i])) {
+            if (checked) s_filterStats.falsePositives++;
+            return false;
+        }
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------------
+// Levels
+//---------------------------------------------------------------------------------
+
+// Candidates for the top level: the level below's results, or every document
+static u32 source_count(int level) {
+    if (s_regexMode) return s_candCount;
+    return level == 0 ? (u32)s_docCount : s_levels[level - 1].count;
+}
+
+static u16 source_id(int level, u32 index) {
+    if (s_regexMode) return s_candAll ? index : s_arena[index];
+    if (level == 0) return index;
+    return s_arena[s_levels[level - 1].start + index];
+}
+
+// Candidates taken from a level with `query` already match all of its terms
+// except the last, which may still grow into a longer term
+static int known_terms(const char* query) {
+    int count = 0;
+    bool inTerm = false;
+    for (const char* p = query; *p && count < SEARCH_MAX_TERMS; p++) {
+        if (*p != ' ' && !inTerm) count++;
+        inTerm = *p != ' ';
+    }
+    return inTerm ? count - 1 : count;
+}
+
+static bool is_prefix(const char* prefix, const char* query) {
+    size_t len = strlen(prefix);
+    return strncmp(prefix, query, len) == 0;
+}
+
+// Drop every level but the top and move its results to the start of the
+// arena, so a new level has room
+static void compact(void) {
+    SearchLevel top = s_levels[s_levelCount - 1];
+    memmove(s_arena, s_arena + top.start, top.count * sizeof(u16));
+    top.start = 0;
+    s_levels[0] = top;
+    s_levelCount = 1;
+}
+
+static void push_level(const char* query) {
+    if (s_levelCount > 0) {
+        const SearchLevel* below = &s_levels[s_levelCount - 1];
+        if (s_levelCount == SEARCH_MAX_QUERY || below->start + 2 * below->count > s_arenaCap) compact();
+    }
+
+    SearchLevel* level = &s_levels[s_levelCount];
+    u32 end = 0;
+    level->firstTerm = 0;
+    if (s_levelCount > 0) {
+        const SearchLevel* below = &s_levels[s_levelCount - 1];
+        end = below->start + below->count;
+        level->firstTerm = known_terms(below->query);
+    }
+    strncpy(level->query, query, SEARCH_MAX_QUERY - 1);
+    level->query[SEARCH_MAX_QUERY - 1] = '\0';
+    level->start = end;
+    level->count = 0;
+    level->cursor = 0;
+    level->complete = false;
+    s_levelCount++;
+}
+
+static void leave_regex(void) {
+    regex_free(s_regex);
+    s_regex = NULL;
+    s_regexError = NULL;
+    s_regexMode = false;
+    s_levelCount = 0;
+}
+
+static void set_regex(const char* query) {
+    if (s_regexMode && s_levelCount > 0 && strcmp(s_levels[0].query, query) == 0) return;
+    leave_regex();
+    s_regexMode = true;
+    s_termCount = 0;
+    if (!query[1]) return;   // Nothing typed after the prefix yet
+
+    s_regex = regex_compile(query + 1, &s_regexError);
+    if (!s_regex || s_docCount == 0) return;
+
+    int count = trigram_candidates(regex_literal(s_regex), s_arena);
+    s_candAll = count < 0;
+    s_candCount = s_candAll ? (u32)s_docCount : (u32)count;
+    push_level(query);
+    s_levels[0].start = s_candAll ? 0 : s_candCount;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+bool search_init(void) {
+    // Letters by frequency in English text; anything else is rarer than all
+    static const char common[] = "etaoinshrdlcumwfgypbvkjxqz";
+    for (int c = 0; c < 256; c++) {
+        s_fold[c] = ascii_fold(c);
+        s_rarity[c] = sizeof(common);
+    }
+    for (int i = 0; common[i]; i++) s_rarity[(u8)common[i]] = i;
+    return true;
+}
+
+void search_exit(void) {
+    leave_regex();
+    free(s_arena);
+    s_arena = NULL;
+    s_arenaCap = 0;
+    s_levelCount = 0;
+}
+
+void search_reset(int count, SearchDocFn doc, void* arg) {
+    if (count > SEARCH_MAX_DOCS) count = SEARCH_MAX_DOCS;
+    s_docCount = count;
+    s_doc = doc;
+    s_docArg = arg;
+    leave_regex();
+    s_termCount = 0;
+
+    u32 cap = count * SEARCH_ARENA_SETS + 1;
+    if (cap > s_arenaCap) {
+        u16* arena = realloc(s_arena, cap * sizeof(u16));
+        if (!arena) {
+            s_docCount = 0;
+            return;
+        }
+        s_arena = arena;
+        s_arenaCap = cap;
+    }
+}
+
+void search_set_filter(SearchFilterFn filter, void* arg) {
+    s_filter = filter;
+    s_filterArg = arg;
+}
+
+const SearchFilterStats* search_filter_stats(void) {
+    return &s_filterStats;
+}
+
+void search_set_query(const char* query) {
+    if (search_is_regex(query)) {
+        set_regex(query);
+        return;
+    }
+    if (s_regexMode) leave_regex();
+
+    // Backspacing: fall back to the longest cached prefix of the new query
+    while (s_levelCount > 0 && !is_prefix(s_levels[s_levelCount - 1].query, query)) {
+        s_levelCount--;
+    }
+    parse_terms(query);
+    if (s_termCount == 0) {
+        s_levelCount = 0;
+        return;
+    }
+
+    if (s_levelCount > 0) {
+        SearchLevel* top = &s_levels[s_levelCount - 1];
+        if (strcmp(top->query, query) == 0) return;
+
+        if (!top->complete) {
+            // The top level was still scanning: keep its place in the source,
+            // drop the results that no longer match, and carry on with the
+            // narrower query. The partial set is not worth caching.
+            u32 kept = 0;
+            for (u32 i = 0; i < top->count; i++) {
+                u16 id = s_arena[top->start + i];
+                if (matches(id, top->firstTerm)) s_arena[top->start + kept++] = id;
+            }
+            top->count = kept;
+            strncpy(top->query, query, SEARCH_MAX_QUERY - 1);
+            top->query[SEARCH_MAX_QUERY - 1] = '\0';
+            return;
+        }
+    }
+    push_level(query);
+}
+
+bool search_step(u32 budget_us) {
+    if (s_levelCount == 0) return true;
+
+    int index = s_levelCount - 1;
+    SearchLevel* level = &s_levels[index];
+    if (level->complete) return true;
+
+    u64 deadline = svcGetSystemTick() + (u64)budget_us * CPU_TICKS_PER_MSEC / 1000;
+    u32 total = source_count(index);
+    while (level->cursor < total) {
+        u16 id = source_id(index, level->cursor++);
+        if (matches(id, level->firstTerm)) s_arena[level->start + level->count++] = id;
+        if (level->cursor % SEARCH_CHECK_EVERY == 0 && svcGetSystemTick() >= deadline) return false;
+    }
+    level->complete = true;
+    return true;
+}
+
+int search_results(const u16** ids) {
+    if (s_levelCount == 0) {
+        *ids = NULL;
+        return 0;
+    }
+    const SearchLevel* top = &s_levels[s_levelCount - 1];
+    *ids = s_arena + top->start;
+    return top->count;
+}
+
+bool search_is_regex(const char* query) {
+    return query[0] == SEARCH_REGEX_PREFIX;
+}
+
+const char* search_error(void) {
+    return s_regexError;
+}
@@ -0,0 +1,64 @@
+//---------------------------------------------------------------------------------
+// search.h
+// Search-as-you-type over note titles and contents. Queries starting with
+// SEARCH_REGEX_PREFIX are regular expressions (see regexp.h).
+//---------------------------------------------------------------------------------
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <3ds.h>
+
+#define SEARCH_MAX_QUERY 64
+#define SEARCH_MAX_DOCS  65535
+#define SEARCH_REGEX_PREFIX '/'
+
+typedef struct {
+    const char* title;
+    const char* body;
+} SearchDoc;
+
+// Fill `out` with the text of document `id`
+typedef void (*SearchDocFn)(int id, SearchDoc* out, void* arg);
+
+// False if the body of document `id` certainly does not contain `term`,
+// which is case-folded with utf8_fold(). May be wrong the other way.
+typedef bool (*SearchFilterFn)(int id, const char* term, size_t len, void* arg);
+
+// How often the filter spared a body scan. A false positive is a body the
+// filter passed that turned out not to contain the term.
+typedef struct {
+    u32 checks;
+    u32 rejected;
+    u32 falsePositives;
+} SearchFilterStats;
+
+bool search_init(void);
+void search_exit(void);
+
+// Search documents 0..count-1. Call again whenever they change; this drops
+// every cached result.
+void search_reset(int count, SearchDocFn doc, void* arg);
+
+// Consult `filter` before scanning a body for a term, or pass NULL to scan
+// every body
+void search_set_filter(SearchFilterFn filter, void* arg);
+
+const SearchFilterStats* search_filter_stats(void);
+
+// Change the query. Results are computed by search_step().
+void search_set_query(const char* query);
+
+bool search_is_regex(const char* query);
+
+// Why the current regex query has no results, or NULL if it is valid
+const char* search_error(void);
+
+// Match candidates for up to `budget_us` microseconds. Returns true once the
+// results for the current query are complete.
+bool search_step(u32 budget_us);
+
+// Matching document IDs found so far, in ID order
+int search_results(const u16** ids);
+
+#endif // SEARCH_H
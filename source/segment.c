@@ -0,0 +1,748 @@
+//---------------------------------------------------------------------------------
+// segment.c
+// Full-text index segments. A segment is one block: the header, the
+// documents sorted by name, the tombstones, the terms sorted by text, the
+// postings grouped by term, the Bloom filters and the string pool, in that
+// order. Building tokenizes the documents once; merging walks the term lists
+// of its inputs side by side, so it never has to see the note text again.
+//
+// A large build is split into shards of consecutive names, one per core.
+// Each thread tokenizes its shard into a segment of its own with a private
+// term table, and the shards are then merged like any other segments.
+//---------------------------------------------------------------------------------
+
+#include "segment.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc.h"
+#include "rank.h"
+#include "storage.h"
+#include "utf8.h"
+#include "util.h"
+#include "worker.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define SEGMENT_MAGIC   0x47455349   // "ISEG"
+#define SEGMENT_VERSION 3
+// Fewest documents per shard. Not yet measured on a New 3DS, so it is kept
+// above what the app holds (MAX_NOTES) and builds stay on one thread.
+#define SEGMENT_SHARD_DOCS 64
+
+// Bloom filters: bits per distinct trigram, probes, and size limits in bits.
+// Eight bits and five probes give about 2% false positives.
+#define BLOOM_BITS_PER_KEY 8
+#define BLOOM_PROBES       5
+#define BLOOM_MIN_BITS     64
+#define BLOOM_MAX_BITS     8192
+
+typedef struct {
+    u32 term;
+    u16 doc;
+    u16 tf;
+    u32 first;
+} Hit;
+
+// A document or tombstone seen by a merge
+typedef struct {
+    const char* name;
+    u16 seg;
+    u16 local;
+    bool tomb;
+} Event;
+
+// A name or term text to sort, and what it belongs to
+typedef struct {
+    const char* text;
+    u32 index;
+} Named;
+
+// Term table and scratch of one building thread
+typedef struct {
+    u32* slots;        // Hash slots holding term ID + 1
+    u32 slotCap;
+    char* terms;       // Term strings, NUL-terminated
+    u32 termsLen;
+    u32 termsCap;
+    u32* termText;     // Offset of each term's string
+    u32 termCount;
+    u32 termCap;
+    u32* keys;         // Trigrams of the document being built
+    u32 keyCap;
+    char* folded;      // Its body, case-folded
+    u32 foldedCap;
+} Builder;
+
+// One shard of a build, run on its own thread
+typedef struct {
+    const SearchDoc* docs;
+    int count;
+    const char* const* tombs;
+    int tombCount;
+    u32 seq;
+    Segment* out;
+} Shard;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static inline bool is_word_byte(u8 c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+static bool rehash(Builder* b, u32 cap) {
+    u32* slots = calloc(cap, sizeof(u32));
+    if (!slots) return false;
+    for (u32 t = 0; t < b->termCount; t++) {
+        u32 i = fnv1a_str(FNV_OFFSET, b->terms + b->termText[t]) & (cap - 1);
+        while (slots[i]) i = (i + 1) & (cap - 1);
+        slots[i] = t + 1;
+    }
+    free(b->slots);
+    b->slots = slots;
+    b->slotCap = cap;
+    return true;
+}
+
+// Term ID of `word`, adding it if new. Returns -1 if memory runs out.
+static s32 intern(Builder* b, const char* word, size_t len) {
+    if ((b->termCount + 1) * 4 > b->slotCap * 3 && !rehash(b, b->slotCap ? b->slotCap * 2 : 1024)) return -1;
+
+    u32 i = fnv1a_str(FNV_OFFSET, word) & (b->slotCap - 1);
+    for (; b->slots[i]; i = (i + 1) & (b->slotCap - 1)) {
+        if (strcmp(b->terms + b->termText[b->slots[i] - 1], word) == 0) return b->slots[i] - 1;
+    }
+
+    if (!grow_array((void**)&b->terms, &b->termsCap, b->termsLen + len + 1, 1, 256)) return -1;
+    if (!grow_array((void**)&b->termText, &b->termCap, b->termCount + 1, sizeof(u32), 256)) return -1;
+    memcpy(b->terms + b->termsLen, word, len + 1);
+    b->termText[b->termCount] = b->termsLen;
+    b->termsLen += len + 1;
+    b->slots[i] = b->termCount + 1;
+    return b->termCount++;
+}
+
+static void free_builder(Builder* b) {
+    free(b->slots);
+    free(b->terms);
+    free(b->termText);
+    free(b->keys);
+    free(b->folded);
+}
+
+// Tokenize `text` and append each word to `words` as its term ID in the high
+// half and its offset in the low half, or RANK_NO_OFFSET if `body` is false.
+// Returns false if memory runs out.
+static bool add_words(Builder* b, const char* text, bool body, u64** words, u32* count, u32* cap) {
+    char word[RANK_TERM_LEN];
+    const char* p = text;
+    size_t len;
+    while ((len = segment_next_word(&p, word)) > 0) {
+        s32 term = intern(b, word, len);
+        if (term < 0 || !grow_array((void**)words, cap, *count + 1, sizeof(u64), 256)) return false;
+        u32 offset = body ? (u32)(p - text - len) : RANK_NO_OFFSET;
+        (*words)[(*count)++] = (u64)term << 32 | offset;
+    }
+    return true;
+}
+
+// Bit positions by double hashing
+static inline u32 bloom_hash(u32 key) {
+    return key * 0x9E3779B1u;
+}
+
+static inline bool bloom_test(const u32* words, u32 mask, u32 key) {
+    u32 h = bloom_hash(key), step = (h >> 17) | 1;
+    for (int i = 0; i < BLOOM_PROBES; i++, h += step) {
+        if (!(words[(h & mask) >> 5] & (1u << (h & 31)))) return false;
+    }
+    return true;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    u32 x = *(const u32*)a, y = *(const u32*)b;
+    return (x > y) - (x < y);
+}
+
+// Append the filter of `body` to `blooms`, sized to the distinct trigrams
+// of its folded text. An empty filter means the body has none.
+static bool add_bloom(Builder* b, const char* body, u32** blooms, u32* count, u32* cap) {
+    size_t len = strlen(body);
+    if (!grow_array((void**)&b->folded, &b->foldedCap, len + 1, 1, 256)) return false;
+    utf8_fold(body, len, b->folded, len + 1);
+
+    const u8* p = (const u8*)b->folded;
+    u32 n = 0;
+    if (p[0] && p[1]) {
+        u32 key = p[0] << 8 | p[1];
+        for (p += 2; *p; p++) {
+            key = (key << 8 | *p) & 0xFFFFFF;
+            if (!grow_array((void**)&b->keys, &b->keyCap, n + 1, sizeof(u32), 256)) return false;
+            b->keys[n++] = key;
+        }
+    }
+    if (n == 0) return true;
+    qsort(b->keys, n, sizeof(u32), compare_u32);
+    u32 distinct = 0;
+    for (u32 i = 0; i < n; i++) {
+        if (i == 0 || b->keys[i] != b->keys[i - 1]) b->keys[distinct++] = b->keys[i];
+    }
+    if (distinct == 0) return true;
+
+    u32 bits = BLOOM_MIN_BITS;
+    while (bits < distinct * BLOOM_BITS_PER_KEY && bits < BLOOM_MAX_BITS) bits *= 2;
+    if (!grow_array((void**)blooms, cap, *count + bits / 32, sizeof(u32), 256)) return false;
+    u32* words = *blooms + *count;
+    memset(words, 0, bits / 8);
+    for (u32 i = 0; i < distinct; i++) {
+        u32 h = bloom_hash(b->keys[i]), step = (h >> 17) | 1;
+        for (int j = 0; j < BLOOM_PROBES; j++, h += step) {
+            words[(h & (bits - 1)) >> 5] |= 1u << (h & 31);
+        }
+    }
+    *count += bits / 32;
+    return true;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    u64 x = *(const u64*)a, y = *(const u64*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_named(const void* a, const void* b) {
+    return strcmp(((const Named*)a)->text, ((const Named*)b)->text);
+}
+
+// By name, newest segment first
+static int compare_events(const void* a, const void* b) {
+    const Event* x = a;
+    const Event* y = b;
+    int order = strcmp(x->name, y->name);
+    return order ? order : y->seg - x->seg;
+}
+
+static int compare_postings(const void* a, const void* b) {
+    return ((const SegmentPosting*)a)->doc - ((const SegmentPosting*)b)->doc;
+}
+
+static u32 append(char* pool, u32* len, const char* text) {
+    u32 at = *len;
+    size_t n = strlen(text) + 1;
+    memcpy(pool + at, text, n);
+    *len += n;
+    return at;
+}
+
+// Point the section pointers into the block
+static void attach(Segment* seg) {
+    const SegmentHeader* h = seg->header;
+    const u8* p = (const u8*)(h + 1);
+    seg->docs = (const SegmentDoc*)p;
+    p += h->docCount * sizeof(SegmentDoc);
+    seg->tombs = (const u32*)p;
+    p += h->tombCount * sizeof(u32);
+    seg->terms = (const SegmentTerm*)p;
+    p += h->termCount * sizeof(SegmentTerm);
+    seg->postings = (const SegmentPosting*)p;
+    p += h->postingCount * sizeof(SegmentPosting);
+    seg->blooms = (const u32*)p;
+    p += h->bloomWords * sizeof(u32);
+    seg->pool = (const char*)p;
+}
+
+static u64 block_size(const SegmentHeader* h) {
+    return sizeof(SegmentHeader) + (u64)h->docCount * sizeof(SegmentDoc) + (u64)h->tombCount * sizeof(u32) +
+           (u64)h->termCount * sizeof(SegmentTerm) + (u64)h->postingCount * sizeof(SegmentPosting) +
+           (u64)h->bloomWords * sizeof(u32) + h->poolLen;
+}
+
+// Copy the sections into one block and checksum it
+static Segment* assemble(SegmentHeader header, const SegmentDoc* docs, const u32* tombs, const SegmentTerm* terms,
+                         const SegmentPosting* postings, const u32* blooms, const char* pool) {
+    Segment* seg = calloc(1, sizeof(Segment));
+    size_t size = block_size(&header);
+    if (!seg || !(seg->header = malloc(size))) {
+        free(seg);
+        return NULL;
+    }
+    seg->size = size;
+    *seg->header = header;
+    attach(seg);
+    memcpy((void*)seg->docs, docs, header.docCount * sizeof(SegmentDoc));
+    memcpy((void*)seg->tombs, tombs, header.tombCount * sizeof(u32));
+    memcpy((void*)seg->terms, terms, header.termCount * sizeof(SegmentTerm));
+    memcpy((void*)seg->postings, postings, header.postingCount * sizeof(SegmentPosting));
+    if (header.bloomWords > 0) memcpy((void*)seg->blooms, blooms, header.bloomWords * sizeof(u32));
+    memcpy((void*)seg->pool, pool, header.poolLen);
+    seg->header->checksum = crc_compute(seg->header + 1, size - sizeof(SegmentHeader));
+    return seg;
+}
+
+// Check that a loaded block is complete and every offset in it is in range
+static bool validate(const Segment* seg) {
+    const SegmentHeader* h = seg->header;
+    if (seg->size < sizeof(SegmentHeader) || h->magic != SEGMENT_MAGIC || h->version != SEGMENT_VERSION ||
+        block_size(h) != seg->size || h->docCount > SEGMENT_NO_DOC || h->lo > h->hi ||
+        crc_compute(h + 1, seg->size - sizeof(SegmentHeader)) != h->checksum) {
+        return false;
+    }
+    if (h->poolLen > 0 ? seg->pool[h->poolLen - 1] != '\0' : h->docCount + h->tombCount + h->termCount > 0) {
+        return false;
+    }
+    for (u32 i = 0; i < h->docCount; i++) {
+        u32 end = i + 1 < h->docCount ? seg->docs[i + 1].bloom : h->bloomWords;
+        u32 words = end - seg->docs[i].bloom;
+        if (seg->docs[i].name >= h->poolLen || seg->docs[i].bloom > end || end > h->bloomWords ||
+            (words & (words - 1)) != 0) {
+            return false;
+        }
+    }
+    for (u32 i = 0; i < h->tombCount; i++) {
+        if (seg->tombs[i] >= h->poolLen) return false;
+    }
+    for (u32 i = 0; i < h->termCount; i++) {
+        u32 end = i + 1 < h->termCount ? seg->terms[i + 1].start : h->postingCount;
+        if (seg->terms[i].text >= h->poolLen || seg->terms[i].start > end || end > h->postingCount) return false;
+    }
+    for (u32 i = 0; i < h->postingCount; i++) {
+        if (seg->postings[i].doc >= h->docCount) return false;
+    }
+    return true;
+}
+
+static bool parse_hex(const char* p, u32* out) {
+    u32 value = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = p[i];
+        u32 digit = (c >= '0' && c <= '9') ? (u32)(c - '0') : (c >= 'a' && c <= 'f') ? (u32)(c - 'a' + 10) : 16;
+        if (digit == 16) return false;
+        value = value << 4 | digit;
+    }
+    *out = value;
+    return true;
+}
+
+// Build one segment on the calling thread
+static Segment* build(const SearchDoc* docs, int count, const char* const* tombs, int tombCount, u32 seq) {
+    Builder b = { 0 };
+    Named* names = malloc((count + tombCount + 1) * sizeof(Named));
+    SegmentDoc* outDocs = malloc((count + 1) * sizeof(SegmentDoc));
+    u32* outTombs = malloc((tombCount + 1) * sizeof(u32));
+    u64* words = NULL;
+    u32 wordCap = 0;
+    u32* blooms = NULL;
+    u32 bloomCount = 0, bloomCap = 0;
+    Hit* hits = NULL;
+    u32 hitCount = 0, hitCap = 0;
+    u32 poolLen = 0;
+    char* pool = NULL;
+    Named* sorted = NULL;
+    u32* rankOf = NULL;
+    SegmentTerm* outTerms = NULL;
+    SegmentPosting* outPostings = NULL;
+    Segment* seg = NULL;
+    bool ok = names && outDocs && outTombs;
+
+    // Documents and tombstones in name order; a document's index in that
+    // order is its local ID
+    for (int i = 0; ok && i < count; i++) {
+        names[i] = (Named){ docs[i].title, i };
+        poolLen += strlen(docs[i].title) + 1;
+    }
+    for (int i = 0; ok && i < tombCount; i++) {
+        names[count + i] = (Named){ tombs[i], i };
+        poolLen += strlen(tombs[i]) + 1;
+    }
+    if (ok) {
+        qsort(names, count, sizeof(Named), compare_named);
+        qsort(names + count, tombCount, sizeof(Named), compare_named);
+    }
+
+    // Tokenize each document into (term, document, frequency) hits, which
+    // come out in document order
+    for (int d = 0; ok && d < count; d++) {
+        const SearchDoc* doc = &docs[names[d].index];
+        u32 length = 0;
+        u32 bloom = bloomCount;
+        ok = add_words(&b, doc->title, false, &words, &length, &wordCap) &&
+             add_words(&b, doc->body, true, &words, &length, &wordCap) &&
+             add_bloom(&b, doc->body, &blooms, &bloomCount, &bloomCap);
+        if (!ok) break;
+
+        // Sorting groups each term's occurrences, earliest body offset first
+        qsort(words, length, sizeof(u64), compare_u64);
+        for (u32 i = 0; i < length && ok; ) {
+            u32 term = words[i] >> 32;
+            u32 run = 1;
+            while (i + run < length && (u32)(words[i + run] >> 32) == term) run++;
+            ok = grow_array((void**)&hits, &hitCap, hitCount + 1, sizeof(Hit), 256);
+            if (ok) hits[hitCount++] = (Hit){ term, d, run > 0xFFFF ? 0xFFFF : run, (u32)words[i] };
+            i += run;
+        }
+        outDocs[d] = (SegmentDoc){ 0, length, segment_hash(doc), bloom };
+    }
+    free(words);
+
+    poolLen += b.termsLen;
+    ok = ok &&
+         (pool = malloc(poolLen ? poolLen : 1)) != NULL &&
+         (sorted = malloc((b.termCount + 1) * sizeof(Named))) != NULL &&
+         (rankOf = malloc((b.termCount + 1) * sizeof(u32))) != NULL &&
+         (outTerms = calloc(b.termCount + 1, sizeof(SegmentTerm))) != NULL &&
+         (outPostings = malloc((hitCount + 1) * sizeof(SegmentPosting))) != NULL;
+    if (ok) {
+        poolLen = 0;
+        for (int d = 0; d < count; d++) outDocs[d].name = append(pool, &poolLen, names[d].text);
+        for (int t = 0; t < tombCount; t++) outTombs[t] = append(pool, &poolLen, names[count + t].text);
+
+        // Terms in text order
+        for (u32 t = 0; t < b.termCount; t++) sorted[t] = (Named){ b.terms + b.termText[t], t };
+        qsort(sorted, b.termCount, sizeof(Named), compare_named);
+        for (u32 r = 0; r < b.termCount; r++) {
+            rankOf[sorted[r].index] = r;
+            outTerms[r].text = append(pool, &poolLen, sorted[r].text);
+            outTerms[r].minLength = 0xFFFFFFFF;
+        }
+
+        // Group the hits by term; a stable counting sort keeps each posting
+        // list in document order
+        for (u32 i = 0; i < hitCount; i++) {
+            u32 r = rankOf[hits[i].term];
+            if (r + 1 < b.termCount) outTerms[r + 1].start++;
+        }
+        for (u32 r = 1; r < b.termCount; r++) outTerms[r].start += outTerms[r - 1].start;
+        for (u32 i = 0; i < hitCount; i++) {
+            SegmentTerm* term = &outTerms[rankOf[hits[i].term]];
+            u32 at = term->start + term->reserved++;
+            outPostings[at] = (SegmentPosting){ hits[i].doc, hits[i].tf, hits[i].first };
+            if (hits[i].tf > term->maxTf) term->maxTf = hits[i].tf;
+            if (outDocs[hits[i].doc].length < term->minLength) term->minLength = outDocs[hits[i].doc].length;
+        }
+        for (u32 r = 0; r < b.termCount; r++) outTerms[r].reserved = 0;
+
+        SegmentHeader header = { SEGMENT_MAGIC, SEGMENT_VERSION, seq, seq, count, tombCount,
+                                 b.termCount, hitCount, bloomCount, poolLen, 0 };
+        seg = assemble(header, outDocs, outTombs, outTerms, outPostings, blooms, pool);
+    }
+
+    free_builder(&b);
+    free(names);
+    free(outDocs);
+    free(outTombs);
+    free(hits);
+    free(blooms);
+    free(pool);
+    free(sorted);
+    free(rankOf);
+    free(outTerms);
+    free(outPostings);
+    return seg;
+}
+
+static void build_shard(void* arg) {
+    Shard* shard = arg;
+    shard->out = build(shard->docs, shard->count, shard->tombs, shard->tombCount, shard->seq);
+}
+
+//---------------------------------------------------------------------------------
+// Building and merging
+//---------------------------------------------------------------------------------
+Segment* segment_build(const SearchDoc* docs, int count, const char* const* tombs, int tombCount, u32 seq) {
+    if (count > SEGMENT_NO_DOC) count = SEGMENT_NO_DOC;
+
+    int shards = worker_threads();
+    if (shards > count / SEGMENT_SHARD_DOCS) shards = count / SEGMENT_SHARD_DOCS;
+    if (shards > WORKER_MAX_THREADS) shards = WORKER_MAX_THREADS;
+    if (shards < 2) return build(docs, count, tombs, tombCount, seq);
+
+    // Shards of consecutive names, so the merge can append their postings.
+    // The tombstones get a shard of their own, oldest, so a document with
+    // the same name still wins.
+    Named* names = malloc(count * sizeof(Named));
+    SearchDoc* sorted = malloc(count * sizeof(SearchDoc));
+    Shard shard[WORKER_MAX_THREADS + 1];
+    void* args[WORKER_MAX_THREADS];
+    Segment* parts[WORKER_MAX_THREADS + 1];
+    Segment* seg = NULL;
+    if (names && sorted) {
+        for (int i = 0; i < count; i++) names[i] = (Named){ docs[i].title, i };
+        qsort(names, count, sizeof(Named), compare_named);
+        for (int i = 0; i < count; i++) sorted[i] = docs[names[i].index];
+
+        for (int s = 0; s < shards; s++) {
+            int first = (int)((s64)count * s / shards), last = (int)((s64)count * (s + 1) / shards);
+            shard[s] = (Shard){ sorted + first, last - first, NULL, 0, seq, NULL };
+            args[s] = &shard[s];
+        }
+        worker_parallel(build_shard, args, shards);
+
+        bool ok = true;
+        int partCount = 0;
+        if (tombCount > 0) {
+            ok = (parts[partCount++] = build(NULL, 0, tombs, tombCount, seq)) != NULL;
+        }
+        for (int s = 0; s < shards; s++) {
+            parts[partCount++] = shard[s].out;
+            ok = ok && shard[s].out;
+        }
+        if (ok) seg = segment_merge(parts, partCount, true);
+        for (int p = 0; p < partCount; p++) segment_free(parts[p]);
+    }
+    free(names);
+    free(sorted);
+    return seg;
+}
+
+Segment* segment_merge(Segment* const* segs, int count, bool keepTombs) {
+    u32 eventCount = 0, termMax = 0, postingMax = 0, bloomMax = 0, poolMax = 0;
+    for (int s = 0; s < count; s++) {
+        const SegmentHeader* h = segs[s]->header;
+        eventCount += h->docCount + h->tombCount;
+        termMax += h->termCount;
+        postingMax += h->postingCount;
+        bloomMax += h->bloomWords;
+        poolMax += h->poolLen;
+    }
+
+    Event* events = malloc((eventCount + 1) * sizeof(Event));
+    u16** map = calloc(count, sizeof(u16*));
+    u32* pos = calloc(count, sizeof(u32));
+    SegmentDoc* docs = malloc((eventCount + 1) * sizeof(SegmentDoc));
+    u32* tombs = malloc((eventCount + 1) * sizeof(u32));
+    SegmentTerm* terms = malloc((termMax + 1) * sizeof(SegmentTerm));
+    SegmentPosting* postings = malloc((postingMax + 1) * sizeof(SegmentPosting));
+    u32* blooms = malloc((bloomMax + 1) * sizeof(u32));
+    char* pool = malloc(poolMax + 1);
+    Segment* out = NULL;
+    bool ok = events && map && pos && docs && tombs && terms && postings && blooms && pool;
+    for (int s = 0; ok && s < count; s++) {
+        ok = (map[s] = malloc((segs[s]->header->docCount + 1) * sizeof(u16))) != NULL;
+    }
+
+    if (ok) {
+        // The newest event for each name decides whether it survives
+        u32 n = 0;
+        for (int s = 0; s < count; s++) {
+            const Segment* seg = segs[s];
+            for (u32 d = 0; d < seg->header->docCount; d++) {
+                events[n++] = (Event){ seg->pool + seg->docs[d].name, s, d, false };
+                map[s][d] = SEGMENT_NO_DOC;
+            }
+            for (u32 t = 0; t < seg->header->tombCount; t++) {
+                events[n++] = (Event){ seg->pool + seg->tombs[t], s, 0, true };
+            }
+        }
+        qsort(events, n, sizeof(Event), compare_events);
+
+        u32 docCount = 0, tombCount = 0, bloomCount = 0, poolLen = 0;
+        for (u32 i = 0; i < n; i++) {
+            const Event* e = &events[i];
+            if (i > 0 && strcmp(e->name, events[i - 1].name) == 0) continue;
+            if (e->tomb) {
+                if (keepTombs) tombs[tombCount++] = append(pool, &poolLen, e->name);
+            } else if (docCount < SEGMENT_NO_DOC) {
+                const Segment* seg = segs[e->seg];
+                const SegmentDoc* doc = &seg->docs[e->local];
+                u32 end = e->local + 1u < seg->header->docCount ? doc[1].bloom : seg->header->bloomWords;
+                memcpy(blooms + bloomCount, seg->blooms + doc->bloom, (end - doc->bloom) * sizeof(u32));
+                map[e->seg][e->local] = docCount;
+                docs[docCount++] = (SegmentDoc){ append(pool, &poolLen, e->name), doc->length, doc->hash, bloomCount };
+                bloomCount += end - doc->bloom;
+            }
+        }
+
+        // Walk the term lists side by side, keeping the surviving postings
+        u32 termCount = 0, postingCount = 0;
+        for (;;) {
+            const char* text = NULL;
+            for (int s = 0; s < count; s++) {
+                if (pos[s] >= segs[s]->header->termCount) continue;
+                const char* t = segs[s]->pool + segs[s]->terms[pos[s]].text;
+                if (!text || strcmp(t, text) < 0) text = t;
+            }
+            if (!text) break;
+
+            SegmentTerm term = { 0, postingCount, 0xFFFFFFFF, 0, 0 };
+            bool interleaved = false;
+            for (int s = 0; s < count; s++) {
+                if (pos[s] >= segs[s]->header->termCount ||
+                    strcmp(segs[s]->pool + segs[s]->terms[pos[s]].text, text) != 0) {
+                    continue;
+                }
+                const SegmentPosting* post;
+                u32 size = segment_postings(segs[s], pos[s]++, &post);
+                u32 before = postingCount;
+                u16 last = postingCount > term.start ? postings[postingCount - 1].doc : 0;
+                for (u32 i = 0; i < size; i++) {
+                    u16 doc = map[s][post[i].doc];
+                    if (doc == SEGMENT_NO_DOC) continue;
+                    postings[postingCount++] = (SegmentPosting){ doc, post[i].tf, post[i].first };
+                    if (post[i].tf > term.maxTf) term.maxTf = post[i].tf;
+                    if (docs[doc].length < term.minLength) term.minLength = docs[doc].length;
+                }
+                interleaved |= before > term.start && postingCount > before && postings[before].doc < last;
+            }
+            if (postingCount == term.start) continue;
+
+            // Each input's postings are in order, but the inputs may interleave
+            if (interleaved) {
+                qsort(postings + term.start, postingCount - term.start, sizeof(SegmentPosting), compare_postings);
+            }
+            term.text = append(pool, &poolLen, text);
+            terms[termCount++] = term;
+        }
+
+        SegmentHeader header = { SEGMENT_MAGIC, SEGMENT_VERSION, segs[0]->header->lo, segs[count - 1]->header->hi,
+                                 docCount, tombCount, termCount, postingCount, bloomCount, poolLen, 0 };
+        out = assemble(header, docs, tombs, terms, postings, blooms, pool);
+    }
+
+    for (int s = 0; map && s < count; s++) free(map[s]);
+    free(map);
+    free(events);
+    free(pos);
+    free(docs);
+    free(tombs);
+    free(terms);
+    free(postings);
+    free(blooms);
+    free(pool);
+    return out;
+}
+
+//---------------------------------------------------------------------------------
+// Files
+//---------------------------------------------------------------------------------
+void segment_file_name(const Segment* seg, char* buf, size_t size) {
+    snprintf(buf, size, SEGMENT_PREFIX "%08lx-%08lx", (unsigned long)seg->header->lo,
+             (unsigned long)seg->header->hi);
+}
+
+bool segment_parse_name(const char* name, u32* lo, u32* hi) {
+    size_t prefix = sizeof(SEGMENT_PREFIX) - 1;
+    return strncmp(name, SEGMENT_PREFIX, prefix) == 0 && strlen(name) == prefix + 17 &&
+           parse_hex(name + prefix, lo) && name[prefix + 8] == '-' && parse_hex(name + prefix + 9, hi);
+}
+
+Segment* segment_load(const char* name, size_t size) {
+    u32 lo, hi;
+    if (!segment_parse_name(name, &lo, &hi) || size < sizeof(SegmentHeader)) return NULL;
+
+    Segment* seg = calloc(1, sizeof(Segment));
+    if (!seg || !(seg->header = malloc(size))) {
+        free(seg);
+        return NULL;
+    }
+    seg->size = size;
+    seg->written = true;
+    bool ok = storage_read(name, seg->header, size) == (s32)size &&
+              block_size(seg->header) == size;
+    if (ok) {
+        attach(seg);
+        ok = validate(seg) && seg->header->lo == lo && seg->header->hi == hi;
+    }
+    if (!ok) {
+        segment_free(seg);
+        return NULL;
+    }
+    return seg;
+}
+
+bool segment_write(Segment* seg) {
+    char name[STORAGE_NAME_LEN];
+    segment_file_name(seg, name, sizeof(name));
+    StorageFile* file = storage_open(name, true);
+    bool ok = file && storage_file_write(file, seg->header, seg->size);
+    ok = storage_close(file) && ok;
+    if (!ok) storage_remove(name);
+    seg->written = ok;
+    return ok;
+}
+
+void segment_free(Segment* seg) {
+    if (!seg) return;
+    free(seg->header);
+    free(seg);
+}
+
+//---------------------------------------------------------------------------------
+// Lookup
+//---------------------------------------------------------------------------------
+s32 segment_find_doc(const Segment* seg, const char* name) {
+    u32 lo = 0, hi = seg->header->docCount;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        int order = strcmp(seg->pool + seg->docs[mid].name, name);
+        if (order == 0) return mid;
+        if (order < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+bool segment_has_tomb(const Segment* seg, const char* name) {
+    u32 lo = 0, hi = seg->header->tombCount;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        int order = strcmp(seg->pool + seg->tombs[mid], name);
+        if (order == 0) return true;
+        if (order < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return false;
+}
+
+u32 segment_lower_bound(const Segment* seg, const char* text) {
+    u32 lo = 0, hi = seg->header->termCount;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (strcmp(seg->pool + seg->terms[mid].text, text) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+const char* segment_term_text(const Segment* seg, u32 term) {
+    return seg->pool + seg->terms[term].text;
+}
+
+u32 segment_postings(const Segment* seg, u32 term, const SegmentPosting** out) {
+    u32 end = term + 1 < seg->header->termCount ? seg->terms[term + 1].start : seg->header->postingCount;
+    *out = seg->postings + seg->terms[term].start;
+    return end - seg->terms[term].start;
+}
+
+bool segment_may_contain(const Segment* seg, u32 doc, const char* term, size_t len) {
+    if (len < 3) return true;
+    u32 first = seg->docs[doc].bloom;
+    u32 end = doc + 1 < seg->header->docCount ? seg->docs[doc + 1].bloom : seg->header->bloomWords;
+    if (end == first) return false;
+
+    const u32* words = seg->blooms + first;
+    u32 mask = (end - first) * 32 - 1;
+    const u8* p = (const u8*)term;
+    u32 key = p[0] << 8 | p[1];
+    for (size_t i = 2; i < len; i++) {
+        key = (key << 8 | p[i]) & 0xFFFFFF;
+        if (!bloom_test(words, mask, key)) return false;
+    }
+    return true;
+}
+
+u32 segment_hash(const SearchDoc* doc) {
+    return fnv1a_str(fnv1a_str(FNV_OFFSET, doc->title) * FNV_PRIME, doc->body);
+}
+
+size_t segment_next_word(const char** p, char* word) {
+    const u8* s = (const u8*)*p;
+    while (*s && !is_word_byte(*s)) s++;
+    const u8* start = s;
+    while (is_word_byte(*s)) s++;
+    *p = (const char*)s;
+    return utf8_fold((const char*)start, s - start, word, RANK_TERM_LEN);
+}
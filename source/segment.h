@@ -0,0 +1,106 @@
+//---------------------------------------------------------------------------------
+// segment.h
+// Immutable pieces of the full-text index. A segment holds the postings of a
+// set of notes plus tombstones for deleted ones, in one block laid out
+// exactly as it is stored, so a segment file is loaded with a single read
+// and written with a single write. A CRC-32 covers the block, so a segment
+// cut short by a crash is detected and thrown away. Each document also has a
+// Bloom filter of the three-byte sequences in its body, which answers "can
+// this note contain that text?" without reading the note.
+//---------------------------------------------------------------------------------
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <3ds.h>
+
+#include "search.h"
+
+#define SEGMENT_PREFIX ".idx-"     // Segment files in the notes directory
+#define SEGMENT_NO_DOC 0xFFFF
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 lo, hi;         // Flush sequence numbers the segment covers
+    u32 docCount;
+    u32 tombCount;
+    u32 termCount;
+    u32 postingCount;
+    u32 bloomWords;
+    u32 poolLen;
+    u32 checksum;       // CRC-32 of everything after the header
+} SegmentHeader;
+
+typedef struct {
+    u32 name;           // Offsets are into the string pool
+    u32 length;         // Words in the title and body
+    u32 hash;           // segment_hash() of the text that was indexed
+    u32 bloom;          // First word of its filter; filters are in document order
+} SegmentDoc;
+
+typedef struct {
+    u32 text;
+    u32 start;          // First posting
+    u32 minLength;      // Shortest document in the postings
+    u16 maxTf;          // Highest frequency in the postings
+    u16 reserved;
+} SegmentTerm;
+
+typedef struct {
+    u16 doc;
+    u16 tf;
+    u32 first;          // Body offset of the first occurrence, or RANK_NO_OFFSET
+} SegmentPosting;
+
+typedef struct {
+    SegmentHeader* header;           // The block; everything below points into it
+    size_t size;
+    const SegmentDoc* docs;          // Sorted by name
+    const u32* tombs;                // Names of deleted notes, sorted
+    const SegmentTerm* terms;        // Sorted by text
+    const SegmentPosting* postings;  // Grouped by term, in document order
+    const u32* blooms;
+    const char* pool;
+    bool written;                    // Stored in its file
+} Segment;
+
+// Index `count` documents, whose titles are their names, and tombstones for
+// the `tombCount` names in `tombs`, as segment `seq`. Returns NULL if memory
+// runs out. Large builds are sharded across worker_parallel() threads.
+Segment* segment_build(const SearchDoc* docs, int count, const char* const* tombs, int tombCount, u32 seq);
+
+// Combine `count` segments, oldest first, covering consecutive sequence
+// numbers. Newer documents and tombstones win; tombstones are kept only if
+// `keepTombs`, i.e. older segments remain outside the merge.
+Segment* segment_merge(Segment* const* segs, int count, bool keepTombs);
+
+// Load segment file `name`, which is `size` bytes. Returns NULL if it is
+// damaged or incomplete.
+Segment* segment_load(const char* name, size_t size);
+bool segment_write(Segment* seg);
+void segment_free(Segment* seg);
+
+// File name of a segment, and the sequence range it covers given its name
+void segment_file_name(const Segment* seg, char* buf, size_t size);
+bool segment_parse_name(const char* name, u32* lo, u32* hi);
+
+// Lookup. Document and term functions return indexes, or -1.
+s32 segment_find_doc(const Segment* seg, const char* name);
+bool segment_has_tomb(const Segment* seg, const char* name);
+u32 segment_lower_bound(const Segment* seg, const char* text);
+const char* segment_term_text(const Segment* seg, u32 term);
+u32 segment_postings(const Segment* seg, u32 term, const SegmentPosting** out);
+
+// False if the body of document `doc` certainly does not contain `term`,
+// which is case-folded with utf8_fold(). Terms under three bytes always pass.
+bool segment_may_contain(const Segment* seg, u32 doc, const char* term, size_t len);
+
+// Hash of a document's title and body, to tell whether it changed
+u32 segment_hash(const SearchDoc* doc);
+
+// Copy the next word at or after *p to `word`, case-folded and truncated to
+// RANK_TERM_LEN - 1 bytes at a code point. Returns its length, 0 at the end.
+size_t segment_next_word(const char** p, char* word);
+
+#endif // SEGMENT_H
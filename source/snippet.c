@@ -0,0 +1,195 @@
+//---------------------------------------------------------------------------------
+// snippet.c
+// Search result snippets. The rank index records where each word first
+// occurs in a note, so a snippet starts from that offset and only the few
+// dozen bytes it shows are examined for highlighting. Notes are scanned only
+// when the match is not an indexed word, such as text inside a longer word.
+// Regex queries highlight the first match of the pattern instead.
+// Snippets are built the first time a result is drawn and kept in a small LRU
+// cache keyed by note, revision and query.
+//---------------------------------------------------------------------------------
+
+#include "snippet.h"
+
+#include <string.h>
+
+#include "rank.h"
+#include "regexp.h"
+#include "search.h"
+#include "utf8.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define SNIPPET_LEAD 16   // Bytes of context shown before the match
+
+typedef struct {
+    bool used;
+    int doc;
+    u32 revision;
+    u32 lastUse;
+    char query[SEARCH_MAX_QUERY];
+    Snippet snippet;
+} SnippetSlot;
+
+static SnippetSlot s_cache[SNIPPET_CACHE_SIZE];
+static u32 s_clock = 0;
+
+// The last regex query, compiled
+static Regex* s_regex = NULL;
+static char s_regexQuery[SEARCH_MAX_QUERY];
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static inline bool is_continuation(u8 c) {
+    return (c & 0xC0) == 0x80;
+}
+
+// Length of the longest term of `terms`, a query folded with utf8_fold(),
+// found at `text`. The text is folded a code point at a time, as search.c
+// does, and folding keeps lengths, so the match is as long as the term.
+static size_t match_at(const char* text, const char* terms) {
+    size_t best = 0;
+    const char* term = terms;
+    while (*term) {
+        while (*term == ' ') term++;
+        size_t len = strcspn(term, " ");
+        if (len == 0) break;
+
+        const char* p = text;
+        size_t i = 0;
+        while (i < len && *p) {
+            const char* start = p;
+            u32 cp = utf8_decode(&p, UTF8_MAX_LEN);
+            size_t n = p - start;
+            char folded[UTF8_MAX_LEN];
+            if (cp == UTF8_INVALID) folded[0] = *start;
+            else utf8_encode(utf8_fold_char(cp), folded);
+            if (i + n > len || memcmp(folded, term + i, n) != 0) break;
+            i += n;
+        }
+        if (i == len && len > best) best = len;
+        term += len;
+    }
+    return best;
+}
+
+// Offset of the first occurrence of any term of folded `terms` in `body`,
+// or -1
+static s32 scan(const char* terms, const char* body) {
+    for (const char* p = body; *p; p++) {
+        if (!is_continuation(*p) && match_at(p, terms)) return p - body;
+    }
+    return -1;
+}
+
+// Bounds of the first match of a regex query in `body`
+static bool regex_span(const char* query, const char* body, size_t* start, size_t* end) {
+    if (strncmp(s_regexQuery, query, SEARCH_MAX_QUERY) != 0) {
+        const char* error;
+        regex_free(s_regex);
+        s_regex = regex_compile(query + 1, &error);
+        strncpy(s_regexQuery, query, SEARCH_MAX_QUERY - 1);
+        s_regexQuery[SEARCH_MAX_QUERY - 1] = '\0';
+    }
+    return s_regex && regex_search(s_regex, body, strlen(body), start, end);
+}
+
+static void build(Snippet* out, int doc, const char* query, const char* body) {
+    bool regex = search_is_regex(query);
+    size_t regexStart = 0, regexEnd = 0;
+    char terms[SEARCH_MAX_QUERY];
+    s32 at;
+    if (regex) {
+        at = regex_span(query, body, &regexStart, &regexEnd) ? (s32)regexStart : -1;
+    } else {
+        utf8_fold(query, strlen(query), terms, sizeof(terms));
+        at = rank_locate(query, doc);
+        if (at < 0) at = scan(terms, body);
+    }
+    if (at < 0) at = 0;   // The match is in the title
+    size_t bodyLen = strlen(body);
+    if ((size_t)at > bodyLen) at = bodyLen;
+
+    // Start a little before the match, on a word boundary if there is one
+    size_t start = at > SNIPPET_LEAD ? at - SNIPPET_LEAD : 0;
+    while (start > 0 && start < (size_t)at && body[start - 1] != ' ' && body[start - 1] != '\n') start++;
+    while (is_continuation(body[start])) start++;
+
+    size_t len = strnlen(body + start, SNIPPET_LEN + 1);
+    bool more = len > SNIPPET_LEN;
+    if (more) {
+        len = SNIPPET_LEN;
+        while (len > 0 && is_continuation(body[start + len])) len--;
+    }
+
+    size_t pos = 0;
+    if (start > 0) {
+        memcpy(out->text, "...", 3);
+        pos = 3;
+    }
+    size_t regexAt = 0, regexLen = 0;
+    if (regex && regexEnd > regexStart) {
+        regexAt = pos + regexStart - start;
+        regexLen = (regexEnd < start + len ? regexEnd : start + len) - regexStart;
+    }
+    for (size_t i = 0; i < len; i++) {
+        u8 c = body[start + i];
+        out->text[pos++] = c < ' ' ? ' ' : c;
+    }
+    if (more) {
+        memcpy(out->text + pos, "...", 3);
+        pos += 3;
+    }
+    out->text[pos] = '\0';
+
+    // Split into plain and matching spans, keeping one span for the tail
+    out->count = 0;
+    size_t plain = 0;
+    for (size_t i = 0; i < pos; ) {
+        size_t match = regex ? (i == regexAt ? regexLen : 0) : match_at(out->text + i, terms);
+        int need = (i > plain) + 2;
+        if (match == 0 || out->count + need > SNIPPET_MAX_SPANS) {
+            i++;
+            continue;
+        }
+        if (i > plain) out->spans[out->count++] = (SnippetSpan){ plain, i - plain, false };
+        out->spans[out->count++] = (SnippetSpan){ i, match, true };
+        i += match;
+        plain = i;
+    }
+    if (pos > plain) out->spans[out->count++] = (SnippetSpan){ plain, pos - plain, false };
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void snippet_exit(void) {
+    regex_free(s_regex);
+    s_regex = NULL;
+    s_regexQuery[0] = '\0';
+}
+
+const Snippet* snippet_get(int doc, u32 revision, const char* query, const char* body) {
+    SnippetSlot* victim = &s_cache[0];
+    for (int i = 0; i < SNIPPET_CACHE_SIZE; i++) {
+        SnippetSlot* slot = &s_cache[i];
+        if (slot->used && slot->doc == doc && slot->revision == revision &&
+            strncmp(slot->query, query, SEARCH_MAX_QUERY) == 0) {
+            slot->lastUse = ++s_clock;
+            return &slot->snippet;
+        }
+        if (victim->used && (!slot->used || slot->lastUse < victim->lastUse)) victim = slot;
+    }
+
+    victim->used = true;
+    victim->doc = doc;
+    victim->revision = revision;
+    victim->lastUse = ++s_clock;
+    strncpy(victim->query, query, SEARCH_MAX_QUERY - 1);
+    victim->query[SEARCH_MAX_QUERY - 1] = '\0';
+    build(&victim->snippet, doc, query, body);
+    return &victim->snippet;
+}
@@ -0,0 +1,33 @@
+//---------------------------------------------------------------------------------
+// snippet.h
+// Short excerpts of a note around a search match, with the matches marked.
+//---------------------------------------------------------------------------------
+
+#ifndef SNIPPET_H
+#define SNIPPET_H
+
+#include <3ds.h>
+
+#define SNIPPET_LEN        56   // Bytes of note text shown
+#define SNIPPET_MAX_SPANS  9
+#define SNIPPET_CACHE_SIZE 16   // A screenful of results, with room to scroll back
+
+typedef struct {
+    u8 start;
+    u8 len;
+    bool match;
+} SnippetSpan;
+
+typedef struct {
+    char text[SNIPPET_LEN + 7];          // With "..." at either cut end
+    int count;
+    SnippetSpan spans[SNIPPET_MAX_SPANS];  // Cover the text in order
+} Snippet;
+
+void snippet_exit(void);
+
+// Snippet of `body` for `query`, built on first request and cached. Callers
+// must give a note a new `revision` whenever its text changes.
+const Snippet* snippet_get(int doc, u32 revision, const char* query, const char* body);
+
+#endif // SNIPPET_H
@@ -0,0 +1,349 @@
+//---------------------------------------------------------------------------------
+// spell.c
+// Spell checker. The dictionary is a pointer-free DAWG image (see dawg.h) read
+// into one buffer and queried in place. Suggestions come from a depth-first
+// walk of the graph carrying one row of the edit-distance table per level,
+// which prunes every branch that is already more than SPELL_MAX_EDITS away.
+//---------------------------------------------------------------------------------
+
+#include "spell.h"
+#include "dawg.h"
+#include "prof.h"
+#include "util.h"
+#include "worker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+typedef enum {
+    ENTRY_EMPTY,
+    ENTRY_PENDING,   // Queued on the worker
+    ENTRY_DONE
+} EntryState;
+
+// The entry keeps its paragraph's text, which the worker checks while the
+// entry is pending and lookups compare, since revisions can collide
+typedef struct {
+    EntryState state;
+    u32 lastUse;
+    char* text;
+    size_t len;
+    SpellResult result;
+} CacheEntry;
+
+typedef struct {
+    int count;
+    int max;
+    int dist[SPELL_MAX_ISSUES];
+    char (*out)[SPELL_MAX_WORD];
+} Candidates;
+
+static u32* s_image = NULL;
+static const u32* s_edges = NULL;
+static u32 s_edgeCount = 0;
+static u32 s_root = 0;
+
+static LightLock s_cacheLock;
+static CacheEntry s_cache[SPELL_CACHE_SIZE];
+static u32 s_useClock = 0;
+
+//---------------------------------------------------------------------------------
+// Dictionary
+//---------------------------------------------------------------------------------
+static bool validate_image(const u32* words, size_t count) {
+    if (count < DAWG_HEADER_WORDS) return false;
+    if (words[0] != DAWG_MAGIC || words[1] != DAWG_VERSION) return false;
+
+    u32 edgeCount = words[2];
+    if (edgeCount == 0 || edgeCount > DAWG_MAX_EDGES || DAWG_HEADER_WORDS + edgeCount != count) return false;
+    if (words[3] >= edgeCount) return false;
+
+    // Check every link once here so queries can skip bounds checks
+    const u32* edges = words + DAWG_HEADER_WORDS;
+    for (u32 i = 1; i < edgeCount; i++) {
+        if (DAWG_CHILD(edges[i]) >= edgeCount) return false;
+    }
+    return (edges[edgeCount - 1] & DAWG_LAST) != 0;
+}
+
+bool spell_init(const char* path) {
+    LightLock_Init(&s_cacheLock);
+    memset(s_cache, 0, sizeof(s_cache));
+
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (size <= 0 || size % 4 != 0) {
+        fclose(file);
+        return false;
+    }
+
+    s_image = malloc(size);
+    bool ok = s_image && fread(s_image, 1, size, file) == (size_t)size &&
+              validate_image(s_image, size / 4);
+    fclose(file);
+
+    if (!ok) {
+        spell_exit();
+        return false;
+    }
+
+    s_edges = s_image + DAWG_HEADER_WORDS;
+    s_edgeCount = s_image[2];
+    s_root = s_image[3];
+    return true;
+}
+
+void spell_exit(void) {
+    // Call after worker_exit(): an entry still pending was never checked
+    for (int i = 0; i < SPELL_CACHE_SIZE; i++) free(s_cache[i].text);
+    memset(s_cache, 0, sizeof(s_cache));
+
+    free(s_image);
+    s_image = NULL;
+    s_edges = NULL;
+    s_edgeCount = 0;
+}
+
+// Index of the edge labelled `c` in the sibling run starting at `run`, or 0
+static u32 find_edge(u32 run, u8 c) {
+    if (run == 0) return 0;
+    for (u32 i = run;; i++) {
+        u32 edge = s_edges[i];
+        if (DAWG_LABEL(edge) == c) return i;
+        if (DAWG_LABEL(edge) > c || (edge & DAWG_LAST)) return 0;
+    }
+}
+
+static bool lookup_folded(const char* word, size_t len) {
+    u32 edge = 0;
+    u32 run = s_root;
+    for (size_t i = 0; i < len; i++) {
+        edge = find_edge(run, ascii_fold((u8)word[i]));
+        if (edge == 0) return false;
+        run = DAWG_CHILD(s_edges[edge]);
+    }
+    return edge != 0 && (s_edges[edge] & DAWG_TERMINAL);
+}
+
+bool spell_check_word(const char* word, size_t len) {
+    if (!s_edges) return true;
+    if (lookup_folded(word, len)) return true;
+
+    // Possessives: "note's" is fine if "note" is
+    if (len > 2 && word[len - 2] == '\'' && ascii_fold(word[len - 1]) == 's') {
+        return lookup_folded(word, len - 2);
+    }
+    return false;
+}
+
+//---------------------------------------------------------------------------------
+// Suggestions
+//---------------------------------------------------------------------------------
+static void add_candidate(Candidates* cands, const char* word, size_t len, int dist) {
+    // Full, and no closer than the furthest one kept
+    if (cands->count == cands->max && dist >= cands->dist[cands->max - 1]) return;
+
+    int pos = cands->count < cands->max ? cands->count++ : cands->max - 1;
+    while (pos > 0 && cands->dist[pos - 1] > dist) {
+        cands->dist[pos] = cands->dist[pos - 1];
+        memcpy(cands->out[pos], cands->out[pos - 1], SPELL_MAX_WORD);
+        pos--;
+    }
+    cands->dist[pos] = dist;
+    memcpy(cands->out[pos], word, len);
+    cands->out[pos][len] = '\0';
+}
+
+// Optimal string alignment distance, one row per graph level. Costs are in
+// half edits so that a swapped pair ("teh") ranks ahead of a substitution.
+static void suggest_walk(u32 run, size_t depth, const u8* word, size_t wlen,
+                         const u8* prevRow, const u8* prevPrevRow, int maxCost,
+                         char* buf, Candidates* cands) {
+    u8 row[SPELL_MAX_WORD + 1];
+
+    for (u32 i = run; run != 0; i++) {
+        u32 edge = s_edges[i];
+        u8 c = DAWG_LABEL(edge);
+        u8 rowMin;
+
+        row[0] = (depth + 1) * 2;
+        rowMin = row[0];
+        for (size_t j = 1; j <= wlen; j++) {
+            u8 cost = word[j - 1] != c ? 2 : 0;
+            u8 best = prevRow[j - 1] + cost;
+            if (prevRow[j] + 2 < best) best = prevRow[j] + 2;
+            if (row[j - 1] + 2 < best) best = row[j - 1] + 2;
+            if (prevPrevRow && j > 1 && depth > 0 && c == word[j - 2] &&
+                (u8)buf[depth - 1] == word[j - 1] && prevPrevRow[j - 2] + 1 < best) {
+                best = prevPrevRow[j - 2] + 1;
+            }
+            row[j] = best;
+            if (best < rowMin) rowMin = best;
+        }
+
+        buf[depth] = c;
+        if ((edge & DAWG_TERMINAL) && row[wlen] <= maxCost) {
+            add_candidate(cands, buf, depth + 1, row[wlen]);
+        }
+        if (rowMin <= maxCost && DAWG_CHILD(edge) != 0 && depth + 2 < SPELL_MAX_WORD) {
+            suggest_walk(DAWG_CHILD(edge), depth + 1, word, wlen, row, prevRow,
+                         maxCost, buf, cands);
+        }
+        if (edge & DAWG_LAST) break;
+    }
+}
+
+int spell_suggest(const char* word, size_t len, char out[][SPELL_MAX_WORD], int max) {
+    if (!s_edges || len == 0 || len >= SPELL_MAX_WORD || max <= 0) return 0;
+    if (max > SPELL_MAX_ISSUES) max = SPELL_MAX_ISSUES;
+
+    u8 folded[SPELL_MAX_WORD];
+    u8 row0[SPELL_MAX_WORD + 1];
+    char buf[SPELL_MAX_WORD];
+    Candidates cands = { 0, max, { 0 }, out };
+
+    for (size_t i = 0; i < len; i++) folded[i] = ascii_fold((u8)word[i]);
+    for (size_t j = 0; j <= len; j++) row0[j] = j * 2;
+
+    // One edit is plenty for short words; two gives nonsense there
+    int maxEdits = len <= 4 ? 1 : SPELL_MAX_EDITS;
+    suggest_walk(s_root, 0, folded, len, row0, NULL, maxEdits * 2, buf, &cands);
+    return cands.count;
+}
+
+//---------------------------------------------------------------------------------
+// Paragraph checking
+//---------------------------------------------------------------------------------
+static inline bool is_letter(u8 c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool is_word_byte(u8 c) {
+    return is_letter(c) || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+// Words with digits, non-ASCII bytes or inner capitals (identifiers,
+// acronyms, other languages) are left alone.
+static bool should_check(const char* word, size_t len) {
+    if (len < 2 || len >= SPELL_MAX_WORD) return false;
+    for (size_t i = 0; i < len; i++) {
+        u8 c = word[i];
+        if (c >= 0x80 || (c >= '0' && c <= '9') || c == '_') return false;
+        if (i > 0 && c >= 'A' && c <= 'Z') return false;
+    }
+    return true;
+}
+
+static void check_paragraph(const char* text, size_t len, SpellResult* result) {
+    bool inCode = false;
+    size_t i = 0;
+
+    result->count = 0;
+    while (i < len && result->count < SPELL_MAX_ISSUES) {
+        u8 c = text[i];
+        if (c == '`') inCode = !inCode;
+        if (!is_word_byte(c)) {
+            i++;
+            continue;
+        }
+
+        // A word is letters with inner apostrophes; any attached digit,
+        // underscore or UTF-8 byte is taken along and disqualifies it
+        size_t start = i;
+        while (i < len && (is_word_byte(text[i]) ||
+                           (text[i] == '\'' && i + 1 < len && is_letter(text[i + 1])))) {
+            i++;
+        }
+
+        size_t wlen = i - start;
+        if (inCode || !should_check(text + start, wlen)) continue;
+        if (spell_check_word(text + start, wlen)) continue;
+
+        SpellIssue* issue = &result->issues[result->count++];
+        char best[1][SPELL_MAX_WORD];
+        issue->offset = start;
+        issue->len = wlen;
+        issue->suggestion[0] = '\0';
+        if (spell_suggest(text + start, wlen, best, 1) > 0) {
+            memcpy(issue->suggestion, best[0], SPELL_MAX_WORD);
+        }
+    }
+}
+
+u32 spell_revision(const char* text, size_t len) {
+    return fnv1a(FNV_OFFSET, text, len) ^ (u32)len;
+}
+
+// A pending entry is not evicted, so its text stays put without the lock
+static void spell_job(void* arg) {
+    CacheEntry* entry = arg;
+    SpellResult result;
+
+    prof_begin("spell check");
+    check_paragraph(entry->text, entry->len, &result);
+    prof_end();
+
+    LightLock_Lock(&s_cacheLock);
+    result.revision = entry->result.revision;
+    entry->result = result;
+    entry->state = ENTRY_DONE;
+    LightLock_Unlock(&s_cacheLock);
+}
+
+bool spell_lookup(const char* text, size_t len, SpellResult* out) {
+    if (!s_edges) {
+        out->revision = 0;
+        out->count = 0;
+        return true;
+    }
+
+    u32 revision = spell_revision(text, len);
+    CacheEntry* victim = NULL;
+    bool found = false;
+
+    LightLock_Lock(&s_cacheLock);
+    s_useClock++;
+    for (int i = 0; i < SPELL_CACHE_SIZE; i++) {
+        CacheEntry* entry = &s_cache[i];
+        if (entry->state != ENTRY_EMPTY && entry->result.revision == revision &&
+            entry->len == len && memcmp(entry->text, text, len) == 0) {
+            entry->lastUse = s_useClock;
+            if (entry->state == ENTRY_DONE) {
+                *out = entry->result;
+                found = true;
+            }
+            LightLock_Unlock(&s_cacheLock);
+            return found;
+        }
+        // Pending entries belong to the worker until it fills them in
+        if (entry->state == ENTRY_PENDING) continue;
+        if (!victim || entry->state == ENTRY_EMPTY ||
+            (victim->state != ENTRY_EMPTY && entry->lastUse < victim->lastUse)) {
+            victim = entry;
+        }
+    }
+
+    char* copy = victim ? malloc(len ? len : 1) : NULL;
+    if (copy) {
+        memcpy(copy, text, len);
+        free(victim->text);
+        victim->text = copy;
+        victim->len = len;
+        victim->lastUse = s_useClock;
+        victim->result.revision = revision;
+        victim->result.count = 0;
+        victim->state = worker_submit(spell_job, victim) ? ENTRY_PENDING : ENTRY_EMPTY;
+    }
+    LightLock_Unlock(&s_cacheLock);
+    return false;
+}
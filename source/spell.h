@@ -0,0 +1,48 @@
+//---------------------------------------------------------------------------------
+// spell.h
+// Spell checking against the romfs dictionary, with per-paragraph results
+// computed on the background worker.
+//---------------------------------------------------------------------------------
+
+#ifndef SPELL_H
+#define SPELL_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+#define SPELL_DICT_PATH    "romfs:/dict/en.dawg"
+#define SPELL_MAX_WORD     32
+#define SPELL_MAX_ISSUES   8     // Misspellings remembered per paragraph
+#define SPELL_CACHE_SIZE   64    // Paragraph revisions kept
+#define SPELL_MAX_EDITS    2
+
+typedef struct {
+    u16 offset;                      // Byte offset of the word in its paragraph
+    u16 len;
+    char suggestion[SPELL_MAX_WORD]; // Closest dictionary word, empty if none
+} SpellIssue;
+
+typedef struct {
+    u32 revision;                    // spell_revision() of the paragraph
+    int count;
+    SpellIssue issues[SPELL_MAX_ISSUES];
+} SpellResult;
+
+// Loads the dictionary image with a single read. Spell checking is simply
+// disabled if it is missing or malformed.
+bool spell_init(const char* path);
+void spell_exit(void);
+
+bool spell_check_word(const char* word, size_t len);
+
+// Closest dictionary words within SPELL_MAX_EDITS edits, nearest first
+int spell_suggest(const char* word, size_t len, char out[][SPELL_MAX_WORD], int max);
+
+// Revision key of a paragraph: changes whenever its text changes
+u32 spell_revision(const char* text, size_t len);
+
+// Copy the result for this paragraph revision into `out`. If it is not
+// cached yet, a check is queued on the worker and false is returned.
+bool spell_lookup(const char* text, size_t len, SpellResult* out);
+
+#endif // SPELL_H
@@ -0,0 +1,72 @@
+//---------------------------------------------------------------------------------
+// storage.h
+// Platform layer for note files. The 3DS backend talks to the SD card archive
+// through FSUSER directly; the host backend uses POSIX files so the note code
+// can run off-device.
+//---------------------------------------------------------------------------------
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+#define STORAGE_NAME_LEN  256
+#define STORAGE_DIR_BATCH 64    // Directory entries fetched per call
+
+typedef struct {
+    char name[STORAGE_NAME_LEN];   // UTF-8
+    u64 size;
+    bool isDir;
+} StorageEntry;
+
+typedef struct StorageDir StorageDir;
+typedef struct StorageFile StorageFile;
+
+// Open the storage rooted at `dir` (e.g. "sdmc:/3ds.md/"), creating the
+// directory if needed. File names below are relative to it.
+bool storage_init(const char* dir);
+void storage_exit(void);
+
+// Read up to `cap` bytes of `name` straight into `buf`. Returns the number of
+// bytes read, or -1 if the file cannot be opened.
+s32 storage_read(const char* name, void* buf, size_t cap);
+
+// Replace the contents of `name` with `len` bytes from `data`
+bool storage_write(const char* name, const void* data, size_t len);
+
+// Add `len` bytes from `data` to the end of `name`, creating it if needed,
+// and flush them
+bool storage_append(const char* name, const void* data, size_t len);
+
+// Open `name` for sequential reading, or create or truncate it for writing
+StorageFile* storage_open(const char* name, bool write);
+
+// Read up to `len` bytes from the current position. Returns the number of
+// bytes read, 0 at the end of the file, or -1 on error.
+s32 storage_file_read(StorageFile* file, void* buf, size_t len);
+bool storage_file_write(StorageFile* file, const void* data, size_t len);
+
+// Close the file, flushing what was written. Returns false if any write
+// failed.
+bool storage_close(StorageFile* file);
+
+bool storage_exists(const char* name);
+
+// Size and modification time of `name`. The time is only good for telling
+// whether a file changed: the 3DS and the host count it differently.
+bool storage_stat(const char* name, u64* size, u64* mtime);
+
+// Create the subdirectory `name`; true if it exists afterwards
+bool storage_make_dir(const char* name);
+
+// Rename `from` to `to`, which must not exist
+bool storage_rename(const char* from, const char* to);
+bool storage_remove(const char* name);
+
+// List the storage directory; entries come back in batches internally
+StorageDir* storage_dir_open(void);
+bool storage_dir_next(StorageDir* dir, StorageEntry* out);
+void storage_dir_close(StorageDir* dir);
+
+#endif // STORAGE_H
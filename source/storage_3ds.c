@@ -0,0 +1,260 @@
+//---------------------------------------------------------------------------------
+// storage_3ds.c
+// FSUSER storage backend. The SDMC archive stays open for the life of the
+// app, files are read and written in one request straight from the caller's
+// buffer, and directories are listed STORAGE_DIR_BATCH entries per request,
+// which avoids newlib's per-call path lookup and the copies through its
+// stdio buffers.
+//---------------------------------------------------------------------------------
+
+#ifdef __3DS__
+
+#include "storage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define STORAGE_ROOT_LEN 256
+#define STORAGE_PATH_LEN (STORAGE_ROOT_LEN + STORAGE_NAME_LEN)
+
+struct StorageDir {
+    Handle handle;
+    u32 count;       // Entries in the current batch
+    u32 next;        // Next entry to hand out
+    FS_DirectoryEntry entries[STORAGE_DIR_BATCH];
+};
+
+struct StorageFile {
+    Handle handle;
+    u64 offset;
+    bool write;
+    bool ok;         // No write has failed
+};
+
+static FS_Archive s_archive;
+static bool s_open = false;
+static char s_root[STORAGE_ROOT_LEN];
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+// `name` below the root as a UTF-16 path in `buf`, so a name that is not
+// ASCII opens as storage_dir_next() listed it. A UTF-8 string never takes
+// more UTF-16 units than bytes, so the path always fits.
+static FS_Path make_path(u16* buf, const char* name) {
+    char utf8[STORAGE_PATH_LEN];
+    snprintf(utf8, sizeof(utf8), "%s%s", s_root, name);
+    ssize_t len = utf8_to_utf16(buf, (const u8*)utf8, STORAGE_PATH_LEN - 1);
+    buf[len < 0 ? 0 : len < STORAGE_PATH_LEN ? len : STORAGE_PATH_LEN - 1] = 0;
+    return fsMakePath(PATH_UTF16, buf);
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+bool storage_init(const char* dir) {
+    u16 path[STORAGE_PATH_LEN];
+
+    // Paths inside the archive have no device prefix
+    const char* colon = strchr(dir, ':');
+    snprintf(s_root, sizeof(s_root), "%s", colon ? colon + 1 : dir);
+
+    if (R_FAILED(FSUSER_OpenArchive(&s_archive, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, "")))) return false;
+    s_open = true;
+
+    // Fails harmlessly if the directory already exists
+    FSUSER_CreateDirectory(s_archive, make_path(path, ""), 0);
+    return true;
+}
+
+void storage_exit(void) {
+    if (s_open) FSUSER_CloseArchive(s_archive);
+    s_open = false;
+}
+
+s32 storage_read(const char* name, void* buf, size_t cap) {
+    u16 path[STORAGE_PATH_LEN];
+    Handle file;
+    u64 size = 0;
+    u32 got = 0;
+
+    if (!s_open || R_FAILED(FSUSER_OpenFile(&file, s_archive, make_path(path, name), FS_OPEN_READ, 0))) {
+        return -1;
+    }
+    if (R_SUCCEEDED(FSFILE_GetSize(file, &size)) && size > 0) {
+        FSFILE_Read(file, &got, 0, buf, size < cap ? size : cap);
+    }
+    FSFILE_Close(file);
+    return got;
+}
+
+bool storage_write(const char* name, const void* data, size_t len) {
+    u16 path[STORAGE_PATH_LEN];
+    Handle file;
+    u32 written = 0;
+
+    if (!s_open || R_FAILED(FSUSER_OpenFile(&file, s_archive, make_path(path, name),
+                                            FS_OPEN_WRITE | FS_OPEN_CREATE, 0))) {
+        return false;
+    }
+    bool ok = R_SUCCEEDED(FSFILE_SetSize(file, len));
+    if (ok && len > 0) {
+        ok = R_SUCCEEDED(FSFILE_Write(file, &written, 0, data, len, FS_WRITE_FLUSH)) && written == len;
+    }
+    FSFILE_Close(file);
+    return ok;
+}
+
+bool storage_append(const char* name, const void* data, size_t len) {
+    u16 path[STORAGE_PATH_LEN];
+    Handle file;
+    u64 size = 0;
+    u32 written = 0;
+
+    if (!s_open || R_FAILED(FSUSER_OpenFile(&file, s_archive, make_path(path, name),
+                                            FS_OPEN_WRITE | FS_OPEN_CREATE, 0))) {
+        return false;
+    }
+    bool ok = R_SUCCEEDED(FSFILE_GetSize(file, &size));
+    if (ok && len > 0) {
+        ok = R_SUCCEEDED(FSFILE_Write(file, &written, size, data, len, FS_WRITE_FLUSH)) && written == len;
+    }
+    FSFILE_Close(file);
+    return ok;
+}
+
+StorageFile* storage_open(const char* name, bool write) {
+    u16 path[STORAGE_PATH_LEN];
+    if (!s_open) return NULL;
+
+    StorageFile* file = malloc(sizeof(StorageFile));
+    if (!file) return NULL;
+    u32 flags = write ? FS_OPEN_WRITE | FS_OPEN_CREATE : FS_OPEN_READ;
+    if (R_FAILED(FSUSER_OpenFile(&file->handle, s_archive, make_path(path, name), flags, 0))) {
+        free(file);
+        return NULL;
+    }
+    file->offset = 0;
+    file->write = write;
+    file->ok = !write || R_SUCCEEDED(FSFILE_SetSize(file->handle, 0));
+    return file;
+}
+
+s32 storage_file_read(StorageFile* file, void* buf, size_t len) {
+    u32 got = 0;
+    if (R_FAILED(FSFILE_Read(file->handle, &got, file->offset, buf, len))) return -1;
+    file->offset += got;
+    return got;
+}
+
+bool storage_file_write(StorageFile* file, const void* data, size_t len) {
+    u32 written = 0;
+    if (file->ok && len > 0) {
+        file->ok = R_SUCCEEDED(FSFILE_Write(file->handle, &written, file->offset, data, len, 0)) && written == len;
+        file->offset += written;
+    }
+    return file->ok;
+}
+
+bool storage_close(StorageFile* file) {
+    if (!file) return false;
+    bool ok = file->ok;
+    if (file->write) ok = R_SUCCEEDED(FSFILE_Flush(file->handle)) && ok;
+    FSFILE_Close(file->handle);
+    free(file);
+    return ok;
+}
+
+bool storage_exists(const char* name) {
+    u16 path[STORAGE_PATH_LEN];
+    Handle file;
+    if (!s_open || R_FAILED(FSUSER_OpenFile(&file, s_archive, make_path(path, name), FS_OPEN_READ, 0))) {
+        return false;
+    }
+    FSFILE_Close(file);
+    return true;
+}
+
+bool storage_stat(const char* name, u64* size, u64* mtime) {
+    u16 path[STORAGE_PATH_LEN];
+    Handle file;
+    if (!s_open) return false;
+
+    FS_Path fsPath = make_path(path, name);
+    if (R_FAILED(FSUSER_OpenFile(&file, s_archive, fsPath, FS_OPEN_READ, 0))) return false;
+    bool ok = R_SUCCEEDED(FSFILE_GetSize(file, size));
+    FSFILE_Close(file);
+
+    // The SD archive reports the modification time through ControlArchive,
+    // given the same UTF-16 path
+    return ok && R_SUCCEEDED(FSUSER_ControlArchive(s_archive, ARCHIVE_ACTION_GET_TIMESTAMP,
+                                                   (void*)fsPath.data, fsPath.size, mtime, sizeof(*mtime)));
+}
+
+bool storage_make_dir(const char* name) {
+    u16 path[STORAGE_PATH_LEN];
+    Handle dir;
+    if (!s_open) return false;
+
+    // Fails harmlessly if the directory already exists
+    FSUSER_CreateDirectory(s_archive, make_path(path, name), 0);
+    if (R_FAILED(FSUSER_OpenDirectory(&dir, s_archive, make_path(path, name)))) return false;
+    FSDIR_Close(dir);
+    return true;
+}
+
+bool storage_rename(const char* from, const char* to) {
+    u16 fromPath[STORAGE_PATH_LEN], toPath[STORAGE_PATH_LEN];
+    return s_open && R_SUCCEEDED(FSUSER_RenameFile(s_archive, make_path(fromPath, from),
+                                                   s_archive, make_path(toPath, to)));
+}
+
+bool storage_remove(const char* name) {
+    u16 path[STORAGE_PATH_LEN];
+    return s_open && R_SUCCEEDED(FSUSER_DeleteFile(s_archive, make_path(path, name)));
+}
+
+StorageDir* storage_dir_open(void) {
+    u16 path[STORAGE_PATH_LEN];
+    if (!s_open) return NULL;
+
+    StorageDir* dir = malloc(sizeof(StorageDir));
+    if (!dir) return NULL;
+    if (R_FAILED(FSUSER_OpenDirectory(&dir->handle, s_archive, make_path(path, "")))) {
+        free(dir);
+        return NULL;
+    }
+    dir->count = 0;
+    dir->next = 0;
+    return dir;
+}
+
+bool storage_dir_next(StorageDir* dir, StorageEntry* out) {
+    if (dir->next == dir->count) {
+        dir->next = 0;
+        dir->count = 0;
+        if (R_FAILED(FSDIR_Read(dir->handle, &dir->count, STORAGE_DIR_BATCH, dir->entries))) return false;
+        if (dir->count == 0) return false;
+    }
+
+    const FS_DirectoryEntry* entry = &dir->entries[dir->next++];
+    // The length returned is what the whole name needs, which may not have fit
+    ssize_t len = utf16_to_utf8((u8*)out->name, entry->name, STORAGE_NAME_LEN - 1);
+    out->name[len < 0 ? 0 : len < STORAGE_NAME_LEN ? len : STORAGE_NAME_LEN - 1] = '\0';
+    out->size = entry->fileSize;
+    out->isDir = (entry->attributes & FS_ATTRIBUTE_DIRECTORY) != 0;
+    return true;
+}
+
+void storage_dir_close(StorageDir* dir) {
+    if (!dir) return;
+    FSDIR_Close(dir->handle);
+    free(dir);
+}
+
+#endif // __3DS__
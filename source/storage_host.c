@@ -0,0 +1,185 @@
+//---------------------------------------------------------------------------------
+// storage_host.c
+// POSIX storage backend, used when the note code is built for the host.
+//---------------------------------------------------------------------------------
+
+#ifndef __3DS__
+
+#include "storage.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define STORAGE_ROOT_LEN 256
+#define STORAGE_PATH_LEN (STORAGE_ROOT_LEN + STORAGE_NAME_LEN)   // Room for the root and any name
+
+struct StorageDir {
+    DIR* dir;
+};
+
+struct StorageFile {
+    FILE* file;
+    bool ok;
+};
+
+static char s_root[STORAGE_ROOT_LEN];
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+bool storage_init(const char* dir) {
+    snprintf(s_root, sizeof(s_root), "%s", dir);
+    mkdir(s_root, 0777);
+    return true;
+}
+
+void storage_exit(void) {
+}
+
+s32 storage_read(const char* name, void* buf, size_t cap) {
+    char path[STORAGE_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%s", s_root, name);
+
+    FILE* file = fopen(path, "rb");
+    if (!file) return -1;
+    size_t got = fread(buf, 1, cap, file);
+    fclose(file);
+    return got;
+}
+
+bool storage_write(const char* name, const void* data, size_t len) {
+    char path[STORAGE_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%s", s_root, name);
+
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = len == 0 || fwrite(data, 1, len, file) == len;
+    return fclose(file) == 0 && ok;
+}
+
+bool storage_append(const char* name, const void* data, size_t len) {
+    char path[STORAGE_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%s", s_root, name);
+
+    FILE* file = fopen(path, "ab");
+    if (!file) return false;
+    bool ok = len == 0 || fwrite(data, 1, len, file) == len;
+    return fclose(file) == 0 && ok;
+}
+
+StorageFile* storage_open(const char* name, bool write) {
+    char path[STORAGE_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%s", s_root, name);
+
+    FILE* handle = fopen(path, write ? "wb" : "rb");
+    if (!handle) return NULL;
+    StorageFile* file = malloc(sizeof(StorageFile));
+    if (!file) {
+        fclose(handle);
+        return NULL;
+    }
+    file->file = handle;
+    file->ok = true;
+    return file;
+}
+
+s32 storage_file_read(StorageFile* file, void* buf, size_t len) {
+    size_t got = fread(buf, 1, len, file->file);
+    return (got == 0 && ferror(file->file)) ? -1 : (s32)got;
+}
+
+bool storage_file_write(StorageFile* file, const void* data, size_t len) {
+    if (file->ok && len > 0) file->ok = fwrite(data, 1, len, file->file) == len;
+    return file->ok;
+}
+
+bool storage_close(StorageFile* file) {
+    if (!file) return false;
+    bool ok = fclose(file->file) == 0 && file->ok;
+    free(file);
+    return ok;
+}
+
+bool storage_exists(const char* name) {
+    char path[STORAGE_PATH_LEN];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s", s_root, name);
+    return stat(path, &st) == 0;
+}
+
+bool storage_stat(const char* name, u64* size, u64* mtime) {
+    char path[STORAGE_PATH_LEN];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s", s_root, name);
+    if (stat(path, &st) != 0) return false;
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return true;
+}
+
+bool storage_make_dir(const char* name) {
+    char path[STORAGE_PATH_LEN];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s", s_root, name);
+    mkdir(path, 0777);
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool storage_rename(const char* from, const char* to) {
+    char fromPath[STORAGE_PATH_LEN], toPath[STORAGE_PATH_LEN];
+    snprintf(fromPath, sizeof(fromPath), "%s%s", s_root, from);
+    snprintf(toPath, sizeof(toPath), "%s%s", s_root, to);
+    return rename(fromPath, toPath) == 0;
+}
+
+bool storage_remove(const char* name) {
+    char path[STORAGE_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%s", s_root, name);
+    return remove(path) == 0;
+}
+
+StorageDir* storage_dir_open(void) {
+    DIR* handle = opendir(s_root);
+    if (!handle) return NULL;
+
+    StorageDir* dir = malloc(sizeof(StorageDir));
+    if (!dir) {
+        closedir(handle);
+        return NULL;
+    }
+    dir->dir = handle;
+    return dir;
+}
+
+bool storage_dir_next(StorageDir* dir, StorageEntry* out) {
+    struct dirent* entry;
+    while ((entry = readdir(dir->dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char path[STORAGE_PATH_LEN];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s%s", s_root, entry->d_name);
+        if (stat(path, &st) != 0) continue;
+
+        snprintf(out->name, sizeof(out->name), "%s", entry->d_name);
+        out->size = st.st_size;
+        out->isDir = S_ISDIR(st.st_mode);
+        return true;
+    }
+    return false;
+}
+
+void storage_dir_close(StorageDir* dir) {
+    if (!dir) return;
+    closedir(dir->dir);
+    free(dir);
+}
+
+#endif // !__3DS__
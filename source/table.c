@@ -0,0 +1,240 @@
+//---------------------------------------------------------------------------------
+// table.c
+// Markdown pipe tables. Every cell is measured once per table revision and
+// the resulting column widths are cached, so drawing a row is a walk over
+// known column offsets that only parses the cells inside the viewport.
+//---------------------------------------------------------------------------------
+
+#include "table.h"
+#include "crc.h"
+#include "util.h"
+#include "view.h"
+
+#include <string.h>
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define TABLE_MIN_WIDTH 12.0f
+
+#define COLOR_TABLE_TEXT   C2D_Color32(0xE0, 0xE0, 0xE0, 0xFF)
+#define COLOR_TABLE_HEADER C2D_Color32(0xFF, 0xFF, 0xFF, 0xFF)
+#define COLOR_TABLE_GRID   C2D_Color32(0x50, 0x50, 0x50, 0xFF)
+
+typedef struct {
+    u32 revision;
+    u32 crc;
+    u32 len;
+    int columns;
+    float width[TABLE_MAX_COLUMNS];
+} WidthEntry;
+
+static WidthEntry s_widthCache[TABLE_WIDTH_CACHE];
+static int s_widthCount = 0;
+static int s_widthNext = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Split a row into trimmed cells; returns the number of cells found
+static int split_cells(const char* line, u32 len, u32* starts, u32* lens, int max) {
+    u32 begin = 0, end = len;
+    while (begin < end && is_space(line[begin])) begin++;
+    while (end > begin && is_space(line[end - 1])) end--;
+    if (begin < end && line[begin] == '|') begin++;
+    if (end > begin && line[end - 1] == '|' && !(end - begin >= 2 && line[end - 2] == '\\')) end--;
+
+    int count = 0;
+    u32 cell = begin;
+    for (u32 i = begin; i <= end && count < max; i++) {
+        if (i < end && (line[i] != '|' || (i > 0 && line[i - 1] == '\\'))) continue;
+
+        u32 s = cell, e = i;
+        while (s < e && is_space(line[s])) s++;
+        while (e > s && is_space(line[e - 1])) e--;
+        starts[count] = s;
+        lens[count] = e - s;
+        count++;
+        cell = i + 1;
+    }
+    return count;
+}
+
+static void update_total(Table* table) {
+    table->totalWidth = 0.0f;
+    for (int c = 0; c < table->columns; c++) {
+        table->totalWidth += table->width[c] + TABLE_CELL_PAD;
+    }
+}
+
+// Find the `n`th line of the table; returns its length
+static u32 table_line(const Table* table, const char* text, u32 n, const char** out) {
+    const char* p = text + table->start;
+    const char* end = p + table->len;
+    while (n > 0 && p < end) {
+        const char* nl = memchr(p, '\n', end - p);
+        if (!nl) return 0;
+        p = nl + 1;
+        n--;
+    }
+    const char* nl = memchr(p, '\n', end - p);
+    *out = p;
+    return (nl ? nl : end) - p;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+bool table_is_row(const char* line, u32 len) {
+    for (u32 i = 0; i < len; i++) {
+        if (line[i] == '|' && (i == 0 || line[i - 1] != '\\')) return true;
+    }
+    return false;
+}
+
+bool table_is_delimiter(const char* line, u32 len) {
+    u32 starts[TABLE_MAX_COLUMNS], lens[TABLE_MAX_COLUMNS];
+    if (!table_is_row(line, len)) return false;
+
+    int cells = split_cells(line, len, starts, lens, TABLE_MAX_COLUMNS);
+    for (int c = 0; c < cells; c++) {
+        const char* cell = line + starts[c];
+        u32 n = lens[c], i = 0, dashes = 0;
+        if (i < n && cell[i] == ':') i++;
+        while (i < n && cell[i] == '-') i++, dashes++;
+        if (i < n && cell[i] == ':') i++;
+        if (dashes == 0 || i != n) return false;
+    }
+    return cells > 0;
+}
+
+void table_init(Table* table, const char* text, u32 start, u32 len, u32 firstLine, u32 lineCount) {
+    u32 starts[TABLE_MAX_COLUMNS], lens[TABLE_MAX_COLUMNS];
+    const char* line;
+    u32 lineLen;
+
+    table->start = start;
+    table->len = len;
+    table->firstLine = firstLine;
+    table->lineCount = lineCount;
+    table->revision = fnv1a(FNV_OFFSET, text + start, len);
+    table->crc = crc_compute(text + start, len);
+    table->measured = false;
+
+    lineLen = table_line(table, text, 0, &line);
+    table->columns = split_cells(line, lineLen, starts, lens, TABLE_MAX_COLUMNS);
+
+    // Column alignment comes from the colons in the delimiter row
+    lineLen = table_line(table, text, 1, &line);
+    int cells = split_cells(line, lineLen, starts, lens, TABLE_MAX_COLUMNS);
+    for (int c = 0; c < table->columns; c++) {
+        table->align[c] = ALIGN_LEFT;
+        if (c >= cells || lens[c] == 0) continue;
+        bool left = line[starts[c]] == ':';
+        bool right = line[starts[c] + lens[c] - 1] == ':';
+        if (left && right) table->align[c] = ALIGN_CENTER;
+        else if (right) table->align[c] = ALIGN_RIGHT;
+    }
+
+    for (int i = 0; i < s_widthCount; i++) {
+        const WidthEntry* entry = &s_widthCache[i];
+        if (entry->revision == table->revision && entry->crc == table->crc && entry->len == table->len &&
+            entry->columns == table->columns) {
+            memcpy(table->width, entry->width, sizeof(table->width));
+            table->measured = true;
+            update_total(table);
+            break;
+        }
+    }
+}
+
+void table_measure(Table* table, const char* text, C2D_TextBuf scratch) {
+    u32 starts[TABLE_MAX_COLUMNS], lens[TABLE_MAX_COLUMNS];
+
+    for (int c = 0; c < table->columns; c++) table->width[c] = TABLE_MIN_WIDTH;
+
+    for (u32 row = 0; row < table->lineCount; row++) {
+        if (row == 1) continue;   // Delimiter
+
+        const char* line;
+        u32 len = table_line(table, text, row, &line);
+        int cells = split_cells(line, len, starts, lens, table->columns);
+        for (int c = 0; c < cells; c++) {
+            if (lens[c] == 0) continue;
+
+            char cell[256];
+            u32 n = lens[c] < sizeof(cell) - 1 ? lens[c] : sizeof(cell) - 1;
+            C2D_Text t;
+            float w = 0.0f;
+            memcpy(cell, line + starts[c], n);
+            cell[n] = '\0';
+            C2D_TextBufClear(scratch);
+            C2D_TextParse(&t, scratch, cell);
+            C2D_TextGetDimensions(&t, VIEW_TEXT_SCALE, VIEW_TEXT_SCALE, &w, NULL);
+            if (w > table->width[c]) table->width[c] = w;
+        }
+    }
+    C2D_TextBufClear(scratch);
+    update_total(table);
+    table->measured = true;
+
+    WidthEntry* entry = &s_widthCache[s_widthNext];
+    s_widthNext = (s_widthNext + 1) % TABLE_WIDTH_CACHE;
+    if (s_widthCount < TABLE_WIDTH_CACHE) s_widthCount++;
+    entry->revision = table->revision;
+    entry->crc = table->crc;
+    entry->len = table->len;
+    entry->columns = table->columns;
+    memcpy(entry->width, table->width, sizeof(entry->width));
+}
+
+void table_draw_row(const Table* table, int row, const char* line, u32 len,
+                    float x, float y, float clipLeft, float clipRight, C2D_TextBuf buf) {
+    u32 starts[TABLE_MAX_COLUMNS], lens[TABLE_MAX_COLUMNS];
+
+    float left = x > clipLeft ? x : clipLeft;
+    float right = x + table->totalWidth < clipRight ? x + table->totalWidth : clipRight;
+    if (row == 1) {
+        if (right > left) {
+            C2D_DrawRectSolid(left, y + VIEW_LINE_H * 0.5f, 0.5f, right - left, 1.0f, COLOR_TABLE_GRID);
+        }
+        return;
+    }
+
+    int cells = split_cells(line, len, starts, lens, table->columns);
+    float cx = x;
+    for (int c = 0; c < table->columns; c++) {
+        float colW = table->width[c] + TABLE_CELL_PAD;
+
+        if (cx + colW > clipLeft && cx < clipRight) {
+            // Text cannot be clipped, so a cell cut by the left edge is left blank
+            if (c < cells && lens[c] > 0 && cx >= clipLeft) {
+                char cell[256];
+                u32 n = lens[c] < sizeof(cell) - 1 ? lens[c] : sizeof(cell) - 1;
+                C2D_Text t;
+                float w = 0.0f;
+                memcpy(cell, line + starts[c], n);
+                cell[n] = '\0';
+                C2D_TextParse(&t, buf, cell);
+                C2D_TextOptimize(&t);
+                C2D_TextGetDimensions(&t, VIEW_TEXT_SCALE, VIEW_TEXT_SCALE, &w, NULL);
+
+                float tx = cx + TABLE_CELL_PAD * 0.5f;
+                if (table->align[c] == ALIGN_RIGHT) tx += table->width[c] - w;
+                else if (table->align[c] == ALIGN_CENTER) tx += (table->width[c] - w) * 0.5f;
+                C2D_DrawText(&t, C2D_WithColor, tx, y, 0.5f, VIEW_TEXT_SCALE, VIEW_TEXT_SCALE,
+                             row == 0 ? COLOR_TABLE_HEADER : COLOR_TABLE_TEXT);
+            }
+            if (c + 1 < table->columns && cx + colW < clipRight) {
+                C2D_DrawRectSolid(cx + colW, y, 0.5f, 1.0f, VIEW_LINE_H, COLOR_TABLE_GRID);
+            }
+        }
+        cx += colW;
+        if (cx >= clipRight) break;
+    }
+}
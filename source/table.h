@@ -0,0 +1,57 @@
+//---------------------------------------------------------------------------------
+// table.h
+// Layout and drawing of markdown pipe tables.
+//---------------------------------------------------------------------------------
+
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <3ds.h>
+#include <citro2d.h>
+
+#define TABLE_MAX_COLUMNS 16
+#define TABLE_WIDTH_CACHE 16     // Table revisions whose column widths are kept
+#define TABLE_CELL_PAD    8.0f
+
+typedef enum {
+    ALIGN_LEFT,
+    ALIGN_CENTER,
+    ALIGN_RIGHT
+} TableAlign;
+
+typedef struct {
+    u32 start;                        // Byte range of all rows in the note
+    u32 len;
+    u32 firstLine;
+    u32 lineCount;                    // Header, delimiter and body rows
+    u32 revision;                     // FNV-1a and CRC-32 of the table text
+    u32 crc;
+    int columns;
+    u8 align[TABLE_MAX_COLUMNS];
+    float width[TABLE_MAX_COLUMNS];   // Widest cell per column, once measured
+    float totalWidth;
+    bool measured;
+} Table;
+
+// A line is a table row if it has an unescaped '|'
+bool table_is_row(const char* line, u32 len);
+
+// The |---|:---:| line under the header
+bool table_is_delimiter(const char* line, u32 len);
+
+// Set up a table over the given rows. Column widths are taken from the cache
+// if a table with the same text was measured before.
+void table_init(Table* table, const char* text, u32 start, u32 len, u32 firstLine, u32 lineCount);
+
+// Measure every cell and cache the column widths. Only needed when
+// `measured` is still false after table_init().
+void table_measure(Table* table, const char* text, C2D_TextBuf scratch);
+
+// Draw row `row` (0 is the header, 1 the delimiter) of a measured table with
+// its left edge at `x`. Cells entirely outside [clipLeft, clipRight) are
+// skipped without being parsed, and a cell that starts left of `clipLeft`
+// is drawn without its text.
+void table_draw_row(const Table* table, int row, const char* line, u32 len,
+                    float x, float y, float clipLeft, float clipRight, C2D_TextBuf buf);
+
+#endif // TABLE_H
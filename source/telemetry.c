@@ -0,0 +1,205 @@
+//---------------------------------------------------------------------------------
+// telemetry.c
+// Session summaries in the metadata store, one key per session numbered in
+// hex so the keys sort oldest first. Frame times go into a histogram of
+// FRAME_BUCKET_US buckets as they happen, so the percentiles cost nothing
+// per frame and no memory grows with the session. A record written by a
+// different version of the app has a different size and is dropped at open.
+//---------------------------------------------------------------------------------
+
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kv.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define TELEMETRY_KEY   "telemetry/"     // Session keys in the metadata store
+#define FRAME_BUCKET_US 100
+#define FRAME_BUCKETS   512              // Up to 51.2 ms; longer frames count in the last
+#define FRAME_GAP_MS    1000             // Longer means the app was suspended, not slow
+
+static TelemetrySession s_history[TELEMETRY_SESSIONS];
+static u32 s_historyIds[TELEMETRY_SESSIONS];
+static int s_historyCount = 0;
+static u32 s_nextId = 0;
+static bool s_open = false;
+
+// This session
+static TelemetrySession s_session;
+static u64 s_start = 0;
+static u64 s_mark = 0;                   // End of the last boot phase
+static u64 s_lastFrame = 0;
+static u32 s_frameBuckets[FRAME_BUCKETS];
+static u64 s_saveTicks = 0;
+static u64 s_saveMaxTicks = 0;
+
+static const char* s_labels[TELEMETRY_METRIC_COUNT] = {
+    "cold start (ms)",
+    "frame time p50 (ms)",
+    "frame time p99 (ms)",
+    "save, average (ms)",
+    "save, slowest (ms)",
+    "note read at start, average (ms)",
+    "library size (KB)",
+};
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static u32 ticks_us(u64 ticks) {
+    return (u32)(ticks * 1000 / CPU_TICKS_PER_MSEC);
+}
+
+// The frame time that `percent` of the frames took at most
+static u32 frame_percentile(u32 percent) {
+    u32 target = (u32)(((u64)s_session.frames * percent + 99) / 100);
+    u32 seen = 0;
+    if (s_session.frames == 0) return 0;
+    for (int i = 0; i < FRAME_BUCKETS - 1; i++) {
+        seen += s_frameBuckets[i];
+        if (seen >= target) return (i + 1) * FRAME_BUCKET_US;
+    }
+    return s_session.frameMax;
+}
+
+static bool load_session(const char* key, const void* value, size_t len, void* txn) {
+    u32 id = strtoul(key + strlen(TELEMETRY_KEY), NULL, 16);
+    if (id >= s_nextId) s_nextId = id + 1;
+    if (len != sizeof(TelemetrySession)) {
+        kv_delete(txn, key);
+        return true;
+    }
+
+    // Only ever more than TELEMETRY_SESSIONS if the limit was lowered
+    if (s_historyCount == TELEMETRY_SESSIONS) {
+        memmove(s_history, s_history + 1, (TELEMETRY_SESSIONS - 1) * sizeof(TelemetrySession));
+        memmove(s_historyIds, s_historyIds + 1, (TELEMETRY_SESSIONS - 1) * sizeof(u32));
+        s_historyCount--;
+    }
+    memcpy(&s_history[s_historyCount], value, sizeof(TelemetrySession));
+    s_historyIds[s_historyCount++] = id;
+    return true;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void telemetry_start(void) {
+    memset(&s_session, 0, sizeof(s_session));
+    memset(s_frameBuckets, 0, sizeof(s_frameBuckets));
+    s_session.started = (u32)time(NULL);
+    s_start = s_mark = svcGetSystemTick();
+    s_lastFrame = 0;
+    s_saveTicks = s_saveMaxTicks = 0;
+}
+
+void telemetry_boot(TelemetryBoot phase) {
+    u64 now = svcGetSystemTick();
+    u32 ms = (u32)((now - s_mark) / CPU_TICKS_PER_MSEC);
+    s_session.bootMs[phase] = ms < 0xFFFF ? ms : 0xFFFF;
+    s_mark = now;
+}
+
+void telemetry_open(void) {
+    s_historyCount = 0;
+    s_nextId = 0;
+    KvTxn* txn = kv_begin();
+    kv_scan_prefix(TELEMETRY_KEY, load_session, txn);
+    kv_commit(txn);
+    s_open = true;
+}
+
+void telemetry_frame(void) {
+    u64 now = svcGetSystemTick();
+    if (s_lastFrame == 0) {
+        telemetry_boot(TELEMETRY_BOOT_FIRST_FRAME);
+    } else if (now - s_lastFrame < (u64)(FRAME_GAP_MS * CPU_TICKS_PER_MSEC)) {
+        u32 us = ticks_us(now - s_lastFrame);
+        u32 bucket = us / FRAME_BUCKET_US;
+        s_frameBuckets[bucket < FRAME_BUCKETS ? bucket : FRAME_BUCKETS - 1]++;
+        if (us > s_session.frameMax) s_session.frameMax = us;
+        s_session.frames++;
+    }
+    s_lastFrame = now;
+}
+
+void telemetry_save(u64 ticks) {
+    s_session.saves++;
+    s_saveTicks += ticks;
+    if (ticks > s_saveMaxTicks) s_saveMaxTicks = ticks;
+}
+
+void telemetry_library(u32 notes, u32 bytes, float readMs) {
+    s_session.notes = notes;
+    s_session.bytes = bytes;
+    s_session.readAvg = notes > 0 ? (u32)(readMs * 1000.0f / notes) : 0;
+}
+
+bool telemetry_record(void) {
+    char key[KV_KEY_LEN];
+    TelemetrySession session;
+    if (!s_open) return false;
+    telemetry_current(&session);
+
+    // Add this session and drop the oldest past the limit, in one commit
+    KvTxn* txn = kv_begin();
+    snprintf(key, sizeof(key), TELEMETRY_KEY "%08lx", (unsigned long)s_nextId);
+    kv_put(txn, key, &session, sizeof(session));
+    int drop = s_historyCount + 1 - TELEMETRY_SESSIONS;
+    for (int i = 0; i < drop; i++) {
+        snprintf(key, sizeof(key), TELEMETRY_KEY "%08lx", (unsigned long)s_historyIds[i]);
+        kv_delete(txn, key);
+    }
+    if (!kv_commit(txn)) return false;
+
+    if (drop > 0) {
+        memmove(s_history, s_history + drop, (s_historyCount - drop) * sizeof(TelemetrySession));
+        memmove(s_historyIds, s_historyIds + drop, (s_historyCount - drop) * sizeof(u32));
+        s_historyCount -= drop;
+    }
+    s_history[s_historyCount] = session;
+    s_historyIds[s_historyCount++] = s_nextId++;
+    return true;
+}
+
+int telemetry_history(const TelemetrySession** out) {
+    *out = s_history;
+    return s_historyCount;
+}
+
+void telemetry_current(TelemetrySession* out) {
+    *out = s_session;
+    out->seconds = (u32)((svcGetSystemTick() - s_start) / (CPU_TICKS_PER_MSEC * 1000));
+    out->frameP50 = frame_percentile(50);
+    out->frameP99 = frame_percentile(99);
+    out->saveAvg = s_session.saves > 0 ? ticks_us(s_saveTicks / s_session.saves) : 0;
+    out->saveMax = ticks_us(s_saveMaxTicks);
+}
+
+float telemetry_value(const TelemetrySession* session, TelemetryMetric metric) {
+    switch (metric) {
+        case TELEMETRY_COLD_START: {
+            u32 ms = 0;
+            for (int i = 0; i < TELEMETRY_BOOT_COUNT; i++) ms += session->bootMs[i];
+            return ms;
+        }
+        case TELEMETRY_FRAME_P50: return session->frameP50 / 1000.0f;
+        case TELEMETRY_FRAME_P99: return session->frameP99 / 1000.0f;
+        case TELEMETRY_SAVE_AVG:  return session->saveAvg / 1000.0f;
+        case TELEMETRY_SAVE_MAX:  return session->saveMax / 1000.0f;
+        case TELEMETRY_READ_AVG:  return session->readAvg / 1000.0f;
+        case TELEMETRY_LIBRARY:   return session->bytes / 1024.0f;
+        default:                  return 0.0f;
+    }
+}
+
+const char* telemetry_label(TelemetryMetric metric) {
+    return metric < TELEMETRY_METRIC_COUNT ? s_labels[metric] : "";
+}
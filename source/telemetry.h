@@ -0,0 +1,85 @@
+//---------------------------------------------------------------------------------
+// telemetry.h
+// Per-session performance summary kept across sessions: how long start-up
+// took, frame time percentiles, save and note read latency and the library
+// size. Each session adds one record to the metadata store at exit, and the
+// oldest are dropped past TELEMETRY_SESSIONS, so weeks of history take a few
+// KB.
+//---------------------------------------------------------------------------------
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <3ds.h>
+
+#define TELEMETRY_SESSIONS 64    // Sessions kept
+
+// Start-up phases, in order; each ends where the next begins
+typedef enum {
+    TELEMETRY_BOOT_INIT,         // Graphics, text and worker set up
+    TELEMETRY_BOOT_STORAGE,      // SD card, metadata store, recovery, dictionary
+    TELEMETRY_BOOT_LOAD,         // Notes read and indexed
+    TELEMETRY_BOOT_FIRST_FRAME,  // Until the first frame is presented
+    TELEMETRY_BOOT_COUNT
+} TelemetryBoot;
+
+// What the viewer can chart
+typedef enum {
+    TELEMETRY_COLD_START,
+    TELEMETRY_FRAME_P50,
+    TELEMETRY_FRAME_P99,
+    TELEMETRY_SAVE_AVG,
+    TELEMETRY_SAVE_MAX,
+    TELEMETRY_READ_AVG,
+    TELEMETRY_LIBRARY,
+    TELEMETRY_METRIC_COUNT
+} TelemetryMetric;
+
+// One session, as stored. Times are in microseconds unless named otherwise.
+typedef struct {
+    u32 started;                         // Seconds since 1970
+    u32 seconds;                         // How long it ran
+    u32 frames;
+    u16 bootMs[TELEMETRY_BOOT_COUNT];
+    u32 frameP50;
+    u32 frameP99;
+    u32 frameMax;
+    u32 saves;
+    u32 saveAvg;
+    u32 saveMax;
+    u32 readAvg;                         // Per note at start-up
+    u32 notes;
+    u32 bytes;                           // Library size
+} TelemetrySession;
+
+// First thing at start-up: the clock boot phases are timed from
+void telemetry_start(void);
+
+// The end of start-up phase `phase`
+void telemetry_boot(TelemetryBoot phase);
+
+// Load earlier sessions, after kv_open()
+void telemetry_open(void);
+
+// Once a frame, after it is presented. The first call ends start-up.
+void telemetry_frame(void);
+
+// A save took `ticks`
+void telemetry_save(u64 ticks);
+
+// The library as loaded: note count, bytes and time spent reading them
+void telemetry_library(u32 notes, u32 bytes, float readMs);
+
+// Add this session to the history. Returns false if it could not be stored
+// or telemetry_open() was never reached.
+bool telemetry_record(void);
+
+// Earlier sessions, oldest first, and this one so far
+int telemetry_history(const TelemetrySession** out);
+void telemetry_current(TelemetrySession* out);
+
+// Chart helpers: a metric's value for a session, in the unit of its label
+float telemetry_value(const TelemetrySession* session, TelemetryMetric metric);
+const char* telemetry_label(TelemetryMetric metric);
+
+#endif // TELEMETRY_H
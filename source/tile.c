@@ -0,0 +1,150 @@
+//---------------------------------------------------------------------------------
+// tile.c
+// Tile cache. Tiles are RGB565 textures in VRAM that double as render targets:
+// the view draws a block's glyphs into one once, then shows it as a single
+// textured quad for as long as the block is unchanged. Tiles are opaque, so
+// they are filled with the background colour instead of being cleared.
+//---------------------------------------------------------------------------------
+
+#include "tile.h"
+#include "memory.h"
+
+#include <string.h>
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define TILE_BYTES_PER_PIXEL 2
+
+static Tile s_tiles[TILE_CACHE_SIZE];
+static u32 s_frame = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static u32 next_pow2(u32 v) {
+    u32 p = 8;   // Smallest texture the GPU accepts
+    while (p < v) p <<= 1;
+    return p;
+}
+
+static bool same_key(const TileKey* a, const TileKey* b) {
+    return a->hash == b->hash && a->crc == b->crc && a->len == b->len;
+}
+
+static u32 tile_bytes(const Tile* tile) {
+    return tile->tex.width * tile->tex.height * TILE_BYTES_PER_PIXEL;
+}
+
+static void release(Tile* tile) {
+    if (!tile->live) return;
+    C3D_RenderTargetDelete(tile->target);
+    C3D_TexDelete(&tile->tex);
+    mem_track(MEM_VRAM, -(s32)tile_bytes(tile));
+    tile->live = false;
+    tile->stale = false;
+}
+
+// Least recently used tile that is not part of the current frame
+static Tile* find_victim(void) {
+    Tile* victim = NULL;
+    for (int i = 0; i < TILE_CACHE_SIZE; i++) {
+        Tile* tile = &s_tiles[i];
+        if (tile->live && tile->lastUse != s_frame && (!victim || tile->lastUse < victim->lastUse)) {
+            victim = tile;
+        }
+    }
+    return victim;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void tile_exit(void) {
+    for (int i = 0; i < TILE_CACHE_SIZE; i++) {
+        release(&s_tiles[i]);
+    }
+}
+
+void tile_begin_frame(void) {
+    s_frame++;
+    for (int i = 0; i < TILE_CACHE_SIZE; i++) {
+        if (s_tiles[i].stale) release(&s_tiles[i]);
+    }
+}
+
+Tile* tile_find(const TileKey* key) {
+    for (int i = 0; i < TILE_CACHE_SIZE; i++) {
+        Tile* tile = &s_tiles[i];
+        if (tile->live && !tile->stale && same_key(&tile->key, key)) {
+            tile->lastUse = s_frame;
+            return tile;
+        }
+    }
+    return NULL;
+}
+
+Tile* tile_create(const TileKey* key, u16 width, u16 height) {
+    u16 texW = next_pow2(width), texH = next_pow2(height);
+    u32 bytes = texW * texH * TILE_BYTES_PER_PIXEL;
+
+    Tile* slot = NULL;
+    for (int i = 0; i < TILE_CACHE_SIZE && !slot; i++) {
+        if (!s_tiles[i].live) slot = &s_tiles[i];
+    }
+    while (!slot || !mem_fits(MEM_VRAM, bytes)) {
+        Tile* victim = find_victim();
+        if (!victim) return NULL;
+        release(victim);
+        if (!slot) slot = victim;
+    }
+
+    if (!C3D_TexInitVRAM(&slot->tex, texW, texH, GPU_RGB565)) return NULL;
+    slot->target = C3D_RenderTargetCreateFromTex(&slot->tex, GPU_TEXFACE_2D, 0, -1);
+    if (!slot->target) {
+        C3D_TexDelete(&slot->tex);
+        return NULL;
+    }
+    mem_track(MEM_VRAM, bytes);
+
+    slot->key = *key;
+    slot->variant = TILE_BLANK;
+    slot->lastUse = s_frame;
+    slot->live = true;
+    slot->width = width;
+    slot->height = height;
+    return slot;
+}
+
+void tile_begin(Tile* tile, u32 background) {
+    C2D_TargetClear(tile->target, 0);
+    C2D_SceneBegin(tile->target);
+    C2D_DrawRectSolid(0.0f, 0.0f, 0.0f, tile->width, tile->height, background);
+}
+
+void tile_draw(const Tile* tile, float x, float y, float top, float height) {
+    float texW = tile->tex.width, texH = tile->tex.height;
+    Tex3DS_SubTexture sub = {
+        tile->width, height,
+        0.0f, 1.0f - top / texH,
+        tile->width / texW, 1.0f - (top + height) / texH
+    };
+    C2D_Image image = { (C3D_Tex*)&tile->tex, &sub };
+    C2D_DrawImageAt(image, x, y, 0.5f, NULL, 1.0f, 1.0f);
+}
+
+void tile_keep(const TileKey* key) {
+    for (int i = 0; i < TILE_CACHE_SIZE; i++) {
+        Tile* tile = &s_tiles[i];
+        if (tile->live && !tile->stale && same_key(&tile->key, key)) tile->kept = true;
+    }
+}
+
+void tile_sweep(void) {
+    for (int i = 0; i < TILE_CACHE_SIZE; i++) {
+        Tile* tile = &s_tiles[i];
+        if (tile->live && !tile->kept) tile->stale = true;
+        tile->kept = false;
+    }
+}
@@ -0,0 +1,58 @@
+//---------------------------------------------------------------------------------
+// tile.h
+// Off-screen render targets holding pre-rendered blocks of the note view.
+//---------------------------------------------------------------------------------
+
+#ifndef TILE_H
+#define TILE_H
+
+#include <3ds.h>
+#include <citro2d.h>
+
+#define TILE_CACHE_SIZE 24
+#define TILE_BLANK      0xFFFFFFFF   // Variant of a tile that was never rendered
+
+// Identifies the content a tile shows. Two independent hashes and the
+// length, so a collision would have to hit all three.
+typedef struct {
+    u32 hash;        // FNV-1a
+    u32 crc;         // CRC-32
+    u32 len;
+} TileKey;
+
+typedef struct {
+    TileKey key;     // The content the tile shows
+    u32 variant;     // Render state within that content, set by the owner
+    u32 lastUse;
+    bool live;
+    bool kept;
+    bool stale;      // Swept; released at the next frame, once the GPU is done with it
+    u16 width, height;
+    C3D_Tex tex;
+    C3D_RenderTarget* target;
+} Tile;
+
+void tile_exit(void);
+
+// Start a new frame; call after C3D_FrameBegin(). Tiles used from here on
+// are not evicted until the next frame.
+void tile_begin_frame(void);
+
+// Find the tile for `key` and mark it used this frame
+Tile* tile_find(const TileKey* key);
+
+// Allocate a blank tile of `width` x `height` pixels, evicting least recently
+// used tiles while VRAM is over budget. Returns NULL if there is no room.
+Tile* tile_create(const TileKey* key, u16 width, u16 height);
+
+// Make `tile` the current scene, filled with `background`
+void tile_begin(Tile* tile, u32 background);
+
+// Draw rows [top, top + height) of the tile with their top-left at (x, y)
+void tile_draw(const Tile* tile, float x, float y, float top, float height);
+
+// Free every tile whose key was not passed to tile_keep() since the last sweep
+void tile_keep(const TileKey* key);
+void tile_sweep(void);
+
+#endif // TILE_H
@@ -0,0 +1,104 @@
+//---------------------------------------------------------------------------------
+// titles.c
+// Title index. Titles are normalized before hashing by folding case only, so
+// "Todo" and "todo" are the same note, as they are to the SD card's
+// case-insensitive file system. Spaces are kept as they are: "a b" and
+// "a  b" are different files. Slots are probed linearly; removed entries
+// leave a tombstone so later probes still reach what was inserted past them.
+//---------------------------------------------------------------------------------
+
+#include "titles.h"
+
+#include <string.h>
+
+#include "utf8.h"
+#include "util.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define SLOT_EMPTY -1
+#define SLOT_DEAD  -2
+
+typedef struct {
+    u32 hash;
+    s32 id;          // Note ID, SLOT_EMPTY or SLOT_DEAD
+    char key[TITLES_KEY_LEN];
+} TitleSlot;
+
+static TitleSlot s_slots[TITLES_CAPACITY];
+static u32 s_used = 0;   // Live and dead slots, which both lengthen probes
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+// Case folding as in search (see utf8_fold()), which keeps lengths
+static bool normalize(const char* title, char* key) {
+    size_t len = strlen(title);
+    return len > 0 && utf8_fold(title, len, key, TITLES_KEY_LEN) == len;
+}
+
+// Slot holding `key`, or NULL. `insert` receives the first reusable slot on
+// the probe path for an insertion.
+static TitleSlot* probe(const char* key, u32 hash, TitleSlot** insert) {
+    TitleSlot* reusable = NULL;
+    for (u32 i = 0; i < TITLES_CAPACITY; i++) {
+        TitleSlot* slot = &s_slots[(hash + i) & (TITLES_CAPACITY - 1)];
+        if (slot->id == SLOT_EMPTY) {
+            if (!reusable) reusable = slot;
+            break;
+        }
+        if (slot->id == SLOT_DEAD) {
+            if (!reusable) reusable = slot;
+        } else if (slot->hash == hash && strcmp(slot->key, key) == 0) {
+            return slot;
+        }
+    }
+    if (insert) *insert = reusable;
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+void titles_clear(void) {
+    for (int i = 0; i < TITLES_CAPACITY; i++) {
+        s_slots[i].id = SLOT_EMPTY;
+    }
+    s_used = 0;
+}
+
+bool titles_insert(const char* title, int id) {
+    char key[TITLES_KEY_LEN];
+    TitleSlot* slot = NULL;
+    if (!normalize(title, key)) return false;
+
+    u32 hash = fnv1a_str(FNV_OFFSET, key);
+    if (probe(key, hash, &slot) || !slot) return false;
+    if (slot->id == SLOT_EMPTY) {
+        if (s_used >= TITLES_CAPACITY * 3 / 4) return false;
+        s_used++;
+    }
+
+    slot->hash = hash;
+    slot->id = id;
+    memcpy(slot->key, key, TITLES_KEY_LEN);
+    return true;
+}
+
+int titles_find(const char* title) {
+    char key[TITLES_KEY_LEN];
+    if (!normalize(title, key)) return -1;
+
+    TitleSlot* slot = probe(key, fnv1a_str(FNV_OFFSET, key), NULL);
+    return slot ? slot->id : -1;
+}
+
+void titles_remove(const char* title) {
+    char key[TITLES_KEY_LEN];
+    if (!normalize(title, key)) return;
+
+    TitleSlot* slot = probe(key, fnv1a_str(FNV_OFFSET, key), NULL);
+    if (slot) slot->id = SLOT_DEAD;
+}
@@ -0,0 +1,25 @@
+//---------------------------------------------------------------------------------
+// titles.h
+// Hash index from normalized note title to note ID.
+//---------------------------------------------------------------------------------
+
+#ifndef TITLES_H
+#define TITLES_H
+
+#include <3ds.h>
+
+#define TITLES_CAPACITY 256    // Slots; kept at most three quarters full
+#define TITLES_KEY_LEN  32
+
+void titles_clear(void);
+
+// Index `title` as note `id`. Returns false if a note with the same
+// normalized title is already indexed, or the index is full.
+bool titles_insert(const char* title, int id);
+
+// Note ID for `title`, or -1
+int titles_find(const char* title);
+
+void titles_remove(const char* title);
+
+#endif // TITLES_H
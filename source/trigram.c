@@ -0,0 +1,375 @@
+//---------------------------------------------------------------------------------
+// trigram.c
+// Trigram index. Every run of three bytes in a title or body, folded to
+// lower case, is a key; its posting list holds the documents containing it,
+// in ID order. A document can only contain a literal if it contains every
+// trigram of it, so intersecting those lists gives the candidates for a
+// regex with a required literal. Titles and bodies are indexed separately,
+// since a match never spans the two.
+//
+// The posting lists are packed in one array and never edited in place. A
+// document that changes afterwards keeps its sorted trigrams on a short
+// list of changed documents instead; queries skip its old postings and test
+// it against that list. Once the list is long, the next query merges it
+// into the packed lists in one pass, without reading any document again.
+//---------------------------------------------------------------------------------
+
+#include "trigram.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define TRIGRAM_MAX_LITERAL 32
+#define TRIGRAM_CHANGED     64   // Changed documents kept aside before a merge
+
+typedef struct {
+    u16 doc;
+    u32 count;
+    u32* keys;       // Its distinct trigrams, sorted
+} ChangedDoc;
+
+static bool s_ready = false;
+static int s_docCount = 0;
+static SearchDocFn s_doc = NULL;
+static void* s_docArg = NULL;
+
+static u32 s_keyCount = 0;
+static u32* s_keys = NULL;       // Sorted trigrams
+static u32* s_start = NULL;      // Postings of key k are [start[k], start[k + 1])
+static u16* s_postings = NULL;
+
+static ChangedDoc* s_changed = NULL;   // Sorted by document
+static u32 s_changedCount = 0;
+static u32 s_changedCap = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+// Append the trigrams of `text` to `out`
+static bool add_trigrams(const char* text, u32** out, u32* count, u32* cap) {
+    const u8* p = (const u8*)text;
+    if (!p[0] || !p[1]) return true;
+    u32 key = ascii_fold(p[0]) << 8 | ascii_fold(p[1]);
+    for (p += 2; *p; p++) {
+        key = (key << 8 | ascii_fold(*p)) & 0xFFFFFF;
+        if (!grow_array((void**)out, cap, *count + 1, sizeof(u32), 1024)) return false;
+        (*out)[(*count)++] = key;
+    }
+    return true;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    u32 x = *(const u32*)a, y = *(const u32*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_u64(const void* a, const void* b) {
+    u64 x = *(const u64*)a, y = *(const u64*)b;
+    return (x > y) - (x < y);
+}
+
+// The distinct trigrams of document `d`, sorted, in *keys
+static bool doc_keys(int d, u32** keys, u32* count, u32* cap) {
+    SearchDoc text = { "", "" };
+    s_doc(d, &text, s_docArg);
+    *count = 0;
+    if (!add_trigrams(text.title, keys, count, cap) || !add_trigrams(text.body, keys, count, cap)) return false;
+    if (*count == 0) return true;
+
+    qsort(*keys, *count, sizeof(u32), compare_u32);
+    u32 kept = 1;
+    for (u32 i = 1; i < *count; i++) {
+        if ((*keys)[i] != (*keys)[kept - 1]) (*keys)[kept++] = (*keys)[i];
+    }
+    *count = kept;
+    return true;
+}
+
+// Index of `key` in s_keys, or -1
+static s32 find_key(u32 key) {
+    u32 lo = 0, hi = s_keyCount;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (s_keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < s_keyCount && s_keys[lo] == key) ? (s32)lo : -1;
+}
+
+// Where document `doc` is or would go in s_changed
+static u32 find_changed(u16 doc) {
+    u32 lo = 0, hi = s_changedCount;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (s_changed[mid].doc < doc) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Whether `doc` changed, for documents visited in ascending order; *at is
+// where the walk through s_changed has got to
+static bool is_changed(u16 doc, u32* at) {
+    while (*at < s_changedCount && s_changed[*at].doc < doc) (*at)++;
+    return *at < s_changedCount && s_changed[*at].doc == doc;
+}
+
+static bool has_key(const ChangedDoc* changed, u32 key) {
+    return bsearch(&key, changed->keys, changed->count, sizeof(u32), compare_u32) != NULL;
+}
+
+// Record or replace a changed document. Takes its keys either way; if memory
+// runs out the index is dropped.
+static bool set_changed(ChangedDoc changed) {
+    u32 at = find_changed(changed.doc);
+    if (at < s_changedCount && s_changed[at].doc == changed.doc) {
+        free(s_changed[at].keys);
+    } else if (grow_array((void**)&s_changed, &s_changedCap, s_changedCount + 1, sizeof(ChangedDoc), 1024)) {
+        memmove(s_changed + at + 1, s_changed + at, (s_changedCount - at) * sizeof(ChangedDoc));
+        s_changedCount++;
+    } else {
+        free(changed.keys);
+        trigram_exit();
+        return false;
+    }
+    s_changed[at] = changed;
+    return true;
+}
+
+static void free_changed(void) {
+    for (u32 i = 0; i < s_changedCount; i++) free(s_changed[i].keys);
+    free(s_changed);
+    s_changed = NULL;
+    s_changedCount = s_changedCap = 0;
+}
+
+// Fold the changed documents into the packed lists: every posting of a
+// changed document is dropped and its current trigrams merged in, key by key
+// and in document order, so nothing needs sorting but the new trigrams
+static bool merge_changed(void) {
+    u32 fresh = 0;
+    for (u32 i = 0; i < s_changedCount; i++) fresh += s_changed[i].count;
+    u64* adds = malloc((fresh ? fresh : 1) * sizeof(u64));   // Trigram << 16 | document
+    if (!adds) return false;
+    u32 addCount = 0;
+    for (u32 i = 0; i < s_changedCount; i++) {
+        const ChangedDoc* changed = &s_changed[i];
+        for (u32 k = 0; k < changed->count; k++) adds[addCount++] = (u64)changed->keys[k] << 16 | changed->doc;
+    }
+    qsort(adds, addCount, sizeof(u64), compare_u64);
+
+    u32 most = s_start[s_keyCount] + addCount;
+    u32* keys = malloc((s_keyCount + addCount + 1) * sizeof(u32));
+    u32* start = malloc((s_keyCount + addCount + 1) * sizeof(u32));
+    u16* postings = malloc((most ? most : 1) * sizeof(u16));
+    if (!keys || !start || !postings) {
+        free(adds);
+        free(keys);
+        free(start);
+        free(postings);
+        return false;
+    }
+
+    u32 keyCount = 0, count = 0, k = 0, a = 0;
+    while (k < s_keyCount || a < addCount) {
+        u32 key = k < s_keyCount ? s_keys[k] : 0xFFFFFFFF;
+        if (a < addCount && adds[a] >> 16 < key) key = adds[a] >> 16;
+
+        u32 first = count;
+        u32 p = 0, end = 0;
+        if (k < s_keyCount && s_keys[k] == key) {
+            p = s_start[k];
+            end = s_start[k + 1];
+            k++;
+        }
+        // The old postings, minus the changed documents, and the new ones
+        u32 c = 0;
+        for (;;) {
+            while (p < end && is_changed(s_postings[p], &c)) p++;
+            bool old = p < end;
+            bool add = a < addCount && adds[a] >> 16 == key;
+            if (!old && !add) break;
+            if (old && (!add || s_postings[p] < (adds[a] & 0xFFFF))) postings[count++] = s_postings[p++];
+            else postings[count++] = adds[a++] & 0xFFFF;
+        }
+        if (count > first) {
+            keys[keyCount] = key;
+            start[keyCount++] = first;
+        }
+    }
+    start[keyCount] = count;
+    free(adds);
+
+    free(s_keys);
+    free(s_start);
+    free(s_postings);
+    s_keys = keys;
+    s_start = start;
+    s_postings = postings;
+    s_keyCount = keyCount;
+    free_changed();
+    return true;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+bool trigram_build(int count, SearchDocFn doc, void* arg) {
+    trigram_exit();
+    if (count > SEARCH_MAX_DOCS) count = SEARCH_MAX_DOCS;
+    if (count < 0) count = 0;
+    s_doc = doc;
+    s_docArg = arg;
+
+    u32* keys = NULL;
+    u32 keyCap = 0;
+    u64* hits = NULL;     // Trigram << 16 | document
+    u32 hitCount = 0, hitCap = 0;
+    bool ok = true;
+
+    for (int d = 0; d < count && ok; d++) {
+        u32 n = 0;
+        ok = doc_keys(d, &keys, &n, &keyCap) &&
+             grow_array((void**)&hits, &hitCap, hitCount + n, sizeof(u64), 1024);
+        for (u32 i = 0; i < n && ok; i++) hits[hitCount++] = (u64)keys[i] << 16 | d;
+    }
+    free(keys);
+
+    // Sorting by trigram keeps each list in document order
+    if (ok) qsort(hits, hitCount, sizeof(u64), compare_u64);
+    u32 distinct = 0;
+    for (u32 i = 0; ok && i < hitCount; i++) {
+        if (i == 0 || hits[i] >> 16 != hits[i - 1] >> 16) distinct++;
+    }
+    ok = ok &&
+         (s_keys = malloc((distinct ? distinct : 1) * sizeof(u32))) != NULL &&
+         (s_start = malloc((distinct + 1) * sizeof(u32))) != NULL &&
+         (s_postings = malloc((hitCount ? hitCount : 1) * sizeof(u16))) != NULL;
+    if (!ok) {
+        free(hits);
+        trigram_exit();
+        return false;
+    }
+
+    for (u32 i = 0; i < hitCount; i++) {
+        u32 key = hits[i] >> 16;
+        if (s_keyCount == 0 || s_keys[s_keyCount - 1] != key) {
+            s_keys[s_keyCount] = key;
+            s_start[s_keyCount++] = i;
+        }
+        s_postings[i] = hits[i] & 0xFFFF;
+    }
+    s_start[s_keyCount] = hitCount;
+    s_docCount = count;
+    s_ready = true;
+    free(hits);
+    return true;
+}
+
+bool trigram_update(int id) {
+    if (!s_ready || id < 0 || id > s_docCount || id >= SEARCH_MAX_DOCS) return false;
+
+    ChangedDoc changed = { id, 0, NULL };
+    u32 cap = 0;
+    if (!doc_keys(id, &changed.keys, &changed.count, &cap)) {
+        free(changed.keys);
+        trigram_exit();
+        return false;
+    }
+    if (!set_changed(changed)) return false;
+    if (id == s_docCount) s_docCount++;
+    return true;
+}
+
+bool trigram_remove(int id) {
+    if (!s_ready || id < 0 || id >= s_docCount) return false;
+    return set_changed((ChangedDoc){ id, 0, NULL });
+}
+
+void trigram_exit(void) {
+    free(s_keys);
+    free(s_start);
+    free(s_postings);
+    s_keys = s_start = NULL;
+    s_postings = NULL;
+    s_keyCount = 0;
+    s_docCount = 0;
+    s_ready = false;
+    free_changed();
+}
+
+int trigram_candidates(const char* literal, u16* ids) {
+    size_t len = strlen(literal);
+    if (!s_ready || s_docCount == 0 || len < 3) return -1;
+    if (len > TRIGRAM_MAX_LITERAL) len = TRIGRAM_MAX_LITERAL;
+    if (s_changedCount > TRIGRAM_CHANGED && !merge_changed()) {
+        trigram_exit();
+        return -1;
+    }
+
+    // The literal's trigrams, and the posting lists of those that have one,
+    // shortest first. A trigram with no list can still be in a changed document.
+    u32 want[TRIGRAM_MAX_LITERAL];
+    s32 lists[TRIGRAM_MAX_LITERAL];
+    int wantCount = 0, listCount = 0;
+    bool missing = false;
+    const u8* p = (const u8*)literal;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        want[wantCount++] = ascii_fold(p[i]) << 16 | ascii_fold(p[i + 1]) << 8 | ascii_fold(p[i + 2]);
+        s32 k = find_key(want[wantCount - 1]);
+        if (k < 0) {
+            missing = true;
+            continue;
+        }
+
+        u32 size = s_start[k + 1] - s_start[k];
+        int j = listCount;
+        bool seen = false;
+        for (int m = 0; m < listCount && !seen; m++) seen = lists[m] == k;
+        if (seen) continue;
+        for (; j > 0 && s_start[lists[j - 1] + 1] - s_start[lists[j - 1]] > size; j--) lists[j] = lists[j - 1];
+        lists[j] = k;
+        listCount++;
+    }
+
+    // Unchanged documents on every list
+    u32 count = 0;
+    if (!missing) {
+        const u16* post = s_postings + s_start[lists[0]];
+        u32 size = s_start[lists[0] + 1] - s_start[lists[0]];
+        u32 c = 0;
+        for (u32 i = 0; i < size; i++) {
+            if (!is_changed(post[i], &c)) ids[count++] = post[i];
+        }
+    }
+    for (int l = 1; l < listCount && count > 0; l++) {
+        const u16* post = s_postings + s_start[lists[l]];
+        u32 size = s_start[lists[l] + 1] - s_start[lists[l]];
+        u32 pos = 0, kept = 0;
+        for (u32 i = 0; i < count && pos < size; i++) {
+            while (pos < size && post[pos] < ids[i]) pos++;
+            if (pos < size && post[pos] == ids[i]) ids[kept++] = ids[i];
+        }
+        count = kept;
+    }
+
+    // Changed documents that have every trigram, merged in by ID from the end
+    u32 extra = 0;
+    u16 found[TRIGRAM_CHANGED];
+    for (u32 c = 0; c < s_changedCount; c++) {
+        bool all = true;
+        for (int i = 0; i < wantCount && all; i++) all = has_key(&s_changed[c], want[i]);
+        if (all) found[extra++] = s_changed[c].doc;
+    }
+    for (u32 i = count + extra, a = count, b = extra; b > 0; i--) {
+        if (a > 0 && ids[a - 1] > found[b - 1]) ids[i - 1] = ids[--a];
+        else ids[i - 1] = found[--b];
+    }
+    return count + extra;
+}
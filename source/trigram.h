@@ -0,0 +1,32 @@
+//---------------------------------------------------------------------------------
+// trigram.h
+// Index of the three-byte sequences in each note, used to narrow regex
+// searches to the notes that can contain a match.
+//---------------------------------------------------------------------------------
+
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include <3ds.h>
+
+#include "search.h"
+
+// Index documents 0..count-1, which are read through `doc` from then on,
+// replacing any previous index. Returns false if memory runs out, leaving no
+// index.
+bool trigram_build(int count, SearchDocFn doc, void* arg);
+void trigram_exit(void);
+
+// Document `id` changed, or was added if it is the next ID: its trigrams
+// are read again. Document `id` was deleted: it is never a candidate again.
+// Both return false if there is no index or memory runs out, which drops it.
+bool trigram_update(int id);
+bool trigram_remove(int id);
+
+// Write the IDs of the documents whose title or body contains every trigram
+// of `literal`, ignoring ASCII case, to `ids` in ID order and return how
+// many. `ids` must hold one entry per document. Returns -1 if the literal is
+// shorter than three bytes or there is no index, so nothing can be ruled out.
+int trigram_candidates(const char* literal, u16* ids);
+
+#endif // TRIGRAM_H
@@ -0,0 +1,368 @@
+//---------------------------------------------------------------------------------
+// utf8.c
+// UTF-8 decoding, validation, case folding and grapheme clusters. Validation
+// checks ASCII a word at a time and decodes only the bytes around non-ASCII
+// text. Folding and cluster properties are range tables searched by binary
+// search, after an ASCII fast path. The cluster rules follow UAX #29 for the
+// scripts the tables cover: CR LF, controls, combining marks, Hangul
+// syllables, emoji ZWJ sequences and regional indicator pairs.
+//---------------------------------------------------------------------------------
+
+#include "utf8.h"
+
+#include <string.h>
+
+#include "util.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+// Code points first..last fold by `delta`; if `alternate`, only every other
+// one does, starting at `first` (upper and lower case interleaved)
+typedef struct {
+    u16 first;
+    u16 last;
+    s16 delta;
+    u16 alternate;
+} FoldRange;
+
+typedef enum {
+    GB_OTHER,
+    GB_CR,
+    GB_LF,
+    GB_CONTROL,
+    GB_EXTEND,
+    GB_ZWJ,
+    GB_SPACING,
+    GB_RI,        // Regional indicator
+    GB_PICT,      // Extended pictographic
+    GB_L,         // Hangul jamo and syllables
+    GB_V,
+    GB_T,
+    GB_LV,
+    GB_LVT
+} GraphemeProp;
+
+typedef struct {
+    u32 first;
+    u32 last;
+    u8 prop;
+} PropRange;
+
+static const FoldRange s_fold[] = {
+    { 0x0041, 0x005A, 32, 0 },   { 0x00B5, 0x00B5, 775, 0 },  { 0x00C0, 0x00D6, 32, 0 },
+    { 0x00D8, 0x00DE, 32, 0 },   { 0x0100, 0x012E, 1, 1 },    { 0x0132, 0x0136, 1, 1 },
+    { 0x0139, 0x0147, 1, 1 },    { 0x014A, 0x0176, 1, 1 },    { 0x0178, 0x0178, -121, 0 },
+    { 0x0179, 0x017D, 1, 1 },    { 0x01CD, 0x01DB, 1, 1 },    { 0x01DE, 0x01EE, 1, 1 },
+    { 0x01F8, 0x021E, 1, 1 },    { 0x0222, 0x0232, 1, 1 },    { 0x0386, 0x0386, 38, 0 },
+    { 0x0388, 0x038A, 37, 0 },   { 0x038C, 0x038C, 64, 0 },   { 0x038E, 0x038F, 63, 0 },
+    { 0x0391, 0x03A1, 32, 0 },   { 0x03A3, 0x03AB, 32, 0 },   { 0x03C2, 0x03C2, 1, 0 },
+    { 0x03D8, 0x03EE, 1, 1 },    { 0x0400, 0x040F, 80, 0 },   { 0x0410, 0x042F, 32, 0 },
+    { 0x0460, 0x0480, 1, 1 },    { 0x048A, 0x04BE, 1, 1 },    { 0x04C0, 0x04C0, 15, 0 },
+    { 0x04C1, 0x04CD, 1, 1 },    { 0x04D0, 0x052E, 1, 1 },    { 0x0531, 0x0556, 48, 0 },
+    { 0x10A0, 0x10C5, 7264, 0 }, { 0x1E00, 0x1E94, 1, 1 },    { 0x1EA0, 0x1EFE, 1, 1 },
+    { 0x1F08, 0x1F0F, -8, 0 },   { 0x1F18, 0x1F1D, -8, 0 },   { 0x1F28, 0x1F2F, -8, 0 },
+    { 0x1F38, 0x1F3F, -8, 0 },   { 0x1F48, 0x1F4D, -8, 0 },   { 0x1F59, 0x1F5F, -8, 1 },
+    { 0x1F68, 0x1F6F, -8, 0 },   { 0x2160, 0x216F, 16, 0 },   { 0x24B6, 0x24CF, 26, 0 },
+    { 0x2C00, 0x2C2F, 48, 0 },   { 0x2C80, 0x2CE2, 1, 1 },    { 0xA640, 0xA66C, 1, 1 },
+    { 0xA680, 0xA69A, 1, 1 },    { 0xA722, 0xA72E, 1, 1 },    { 0xA732, 0xA76E, 1, 1 },
+    { 0xFF21, 0xFF3A, 32, 0 },
+};
+
+// Grapheme break properties above U+02FF; below that only controls matter
+static const PropRange s_props[] = {
+    { 0x0300, 0x036F, GB_EXTEND },   { 0x0483, 0x0489, GB_EXTEND },   { 0x0591, 0x05BD, GB_EXTEND },
+    { 0x05BF, 0x05BF, GB_EXTEND },   { 0x05C1, 0x05C2, GB_EXTEND },   { 0x05C4, 0x05C5, GB_EXTEND },
+    { 0x05C7, 0x05C7, GB_EXTEND },   { 0x0610, 0x061A, GB_EXTEND },   { 0x064B, 0x065F, GB_EXTEND },
+    { 0x0670, 0x0670, GB_EXTEND },   { 0x06D6, 0x06DC, GB_EXTEND },   { 0x06DF, 0x06E4, GB_EXTEND },
+    { 0x06E7, 0x06E8, GB_EXTEND },   { 0x06EA, 0x06ED, GB_EXTEND },   { 0x0900, 0x0902, GB_EXTEND },
+    { 0x0903, 0x0903, GB_SPACING },  { 0x093A, 0x093A, GB_EXTEND },   { 0x093B, 0x093B, GB_SPACING },
+    { 0x093C, 0x093C, GB_EXTEND },   { 0x093E, 0x0940, GB_SPACING },  { 0x0941, 0x0948, GB_EXTEND },
+    { 0x0949, 0x094C, GB_SPACING },  { 0x094D, 0x094D, GB_EXTEND },   { 0x094E, 0x094F, GB_SPACING },
+    { 0x0951, 0x0957, GB_EXTEND },   { 0x0962, 0x0963, GB_EXTEND },   { 0x0E31, 0x0E31, GB_EXTEND },
+    { 0x0E33, 0x0E33, GB_SPACING },  { 0x0E34, 0x0E3A, GB_EXTEND },   { 0x0E47, 0x0E4E, GB_EXTEND },
+    { 0x1100, 0x115F, GB_L },        { 0x1160, 0x11A7, GB_V },        { 0x11A8, 0x11FF, GB_T },
+    { 0x1AB0, 0x1AFF, GB_EXTEND },   { 0x1DC0, 0x1DFF, GB_EXTEND },   { 0x200B, 0x200B, GB_CONTROL },
+    { 0x200C, 0x200C, GB_EXTEND },   { 0x200D, 0x200D, GB_ZWJ },      { 0x200E, 0x200F, GB_CONTROL },
+    { 0x2028, 0x202E, GB_CONTROL },  { 0x203C, 0x203C, GB_PICT },     { 0x2049, 0x2049, GB_PICT },
+    { 0x2060, 0x206F, GB_CONTROL },  { 0x20D0, 0x20FF, GB_EXTEND },   { 0x2122, 0x2122, GB_PICT },
+    { 0x2139, 0x2139, GB_PICT },     { 0x2194, 0x2199, GB_PICT },     { 0x21A9, 0x21AA, GB_PICT },
+    { 0x231A, 0x231B, GB_PICT },     { 0x2328, 0x2328, GB_PICT },     { 0x23CF, 0x23CF, GB_PICT },
+    { 0x23E9, 0x23F3, GB_PICT },     { 0x23F8, 0x23FA, GB_PICT },     { 0x24C2, 0x24C2, GB_PICT },
+    { 0x25AA, 0x25AB, GB_PICT },     { 0x25B6, 0x25B6, GB_PICT },     { 0x25C0, 0x25C0, GB_PICT },
+    { 0x25FB, 0x25FE, GB_PICT },     { 0x2600, 0x27BF, GB_PICT },     { 0x2934, 0x2935, GB_PICT },
+    { 0x2B05, 0x2B07, GB_PICT },     { 0x2B1B, 0x2B1C, GB_PICT },     { 0x2B50, 0x2B50, GB_PICT },
+    { 0x2B55, 0x2B55, GB_PICT },     { 0x302A, 0x302F, GB_EXTEND },   { 0x3030, 0x3030, GB_PICT },
+    { 0x303D, 0x303D, GB_PICT },     { 0x3099, 0x309A, GB_EXTEND },   { 0x3297, 0x3297, GB_PICT },
+    { 0x3299, 0x3299, GB_PICT },     { 0xA960, 0xA97C, GB_L },        { 0xD7B0, 0xD7C6, GB_V },
+    { 0xD7CB, 0xD7FB, GB_T },        { 0xFE00, 0xFE0F, GB_EXTEND },   { 0xFE20, 0xFE2F, GB_EXTEND },
+    { 0xFEFF, 0xFEFF, GB_CONTROL },  { 0xFF9E, 0xFF9F, GB_EXTEND },   { 0xFFF0, 0xFFFB, GB_CONTROL },
+    { 0x1F000, 0x1F0FF, GB_PICT },   { 0x1F10D, 0x1F10F, GB_PICT },   { 0x1F12F, 0x1F12F, GB_PICT },
+    { 0x1F16C, 0x1F171, GB_PICT },   { 0x1F17E, 0x1F17F, GB_PICT },   { 0x1F18E, 0x1F18E, GB_PICT },
+    { 0x1F191, 0x1F19A, GB_PICT },   { 0x1F1AD, 0x1F1E5, GB_PICT },   { 0x1F1E6, 0x1F1FF, GB_RI },
+    { 0x1F201, 0x1F3FA, GB_PICT },   { 0x1F3FB, 0x1F3FF, GB_EXTEND },  { 0x1F400, 0x1F53D, GB_PICT },
+    { 0x1F546, 0x1F64F, GB_PICT },   { 0x1F680, 0x1F6FF, GB_PICT },   { 0x1F774, 0x1F77F, GB_PICT },
+    { 0x1F7D5, 0x1F7FF, GB_PICT },   { 0x1F80C, 0x1F80F, GB_PICT },   { 0x1F848, 0x1F84F, GB_PICT },
+    { 0x1F85A, 0x1F85F, GB_PICT },   { 0x1F888, 0x1F88F, GB_PICT },   { 0x1F8AE, 0x1F8FF, GB_PICT },
+    { 0x1F90C, 0x1F93A, GB_PICT },   { 0x1F93C, 0x1F945, GB_PICT },   { 0x1F947, 0x1FAFF, GB_PICT },
+    { 0x1FC00, 0x1FFFD, GB_PICT },   { 0xE0000, 0xE001F, GB_CONTROL }, { 0xE0020, 0xE007F, GB_EXTEND },
+    { 0xE0080, 0xE00FF, GB_CONTROL }, { 0xE0100, 0xE01EF, GB_EXTEND },
+};
+
+#define FOLD_RANGES (sizeof(s_fold) / sizeof(s_fold[0]))
+#define PROP_RANGES (sizeof(s_props) / sizeof(s_props[0]))
+
+// Cluster state carried across code points: regional indicators in a row,
+// and whether the text so far is an emoji that a ZWJ may join to another
+typedef struct {
+    int riCount;
+    bool pict;
+    bool joinable;
+} GraphemeState;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static GraphemeProp prop_of(u32 cp) {
+    if (cp == '\r') return GB_CR;
+    if (cp == '\n') return GB_LF;
+    if (cp < 0x20 || (cp >= 0x7F && cp <= 0x9F) || cp == 0xAD) return GB_CONTROL;
+    if (cp < 0x300 || cp == UTF8_INVALID) return GB_OTHER;
+    if (cp >= 0xAC00 && cp <= 0xD7A3) return (cp - 0xAC00) % 28 == 0 ? GB_LV : GB_LVT;
+
+    size_t lo = 0, hi = PROP_RANGES;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (s_props[mid].last < cp) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < PROP_RANGES && s_props[lo].first <= cp ? (GraphemeProp)s_props[lo].prop : GB_OTHER;
+}
+
+static void start_cluster(GraphemeState* state, GraphemeProp prop) {
+    state->riCount = prop == GB_RI;
+    state->pict = prop == GB_PICT;
+    state->joinable = false;
+}
+
+// Whether there is a cluster boundary between `a` and `b`, and if not, the
+// state after `b`
+static bool is_break(GraphemeState* state, GraphemeProp a, GraphemeProp b) {
+    bool join;
+    if (a == GB_CR && b == GB_LF) join = true;
+    else if (a == GB_CR || a == GB_LF || a == GB_CONTROL || b == GB_CR || b == GB_LF || b == GB_CONTROL) join = false;
+    else if (a == GB_L) join = b == GB_L || b == GB_V || b == GB_LV || b == GB_LVT;
+    else if ((a == GB_LV || a == GB_V) && (b == GB_V || b == GB_T)) join = true;
+    else if ((a == GB_LVT || a == GB_T) && b == GB_T) join = true;
+    else if (b == GB_EXTEND || b == GB_ZWJ || b == GB_SPACING) join = true;
+    else if (a == GB_ZWJ && b == GB_PICT) join = state->joinable;
+    else if (a == GB_RI && b == GB_RI) join = state->riCount % 2 == 1;
+    else join = false;
+
+    if (!join) return true;
+    if (b == GB_RI) state->riCount++;
+    state->joinable = b == GB_ZWJ && state->pict;
+    state->pict = b == GB_PICT || (state->pict && b == GB_EXTEND);
+    return false;
+}
+
+// Length of the valid sequence at `s`, which has `len` > 0 bytes left, or 0.
+// Each lead byte allows a narrower range for the byte after it, which rules
+// out overlong forms, surrogates and code points past U+10FFFF.
+static inline size_t seq_len(const u8* s, size_t len) {
+    u8 c = s[0];
+    if (c < 0x80) return 1;
+
+    size_t n;
+    u8 lo = 0x80, hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    } else {
+        return 0;
+    }
+    if (len < n || s[1] < lo || s[1] > hi) return 0;
+    if (n > 2 && (s[2] & 0xC0) != 0x80) return 0;
+    if (n > 3 && (s[3] & 0xC0) != 0x80) return 0;
+    return n;
+}
+
+// Start of the code point ending at `at`, which is past the start of `s`
+static size_t prev_char(const char* s, size_t at, u32* cp) {
+    size_t j = at - 1;
+    while (j > 0 && at - j < UTF8_MAX_LEN && ((u8)s[j] & 0xC0) == 0x80) j--;
+    const char* p = s + j;
+    *cp = utf8_decode(&p, at - j);
+    if ((size_t)(p - s) != at) {
+        j = at - 1;
+        *cp = UTF8_INVALID;
+    }
+    return j;
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+u32 utf8_decode(const char** p, size_t len) {
+    const u8* s = (const u8*)*p;
+    size_t n = len > 0 ? seq_len(s, len) : 0;
+    if (n == 0) {
+        *p += 1;
+        return UTF8_INVALID;
+    }
+    *p += n;
+
+    static const u8 leadMask[5] = { 0, 0x7F, 0x1F, 0x0F, 0x07 };
+    u32 cp = s[0] & leadMask[n];
+    for (size_t i = 1; i < n; i++) cp = cp << 6 | (s[i] & 0x3F);
+    return cp;
+}
+
+size_t utf8_encode(u32 cp, char* out) {
+    u8* o = (u8*)out;
+    if (cp < 0x80) {
+        o[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        o[0] = 0xC0 | cp >> 6;
+        o[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        if (cp >= 0xD800 && cp <= 0xDFFF) return 0;
+        o[0] = 0xE0 | cp >> 12;
+        o[1] = 0x80 | (cp >> 6 & 0x3F);
+        o[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    if (cp <= 0x10FFFF) {
+        o[0] = 0xF0 | cp >> 18;
+        o[1] = 0x80 | (cp >> 12 & 0x3F);
+        o[2] = 0x80 | (cp >> 6 & 0x3F);
+        o[3] = 0x80 | (cp & 0x3F);
+        return 4;
+    }
+    return 0;
+}
+
+size_t utf8_valid_prefix(const char* s, size_t len) {
+    const u8* p = (const u8*)s;
+    size_t i = 0;
+    while (i < len) {
+        if (p[i] < 0x80) {
+            // ASCII runs four bytes at a time
+            u32 word;
+            for (i++; i + 4 <= len; i += 4) {
+                memcpy(&word, p + i, 4);
+                if (word & 0x80808080) break;
+            }
+            continue;
+        }
+        size_t n = seq_len(p + i, len - i);
+        if (n == 0) return i;
+        i += n;
+    }
+    return i;
+}
+
+u32 utf8_fold_char(u32 cp) {
+    if (cp < 0x80) return ascii_fold(cp);
+    if (cp > 0xFFFF) return cp;
+
+    size_t lo = 0, hi = FOLD_RANGES;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (s_fold[mid].last < cp) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == FOLD_RANGES || s_fold[lo].first > cp) return cp;
+    const FoldRange* range = &s_fold[lo];
+    if (range->alternate && (cp - range->first) % 2 != 0) return cp;
+    return cp + range->delta;
+}
+
+size_t utf8_fold(const char* s, size_t len, char* out, size_t cap) {
+    size_t o = 0;
+    const char* p = s;
+    const char* end = s + len;
+    while (p < end) {
+        u8 c = *p;
+        if (c < 0x80) {
+            if (o + 1 >= cap) break;
+            out[o++] = ascii_fold(c);
+            p++;
+            continue;
+        }
+
+        const char* start = p;
+        u32 cp = utf8_decode(&p, end - p);
+        size_t n = p - start;
+        if (o + n >= cap) {
+            p = start;
+            break;
+        }
+        if (cp == UTF8_INVALID) out[o] = c;
+        else utf8_encode(utf8_fold_char(cp), out + o);
+        o += n;
+    }
+    if (cap > 0) out[o] = '\0';
+    return o;
+}
+
+size_t utf8_next_grapheme(const char* s, size_t len, size_t at) {
+    if (at >= len) return len;
+    const char* p = s + at;
+    const char* end = s + len;
+    GraphemeProp a = prop_of(utf8_decode(&p, end - p));
+    GraphemeState state;
+    start_cluster(&state, a);
+
+    while (p < end) {
+        const char* next = p;
+        GraphemeProp b = prop_of(utf8_decode(&next, end - next));
+        if (is_break(&state, a, b)) break;
+        a = b;
+        p = next;
+    }
+    return p - s;
+}
+
+size_t utf8_prev_grapheme(const char* s, size_t at) {
+    if (at == 0) return 0;
+
+    // Back up to a boundary that holds whatever came before it, treating
+    // the pairs that depend on earlier text as joined, then walk forward
+    u32 cp;
+    size_t start = prev_char(s, at, &cp);
+    GraphemeProp b = prop_of(cp);
+    while (start > 0) {
+        size_t before = prev_char(s, start, &cp);
+        GraphemeProp a = prop_of(cp);
+        GraphemeState state = { 1, true, true };
+        if (is_break(&state, a, b)) break;
+        start = before;
+        b = a;
+    }
+
+    for (;;) {
+        size_t next = utf8_next_grapheme(s, at, start);
+        if (next >= at) return start;
+        start = next;
+    }
+}
+
+size_t utf8_truncate(const char* s, size_t max) {
+    size_t len = strlen(s);
+    if (len <= max) return len;
+    size_t start = utf8_prev_grapheme(s, max);
+    return utf8_next_grapheme(s, len, start) == max ? max : start;
+}
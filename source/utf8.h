@@ -0,0 +1,49 @@
+//---------------------------------------------------------------------------------
+// utf8.h
+// UTF-8 text handling: validation, case folding for search, and grapheme
+// cluster boundaries for cursor movement and truncation.
+//---------------------------------------------------------------------------------
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <3ds.h>
+#include <stddef.h>
+
+#define UTF8_INVALID 0xFFFFFFFF
+#define UTF8_MAX_LEN 4
+
+// Decode the code point at *p, which has `len` bytes left, and advance *p
+// past it. An invalid, overlong or cut-off sequence returns UTF8_INVALID and
+// advances one byte.
+u32 utf8_decode(const char** p, size_t len);
+
+// Write `cp` to `out` and return its length, 0 if it is not encodable
+size_t utf8_encode(u32 cp, char* out);
+
+// Length of the longest valid UTF-8 prefix of the `len` bytes at `s`
+size_t utf8_valid_prefix(const char* s, size_t len);
+
+static inline bool utf8_valid(const char* s, size_t len) {
+    return utf8_valid_prefix(s, len) == len;
+}
+
+// Simple case folding of one code point. Every mapping keeps the UTF-8
+// length, so offsets in folded text are offsets in the original.
+u32 utf8_fold_char(u32 cp);
+
+// Case-fold the `len` bytes at `s` into `out`, which holds `cap` bytes, and
+// NUL-terminate it. Invalid bytes are copied as they are. Stops before a code
+// point that does not fit; returns the length written.
+size_t utf8_fold(const char* s, size_t len, char* out, size_t cap);
+
+// Grapheme cluster boundaries in the `len` bytes at `s`: the end of the
+// cluster starting at `at`, and the start of the one ending at `at`
+size_t utf8_next_grapheme(const char* s, size_t len, size_t at);
+size_t utf8_prev_grapheme(const char* s, size_t at);
+
+// Longest prefix of NUL-terminated `s` of at most `max` bytes that ends on a
+// grapheme cluster boundary
+size_t utf8_truncate(const char* s, size_t max);
+
+#endif // UTF8_H
@@ -0,0 +1,52 @@
+//---------------------------------------------------------------------------------
+// util.h
+// Small helpers shared by several modules: FNV-1a hashing, doubling growth of
+// heap arrays and ASCII case folding.
+//---------------------------------------------------------------------------------
+
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <3ds.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME  16777619u
+
+// FNV-1a of `len` bytes, continuing from `hash` (FNV_OFFSET for a new one)
+static inline u32 fnv1a(u32 hash, const void* data, size_t len) {
+    const u8* p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// The same for a NUL-terminated string
+static inline u32 fnv1a_str(u32 hash, const char* text) {
+    for (const u8* p = (const u8*)text; *p; p++) {
+        hash = (hash ^ *p) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Make room in `*array`, of `*cap` elements of `size` bytes, for `need`
+// elements. The capacity doubles, starting from `first`; returns false, with
+// the array unchanged, if memory runs out.
+static inline bool grow_array(void** array, u32* cap, u32 need, size_t size, u32 first) {
+    if (need <= *cap) return true;
+    u32 next = *cap ? *cap : first;
+    while (next < need) next *= 2;
+    void* bigger = realloc(*array, next * size);
+    if (!bigger) return false;
+    *array = bigger;
+    *cap = next;
+    return true;
+}
+
+static inline u8 ascii_fold(u8 c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+#endif // UTIL_H
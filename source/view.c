@@ -0,0 +1,561 @@
+//---------------------------------------------------------------------------------
+// view.c
+// Note view. The text is split once into lines and blank-line separated
+// paragraphs; each frame only the lines inside the viewport are parsed, and
+// only the paragraphs they belong to are spell checked. Lines inside fenced
+// code blocks are drawn span by span with syntax highlighting instead, and
+// pipe tables are laid out in columns that scroll horizontally. A line that
+// is just an image reference is drawn as the image, VIEW_IMAGE_ROWS tall.
+//
+// Paragraphs and code blocks are also grouped into blocks of up to
+// VIEW_TILE_LINES lines, keyed by two hashes of their text. A visible block is
+// rendered once into an off-screen tile and then drawn as one textured quad,
+// so scrolling through unchanged text submits no glyphs at all.
+//---------------------------------------------------------------------------------
+
+#include "view.h"
+#include "crc.h"
+#include "highlight.h"
+#include "image.h"
+#include "table.h"
+#include "tile.h"
+#include "util.h"
+
+#include <citro2d.h>
+#include <stdio.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define VIEW_SCRATCH_LEN 1024
+#define VIEW_MAX_VISIBLE 32
+#define VIEW_TILE_LINES  8
+#define VIEW_TILE_RENDERS 2        // Tiles rendered per frame; the rest draw directly
+#define VIEW_NONE        0xFFFF
+
+#define COLOR_VIEW_TEXT  C2D_Color32(0xE0, 0xE0, 0xE0, 0xFF)
+#define COLOR_SPELL      C2D_Color32(0xE0, 0x50, 0x50, 0xFF)
+#define COLOR_FENCE      C2D_Color32(0x70, 0x70, 0x70, 0xFF)
+
+typedef enum {
+    LINE_TEXT,
+    LINE_FENCE,      // ``` opening or closing a code block
+    LINE_CODE,
+    LINE_TABLE,      // Any row of a pipe table, delimiter included
+    LINE_IMAGE       // ![alt](path) on a line of its own
+} LineType;
+
+typedef struct {
+    u32 start;
+    u32 len;
+    u8 type;
+    u8 lang;         // HlLang of the enclosing code block
+    u8 mode;         // Lexer mode the line starts in
+    u8 table;        // Index into s_tables for LINE_TABLE
+    u16 para;        // Paragraph of a LINE_TEXT line, or VIEW_NONE
+    u16 block;       // Tile block holding the line, or VIEW_NONE
+} ViewLine;
+
+typedef struct {
+    u32 start;
+    u32 len;
+    u32 firstLine;
+    u32 lineCount;
+} ViewParagraph;
+
+typedef struct {
+    u32 firstLine;
+    u32 lineCount;
+    TileKey key;     // The block's text and how it is styled
+    u32 variant;     // Spell-check state it was last drawn with
+    u16 para;        // Paragraph the block belongs to, or VIEW_NONE for code
+} ViewBlock;
+
+static const char* s_text = NULL;
+static ViewLine s_lines[VIEW_MAX_LINES];
+static u32 s_lineCount = 0;
+static ViewParagraph s_paras[VIEW_MAX_PARAGRAPHS];
+static u32 s_paraCount = 0;
+static int s_scroll = 0;
+static Table s_tables[VIEW_MAX_TABLES];
+static u32 s_tableCount = 0;
+static float s_hscroll = 0.0f;
+static ViewBlock s_blocks[VIEW_MAX_LINES];
+static u32 s_blockCount = 0;
+static float s_drawX = 0.0f;
+static u32 s_first = 0;                   // Visible lines, set by view_prepare()
+static u32 s_last = 0;
+static float s_lineY[VIEW_MAX_VISIBLE];   // Top of each visible line
+static bool s_lineTiled[VIEW_MAX_VISIBLE];
+
+static C2D_TextBuf s_lineBuf;
+static C2D_TextBuf s_measureBuf;
+static char s_scratch[VIEW_SCRATCH_LEN];
+
+static ViewNotice s_notices[VIEW_MAX_NOTICES];
+static int s_noticeCount = 0;
+
+//---------------------------------------------------------------------------------
+// Helper functions
+//---------------------------------------------------------------------------------
+static const char* scratch_copy(const char* src, size_t len) {
+    if (len >= VIEW_SCRATCH_LEN) len = VIEW_SCRATCH_LEN - 1;
+    memcpy(s_scratch, src, len);
+    s_scratch[len] = '\0';
+    return s_scratch;
+}
+
+static float text_width(const char* src, size_t len) {
+    C2D_Text text;
+    float w = 0.0f;
+    C2D_TextBufClear(s_measureBuf);
+    C2D_TextParse(&text, s_measureBuf, scratch_copy(src, len));
+    C2D_TextGetDimensions(&text, VIEW_TEXT_SCALE, VIEW_TEXT_SCALE, &w, NULL);
+    return w;
+}
+
+static bool is_blank(const char* line, u32 len) {
+    for (u32 i = 0; i < len; i++) {
+        if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r') return false;
+    }
+    return true;
+}
+
+// Returns true for a ``` fence; `info` receives the language tag, if any
+static bool is_fence(const char* line, u32 len, const char** info, u32* infoLen) {
+    u32 i = 0;
+    while (i < len && i < 3 && line[i] == ' ') i++;
+    if (len - i < 3 || memcmp(line + i, "```", 3) != 0) return false;
+
+    i += 3;
+    while (i < len && line[i] == ' ') i++;
+    u32 end = i;
+    while (end < len && line[end] != ' ' && line[end] != '\r') end++;
+    *info = line + i;
+    *infoLen = end - i;
+    return true;
+}
+
+static float line_height(const ViewLine* line) {
+    return line->type == LINE_IMAGE ? VIEW_IMAGE_ROWS * VIEW_LINE_H : VIEW_LINE_H;
+}
+
+static u32 kind_color(u8 kind) {
+    switch (kind) {
+        case HL_KEYWORD:  return C2D_Color32(0x7F, 0xB2, 0xF0, 0xFF);
+        case HL_STRING:   return C2D_Color32(0xA5, 0xD6, 0xA7, 0xFF);
+        case HL_NUMBER:   return C2D_Color32(0xF0, 0xB2, 0x7F, 0xFF);
+        case HL_COMMENT:  return C2D_Color32(0x80, 0x80, 0x80, 0xFF);
+        case HL_PREPROC:  return C2D_Color32(0xC3, 0x9B, 0xD3, 0xFF);
+        case HL_VARIABLE: return C2D_Color32(0xF7, 0xDC, 0x6F, 0xFF);
+        case HL_LITERAL:  return C2D_Color32(0xF0, 0x90, 0x90, 0xFF);
+    }
+    return COLOR_VIEW_TEXT;
+}
+
+//---------------------------------------------------------------------------------
+// Init and cleanup
+//---------------------------------------------------------------------------------
+bool view_init(void) {
+    s_lineBuf = C2D_TextBufNew(4096);
+    s_measureBuf = C2D_TextBufNew(VIEW_SCRATCH_LEN);
+    return s_lineBuf && s_measureBuf;
+}
+
+void view_exit(void) {
+    tile_exit();
+    if (s_lineBuf) C2D_TextBufDelete(s_lineBuf);
+    if (s_measureBuf) C2D_TextBufDelete(s_measureBuf);
+    s_lineBuf = NULL;
+    s_measureBuf = NULL;
+}
+
+//---------------------------------------------------------------------------------
+// Layout
+//---------------------------------------------------------------------------------
+
+// Group runs of paragraph or code lines into tile blocks. Tiles of blocks
+// whose text survived an edit are kept; all others are dropped.
+static void build_blocks(void) {
+    s_blockCount = 0;
+    for (u32 i = 0; i < s_lineCount;) {
+        const ViewLine* line = &s_lines[i];
+        bool code = line->type == LINE_FENCE || line->type == LINE_CODE;
+        if (!code && line->para == VIEW_NONE) {
+            i++;
+            continue;
+        }
+
+        ViewBlock* block = &s_blocks[s_blockCount];
+        block->firstLine = i;
+        block->lineCount = 0;
+        block->para = line->para;
+        block->variant = 0;
+        u8 style[3] = { code ? LINE_CODE : LINE_TEXT, line->lang, line->mode };
+        block->key = (TileKey){ fnv1a(FNV_OFFSET, style, sizeof(style)), crc_update(0, style, sizeof(style)),
+                                sizeof(style) };
+        while (i < s_lineCount && block->lineCount < VIEW_TILE_LINES &&
+               s_lines[i].para == block->para &&
+               (code ? s_lines[i].type == LINE_FENCE || s_lines[i].type == LINE_CODE
+                     : s_lines[i].type == LINE_TEXT)) {
+            s_lines[i].block = s_blockCount;
+            const char* text = s_text + s_lines[i].start;
+            size_t len = s_lines[i].len + 1;
+            block->key.hash = fnv1a(block->key.hash, text, len);
+            block->key.crc = crc_update(block->key.crc, text, len);
+            block->key.len += len;
+            block->lineCount++;
+            i++;
+        }
+        tile_keep(&block->key);
+        s_blockCount++;
+    }
+    tile_sweep();
+}
+
+void view_set_text(const char* text) {
+    if (text != s_text) {
+        s_scroll = 0;
+        s_hscroll = 0.0f;
+    }
+    s_text = text;
+    s_lineCount = 0;
+    s_paraCount = 0;
+    s_tableCount = 0;
+    s_blockCount = 0;
+    if (!text) return;
+
+    u32 pos = 0;
+    bool inPara = false;
+    bool inTable = false;
+    u32 tableStart = 0, tableEnd = 0, tableLine = 0;
+    bool inCode = false;
+    u8 codeLang = HL_LANG_NONE;
+    u8 codeMode = 0;
+    char path[IMAGE_PATH_LEN];
+    for (;;) {
+        u32 end = pos;
+        while (text[end] && text[end] != '\n') end++;
+        if (s_lineCount == VIEW_MAX_LINES) break;
+
+        u32 line = s_lineCount++;
+        ViewLine* l = &s_lines[line];
+        const char* info;
+        u32 infoLen;
+        l->start = pos;
+        l->len = end - pos;
+        l->type = LINE_TEXT;
+        l->lang = HL_LANG_NONE;
+        l->mode = 0;
+        l->table = 0;
+        l->para = VIEW_NONE;
+        l->block = VIEW_NONE;
+
+        // A table runs from a header row followed by a delimiter row to the
+        // first line without a pipe
+        if (inTable && (inCode || !table_is_row(text + pos, end - pos))) {
+            table_init(&s_tables[s_tableCount++], text, tableStart, tableEnd - tableStart,
+                       tableLine, line - tableLine);
+            inTable = false;
+        }
+        if (!inCode && !inTable && s_tableCount < VIEW_MAX_TABLES && text[end] &&
+            table_is_row(text + pos, end - pos)) {
+            u32 next = end + 1;
+            u32 nextEnd = next;
+            while (text[nextEnd] && text[nextEnd] != '\n') nextEnd++;
+            if (table_is_delimiter(text + next, nextEnd - next)) {
+                inTable = true;
+                tableStart = pos;
+                tableLine = line;
+            }
+        }
+
+        if (inTable) {
+            l->type = LINE_TABLE;
+            l->table = s_tableCount;
+            tableEnd = end;
+            inPara = false;
+        } else if (is_fence(text + pos, end - pos, &info, &infoLen)) {
+            l->type = LINE_FENCE;
+            inCode = !inCode;
+            codeLang = inCode ? hl_language(info, infoLen) : HL_LANG_NONE;
+            codeMode = 0;
+            inPara = false;
+        } else if (inCode) {
+            // Carry the lexer mode down the block; unchanged lines are
+            // answered from the highlight cache without lexing
+            l->type = LINE_CODE;
+            l->lang = codeLang;
+            l->mode = codeMode;
+            codeMode = hl_line(codeLang, codeMode, text + pos, end - pos)->outMode;
+            inPara = false;
+        } else if (is_blank(text + pos, end - pos)) {
+            inPara = false;
+        } else if (image_parse_line(text + pos, end - pos, path, sizeof(path))) {
+            l->type = LINE_IMAGE;
+            inPara = false;
+        } else if (inPara) {
+            ViewParagraph* para = &s_paras[s_paraCount - 1];
+            para->len = end - para->start;
+            para->lineCount++;
+            l->para = s_paraCount - 1;
+        } else if (s_paraCount < VIEW_MAX_PARAGRAPHS) {
+            ViewParagraph* para = &s_paras[s_paraCount++];
+            para->start = pos;
+            para->len = end - pos;
+            para->firstLine = line;
+            para->lineCount = 1;
+            l->para = s_paraCount - 1;
+            inPara = true;
+        }
+
+        if (!text[end]) break;
+        pos = end + 1;
+    }
+    if (inTable) {
+        table_init(&s_tables[s_tableCount++], text, tableStart, tableEnd - tableStart,
+                   tableLine, s_lineCount - tableLine);
+    }
+    build_blocks();
+    view_scroll(0);
+}
+
+void view_scroll(int lines) {
+    s_scroll += lines;
+    if (s_scroll > (int)s_lineCount - 1) s_scroll = (int)s_lineCount - 1;
+    if (s_scroll < 0) s_scroll = 0;
+}
+
+void view_hscroll(float dx) {
+    float widest = 0.0f;
+    for (u32 i = 0; i < s_tableCount; i++) {
+        if (s_tables[i].measured && s_tables[i].totalWidth > widest) widest = s_tables[i].totalWidth;
+    }
+
+    float limit = widest - (VIEW_SCREEN_W - s_drawX);
+    s_hscroll += dx;
+    if (s_hscroll > limit) s_hscroll = limit;
+    if (s_hscroll < 0.0f) s_hscroll = 0.0f;
+}
+
+//---------------------------------------------------------------------------------
+// Drawing
+//---------------------------------------------------------------------------------
+static u32 issue_line(const ViewParagraph* para, u32 offset) {
+    u32 line = para->firstLine;
+    while (line + 1 < para->firstLine + para->lineCount && s_lines[line + 1].start <= offset) line++;
+    return line;
+}
+
+// Underline the misspellings on lines [from, to) of `para`; line `from` is at `y`
+static void draw_underlines(const ViewParagraph* para, const SpellResult* result,
+                            u32 from, u32 to, float x, float y) {
+    for (int i = 0; i < result->count; i++) {
+        const SpellIssue* issue = &result->issues[i];
+        u32 offset = para->start + issue->offset;
+        u32 line = issue_line(para, offset);
+        if (line < from || line >= to) continue;
+
+        const ViewLine* l = &s_lines[line];
+        float wx = x + text_width(s_text + l->start, offset - l->start);
+        float ww = text_width(s_text + offset, issue->len);
+        float wy = y + (line - from + 1) * VIEW_LINE_H - 2.0f;
+        C2D_DrawRectSolid(wx, wy, 0.5f, ww, 1.0f, COLOR_SPELL);
+    }
+}
+
+static void add_notices(const ViewParagraph* para, const SpellResult* result, u32 from, u32 to) {
+    for (int i = 0; i < result->count && s_noticeCount < VIEW_MAX_NOTICES; i++) {
+        const SpellIssue* issue = &result->issues[i];
+        u32 offset = para->start + issue->offset;
+        u32 line = issue_line(para, offset);
+        if (line < from || line >= to) continue;
+
+        ViewNotice* notice = &s_notices[s_noticeCount++];
+        size_t len = issue->len < SPELL_MAX_WORD - 1 ? issue->len : SPELL_MAX_WORD - 1;
+        memcpy(notice->word, s_text + offset, len);
+        notice->word[len] = '\0';
+        memcpy(notice->suggestion, issue->suggestion, SPELL_MAX_WORD);
+    }
+}
+
+static void draw_code_line(const ViewLine* line, float x, float y) {
+    const char* src = s_text + line->start;
+    const HlLine* hl = hl_line(line->lang, line->mode, src, line->len);
+
+    for (int i = 0; i < hl->count; i++) {
+        const HlSpan* span = &hl->spans[i];
+        C2D_Text text;
+        float w = 0.0f;
+
+        C2D_TextParse(&text, s_lineBuf, scratch_copy(src + span->start, span->len));
+        C2D_TextOptimize(&text);
+        C2D_TextGetDimensions(&text, VIEW_TEXT_SCALE, VIEW_TEXT_SCALE, &w, NULL);
+        C2D_DrawText(&text, C2D_WithColor, x, y, 0.5f, VIEW_TEXT_SCALE, VIEW_TEXT_SCALE,
+                     kind_color(span->kind));
+        x += w;
+    }
+}
+
+static void draw_image_line(const ViewLine* line, float x, float y) {
+    char path[IMAGE_PATH_LEN];
+    char label[IMAGE_PATH_LEN + 16];
+    C2D_Image image;
+
+    if (!image_parse_line(s_text + line->start, line->len, path, sizeof(path))) return;
+    ImageState state = image_get(path, &image);
+    if (state == IMAGE_READY) {
+        C2D_DrawImageAt(image, x, y + 2.0f, 0.5f, NULL, 1.0f, 1.0f);
+        return;
+    }
+
+    C2D_Text text;
+    snprintf(label, sizeof(label), state == IMAGE_LOADING ? "[loading %s]" : "[cannot show %s]", path);
+    C2D_TextParse(&text, s_lineBuf, label);
+    C2D_TextOptimize(&text);
+    C2D_DrawText(&text, C2D_WithColor, x, y, 0.5f, VIEW_TEXT_SCALE, VIEW_TEXT_SCALE, COLOR_FENCE);
+}
+
+static void draw_line(u32 index, float x, float y) {
+    const ViewLine* line = &s_lines[index];
+    if (line->len == 0) return;
+
+    if (line->type == LINE_IMAGE) {
+        draw_image_line(line, x, y);
+        return;
+    }
+    if (line->type == LINE_CODE) {
+        draw_code_line(line, x, y);
+        return;
+    }
+    if (line->type == LINE_TABLE) {
+        Table* table = &s_tables[line->table];
+        if (!table->measured) table_measure(table, s_text, s_measureBuf);
+        table_draw_row(table, index - table->firstLine, s_text + line->start, line->len,
+                       x - s_hscroll, y, x, VIEW_SCREEN_W, s_lineBuf);
+        return;
+    }
+
+    C2D_Text text;
+    C2D_TextParse(&text, s_lineBuf, scratch_copy(s_text + line->start, line->len));
+    C2D_TextOptimize(&text);
+    C2D_DrawText(&text, C2D_WithColor, x, y, 0.5f, VIEW_TEXT_SCALE, VIEW_TEXT_SCALE,
+                 line->type == LINE_FENCE ? COLOR_FENCE : COLOR_VIEW_TEXT);
+}
+
+// The spell-check state a text block is drawn with: underlines appear once
+// the paragraph's result comes back from the worker
+static u32 block_variant(const ViewBlock* block, SpellResult* result) {
+    if (block->para == VIEW_NONE) return 0;
+    const ViewParagraph* para = &s_paras[block->para];
+    return spell_lookup(s_text + para->start, para->len, result) ? 1 : 0;
+}
+
+static void render_block(const ViewBlock* block, Tile* tile, u32 background) {
+    SpellResult result;
+    bool checked = block_variant(block, &result) != 0;
+
+    tile_begin(tile, background);
+    C2D_TextBufClear(s_lineBuf);
+    for (u32 i = 0; i < block->lineCount; i++) {
+        draw_line(block->firstLine + i, 0.0f, i * VIEW_LINE_H);
+    }
+    if (checked) {
+        draw_underlines(&s_paras[block->para], &result, block->firstLine,
+                        block->firstLine + block->lineCount, 0.0f, 0.0f);
+    }
+}
+
+// Tile holding line `index`, if it is up to date
+static const Tile* line_tile(u32 index) {
+    const ViewLine* line = &s_lines[index];
+    if (line->block == VIEW_NONE) return NULL;
+
+    const ViewBlock* block = &s_blocks[line->block];
+    const Tile* tile = tile_find(&block->key);
+    return tile && tile->variant == block->variant ? tile : NULL;
+}
+
+void view_prepare(float x, float y, float bottom, u32 background) {
+    s_drawX = x;
+    s_first = s_scroll;
+    s_last = s_first;
+    if (!s_text) return;
+
+    // Lines differ in height, so find the visible range before drawing
+    float top = y;
+    while (s_last < s_lineCount && s_last - s_first < VIEW_MAX_VISIBLE && top + VIEW_LINE_H <= bottom) {
+        s_lineY[s_last - s_first] = top;
+        top += line_height(&s_lines[s_last++]);
+    }
+
+    tile_begin_frame();
+    int renders = 0;
+    for (u32 i = s_first; i < s_last;) {
+        if (s_lines[i].block == VIEW_NONE) {
+            i++;
+            continue;
+        }
+
+        ViewBlock* block = &s_blocks[s_lines[i].block];
+        SpellResult result;
+        i = block->firstLine + block->lineCount;
+        block->variant = block_variant(block, &result);
+
+        Tile* tile = tile_find(&block->key);
+        if (renders == VIEW_TILE_RENDERS || (tile && tile->variant == block->variant)) continue;
+        if (!tile) tile = tile_create(&block->key, VIEW_SCREEN_W - x, block->lineCount * VIEW_LINE_H);
+        if (!tile) continue;
+
+        render_block(block, tile, background);
+        tile->variant = block->variant;
+        renders++;
+    }
+}
+
+void view_draw(void) {
+    s_noticeCount = 0;
+    if (!s_text) return;
+
+    C2D_TextBufClear(s_lineBuf);
+    for (u32 i = s_first; i < s_last;) {
+        const Tile* tile = line_tile(i);
+        if (!tile) {
+            s_lineTiled[i - s_first] = false;
+            draw_line(i, s_drawX, s_lineY[i - s_first]);
+            i++;
+            continue;
+        }
+
+        const ViewBlock* block = &s_blocks[s_lines[i].block];
+        u32 end = block->firstLine + block->lineCount;
+        if (end > s_last) end = s_last;
+        tile_draw(tile, s_drawX, s_lineY[i - s_first], (i - block->firstLine) * VIEW_LINE_H,
+                  (end - i) * VIEW_LINE_H);
+        for (; i < end; i++) s_lineTiled[i - s_first] = true;
+    }
+
+    // Tiles carry their own underlines; lines drawn directly need them here
+    for (u32 p = 0; p < s_paraCount; p++) {
+        const ViewParagraph* para = &s_paras[p];
+        SpellResult result;
+        if (para->firstLine + para->lineCount <= s_first) continue;
+        if (para->firstLine >= s_last) break;
+        if (!spell_lookup(s_text + para->start, para->len, &result)) continue;
+
+        add_notices(para, &result, s_first, s_last);
+        u32 end = para->firstLine + para->lineCount;
+        for (u32 i = para->firstLine > s_first ? para->firstLine : s_first; i < end && i < s_last; i++) {
+            if (!s_lineTiled[i - s_first]) {
+                draw_underlines(para, &result, i, i + 1, s_drawX, s_lineY[i - s_first]);
+            }
+        }
+    }
+}
+
+int view_notices(const ViewNotice** out) {
+    *out = s_notices;
+    return s_noticeCount;
+}
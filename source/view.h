@@ -0,0 +1,52 @@
+//---------------------------------------------------------------------------------
+// view.h
+// Scrollable, line-based rendering of a note on the top screen.
+//---------------------------------------------------------------------------------
+
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <3ds.h>
+
+#include "spell.h"
+
+#define VIEW_MAX_LINES      1024
+#define VIEW_MAX_PARAGRAPHS 512
+#define VIEW_MAX_TABLES     32
+#define VIEW_MAX_NOTICES    8
+#define VIEW_SCREEN_W       400.0f
+#define VIEW_TEXT_SCALE     0.75f
+#define VIEW_LINE_H         22.0f
+#define VIEW_IMAGE_ROWS     6      // Lines taken by an inline image
+
+// A misspelled word in a visible paragraph
+typedef struct {
+    char word[SPELL_MAX_WORD];
+    char suggestion[SPELL_MAX_WORD];
+} ViewNotice;
+
+bool view_init(void);
+void view_exit(void);
+
+// Point the view at `text` and rebuild the line and paragraph tables. Call
+// again whenever the text changes. Switching to a different buffer scrolls
+// back to the top.
+void view_set_text(const char* text);
+
+void view_scroll(int lines);
+
+// Scroll tables horizontally by `dx` pixels
+void view_hscroll(float dx);
+
+// Lay out the lines that fit between `y` and `bottom` at `x`, and render the
+// tiles they need. Call after C3D_FrameBegin() and before any scene begins,
+// since tiles are separate render targets; `background` fills the tiles.
+void view_prepare(float x, float y, float bottom, u32 background);
+
+// Draw the lines laid out by view_prepare() on the current scene
+void view_draw(void);
+
+// Spelling notices gathered by the last view_draw()
+int view_notices(const ViewNotice** out);
+
+#endif // VIEW_H
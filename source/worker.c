@@ -0,0 +1,157 @@
+//---------------------------------------------------------------------------------
+// worker.c
+// Background worker thread. Jobs run one at a time, in submission order, at a
+// priority just below the main thread so they never steal a frame from it.
+//
+// Parallel runs use short-lived helper threads instead. The main thread owns
+// core 0; on a New 3DS core 2 is also free for the application, while the
+// Old 3DS system core is time-sliced and would not speed anything up.
+//---------------------------------------------------------------------------------
+
+#include "worker.h"
+
+#include "prof.h"
+
+//---------------------------------------------------------------------------------
+// Definitions and globals
+//---------------------------------------------------------------------------------
+
+#define WORKER_STACK_SIZE (32 * 1024)
+
+typedef struct {
+    WorkerFunc fn;
+    void* arg;
+} WorkerJob;
+
+static Thread s_thread = NULL;
+static LightLock s_lock;
+static LightEvent s_wake;
+// A worker_parallel() call on a helper thread
+typedef struct {
+    WorkerFunc fn;
+    void* arg;
+    ProfTrack track;
+} HelperCall;
+
+static WorkerJob s_queue[WORKER_QUEUE_LEN];
+static int s_head = 0;
+static int s_count = 0;
+static volatile bool s_quit = false;
+
+static int s_helperCores[WORKER_MAX_THREADS - 1];
+static int s_threadCount = 1;
+
+//---------------------------------------------------------------------------------
+// Worker thread
+//---------------------------------------------------------------------------------
+static void worker_main(void* unused) {
+    (void)unused;
+    prof_thread(PROF_TRACK_WORKER);
+
+    while (!s_quit) {
+        WorkerJob job = { NULL, NULL };
+
+        LightLock_Lock(&s_lock);
+        if (s_count > 0) {
+            job = s_queue[s_head];
+            s_head = (s_head + 1) % WORKER_QUEUE_LEN;
+            s_count--;
+        }
+        LightLock_Unlock(&s_lock);
+
+        if (job.fn) {
+            job.fn(job.arg);
+        } else {
+            LightEvent_Wait(&s_wake);
+        }
+    }
+}
+
+static void helper_main(void* arg) {
+    HelperCall* call = arg;
+    prof_thread(call->track);
+    prof_begin("parallel");
+    call->fn(call->arg);
+    prof_end();
+}
+
+//---------------------------------------------------------------------------------
+// Public interface
+//---------------------------------------------------------------------------------
+bool worker_init(void) {
+    s32 prio = 0x30;
+    svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+
+    LightLock_Init(&s_lock);
+    LightEvent_Init(&s_wake, RESET_ONESHOT);
+    s_head = 0;
+    s_count = 0;
+    s_quit = false;
+
+    bool n3ds = false;
+    APT_CheckNew3DS(&n3ds);
+    s_threadCount = 1;
+    if (n3ds) s_helperCores[s_threadCount++ - 1] = 2;
+
+    s_thread = threadCreate(worker_main, NULL, WORKER_STACK_SIZE, prio + 1, -2, false);
+    return s_thread != NULL;
+}
+
+void worker_exit(void) {
+    if (!s_thread) return;
+
+    s_quit = true;
+    LightEvent_Signal(&s_wake);
+    threadJoin(s_thread, U64_MAX);
+    threadFree(s_thread);
+    s_thread = NULL;
+
+    // Drop what never ran; its args go back to the modules that queued them
+    s_head = 0;
+    s_count = 0;
+}
+
+bool worker_submit(WorkerFunc fn, void* arg) {
+    bool queued = false;
+
+    LightLock_Lock(&s_lock);
+    if (s_count < WORKER_QUEUE_LEN) {
+        s_queue[(s_head + s_count) % WORKER_QUEUE_LEN] = (WorkerJob){ fn, arg };
+        s_count++;
+        queued = true;
+    }
+    LightLock_Unlock(&s_lock);
+
+    if (queued) LightEvent_Signal(&s_wake);
+    return queued;
+}
+
+int worker_threads(void) {
+    return s_threadCount;
+}
+
+void worker_parallel(WorkerFunc fn, void* const* args, int count) {
+    if (count <= 0) return;
+    s32 prio = 0x30;
+    svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+
+    Thread helpers[WORKER_MAX_THREADS] = { NULL };
+    HelperCall calls[WORKER_MAX_THREADS];
+    int helperCount = count < s_threadCount ? count : s_threadCount;
+    for (int i = 1; i < helperCount; i++) {
+        calls[i] = (HelperCall){ fn, args[i], PROF_TRACK_JOB + i - 1 };
+        helpers[i] = threadCreate(helper_main, &calls[i], WORKER_STACK_SIZE, prio, s_helperCores[i - 1], false);
+    }
+
+    prof_begin("parallel");
+    fn(args[0]);
+    for (int i = 1; i < count; i++) {
+        if (i < helperCount && helpers[i]) {
+            threadJoin(helpers[i], U64_MAX);
+            threadFree(helpers[i]);
+        } else {
+            fn(args[i]);
+        }
+    }
+    prof_end();
+}
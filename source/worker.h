@@ -0,0 +1,36 @@
+//---------------------------------------------------------------------------------
+// worker.h
+// Background worker thread with a small FIFO job queue, plus fork-join runs
+// of one job per core for CPU-bound work.
+//---------------------------------------------------------------------------------
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <3ds.h>
+
+#define WORKER_QUEUE_LEN   32
+#define WORKER_MAX_THREADS 4
+
+typedef void (*WorkerFunc)(void* arg);
+
+bool worker_init(void);
+
+// Stops the thread after the job in progress; queued jobs are dropped without
+// running. Their args stay owned by the modules that queued them, which free
+// them in their own exit functions, called after this.
+void worker_exit(void);
+
+// Queue `fn(arg)` to run on the worker. Returns false if the queue is full,
+// in which case the caller still owns `arg`.
+bool worker_submit(WorkerFunc fn, void* arg);
+
+// Threads worker_parallel() runs at once, counting the caller
+int worker_threads(void);
+
+// Run `fn` on each of the `count` args at once, the first on the calling
+// thread and the others on helper threads on the other cores, and return
+// when all are done. Args without a thread run on the caller afterwards.
+void worker_parallel(WorkerFunc fn, void* const* args, int count);
+
+#endif // WORKER_H
@@ -0,0 +1,152 @@
+//---------------------------------------------------------------------------------
+// benchindex.c
+// Host tool: times a full index build of a synthetic library with 1 to N
+// build threads, and checks that each sharded build is byte-identical to
+// the single-threaded one.
+//
+//   cc -O2 -pthread -Itools/host -o benchindex tools/benchindex.c && ./benchindex 8000 4
+//
+// The notes are random text over a Zipf-like vocabulary, about 1 KB each.
+// worker_parallel() is provided here on pthreads, so the build is sharded
+// exactly as on the console.
+//---------------------------------------------------------------------------------
+
+#include "../source/crc.c"
+#include "../source/segment.c"
+#include "../source/storage_host.c"
+#include "../source/utf8.c"
+
+#include <pthread.h>
+#include <time.h>
+
+#define BENCH_VOCAB    4000
+#define BENCH_BODY     1024
+#define BENCH_RUNS     3
+
+static int s_threads = 1;
+static int s_parallelRuns = 0;      // worker_parallel() calls, i.e. sharded builds
+static char s_vocab[BENCH_VOCAB][12];
+
+int worker_threads(void) {
+    return s_threads;
+}
+
+static void* run_job(void* arg) {
+    void** job = arg;
+    ((WorkerFunc)job[0])(job[1]);
+    return NULL;
+}
+
+void worker_parallel(WorkerFunc fn, void* const* args, int count) {
+    pthread_t threads[WORKER_MAX_THREADS];
+    void* jobs[WORKER_MAX_THREADS][2];
+    s_parallelRuns++;
+    for (int i = 1; i < count; i++) {
+        jobs[i][0] = (void*)fn;
+        jobs[i][1] = args[i];
+        pthread_create(&threads[i], NULL, run_job, jobs[i]);
+    }
+    fn(args[0]);
+    for (int i = 1; i < count; i++) pthread_join(threads[i], NULL);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void make_vocab(void) {
+    for (int i = 0; i < BENCH_VOCAB; i++) {
+        int len = 2 + rand() % 9;
+        for (int j = 0; j < len; j++) s_vocab[i][j] = 'a' + rand() % 26;
+        s_vocab[i][len] = '\0';
+    }
+}
+
+// Squaring a uniform pick favours the start of the vocabulary
+static const char* pick_word(void) {
+    double r = rand() / (RAND_MAX + 1.0);
+    return s_vocab[(int)(r * r * BENCH_VOCAB)];
+}
+
+// Fill `docs` with `count` notes; returns the text, which the docs point into
+static char* make_docs(SearchDoc* docs, int count) {
+    char* text = malloc((size_t)count * (32 + BENCH_BODY + 16));
+    if (!text) return NULL;
+    char* p = text;
+    for (int i = 0; i < count; i++) {
+        docs[i].title = p;
+        p += sprintf(p, "note %d %s", i, pick_word()) + 1;
+        docs[i].body = p;
+        size_t len = 0;
+        while (len < BENCH_BODY) len += sprintf(p + len, "%s%s", pick_word(), rand() % 12 ? " " : ".\n");
+        p += len + 1;
+    }
+    return text;
+}
+
+// Best time of `runs` builds of `docs` with `threads` threads
+static double time_build(const SearchDoc* docs, int count, int threads, int runs) {
+    double best = 0.0;
+    s_threads = threads;
+    for (int run = 0; run < runs; run++) {
+        double start = now_ms();
+        Segment* seg = segment_build(docs, count, NULL, 0, 0);
+        double ms = now_ms() - start;
+        segment_free(seg);
+        if (run == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 8000;
+    int maxThreads = argc > 2 ? atoi(argv[2]) : WORKER_MAX_THREADS;
+    if (count < 1 || count > SEGMENT_NO_DOC) count = 8000;
+    if (maxThreads < 1 || maxThreads > WORKER_MAX_THREADS) maxThreads = WORKER_MAX_THREADS;
+
+    srand(1);
+    make_vocab();
+    SearchDoc* docs = malloc(count * sizeof(SearchDoc));
+    char* text = docs ? make_docs(docs, count) : NULL;
+    if (!docs || !text) return 1;
+    size_t textLen = 0;
+    for (int i = 0; i < count; i++) textLen += strlen(docs[i].title) + strlen(docs[i].body) + 2;
+
+    printf("%d notes, %.1f MB\n", count, textLen / 1048576.0);
+    s_threads = 1;
+    Segment* single = segment_build(docs, count, NULL, 0, 0);
+    if (!single) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    double base = 0.0;
+    bool identical = true;
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        double best = time_build(docs, count, threads, BENCH_RUNS);
+
+        // Without tombstones a sharded build must match the single one exactly
+        int before = s_parallelRuns;
+        Segment* seg = segment_build(docs, count, NULL, 0, 0);
+        if (!seg) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        bool sharded = s_parallelRuns > before;
+        bool same = seg->size == single->size && memcmp(seg->header, single->header, seg->size) == 0;
+        identical = identical && same;
+
+        if (threads == 1) base = best;
+        printf("%d thread%s  %8.1f ms  %5.2fx  (%lu terms, %s, %s)\n", threads, threads > 1 ? "s" : " ",
+               best, base / best, (unsigned long)seg->header->termCount, sharded ? "sharded" : "one shard",
+               same ? "identical" : "DIFFERS");
+        segment_free(seg);
+    }
+    segment_free(single);
+
+    free(docs);
+    free(text);
+    return identical ? 0 : 1;
+}
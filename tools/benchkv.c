@@ -0,0 +1,144 @@
+//---------------------------------------------------------------------------------
+// benchkv.c
+// Host tool: measures the metadata store on a throwaway directory.
+//
+//   cc -O2 -pthread -Itools/host -o benchkv tools/benchkv.c && ./benchkv 20000
+//
+// Reports single-key and batched commit rates, point lookups, full and prefix
+// scans, and how long reopening takes, which is a replay of the whole log.
+// It then cuts the log short in the middle of the last commit and checks that
+// reopening drops exactly that commit.
+//---------------------------------------------------------------------------------
+
+#include "../source/crc.c"
+#include "../source/kv.c"
+#include "../source/storage_host.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BATCH   100
+#define BENCH_LOOKUPS 1000000
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Keys in a few prefixes, like the app's own namespaces
+static void make_key(char* buf, int i) {
+    static const char* prefixes[] = { "note/", "replace/", "session/", "tag/" };
+    snprintf(buf, KV_KEY_LEN, "%s%08d", prefixes[i % 4], i);
+}
+
+static bool count_key(const char* key, const void* value, size_t len, void* arg) {
+    (void)key;
+    (void)value;
+    *(u32*)arg += len;
+    return true;
+}
+
+static long file_size(const char* dir, const char* name) {
+    char path[STORAGE_PATH_LEN];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s", dir, name);
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 20000;
+    char dir[] = "/tmp/benchkv-XXXXXX";
+    char root[64];
+    char key[KV_KEY_LEN];
+    char value[64];
+    u32 bytes = 0;
+
+    if (count < BENCH_BATCH || !mkdtemp(dir)) return 1;
+    snprintf(root, sizeof(root), "%s/", dir);
+    storage_init(root);
+    kv_open();
+
+    // Commits of one key each: every one is an append and a flush
+    int single = count / 10;
+    double t0 = now_ms();
+    for (int i = 0; i < single; i++) {
+        make_key(key, i);
+        int len = snprintf(value, sizeof(value), "value %d", i);
+        if (!kv_set(key, value, len)) return 1;
+    }
+    double singleMs = now_ms() - t0;
+
+    // The rest in batches
+    t0 = now_ms();
+    for (int i = single; i < count; i += BENCH_BATCH) {
+        KvTxn* txn = kv_begin();
+        for (int j = i; j < i + BENCH_BATCH && j < count; j++) {
+            make_key(key, j);
+            int len = snprintf(value, sizeof(value), "value %d", j);
+            kv_put(txn, key, value, len);
+        }
+        if (!kv_commit(txn)) return 1;
+    }
+    double batchMs = now_ms() - t0;
+
+    t0 = now_ms();
+    u32 sum = 0;
+    srand(1);
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        make_key(key, rand() % count);
+        sum += kv_get(key, value, sizeof(value));
+    }
+    double lookupMs = now_ms() - t0;
+
+    t0 = now_ms();
+    int scanned = 0;
+    for (int i = 0; i < 10; i++) scanned += kv_scan(NULL, NULL, count_key, &bytes);
+    double scanMs = (now_ms() - t0) / 10;
+    t0 = now_ms();
+    int prefixed = 0;
+    for (int i = 0; i < 10; i++) prefixed += kv_scan_prefix("session/", count_key, &bytes);
+    double prefixMs = (now_ms() - t0) / 10;
+
+    long logSize = file_size(root, KV_FILE);
+    kv_close();
+    t0 = now_ms();
+    kv_open();
+    double openMs = now_ms() - t0;
+    int reopened = kv_scan(NULL, NULL, count_key, &bytes);
+
+    printf("%d keys, log %ld bytes\n", count, logSize);
+    printf("  commit, 1 key        %10.0f commits/s\n", single / (singleMs / 1000));
+    printf("  commit, %d keys    %10.0f commits/s  %10.0f keys/s\n", BENCH_BATCH,
+           (count - single) / BENCH_BATCH / (batchMs / 1000), (count - single) / (batchMs / 1000));
+    printf("  point lookup         %10.0f lookups/s (checksum %u)\n", BENCH_LOOKUPS / (lookupMs / 1000), sum);
+    printf("  full scan            %10.0f keys/s\n", scanned / 10 / (scanMs / 1000));
+    printf("  prefix scan          %10.0f keys/s\n", prefixed / 10 / (prefixMs / 1000));
+    printf("  reopen               %10.2f ms\n", openMs);
+
+    // A commit cut short: only the last block may be lost, and the log is
+    // rewritten so later commits are readable
+    KvTxn* txn = kv_begin();
+    kv_put(txn, "crash/a", "1", 1);
+    kv_put(txn, "crash/b", "2", 1);
+    kv_commit(txn);
+    char path[STORAGE_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%s", root, KV_FILE);
+    if (truncate(path, file_size(root, KV_FILE) - 3) != 0) return 1;
+    kv_close();
+    kv_open();
+    int crashed = kv_scan_prefix("crash/", count_key, &bytes);
+    kv_set("crash/c", "3", 1);
+    kv_close();
+    kv_open();
+    int after = kv_scan_prefix("crash/", count_key, &bytes);
+    bool ok = reopened == count && crashed == 0 && after == 1;
+    printf("  torn commit          %s\n", ok ? "dropped" : "FAILED");
+
+    kv_close();
+    storage_remove(KV_FILE);
+    rmdir(dir);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+//---------------------------------------------------------------------------------
+// benchpredict.c
+// Host tool: measures the completion trie on a synthetic 50k-word
+// vocabulary with Zipf-like word frequencies.
+//
+//   cc -O2 -Itools/host -o benchpredict tools/benchpredict.c && ./benchpredict 50000
+//
+// Reports node count and memory, top-3 lookup latency for one- to four-
+// letter prefixes (mean, p99 and worst), the cost of the incremental update
+// a note save makes, and the cost of rebuilding the whole model, which is
+// what a structure that cannot be updated in place (a minimal DAWG, a
+// packed double array) would pay on every save instead.
+//---------------------------------------------------------------------------------
+
+#include "../source/predict.c"
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_EXTRA   500000     // Words sampled on top of one of each
+#define BENCH_QUERIES 200000
+#define BENCH_NOTE    1024       // Bytes of text a save replaces
+#define BENCH_SAVES   2000
+
+static char (*s_vocab)[16];
+static int s_vocabCount;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Letters drawn with roughly English frequencies, so prefixes share as
+// they would in real notes. A hash set keeps the words distinct.
+static void make_vocab(int count) {
+    static const char letters[] = "eeeeeeeeeeeettttttttaaaaaaaaoooooooiiiiiiinnnnnnnsssssshhhhhhrrrrrr"
+                                  "ddddllllcccuuummwwffggyyppbbvkjxqz";
+    u32 cap = 1;
+    while (cap < (u32)count * 2) cap *= 2;
+    int* seen = malloc(cap * sizeof(int));
+    memset(seen, 0xFF, cap * sizeof(int));
+    s_vocab = malloc(count * sizeof(*s_vocab));
+    s_vocabCount = 0;
+
+    while (s_vocabCount < count) {
+        char* word = s_vocab[s_vocabCount];
+        int len = 3 + rand() % 10;
+        for (int j = 0; j < len; j++) word[j] = letters[rand() % (sizeof(letters) - 1)];
+        word[len] = '\0';
+
+        u32 slot = 2166136261u;
+        for (int j = 0; j < len; j++) slot = (slot ^ (u8)word[j]) * 16777619u;
+        for (slot &= cap - 1; seen[slot] >= 0; slot = (slot + 1) & (cap - 1)) {
+            if (strcmp(s_vocab[seen[slot]], word) == 0) break;
+        }
+        if (seen[slot] >= 0) continue;
+        seen[slot] = s_vocabCount++;
+    }
+    free(seen);
+}
+
+// Squaring a uniform pick favours the start of the vocabulary
+static const char* pick_word(void) {
+    double r = rand() / (RAND_MAX + 1.0);
+    return s_vocab[(int)(r * r * s_vocabCount)];
+}
+
+// `len` bytes of text sampled from the vocabulary
+static void make_text(char* buf, size_t len) {
+    size_t used = 0;
+    buf[0] = '\0';
+    for (;;) {
+        const char* word = pick_word();
+        size_t n = strlen(word);
+        if (used + n + 2 > len) break;
+        memcpy(buf + used, word, n);
+        used += n;
+        buf[used++] = ' ';
+        buf[used] = '\0';
+    }
+}
+
+static void build(void) {
+    char text[4096];
+    predict_exit();
+    predict_init();
+    for (int i = 0; i < s_vocabCount; i++) predict_add_text(s_vocab[i]);
+    for (int i = 0; i < BENCH_EXTRA / 512; i++) {
+        make_text(text, sizeof(text));
+        predict_add_text(text);
+    }
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 50000;
+    if (count < 100) count = 50000;
+
+    srand(1);
+    make_vocab(count);
+    double start = now_us();
+    build();
+    double rebuild = now_us() - start;
+
+    u32 distinct = 0;
+    for (u32 i = 0; i < s_nodeCount; i++) distinct += s_nodes[i].count > 0;
+    printf("%d-word vocabulary, %lu distinct words counted\n", s_vocabCount, (unsigned long)distinct);
+    printf("nodes     %lu x %u bytes = %.1f KB, %.1f KB allocated\n", (unsigned long)s_nodeCount,
+           (unsigned)sizeof(TrieNode), s_nodeCount * sizeof(TrieNode) / 1024.0,
+           s_nodeCap * sizeof(TrieNode) / 1024.0);
+
+    // Lookups by prefix length; one letter is the worst case, the widest subtree
+    char out[PREDICT_MAX_RESULTS][PREDICT_MAX_WORD];
+    double* times = malloc(BENCH_QUERIES * sizeof(double));
+    int sink = 0;
+    for (int prefixLen = 1; prefixLen <= 4; prefixLen++) {
+        double total = 0.0;
+        for (int q = 0; q < BENCH_QUERIES; q++) {
+            char prefix[8];
+            const char* word = s_vocab[rand() % s_vocabCount];
+            memcpy(prefix, word, prefixLen);
+            prefix[prefixLen] = '\0';
+
+            double t = now_us();
+            sink += predict_complete(prefix, out, PREDICT_MAX_RESULTS);
+            times[q] = now_us() - t;
+            total += times[q];
+        }
+        qsort(times, BENCH_QUERIES, sizeof(double), compare_double);
+        printf("lookup    %d-letter prefix  mean %6.2f us  p99 %6.2f us  worst %6.2f us\n", prefixLen,
+               total / BENCH_QUERIES, times[BENCH_QUERIES * 99 / 100], times[BENCH_QUERIES - 1]);
+    }
+    free(times);
+
+    // A save: the note's old words out, its new words in
+    char* before = malloc(BENCH_NOTE);
+    char* after = malloc(BENCH_NOTE);
+    make_text(before, BENCH_NOTE);
+    predict_add_text(before);
+    start = now_us();
+    for (int i = 0; i < BENCH_SAVES; i++) {
+        make_text(after, BENCH_NOTE);
+        predict_remove_text(before);
+        predict_add_text(after);
+        char* swap = before;
+        before = after;
+        after = swap;
+    }
+    printf("update    %.1f us per %d-byte note saved\n", (now_us() - start) / BENCH_SAVES, BENCH_NOTE);
+    printf("rebuild   %.1f ms for the whole model\n", rebuild / 1000.0);
+
+    free(before);
+    free(after);
+    free(s_vocab);
+    predict_exit();
+    return sink < 0;
+}
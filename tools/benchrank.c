@@ -0,0 +1,515 @@
+//---------------------------------------------------------------------------------
+// benchrank.c
+// Host tool: times BM25 ranking on a synthetic library. Each query is ranked
+// with rank_top(), which stops admitting candidates once the MaxScore bound
+// closes, and again by scoring every posting of the same lists; the top k
+// of the two must be the same notes with the same scores. Every fourth
+// query is ranked within a filter, as the search screen does.
+//
+// Then notes are edited and added at random, with the worker's jobs run
+// only every few edits, and each update is timed against the full build.
+// The app is restarted twice, once cleanly and once after notes were
+// deleted and edited behind its back and the newest segment was cut short.
+// Throughout, every note must be indexed under its current text, and
+// rankings must agree with frequencies and lengths counted from the notes'
+// own words.
+//
+//   cc -O2 -Itools/host -o benchrank tools/benchrank.c source/segment.c
+//      source/storage_host.c source/crc.c source/utf8.c -lm && ./benchrank 10000
+//
+// The notes are 200 to 1000 bytes of random text over a Zipf-distributed
+// vocabulary of 5000 words with English letter frequencies. Queries are one
+// to three words, some cut short to a prefix as they are while typing. The
+// index is kept in a temporary directory; the worker's jobs are run here,
+// in order, after each call that queues them.
+//---------------------------------------------------------------------------------
+
+#include "../source/rank.c"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define BENCH_VOCAB   5000
+#define BENCH_QUERIES 2000
+#define BENCH_JOBS    64
+#define BENCH_WORDS   1024       // Words in a note, at most
+#define BENCH_EDITS   600
+#define BENCH_BATCH   8          // Edits between runs of the worker's jobs
+#define BENCH_CHECKS  20         // Queries per check of the index
+#define BENCH_DELETED 50         // Notes deleted while the app is closed
+#define BENCH_OUTSIDE 20         // and edited
+
+typedef struct {
+    char text[RANK_TERM_LEN];
+    u32 tf;
+} BenchTerm;
+
+typedef struct {
+    char title[48];
+    char* body;
+    BenchTerm* terms;    // Distinct words, sorted, for the reference
+    u32 termCount;
+    u32 length;          // Words in the title and body
+} BenchNote;
+
+static char s_vocab[BENCH_VOCAB][12];
+static double s_zipf[BENCH_VOCAB];   // Cumulative word probabilities
+static BenchNote* s_notes;
+static int s_noteTotal;
+static int s_noteSpace;
+static int s_created = 0;           // Keeps titles unique
+
+static WorkerFunc s_jobFn[BENCH_JOBS];
+static void* s_jobArg[BENCH_JOBS];
+static int s_jobCount = 0;
+
+// The worker: jobs wait in order until run_jobs()
+bool worker_submit(WorkerFunc fn, void* arg) {
+    if (s_jobCount == BENCH_JOBS) return false;
+    s_jobFn[s_jobCount] = fn;
+    s_jobArg[s_jobCount++] = arg;
+    return true;
+}
+
+int worker_threads(void) {
+    return 1;
+}
+
+void worker_parallel(WorkerFunc fn, void* const* args, int count) {
+    for (int i = 0; i < count; i++) fn(args[i]);
+}
+
+void prof_begin(const char* name) {
+    (void)name;
+}
+
+void prof_end(void) {
+}
+
+// Run what was queued, and swap in merges, until nothing is left
+static void run_jobs(void) {
+    while (s_jobCount > 0) {
+        int count = s_jobCount;
+        s_jobCount = 0;
+        for (int i = 0; i < count; i++) s_jobFn[i](s_jobArg[i]);
+        rank_poll();
+    }
+}
+
+static double now_ms(void) {
+    return svcGetSystemTick() / (double)CPU_TICKS_PER_MSEC;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_doc(int id, SearchDoc* out, void* arg) {
+    (void)arg;
+    out->title = s_notes[id].title;
+    out->body = s_notes[id].body;
+}
+
+static const char* pick_word(void) {
+    double r = rand() / (RAND_MAX + 1.0);
+    int lo = 0, hi = BENCH_VOCAB - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (s_zipf[mid] < r) lo = mid + 1;
+        else hi = mid;
+    }
+    return s_vocab[lo];
+}
+
+static void make_vocab(void) {
+    static const char letters[] = "eeeeeeeeeeeettttttttaaaaaaaaoooooooiiiiiiinnnnnnnsssssshhhhhhrrrrrr"
+                                  "ddddllllcccuuummwwffggyyppbbvkjxqz";
+    double total = 0.0;
+    for (int i = 0; i < BENCH_VOCAB; i++) {
+        int len = 2 + rand() % 8;
+        for (int j = 0; j < len; j++) s_vocab[i][j] = letters[rand() % (sizeof(letters) - 1)];
+        s_vocab[i][len] = '\0';
+        total += 1.0 / (i + 1);
+        s_zipf[i] = total;
+    }
+    for (int i = 0; i < BENCH_VOCAB; i++) s_zipf[i] /= total;
+}
+
+static int compare_text(const void* a, const void* b) {
+    return strcmp(a, b);
+}
+
+// Count the note's words as the index should
+static void tokenize(BenchNote* note) {
+    static char words[BENCH_WORDS][RANK_TERM_LEN];
+    const char* texts[2] = { note->title, note->body };
+    u32 count = 0;
+    for (int t = 0; t < 2; t++) {
+        const char* p = texts[t];
+        while (count < BENCH_WORDS && segment_next_word(&p, words[count]) > 0) count++;
+    }
+    qsort(words, count, RANK_TERM_LEN, compare_text);
+
+    note->terms = realloc(note->terms, (count + 1) * sizeof(BenchTerm));
+    note->termCount = 0;
+    note->length = count;
+    for (u32 i = 0; i < count; i++) {
+        BenchTerm* last = note->termCount ? &note->terms[note->termCount - 1] : NULL;
+        if (last && strcmp(last->text, words[i]) == 0) {
+            last->tf++;
+        } else {
+            memcpy(note->terms[note->termCount].text, words[i], RANK_TERM_LEN);
+            note->terms[note->termCount++].tf = 1;
+        }
+    }
+}
+
+static void make_body(BenchNote* note) {
+    size_t len = 200 + rand() % 801, used = 0;
+    note->body = realloc(note->body, len + 1);
+    for (;;) {
+        const char* word = pick_word();
+        size_t n = strlen(word);
+        if (used + n + 1 > len) break;
+        memcpy(note->body + used, word, n);
+        if (rand() % 8 == 0) note->body[used] -= 'a' - 'A';
+        used += n;
+        note->body[used++] = rand() % 12 ? ' ' : '\n';
+    }
+    note->body[used] = '\0';
+    tokenize(note);
+}
+
+static void add_note(void) {
+    if (s_noteTotal == s_noteSpace) {
+        s_noteSpace = s_noteSpace ? s_noteSpace * 2 : 1024;
+        s_notes = realloc(s_notes, s_noteSpace * sizeof(BenchNote));
+    }
+    BenchNote* note = &s_notes[s_noteTotal++];
+    memset(note, 0, sizeof(*note));
+    snprintf(note->title, sizeof(note->title), "%s %s %d", pick_word(), pick_word(), s_created++);
+    make_body(note);
+}
+
+static void delete_note(int id) {
+    free(s_notes[id].body);
+    free(s_notes[id].terms);
+    memmove(&s_notes[id], &s_notes[id + 1], (s_noteTotal - id - 1) * sizeof(BenchNote));
+    s_noteTotal--;
+}
+
+static void make_library(int count) {
+    for (int i = 0; i < count; i++) add_note();
+}
+
+static void make_query(char* query, size_t size) {
+    int words = 1 + rand() % 3;
+    size_t used = 0;
+    query[0] = '\0';
+    for (int w = 0; w < words && used + 12 < size; w++) {
+        const char* word = pick_word();
+        size_t n = strlen(word);
+        if (n > 2 && rand() % 3 == 0) n = 2 + rand() % (n - 2);
+        if (w > 0) query[used++] = ' ';
+        memcpy(query + used, word, n);
+        used += n;
+        query[used] = '\0';
+    }
+}
+
+// The k best of the scored candidates, best first, in the order rank_top()
+// uses. Clears their scores.
+static int take_top(u32 candCount, u16* ids, float* scores, int k) {
+    u16 heap[RANK_TOP_K];
+    int count = select_top(heap, k, candCount);
+    for (int j = count / 2 - 1; j >= 0; j--) sift_down(heap, count, j);
+    for (int n = count; n > 0; n--) {
+        ids[n - 1] = heap[0];
+        scores[n - 1] = s_acc[heap[0]];
+        heap[0] = heap[n - 1];
+        sift_down(heap, n - 1, 0);
+    }
+    for (u32 i = 0; i < candCount; i++) s_acc[s_cand[i]] = 0.0f;
+    return count;
+}
+
+// The reference: every posting of every list is scored
+static int exhaustive_top(const char* query, const u16* filter, int filterCount, u16* ids, float* scores, int k) {
+    if (s_live == 0 || k <= 0) return 0;
+    if (k > RANK_TOP_K) k = RANK_TOP_K;
+
+    QueryList lists[RANK_MAX_LISTS];
+    int listCount = build_lists(query, lists);
+    if (filter) {
+        memset(s_allowed, 0, s_noteCount);
+        for (int i = 0; i < filterCount; i++) s_allowed[filter[i]] = 1;
+    }
+
+    u32 candCount = 0;
+    for (int i = 0; i < listCount; i++) {
+        for (int l = 0; l < s_levelCount; l++) {
+            if (lists[i].term[l] < 0) continue;
+            const SegmentPosting* post;
+            u32 postCount = segment_postings(s_levels[l].seg, lists[i].term[l], &post);
+            for (u32 p = 0; p < postCount; p++) {
+                u16 doc = s_levels[l].note[post[p].doc];
+                if (doc == RANK_NO_NOTE || (filter && !s_allowed[doc])) continue;
+                if (s_acc[doc] == 0.0f) s_cand[candCount++] = doc;
+                s_acc[doc] += bm25(&lists[i], &post[p], doc);
+            }
+        }
+    }
+    return take_top(candCount, ids, scores, k);
+}
+
+// The reference for an index that is up to date: the index's word lists
+// and IDFs, which count hidden copies until they are merged away, but
+// frequencies and lengths counted from the notes themselves
+static int reference_top(const char* query, u16* ids, float* scores, int k) {
+    QueryList lists[RANK_MAX_LISTS];
+    int listCount = build_lists(query, lists);
+    u64 total = 0;
+    for (int id = 0; id < s_noteTotal; id++) total += s_notes[id].length;
+    float average = total ? (float)total / s_noteTotal : 1.0f;
+
+    u32 candCount = 0;
+    for (int i = 0; i < listCount; i++) {
+        for (int id = 0; id < s_noteTotal; id++) {
+            const BenchNote* note = &s_notes[id];
+            const BenchTerm* term = bsearch(lists[i].text, note->terms, note->termCount, sizeof(BenchTerm), compare_text);
+            if (!term) continue;
+            u16 tf = term->tf;
+            float norm = RANK_K1 * (1.0f - RANK_B + RANK_B * note->length / average);
+            if (s_acc[id] == 0.0f) s_cand[candCount++] = id;
+            s_acc[id] += lists[i].idf * tf * (RANK_K1 + 1) / (tf + norm);
+        }
+    }
+    return take_top(candCount, ids, scores, k);
+}
+
+// Every note is indexed under its current text, and `queries` random
+// queries rank as the reference does
+static bool check_index(int queries) {
+    if (s_noteCount != s_noteTotal || s_live != s_noteTotal) {
+        printf("index holds %d of %d notes\n", s_live, s_noteTotal);
+        return false;
+    }
+    for (int id = 0; id < s_noteTotal; id++) {
+        SearchDoc doc;
+        bench_doc(id, &doc, NULL);
+        const SegmentDoc* indexed = &s_levels[s_owner[id]].seg->docs[s_local[id]];
+        if (indexed->hash != segment_hash(&doc) || indexed->length != s_notes[id].length) {
+            printf("note \"%s\" is indexed under an old text\n", doc.title);
+            return false;
+        }
+    }
+
+    for (int q = 0; q < queries; q++) {
+        char query[64];
+        u16 ids[RANK_TOP_K], expectIds[RANK_TOP_K];
+        float scores[RANK_TOP_K], expectScores[RANK_TOP_K];
+        make_query(query, sizeof(query));
+        int count = rank_top(query, NULL, 0, ids, scores, RANK_TOP_K);
+        bool same = count == reference_top(query, expectIds, expectScores, RANK_TOP_K);
+        for (int i = 0; same && i < count; i++) {
+            same = ids[i] == expectIds[i] && scores[i] == expectScores[i];
+        }
+        if (!same) {
+            printf("query \"%s\" DIFFERS from the notes' own words\n", query);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void report(const char* label, double* times, int count) {
+    double total = 0.0;
+    for (int i = 0; i < count; i++) total += times[i];
+    qsort(times, count, sizeof(double), compare_double);
+    printf("%-11s mean %6.3f ms  p99 %6.3f ms  best %6.3f ms  worst %6.3f ms\n", label, total / count,
+           times[count * 99 / 100], times[0], times[count - 1]);
+}
+
+// Rank BENCH_QUERIES random queries both ways. Returns how many differ.
+static int bench_queries(void) {
+    u16* filter = malloc(s_noteCount * sizeof(u16));
+    double* fast = malloc(BENCH_QUERIES * sizeof(double));
+    double* full = malloc(BENCH_QUERIES * sizeof(double));
+    int filterCount = 0, differ = 0;
+    for (int id = 0; id < s_noteCount; id += 2) filter[filterCount++] = id;
+
+    for (int q = 0; q < BENCH_QUERIES; q++) {
+        char query[64];
+        u16 ids[RANK_TOP_K], expectIds[RANK_TOP_K];
+        float scores[RANK_TOP_K], expectScores[RANK_TOP_K];
+        const u16* only = q % 4 == 3 ? filter : NULL;
+        make_query(query, sizeof(query));
+
+        // Alternate which goes first, so neither always finds the lists cached
+        int count = 0, expected = 0;
+        for (int pass = 0; pass < 2; pass++) {
+            double t0 = now_ms();
+            if ((pass + q) % 2 == 0) {
+                count = rank_top(query, only, filterCount, ids, scores, RANK_TOP_K);
+                fast[q] = now_ms() - t0;
+            } else {
+                expected = exhaustive_top(query, only, filterCount, expectIds, expectScores, RANK_TOP_K);
+                full[q] = now_ms() - t0;
+            }
+        }
+
+        bool same = count == expected;
+        for (int i = 0; same && i < count; i++) {
+            same = ids[i] == expectIds[i] && scores[i] == expectScores[i];
+        }
+        if (!same && differ++ < 5) printf("query \"%s\" DIFFERS from exhaustive scoring\n", query);
+    }
+    report("top-k", fast, BENCH_QUERIES);
+    report("exhaustive", full, BENCH_QUERIES);
+
+    free(filter);
+    free(fast);
+    free(full);
+    return differ;
+}
+
+// Edit and add notes at random. The worker's jobs run only every
+// BENCH_BATCH edits, as they would behind a busy worker, so updates land
+// while writes and merges are still queued.
+static bool bench_edits(double buildMs) {
+    double* times = malloc(BENCH_EDITS * sizeof(double));
+    double jobsMs = 0.0;
+    bool same = true;
+    for (int e = 0; e < BENCH_EDITS && same; e++) {
+        int id = s_noteTotal;
+        if (rand() % 5 == 0) add_note();
+        else make_body(&s_notes[id = rand() % s_noteTotal]);
+
+        double t0 = now_ms();
+        rank_update(id);
+        rank_poll();
+        times[e] = now_ms() - t0;
+        if (e % BENCH_BATCH == BENCH_BATCH - 1) {
+            t0 = now_ms();
+            run_jobs();
+            jobsMs += now_ms() - t0;
+        }
+        if (e % 100 == 99) same = check_index(BENCH_CHECKS);
+    }
+    if (same) {
+        report("update", times, BENCH_EDITS);
+        printf("worker      %.3f ms per edit writing and merging segments\n", jobsMs / BENCH_EDITS);
+        printf("rebuild     %.1f ms, what every edit cost with a single index\n", buildMs);
+    }
+    free(times);
+    return same;
+}
+
+// Stop as the app does: queued jobs are dropped and rank_exit() writes out
+// what they would have
+static void stop_index(void) {
+    s_jobCount = 0;
+    rank_exit();
+}
+
+// Cut the newest segment file in half, as a crash while writing it would
+static void tear_newest(void) {
+    StorageEntry entry, newest;
+    u32 newestLo = 0, lo, hi;
+    bool found = false;
+    StorageDir* list = storage_dir_open();
+    while (list && storage_dir_next(list, &entry)) {
+        if (!rank_is_file(entry.name) || !segment_parse_name(entry.name, &lo, &hi)) continue;
+        if (!found || lo > newestLo) {
+            newest = entry;
+            newestLo = lo;
+            found = true;
+        }
+    }
+    if (list) storage_dir_close(list);
+    if (!found) return;
+
+    char* data = malloc(newest.size + 1);
+    s32 got = storage_read(newest.name, data, newest.size);
+    if (got > 0) storage_write(newest.name, data, got / 2);
+    free(data);
+}
+
+// Start as the app does and report how long loading the index took and how
+// many notes had to be tokenized again
+static bool restart(const char* label) {
+    double t0 = now_ms();
+    bool ok = rank_sync(s_noteTotal, bench_doc, NULL);
+    double ms = now_ms() - t0;
+    u32 tokenized = 0;
+    for (int l = 0; l < s_levelCount; l++) {
+        if (!s_levels[l].seg->written) tokenized += s_levels[l].seg->header->docCount;
+    }
+    run_jobs();
+    printf("%-11s %.1f ms, %lu notes tokenized again\n", label, ms, (unsigned long)tokenized);
+    return ok && check_index(BENCH_CHECKS);
+}
+
+// Remove the segment files, then the directory
+static void remove_index(const char* dir) {
+    StorageEntry entry;
+    StorageDir* list = storage_dir_open();
+    while (list && storage_dir_next(list, &entry)) {
+        if (rank_is_file(entry.name)) storage_remove(entry.name);
+    }
+    if (list) storage_dir_close(list);
+    rmdir(dir);
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    if (count < 100 || count > SEARCH_MAX_DOCS) count = 10000;
+
+    char dir[] = "/tmp/benchrank-XXXXXX";
+    char root[64];
+    if (!mkdtemp(dir)) return 1;
+    snprintf(root, sizeof(root), "%s/", dir);
+    storage_init(root);
+
+    srand(1);
+    make_vocab();
+    make_library(count);
+
+    double t0 = now_ms();
+    bool ok = rank_sync(count, bench_doc, NULL);
+    run_jobs();
+    double buildMs = now_ms() - t0;
+    printf("%d notes, %d-word vocabulary, indexed in %.1f ms\n", count, BENCH_VOCAB, buildMs);
+    if (!ok) {
+        printf("out of memory building the index\n");
+        return 1;
+    }
+
+    int differ = bench_queries();
+    printf("%d queries, top %d %s exhaustive scoring\n", BENCH_QUERIES, RANK_TOP_K,
+           differ ? "DIFFER from" : "identical to");
+
+    bool same = bench_edits(buildMs);
+    if (same) {
+        stop_index();
+        same = restart("restart");
+    }
+    if (same) {
+        stop_index();
+        for (int i = 0; i < BENCH_DELETED; i++) delete_note(rand() % s_noteTotal);
+        for (int i = 0; i < BENCH_OUTSIDE; i++) make_body(&s_notes[rand() % s_noteTotal]);
+        tear_newest();
+        same = restart("after crash");
+    }
+    printf("%d edits, two restarts, index %s the notes' text\n", BENCH_EDITS, same ? "matches" : "DIFFERS from");
+
+    rank_exit();
+    remove_index(dir);
+    for (int i = 0; i < s_noteTotal; i++) {
+        free(s_notes[i].body);
+        free(s_notes[i].terms);
+    }
+    free(s_notes);
+    return differ || !same ? 1 : 0;
+}
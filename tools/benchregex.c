@@ -0,0 +1,399 @@
+//---------------------------------------------------------------------------------
+// benchregex.c
+// Host tool: measures regex search. First the DFA's scan rate in MB/s, over
+// a synthetic library and over texts built to make backtracking matchers
+// blow up. Then regex queries through search.c, as the app runs them, with
+// the trigram prefilter and without it; the results must be identical.
+// Then notes are edited, added and removed one at a time, keeping the
+// trigram index up to date as main.c does, and its candidates are checked
+// against the notes' text. Last, random patterns over a small alphabet are
+// checked against the C library's POSIX regexec().
+//
+//   cc -O2 -Itools/host -o benchregex tools/benchregex.c source/search.c
+//      source/regexp.c source/trigram.c source/utf8.c && ./benchregex 10000
+//
+// The notes are 200 to 1000 bytes of words with English letter frequencies,
+// with the odd ticket number and e-mail address mixed in.
+//---------------------------------------------------------------------------------
+
+#include "../source/regexp.h"
+#include "../source/search.h"
+#include "../source/trigram.h"
+
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_VOCAB  5000
+#define BENCH_PATHOLOGICAL (4 << 20)   // Bytes of text for the pathological patterns
+#define BENCH_RANDOM 60000             // Random pattern and text pairs
+#define BENCH_QUERY_COUNT 5
+#define BENCH_EDITS  3000              // Notes changed, added or removed
+#define BENCH_ADDED  100               // Room for notes added while editing
+
+typedef struct {
+    char title[48];
+    char* body;
+    bool removed;
+} BenchNote;
+
+static char s_vocab[BENCH_VOCAB][12];
+static BenchNote* s_notes;
+static int s_noteCount;
+static int s_noteCap;
+
+static double now_ms(void) {
+    return svcGetSystemTick() / (double)CPU_TICKS_PER_MSEC;
+}
+
+static void bench_doc(int id, SearchDoc* out, void* arg) {
+    (void)arg;
+    out->title = s_notes[id].removed ? "" : s_notes[id].title;
+    out->body = s_notes[id].removed ? "" : s_notes[id].body;
+}
+
+// Squaring a uniform pick favours the start of the vocabulary
+static const char* pick_word(void) {
+    double r = rand() / (RAND_MAX + 1.0);
+    return s_vocab[(int)(r * r * BENCH_VOCAB)];
+}
+
+static void make_note(int id) {
+    BenchNote* note = &s_notes[id];
+    snprintf(note->title, sizeof(note->title), "%s %s %d", pick_word(), pick_word(), id);
+    note->removed = false;
+
+    size_t len = 200 + rand() % 801, used = 0;
+    note->body = malloc(len + 1);
+    for (;;) {
+        char word[32];
+        int kind = rand() % 400;
+        if (kind == 0) snprintf(word, sizeof(word), "TICKET-%04d", rand() % 10000);
+        else if (kind == 1) snprintf(word, sizeof(word), "%s@example.com", pick_word());
+        else snprintf(word, sizeof(word), "%s", pick_word());
+        if (rand() % 8 == 0) word[0] -= 'a' - 'A';
+
+        size_t n = strlen(word);
+        if (used + n + 1 > len) break;
+        memcpy(note->body + used, word, n);
+        used += n;
+        note->body[used++] = rand() % 12 ? ' ' : '\n';
+    }
+    note->body[used] = '\0';
+}
+
+static void make_library(int count) {
+    static const char letters[] = "eeeeeeeeeeeettttttttaaaaaaaaoooooooiiiiiiinnnnnnnsssssshhhhhhrrrrrr"
+                                  "ddddllllcccuuummwwffggyyppbbvkjxqz";
+    for (int i = 0; i < BENCH_VOCAB; i++) {
+        int len = 2 + rand() % 8;
+        for (int j = 0; j < len; j++) s_vocab[i][j] = letters[rand() % (sizeof(letters) - 1)];
+        s_vocab[i][len] = '\0';
+    }
+
+    s_noteCap = count + BENCH_ADDED;
+    s_notes = malloc(s_noteCap * sizeof(BenchNote));
+    s_noteCount = count;
+    for (int i = 0; i < count; i++) make_note(i);
+}
+
+//---------------------------------------------------------------------------------
+// Scan rate
+//---------------------------------------------------------------------------------
+
+// Every match in `text`, one after the other, as a search for all of them would
+static void scan(const char* label, const char* pattern, const char* text, size_t len) {
+    const char* error = NULL;
+    Regex* re = regex_compile(pattern, &error);
+    if (!re) {
+        printf("scan    %-28s %s\n", pattern, error);
+        return;
+    }
+    u32 matches = 0;
+    size_t pos = 0, end;
+    double start = now_ms();
+    while (pos < len && regex_search(re, text + pos, len - pos, NULL, &end)) {
+        matches++;
+        pos += end > 0 ? end : 1;
+    }
+    double ms = now_ms() - start;
+    printf("scan    %-28s %-12s %7.1f MB/s  %lu matches\n", pattern, label, len / 1048576.0 / (ms / 1000.0),
+           (unsigned long)matches);
+    regex_free(re);
+}
+
+static void bench_scan(void) {
+    size_t len = 0;
+    for (int i = 0; i < s_noteCount; i++) len += strlen(s_notes[i].body) + 1;
+    char* library = malloc(len + 1);
+    size_t used = 0;
+    for (int i = 0; i < s_noteCount; i++) {
+        size_t n = strlen(s_notes[i].body);
+        memcpy(library + used, s_notes[i].body, n);
+        used += n;
+        library[used++] = '\n';
+    }
+
+    static const char* const patterns[] = {
+        "zqxzqx",                    // Never matches
+        "TICKET-\\d+",
+        "\\w+@\\w+\\.com",
+        "[A-Z][a-z]+ing",
+        "(th|sh|ch)[aeiou]+[^aeiou ]",
+        "[a-q][^u-z]{13}x",          // Needs more DFA states than are cached
+    };
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) scan("library", patterns[i], library, len);
+    free(library);
+
+    char* same = malloc(BENCH_PATHOLOGICAL);
+    memset(same, 'a', BENCH_PATHOLOGICAL);
+    scan("4 MB of 'a'", "(a|aa)*c", same, BENCH_PATHOLOGICAL);
+    scan("4 MB of 'a'", "(a*)*b", same, BENCH_PATHOLOGICAL);
+    memset(same, 'x', BENCH_PATHOLOGICAL);
+    scan("4 MB of 'x'", "(x+x+)+y", same, BENCH_PATHOLOGICAL);
+    free(same);
+}
+
+//---------------------------------------------------------------------------------
+// Search with and without the prefilter
+//---------------------------------------------------------------------------------
+static double run_query(const char* query, u16* ids, int* count) {
+    const u16* results;
+    double start = now_ms();
+    search_set_query(query);
+    while (!search_step(1000000)) {}
+    double ms = now_ms() - start;
+    *count = search_results(&results);
+    memcpy(ids, results, *count * sizeof(u16));
+    search_set_query("");
+    return ms;
+}
+
+static bool bench_search(void) {
+    static const char* const queries[BENCH_QUERY_COUNT] = {
+        "/TICKET-4\\d\\d\\d",
+        "/\\w+@example\\.com",
+        "/[Tt]he[a-z]*ing",
+        "/zqx[a-z]",
+        "/e[a-z]+e",                 // No literal: every note is scanned
+    };
+    u16* ids[2][BENCH_QUERY_COUNT];
+    int counts[2][BENCH_QUERY_COUNT];
+    double ms[2][BENCH_QUERY_COUNT];
+    bool same = true;
+
+    double start = now_ms();
+    trigram_build(s_noteCount, bench_doc, NULL);
+    printf("trigram index built in %.1f ms\n", now_ms() - start);
+    search_reset(s_noteCount, bench_doc, NULL);
+
+    // With the index, then with none, so every note is a candidate
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) trigram_exit();
+        for (int i = 0; i < BENCH_QUERY_COUNT; i++) {
+            ids[pass][i] = malloc(s_noteCount * sizeof(u16));
+            ms[pass][i] = run_query(queries[i], ids[pass][i], &counts[pass][i]);
+        }
+    }
+
+    for (int i = 0; i < BENCH_QUERY_COUNT; i++) {
+        bool match = counts[0][i] == counts[1][i] &&
+                     memcmp(ids[0][i], ids[1][i], counts[0][i] * sizeof(u16)) == 0;
+        same = same && match;
+        printf("search  %-28s %5d notes  %7.2f ms prefiltered  %7.2f ms full scan  %s\n", queries[i] + 1,
+               counts[0][i], ms[0][i], ms[1][i], match ? "identical" : "DIFFERS");
+        free(ids[0][i]);
+        free(ids[1][i]);
+    }
+    return same;
+}
+
+//---------------------------------------------------------------------------------
+// Keeping the trigram index up to date
+//---------------------------------------------------------------------------------
+
+// Whether the three bytes at `tri` occur in `text`, ignoring ASCII case
+static bool has_trigram(const char* text, const char* tri) {
+    for (const char* t = text; t[0] && t[1] && t[2]; t++) {
+        int i = 0;
+        while (i < 3 && (t[i] | 0x20) == (tri[i] | 0x20)) i++;
+        if (i == 3) return true;
+    }
+    return false;
+}
+
+// The reference for trigram_candidates(): documents with every trigram of
+// `literal` in their title or body
+static int reference_candidates(const char* literal, u16* ids) {
+    int count = 0;
+    size_t len = strlen(literal);
+    for (int id = 0; id < s_noteCount; id++) {
+        if (s_notes[id].removed) continue;
+        bool all = true;
+        for (size_t i = 0; i + 3 <= len && all; i++) {
+            all = has_trigram(s_notes[id].title, literal + i) || has_trigram(s_notes[id].body, literal + i);
+        }
+        if (all) ids[count++] = id;
+    }
+    return count;
+}
+
+static bool bench_update(void) {
+    u16* ids = malloc(s_noteCap * sizeof(u16));
+    u16* expected = malloc(s_noteCap * sizeof(u16));
+    bool* pending = calloc(s_noteCap, sizeof(bool));
+    int pendingCount = 0, merges = 0, checks = 0, wrong = 0;
+    double updateMs = 0.0, mergeMs = 0.0;
+
+    double start = now_ms();
+    trigram_build(s_noteCount, bench_doc, NULL);
+    double buildMs = now_ms() - start;
+
+    for (int e = 0; e < BENCH_EDITS; e++) {
+        int id = rand() % s_noteCount;
+        int kind = rand() % 50;
+        if (kind == 0 && s_noteCount < s_noteCap) {
+            id = s_noteCount++;
+            make_note(id);
+        } else if (kind == 1 && !s_notes[id].removed) {
+            s_notes[id].removed = true;
+        } else if (!s_notes[id].removed) {
+            free(s_notes[id].body);
+            make_note(id);
+        }
+
+        start = now_ms();
+        bool ok = s_notes[id].removed ? trigram_remove(id) : trigram_update(id);
+        updateMs += now_ms() - start;
+        if (!ok) {
+            printf("update  note %d: out of memory\n", id);
+            wrong++;
+            break;
+        }
+        if (!pending[id]) {
+            pending[id] = true;
+            pendingCount++;
+        }
+
+        // The first query after this many changes merges them in
+        if (pendingCount > 64) {
+            start = now_ms();
+            trigram_candidates("zzz", ids);
+            mergeMs += now_ms() - start;
+            merges++;
+            memset(pending, 0, s_noteCap * sizeof(bool));
+            pendingCount = 0;
+        }
+
+        // Literals taken from the notes, so most have candidates
+        if (e % 100 == 50) {
+            for (int q = 0; q < 4; q++) {
+                const BenchNote* note = &s_notes[rand() % s_noteCount];
+                size_t len = strlen(note->body);
+                if (note->removed || len < 8) continue;
+                char literal[8];
+                size_t at = rand() % (len - 6), n = 3 + rand() % 3;
+                memcpy(literal, note->body + at, n);
+                literal[n] = '\0';
+
+                int count = trigram_candidates(literal, ids);
+                int want = reference_candidates(literal, expected);
+                checks++;
+                if (count != want || memcmp(ids, expected, count * sizeof(u16)) != 0) {
+                    if (wrong++ < 5) printf("update  \"%s\": %d candidates, %d expected\n", literal, count, want);
+                }
+            }
+        }
+    }
+    printf("update  %.1f us per note changed, %.2f ms per merge of 65 changed notes, %.1f ms to build\n",
+           updateMs * 1000.0 / BENCH_EDITS, merges ? mergeMs / merges : 0.0, buildMs);
+    printf("update  %d edits, %d merges, %d literals checked, %d wrong\n", BENCH_EDITS, merges, checks, wrong);
+    free(ids);
+    free(expected);
+    free(pending);
+    return wrong == 0;
+}
+
+//---------------------------------------------------------------------------------
+// Against POSIX
+//---------------------------------------------------------------------------------
+
+// A random pattern in the syntax both engines share, over the letters a-c
+static void random_pattern(char* out, size_t cap, int depth) {
+    static const char* const atoms[] = { "a", "b", "c", ".", "[ab]", "[^a]", "[a-b]" };
+    size_t used = strlen(out);
+    int kind = depth > 3 ? 0 : rand() % 6;
+    if (kind <= 1 || used + 16 > cap) {
+        snprintf(out + used, cap - used, "%s", atoms[rand() % (sizeof(atoms) / sizeof(atoms[0]))]);
+    } else if (kind == 2) {
+        random_pattern(out, cap, depth + 1);
+        random_pattern(out, cap, depth + 1);
+    } else if (kind == 3) {
+        strcat(out, "(");
+        random_pattern(out, cap, depth + 1);
+        strcat(out, "|");
+        random_pattern(out, cap, depth + 1);
+        strcat(out, ")");
+    } else {
+        static const char* const repeats[] = { "*", "+", "?", "{2}", "{1,3}", "{2,}" };
+        strcat(out, "(");
+        random_pattern(out, cap, depth + 1);
+        strcat(out, ")");
+        strcat(out, repeats[rand() % (sizeof(repeats) / sizeof(repeats[0]))]);
+    }
+}
+
+static bool bench_posix(void) {
+    int disagree = 0;
+    for (int i = 0; i < BENCH_RANDOM; i++) {
+        char pattern[256] = "";
+        char text[32];
+        random_pattern(pattern, sizeof(pattern), 0);
+        int len = rand() % 24;
+        for (int j = 0; j < len; j++) text[j] = "abc"[rand() % 3];
+        text[len] = '\0';
+
+        const char* error = NULL;
+        regex_t posix;
+        Regex* re = regex_compile(pattern, &error);
+        if (!re) continue;
+        if (regcomp(&posix, pattern, REG_EXTENDED | REG_NOSUB) != 0) {
+            regex_free(re);
+            continue;
+        }
+        bool ours = regex_search(re, text, len, NULL, NULL);
+        bool theirs = regexec(&posix, text, 0, NULL, 0) == 0;
+        if (ours != theirs && disagree++ < 5) {
+            printf("posix   /%s/ on \"%s\": %s here, %s in regexec()\n", pattern, text, ours ? "match" : "no match",
+                   theirs ? "match" : "no match");
+        }
+        regfree(&posix);
+        regex_free(re);
+    }
+    printf("posix   %d random patterns, %d disagreements with regexec()\n", BENCH_RANDOM, disagree);
+    return disagree == 0;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    if (count < 1 || count > SEARCH_MAX_DOCS) count = 10000;
+
+    srand(1);
+    make_library(count);
+    size_t bytes = 0;
+    for (int i = 0; i < count; i++) bytes += strlen(s_notes[i].body);
+    printf("%d notes, %.1f MB\n", count, bytes / 1048576.0);
+
+    search_init();
+    bench_scan();
+    bool ok = bench_search();
+    ok = bench_update() && ok;
+    ok = bench_posix() && ok;
+
+    search_exit();
+    trigram_exit();
+    for (int i = 0; i < s_noteCount; i++) free(s_notes[i].body);
+    free(s_notes);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+//---------------------------------------------------------------------------------
+// benchsearch.c
+// Host tool: times search-as-you-type on a synthetic library. Queries are
+// typed a character at a time, with some backspacing, and each keystroke
+// is timed from search_set_query() until search_step() reports the results
+// complete. The same keystrokes are then timed with the cache dropped
+// before each one, which is what a search without levels would cost. Every
+// result set is checked against a plain case-insensitive scan.
+//
+// As in main.c, terms of three bytes or more are checked against the notes'
+// Bloom filters before their bodies are scanned; the filters come from a
+// segment built over the library.
+//
+//   cc -O2 -Itools/host -o benchsearch tools/benchsearch.c source/search.c
+//      source/regexp.c source/trigram.c source/segment.c source/storage_host.c
+//      source/crc.c source/utf8.c && ./benchsearch 10000
+//
+// The notes are 200 to 1000 bytes of random text over a Zipf-like
+// vocabulary of words with English letter frequencies, some capitalised.
+//---------------------------------------------------------------------------------
+
+#include "../source/search.h"
+#include "../source/segment.h"
+#include "../source/worker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_VOCAB   5000
+#define BENCH_QUERIES 200
+#define BENCH_BUDGET  4000       // Microseconds per frame, as in main.c
+
+typedef struct {
+    char title[48];
+    char* body;
+    char* folded;    // Title and body in lower case, for the reference
+} BenchNote;
+
+static char s_vocab[BENCH_VOCAB][12];
+static BenchNote* s_notes;
+static int s_noteCount;
+static Segment* s_segment;
+static u32* s_segmentDocs;  // Each note's document in the segment, which sorts by title
+
+// segment_build() shards across these; here the shards run in turn
+int worker_threads(void) {
+    return 1;
+}
+
+void worker_parallel(WorkerFunc fn, void* const* args, int count) {
+    for (int i = 0; i < count; i++) fn(args[i]);
+}
+
+static double now_ms(void) {
+    return svcGetSystemTick() / (double)CPU_TICKS_PER_MSEC;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_doc(int id, SearchDoc* out, void* arg) {
+    (void)arg;
+    out->title = s_notes[id].title;
+    out->body = s_notes[id].body;
+}
+
+static bool bench_may_contain(int id, const char* term, size_t len, void* arg) {
+    (void)arg;
+    return segment_may_contain(s_segment, s_segmentDocs[id], term, len);
+}
+
+// Squaring a uniform pick favours the start of the vocabulary
+static const char* pick_word(void) {
+    double r = rand() / (RAND_MAX + 1.0);
+    return s_vocab[(int)(r * r * BENCH_VOCAB)];
+}
+
+static void make_library(int count) {
+    static const char letters[] = "eeeeeeeeeeeettttttttaaaaaaaaoooooooiiiiiiinnnnnnnsssssshhhhhhrrrrrr"
+                                  "ddddllllcccuuummwwffggyyppbbvkjxqz";
+    for (int i = 0; i < BENCH_VOCAB; i++) {
+        int len = 2 + rand() % 8;
+        for (int j = 0; j < len; j++) s_vocab[i][j] = letters[rand() % (sizeof(letters) - 1)];
+        s_vocab[i][len] = '\0';
+    }
+
+    s_notes = malloc(count * sizeof(BenchNote));
+    s_noteCount = count;
+    for (int i = 0; i < count; i++) {
+        BenchNote* note = &s_notes[i];
+        snprintf(note->title, sizeof(note->title), "%s %s %d", pick_word(), pick_word(), i);
+
+        size_t len = 200 + rand() % 801, used = 0;
+        note->body = malloc(len + 1);
+        for (;;) {
+            const char* word = pick_word();
+            size_t n = strlen(word);
+            if (used + n + 1 > len) break;
+            memcpy(note->body + used, word, n);
+            if (rand() % 8 == 0) note->body[used] -= 'a' - 'A';
+            used += n;
+            note->body[used++] = rand() % 12 ? ' ' : '\n';
+        }
+        note->body[used] = '\0';
+
+        note->folded = malloc(sizeof(note->title) + used + 2);
+        snprintf(note->folded, sizeof(note->title) + used + 2, "%s\n%s", note->title, note->body);
+        for (char* p = note->folded; *p; p++) {
+            if (*p >= 'A' && *p <= 'Z') *p += 'a' - 'A';
+        }
+    }
+}
+
+// The reference: every term is in the folded text. A query with no terms
+// matches nothing, as in search.c.
+static bool naive_matches(int id, const char* query) {
+    char terms[SEARCH_MAX_QUERY];
+    int found = 0;
+    strcpy(terms, query);
+    for (char* term = strtok(terms, " "); term; term = strtok(NULL, " ")) {
+        if (!strstr(s_notes[id].folded, term)) return false;
+        found++;
+    }
+    return found > 0;
+}
+
+static bool check_results(const char* query) {
+    const u16* ids;
+    int count = search_results(&ids);
+    int expected = 0;
+    for (int id = 0; id < s_noteCount; id++) {
+        if (!naive_matches(id, query)) continue;
+        if (expected >= count || ids[expected] != id) return false;
+        expected++;
+    }
+    return expected == count;
+}
+
+// One keystroke: the query changes, then frames run until it is complete
+static double keystroke(const char* query, int* frames) {
+    double start = now_ms();
+    search_set_query(query);
+    *frames = 1;
+    while (!search_step(BENCH_BUDGET)) (*frames)++;
+    return now_ms() - start;
+}
+
+// The queries as typed: one to three words, each word sometimes mistyped
+// and corrected, so the keystrokes include backspaces
+static int make_keystrokes(char (*out)[SEARCH_MAX_QUERY], int max) {
+    int count = 0;
+    for (int q = 0; q < BENCH_QUERIES; q++) {
+        char query[SEARCH_MAX_QUERY] = "";
+        int words = 1 + rand() % 3;
+        for (int w = 0; w < words; w++) {
+            const char* word = pick_word();
+            size_t at = strlen(query);
+            if (w > 0) query[at++] = ' ';
+            for (size_t i = 0; word[i] && count + 2 < max; i++) {
+                if (i > 0 && rand() % 10 == 0) {
+                    query[at] = 'a' + rand() % 26;
+                    query[at + 1] = '\0';
+                    strcpy(out[count++], query);
+                }
+                query[at++] = word[i];
+                query[at] = '\0';
+                strcpy(out[count++], query);
+            }
+        }
+        // Clear the field for the next query
+        strcpy(out[count++], "");
+        if (count + SEARCH_MAX_QUERY >= max) break;
+    }
+    return count;
+}
+
+static void report(const char* label, double* times, int count, int frames, int maxFrames) {
+    double total = 0.0;
+    for (int i = 0; i < count; i++) total += times[i];
+    qsort(times, count, sizeof(double), compare_double);
+    printf("%-12s mean %6.3f ms  p99 %6.3f ms  worst %6.3f ms  %.2f frames, at most %d\n", label,
+           total / count, times[count * 99 / 100], times[count - 1], (double)frames / count, maxFrames);
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    if (count < 1 || count > SEARCH_MAX_DOCS) count = 10000;
+
+    srand(1);
+    make_library(count);
+    size_t bytes = 0;
+    for (int i = 0; i < count; i++) bytes += strlen(s_notes[i].body);
+    printf("%d notes, %.1f MB\n", count, bytes / 1048576.0);
+
+    SearchDoc* docs = malloc(count * sizeof(SearchDoc));
+    s_segmentDocs = malloc(count * sizeof(u32));
+    for (int i = 0; i < count; i++) bench_doc(i, &docs[i], NULL);
+    s_segment = segment_build(docs, count, NULL, 0, 1);
+    if (!s_segment) {
+        printf("out of memory building the filters\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) s_segmentDocs[i] = segment_find_doc(s_segment, s_notes[i].title);
+    free(docs);
+
+    int cap = BENCH_QUERIES * 48;
+    char (*keys)[SEARCH_MAX_QUERY] = malloc(cap * sizeof(*keys));
+    int keyCount = make_keystrokes(keys, cap);
+    double* times = malloc(keyCount * sizeof(double));
+
+    search_init();
+    search_set_filter(bench_may_contain, NULL);
+    SearchFilterStats filter = { 0, 0, 0 };
+    bool same = true;
+    for (int pass = 0; pass < 2; pass++) {
+        int frames = 0, maxFrames = 0;
+        search_reset(count, bench_doc, NULL);
+        for (int k = 0; k < keyCount; k++) {
+            // The second pass drops every cached level first
+            if (pass == 1) search_reset(count, bench_doc, NULL);
+            int used;
+            times[k] = keystroke(keys[k], &used);
+            frames += used;
+            if (used > maxFrames) maxFrames = used;
+            if (pass == 0 && !check_results(keys[k])) {
+                printf("query \"%s\" DIFFERS from a plain scan\n", keys[k]);
+                same = false;
+            }
+        }
+        if (pass == 0) filter = *search_filter_stats();
+        report(pass == 0 ? "incremental" : "from scratch", times, keyCount, frames, maxFrames);
+    }
+    printf("%d keystrokes, results %s a plain scan\n", keyCount, same ? "identical to" : "DIFFER from");
+    printf("filter       %lu checks, %lu bodies skipped, %lu false positives while typing\n",
+           (unsigned long)filter.checks, (unsigned long)filter.rejected, (unsigned long)filter.falsePositives);
+
+    free(times);
+    free(keys);
+    search_exit();
+    segment_free(s_segment);
+    free(s_segmentDocs);
+    for (int i = 0; i < count; i++) {
+        free(s_notes[i].body);
+        free(s_notes[i].folded);
+    }
+    free(s_notes);
+    return same ? 0 : 1;
+}
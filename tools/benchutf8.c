@@ -0,0 +1,137 @@
+//---------------------------------------------------------------------------------
+// benchutf8.c
+// Host tool: measures the UTF-8 routines on Latin, Japanese and mixed text.
+//
+//   cc -O2 -Itools/host -o benchutf8 tools/benchutf8.c && ./benchutf8
+//
+// Validation is compared with decoding a code point at a time, and folding
+// with the ASCII-only folding search used before. Each corpus is about 4 MB
+// of generated text, so the numbers are throughput, not latency.
+//---------------------------------------------------------------------------------
+
+#include "../source/utf8.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_BYTES (4 * 1024 * 1024)
+#define BENCH_RUNS  5
+
+typedef struct {
+    const char* name;
+    int japanese;    // Percent of words in Japanese
+} Corpus;
+
+static const char* s_latin[] = {
+    "the", "note", "Search", "index", "café", "naïve", "Über", "straße", "résumé", "Ελλάδα",
+    "Москва", "déjà", "vu", "CRÈME", "brûlée", "façade", "and", "of", "Tokyo", "3DS",
+};
+
+static const char* s_japanese[] = {
+    "今日は", "東京", "へ", "行きます", "カタカナ", "ひらがな", "漢字", "メモ", "検索", "が",
+    "ｶﾞ", "ＡＢＣ", "日本語", "です", "。", "、", "👍🏽", "🇯🇵", "か\xe3\x82\x99", "テキスト",
+};
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static size_t make_corpus(char* buf, size_t cap, int japanese) {
+    size_t len = 0;
+    while (len + 64 < cap) {
+        const char* word = rand() % 100 < japanese ? s_japanese[rand() % 20] : s_latin[rand() % 20];
+        len += sprintf(buf + len, "%s%s", word, rand() % 10 ? " " : "\n");
+    }
+    return len;
+}
+
+// Baselines: what the code did before, or the obvious loop
+static size_t validate_bytewise(const char* s, size_t len) {
+    const char* p = s;
+    const char* end = s + len;
+    while (p < end) {
+        const char* start = p;
+        if (utf8_decode(&p, end - p) == UTF8_INVALID) return start - s;
+    }
+    return len;
+}
+
+static size_t fold_ascii(const char* s, size_t len, char* out) {
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        out[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    return len;
+}
+
+static size_t count_graphemes(const char* s, size_t len) {
+    size_t count = 0;
+    for (size_t at = 0; at < len; at = utf8_next_grapheme(s, len, at)) count++;
+    return count;
+}
+
+static size_t count_graphemes_back(const char* s, size_t len) {
+    size_t count = 0;
+    for (size_t at = len; at > 0; at = utf8_prev_grapheme(s, at)) count++;
+    return count;
+}
+
+// Best of BENCH_RUNS, in MB/s
+static double rate(double best_ms, size_t len) {
+    return len / 1048576.0 / (best_ms / 1000.0);
+}
+
+#define TIME(result, expr)                                      \
+    do {                                                        \
+        double best = 0.0;                                      \
+        for (int run = 0; run < BENCH_RUNS; run++) {            \
+            double start = now_ms();                            \
+            result = (expr);                                    \
+            double ms = now_ms() - start;                       \
+            if (run == 0 || ms < best) best = ms;               \
+        }                                                       \
+        mbs = rate(best, len);                                  \
+    } while (0)
+
+int main(void) {
+    static const Corpus corpora[] = { { "latin", 0 }, { "mixed", 50 }, { "japanese", 100 } };
+    char* text = malloc(BENCH_BYTES);
+    char* out = malloc(BENCH_BYTES);
+    if (!text || !out) return 1;
+
+    printf("%-9s %12s %12s %12s %12s %12s %12s\n", "MB/s", "validate", "bytewise", "fold", "fold ascii",
+           "graphemes", "backwards");
+    for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); c++) {
+        srand(1);
+        size_t len = make_corpus(text, BENCH_BYTES, corpora[c].japanese);
+        double mbs, valid, bytewise, fold, ascii, forward, backward;
+        size_t r1, r2, n1, n2, g1, g2;
+
+        TIME(r1, utf8_valid_prefix(text, len));
+        valid = mbs;
+        TIME(r2, validate_bytewise(text, len));
+        bytewise = mbs;
+        TIME(n1, utf8_fold(text, len, out, BENCH_BYTES));
+        fold = mbs;
+        TIME(n2, fold_ascii(text, len, out));
+        ascii = mbs;
+        TIME(g1, count_graphemes(text, len));
+        forward = mbs;
+        TIME(g2, count_graphemes_back(text, len));
+        backward = mbs;
+
+        if (r1 != len || r2 != len || n1 != len || n2 != len || g1 != g2) {
+            fprintf(stderr, "%s: results disagree\n", corpora[c].name);
+            return 1;
+        }
+        printf("%-9s %12.0f %12.0f %12.0f %12.0f %12.0f %12.0f\n", corpora[c].name, valid, bytewise, fold, ascii,
+               forward, backward);
+    }
+
+    free(text);
+    free(out);
+    return 0;
+}
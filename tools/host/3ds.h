@@ -0,0 +1,50 @@
+//---------------------------------------------------------------------------------
+// 3ds.h
+// Host stand-in for the few libctru definitions the index code, metadata
+// store and search need, so the host tools can compile them with the system
+// compiler.
+//---------------------------------------------------------------------------------
+
+#ifndef HOST_3DS_H
+#define HOST_3DS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef s32 Result;
+
+// A tick is a nanosecond here
+#define CPU_TICKS_PER_MSEC 1000000ULL
+
+static inline u64 svcGetSystemTick(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+typedef pthread_mutex_t LightLock;
+
+static inline void LightLock_Init(LightLock* lock) {
+    pthread_mutex_init(lock, NULL);
+}
+
+static inline void LightLock_Lock(LightLock* lock) {
+    pthread_mutex_lock(lock);
+}
+
+static inline void LightLock_Unlock(LightLock* lock) {
+    pthread_mutex_unlock(lock);
+}
+
+#endif // HOST_3DS_H
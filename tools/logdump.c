@@ -0,0 +1,75 @@
+//---------------------------------------------------------------------------------
+// logdump.c
+// Host tool: prints the app's binary log as text, one event per line, with
+// the time since the first record.
+//
+//   cc -O2 -Itools/host -o logdump tools/logdump.c && ./logdump .log-1 .log-0
+//
+// Event names and formats come from LOG_EVENTS in source/log.h, so the tool
+// only needs rebuilding when events are added.
+//---------------------------------------------------------------------------------
+
+#include "../source/log.h"
+
+#include <stdio.h>
+
+typedef struct {
+    const char* name;
+    LogLevel level;
+    const char* format;
+} EventInfo;
+
+static const EventInfo s_events[] = {
+#define LOG_INFO_ROW(id, level, format) { #id, level, format },
+    LOG_EVENTS(LOG_INFO_ROW)
+#undef LOG_INFO_ROW
+};
+
+static const char* s_levels[] = { "debug", "info", "warn", "error" };
+
+static int dump(const char* path) {
+    FILE* file = fopen(path, "rb");
+    LogFileHeader header;
+    LogRecord record;
+    u64 first = 0;
+    u32 count = 0;
+
+    if (!file) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != LOG_MAGIC ||
+        header.recordSize != sizeof(LogRecord) || header.ticksPerSecond == 0) {
+        fprintf(stderr, "%s: not a log file, or from a different version\n", path);
+        fclose(file);
+        return 1;
+    }
+
+    printf("== %s\n", path);
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        if (count++ == 0) first = record.tick;
+        double seconds = (double)(record.tick - first) / header.ticksPerSecond;
+        printf("%10.3f  #%-6u ", seconds, record.seq);
+        if (record.event >= LOG_EVENT_COUNT) {
+            printf("?      unknown event %u: %d %d %d %d\n", record.event, record.args[0], record.args[1],
+                   record.args[2], record.args[3]);
+            continue;
+        }
+        const EventInfo* info = &s_events[record.event];
+        printf("%-6s ", s_levels[info->level]);
+        printf(info->format, record.args[0], record.args[1], record.args[2], record.args[3]);
+        printf("\n");
+    }
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int failed = 0;
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s log-file...\n", argv[0]);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) failed |= dump(argv[i]);
+    return failed;
+}
@@ -0,0 +1,229 @@
+//---------------------------------------------------------------------------------
+// mkdawg.c
+// Host tool: builds the romfs spelling dictionary from a word list.
+//
+//   cc -O2 -o mkdawg tools/mkdawg.c && ./mkdawg dict/words.txt romfs/dict/en.dawg
+//
+// Words are read one per line and lower-cased. The trie is minimized by
+// merging nodes with identical outgoing edges, then written in the layout
+// described in source/dawg.h.
+//---------------------------------------------------------------------------------
+
+#include "../source/dawg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_WORD 64
+
+typedef struct Node {
+    int count;
+    int cap;
+    unsigned char* labels;
+    struct Node** kids;
+    int terminal;
+    int unique;      // Index of the equivalent node in the unique table
+} Node;
+
+typedef struct {
+    int count;
+    const unsigned char* labels;
+    int* term;
+    int* kids;       // Unique indices
+    unsigned offset; // First edge of this node's child run, 0 if leaf
+} Unique;
+
+static Unique* s_unique = NULL;
+static int s_uniqueCount = 0;
+static int s_uniqueCap = 0;
+static int* s_table = NULL;      // Open addressing: unique index + 1, 0 if empty
+static unsigned s_tableSize = 0;
+
+static void* xalloc(size_t size) {
+    void* p = calloc(1, size);
+    if (!p) {
+        fprintf(stderr, "mkdawg: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static Node* node_new(void) {
+    return xalloc(sizeof(Node));
+}
+
+static Node* node_child(Node* node, unsigned char label) {
+    int i = 0;
+    while (i < node->count && node->labels[i] < label) i++;
+    if (i < node->count && node->labels[i] == label) return node->kids[i];
+
+    if (node->count == node->cap) {
+        node->cap = node->cap ? node->cap * 2 : 2;
+        node->labels = realloc(node->labels, node->cap);
+        node->kids = realloc(node->kids, node->cap * sizeof(Node*));
+        if (!node->labels || !node->kids) {
+            fprintf(stderr, "mkdawg: out of memory\n");
+            exit(1);
+        }
+    }
+    memmove(node->labels + i + 1, node->labels + i, node->count - i);
+    memmove(node->kids + i + 1, node->kids + i, (node->count - i) * sizeof(Node*));
+    node->labels[i] = label;
+    node->kids[i] = node_new();
+    node->count++;
+    return node->kids[i];
+}
+
+static unsigned hash_node(const Node* node) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < node->count; i++) {
+        h = (h ^ node->labels[i]) * 16777619u;
+        h = (h ^ (unsigned)node->kids[i]->terminal) * 16777619u;
+        h = (h ^ (unsigned)node->kids[i]->unique) * 16777619u;
+    }
+    return h;
+}
+
+static int same_node(const Node* node, const Unique* u) {
+    if (node->count != u->count) return 0;
+    for (int i = 0; i < node->count; i++) {
+        if (node->labels[i] != u->labels[i] ||
+            node->kids[i]->terminal != u->term[i] ||
+            node->kids[i]->unique != u->kids[i]) return 0;
+    }
+    return 1;
+}
+
+static void table_grow(void) {
+    unsigned size = s_tableSize ? s_tableSize * 2 : 1024;
+    int* table = xalloc(size * sizeof(int));
+    for (unsigned i = 0; i < s_tableSize; i++) {
+        if (!s_table[i]) continue;
+        const Unique* u = &s_unique[s_table[i] - 1];
+        unsigned h = 2166136261u;
+        for (int k = 0; k < u->count; k++) {
+            h = (h ^ u->labels[k]) * 16777619u;
+            h = (h ^ (unsigned)u->term[k]) * 16777619u;
+            h = (h ^ (unsigned)u->kids[k]) * 16777619u;
+        }
+        unsigned slot = h & (size - 1);
+        while (table[slot]) slot = (slot + 1) & (size - 1);
+        table[slot] = s_table[i];
+    }
+    free(s_table);
+    s_table = table;
+    s_tableSize = size;
+}
+
+// Post-order: give every node the index of its unique equivalent
+static void minimize(Node* node) {
+    for (int i = 0; i < node->count; i++) {
+        minimize(node->kids[i]);
+    }
+
+    if ((unsigned)s_uniqueCount * 2 >= s_tableSize) table_grow();
+
+    unsigned slot = hash_node(node) & (s_tableSize - 1);
+    while (s_table[slot]) {
+        if (same_node(node, &s_unique[s_table[slot] - 1])) {
+            node->unique = s_table[slot] - 1;
+            return;
+        }
+        slot = (slot + 1) & (s_tableSize - 1);
+    }
+
+    if (s_uniqueCount == s_uniqueCap) {
+        s_uniqueCap = s_uniqueCap ? s_uniqueCap * 2 : 1024;
+        s_unique = realloc(s_unique, s_uniqueCap * sizeof(Unique));
+        if (!s_unique) {
+            fprintf(stderr, "mkdawg: out of memory\n");
+            exit(1);
+        }
+    }
+    Unique* u = &s_unique[s_uniqueCount];
+    u->count = node->count;
+    u->labels = node->labels;
+    u->term = xalloc((node->count + 1) * sizeof(int));
+    u->kids = xalloc((node->count + 1) * sizeof(int));
+    u->offset = 0;
+    for (int i = 0; i < node->count; i++) {
+        u->term[i] = node->kids[i]->terminal;
+        u->kids[i] = node->kids[i]->unique;
+    }
+    node->unique = s_uniqueCount++;
+    s_table[slot] = node->unique + 1;
+}
+
+static void put_u32(FILE* f, unsigned v) {
+    unsigned char b[4] = { v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, (v >> 24) & 0xFF };
+    fwrite(b, 1, 4, f);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s words.txt out.dawg\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    Node* root = node_new();
+    char line[MAX_WORD + 2];
+    int words = 0;
+    while (fgets(line, sizeof(line), in)) {
+        size_t len = strcspn(line, "\r\n");
+        if (len == 0 || len > MAX_WORD) continue;
+
+        Node* node = root;
+        for (size_t i = 0; i < len; i++) {
+            unsigned char c = line[i];
+            if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+            node = node_child(node, c);
+        }
+        words += !node->terminal;
+        node->terminal = 1;
+    }
+    fclose(in);
+
+    minimize(root);
+
+    // Lay out child runs; edge 0 is the reserved "no children" slot
+    unsigned edges = 1;
+    for (int i = 0; i < s_uniqueCount; i++) {
+        if (s_unique[i].count == 0) continue;
+        s_unique[i].offset = edges;
+        edges += s_unique[i].count;
+    }
+    if (edges >= DAWG_MAX_EDGES) {
+        fprintf(stderr, "mkdawg: %u edges do not fit the format\n", edges);
+        return 1;
+    }
+
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        perror(argv[2]);
+        return 1;
+    }
+    put_u32(out, DAWG_MAGIC);
+    put_u32(out, DAWG_VERSION);
+    put_u32(out, edges);
+    put_u32(out, s_unique[root->unique].offset);
+    put_u32(out, 0);
+    for (int i = 0; i < s_uniqueCount; i++) {
+        const Unique* u = &s_unique[i];
+        for (int k = 0; k < u->count; k++) {
+            unsigned flags = (u->term[k] ? DAWG_TERMINAL : 0) | (k == u->count - 1 ? DAWG_LAST : 0);
+            put_u32(out, DAWG_EDGE(u->labels[k], flags, s_unique[u->kids[k]].offset));
+        }
+    }
+    fclose(out);
+
+    printf("%d words, %d unique nodes, %u edges (%u bytes)\n",
+           words, s_uniqueCount, edges, (DAWG_HEADER_WORDS + edges) * 4);
+    return 0;
+}
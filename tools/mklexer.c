@@ -0,0 +1,608 @@
+//---------------------------------------------------------------------------------
+// mklexer.c
+// Host tool: compiles the code-block lexer rules below into DFA tables.
+//
+//   cc -O2 -o mklexer tools/mklexer.c && ./mklexer lexer_tables.h
+//
+// Each language is a set of modes (lex-style start conditions). A mode is a
+// list of rules: a pattern, the token kind it produces and the mode to switch
+// to afterwards. Patterns support literals, escapes, [sets], [^sets], '.',
+// and the postfix operators * + ?. Constructs that need alternation, such as
+// strings and block comments, are written as modes instead.
+//
+// Every mode's rules are turned into one NFA and determinized; bytes that no
+// pattern tells apart share a character class. The output is a header of
+// static const arrays, included by source/highlight.c.
+//---------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------------
+// Rule definitions
+//---------------------------------------------------------------------------------
+
+// Token kinds; must match HlKind in source/highlight.h
+#define K_TEXT     "HL_TEXT"
+#define K_KEYWORD  "HL_KEYWORD"
+#define K_STRING   "HL_STRING"
+#define K_NUMBER   "HL_NUMBER"
+#define K_COMMENT  "HL_COMMENT"
+#define K_PREPROC  "HL_PREPROC"
+#define K_VARIABLE "HL_VARIABLE"
+#define K_LITERAL  "HL_LITERAL"
+
+#define STAY -1
+
+typedef struct {
+    int mode;
+    const char* pattern;
+    const char* kind;
+    int next;
+} Rule;
+
+typedef struct {
+    const char* name;
+    int multiline;      // If 0, a line ending in this mode starts the next in mode 0
+} Mode;
+
+typedef struct {
+    const char* name;
+    const Mode* modes;
+    int modeCount;
+    const Rule* rules;
+    int ruleCount;
+    const char* const* keywords;
+    const char* const* literals;
+} Language;
+
+// Keyword and literal lists are expanded into literal rules that come before
+// the identifier rule, so an exact keyword wins a tie but "iffy" does not.
+
+enum { C_NORMAL, C_COMMENT, C_STRING, C_CHAR };
+static const Mode c_modes[] = {
+    { "normal", 1 }, { "comment", 1 }, { "string", 0 }, { "char", 0 },
+};
+static const Rule c_rules[] = {
+    { C_NORMAL,  "//.*",                    K_COMMENT, STAY },
+    { C_NORMAL,  "/\\*",                    K_COMMENT, C_COMMENT },
+    { C_NORMAL,  "\"",                      K_STRING,  C_STRING },
+    { C_NORMAL,  "'",                       K_STRING,  C_CHAR },
+    { C_NORMAL,  "#[ \t]*[a-z]+",           K_PREPROC, STAY },
+    { C_NORMAL,  "[0-9][0-9a-zA-Z_.]*",     K_NUMBER,  STAY },
+    { C_NORMAL,  "\\.[0-9][0-9a-zA-Z_.]*",  K_NUMBER,  STAY },
+    { C_NORMAL,  "[a-zA-Z_][a-zA-Z0-9_]*",  K_TEXT,    STAY },
+    { C_NORMAL,  "[ \t]+",                  K_TEXT,    STAY },
+    { C_COMMENT, "[^*]+",                   K_COMMENT, STAY },
+    { C_COMMENT, "\\*+",                    K_COMMENT, STAY },
+    { C_COMMENT, "\\*+/",                   K_COMMENT, C_NORMAL },
+    { C_STRING,  "[^\"\\\\]+",              K_STRING,  STAY },
+    { C_STRING,  "\\\\.?",                  K_STRING,  STAY },
+    { C_STRING,  "\"",                      K_STRING,  C_NORMAL },
+    { C_CHAR,    "[^'\\\\]+",               K_STRING,  STAY },
+    { C_CHAR,    "\\\\.?",                  K_STRING,  STAY },
+    { C_CHAR,    "'",                       K_STRING,  C_NORMAL },
+};
+static const char* const c_keywords[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do",
+    "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline",
+    "int", "long", "register", "restrict", "return", "short", "signed",
+    "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned",
+    "void", "volatile", "while", "bool", "size_t",
+    "u8", "u16", "u32", "u64", "s8", "s16", "s32", "s64", NULL,
+};
+static const char* const c_literals[] = { "true", "false", "NULL", NULL };
+
+enum { PY_NORMAL, PY_TDQ, PY_TSQ, PY_DQ, PY_SQ };
+static const Mode py_modes[] = {
+    { "normal", 1 }, { "tdq", 1 }, { "tsq", 1 }, { "dq", 0 }, { "sq", 0 },
+};
+static const Rule py_rules[] = {
+    { PY_NORMAL, "#.*",                          K_COMMENT, STAY },
+    { PY_NORMAL, "[rbfuRBFU]?[rbfuRBFU]?\"\"\"", K_STRING,  PY_TDQ },
+    { PY_NORMAL, "[rbfuRBFU]?[rbfuRBFU]?'''",    K_STRING,  PY_TSQ },
+    { PY_NORMAL, "[rbfuRBFU]?[rbfuRBFU]?\"",     K_STRING,  PY_DQ },
+    { PY_NORMAL, "[rbfuRBFU]?[rbfuRBFU]?'",      K_STRING,  PY_SQ },
+    { PY_NORMAL, "@[a-zA-Z_][a-zA-Z0-9_.]*",     K_PREPROC, STAY },
+    { PY_NORMAL, "[0-9][0-9a-zA-Z_.]*",          K_NUMBER,  STAY },
+    { PY_NORMAL, "[a-zA-Z_][a-zA-Z0-9_]*",       K_TEXT,    STAY },
+    { PY_NORMAL, "[ \t]+",                       K_TEXT,    STAY },
+    { PY_TDQ,    "[^\"\\\\]+",                   K_STRING,  STAY },
+    { PY_TDQ,    "\\\\.?",                       K_STRING,  STAY },
+    { PY_TDQ,    "\"\"?",                        K_STRING,  STAY },
+    { PY_TDQ,    "\"\"\"",                       K_STRING,  PY_NORMAL },
+    { PY_TSQ,    "[^'\\\\]+",                    K_STRING,  STAY },
+    { PY_TSQ,    "\\\\.?",                       K_STRING,  STAY },
+    { PY_TSQ,    "''?",                          K_STRING,  STAY },
+    { PY_TSQ,    "'''",                          K_STRING,  PY_NORMAL },
+    { PY_DQ,     "[^\"\\\\]+",                   K_STRING,  STAY },
+    { PY_DQ,     "\\\\.?",                       K_STRING,  STAY },
+    { PY_DQ,     "\"",                           K_STRING,  PY_NORMAL },
+    { PY_SQ,     "[^'\\\\]+",                    K_STRING,  STAY },
+    { PY_SQ,     "\\\\.?",                       K_STRING,  STAY },
+    { PY_SQ,     "'",                            K_STRING,  PY_NORMAL },
+};
+static const char* const py_keywords[] = {
+    "and", "as", "assert", "async", "await", "break", "class", "continue",
+    "def", "del", "elif", "else", "except", "finally", "for", "from", "global",
+    "if", "import", "in", "is", "lambda", "nonlocal", "not", "or", "pass",
+    "raise", "return", "try", "while", "with", "yield", NULL,
+};
+static const char* const py_literals[] = { "True", "False", "None", "self", NULL };
+
+enum { SH_NORMAL, SH_DQ, SH_SQ };
+static const Mode sh_modes[] = {
+    { "normal", 1 }, { "dq", 1 }, { "sq", 1 },
+};
+static const Rule sh_rules[] = {
+    { SH_NORMAL, "#.*",                      K_COMMENT,  STAY },
+    { SH_NORMAL, "\"",                       K_STRING,   SH_DQ },
+    { SH_NORMAL, "'",                        K_STRING,   SH_SQ },
+    { SH_NORMAL, "\\$[a-zA-Z_][a-zA-Z0-9_]*", K_VARIABLE, STAY },
+    { SH_NORMAL, "\\${[^}]*}?",              K_VARIABLE, STAY },
+    { SH_NORMAL, "\\$[0-9#?@*$!-]",          K_VARIABLE, STAY },
+    { SH_NORMAL, "\\\\.?",                   K_TEXT,     STAY },
+    { SH_NORMAL, "[0-9]+",                   K_NUMBER,   STAY },
+    { SH_NORMAL, "[a-zA-Z_][a-zA-Z0-9_-]*",  K_TEXT,     STAY },
+    { SH_NORMAL, "-[-a-zA-Z0-9_]+",          K_LITERAL,  STAY },
+    { SH_NORMAL, "[ \t]+",                   K_TEXT,     STAY },
+    { SH_DQ,     "[^\"\\\\$]+",              K_STRING,   STAY },
+    { SH_DQ,     "\\\\.?",                   K_STRING,   STAY },
+    { SH_DQ,     "\\$[a-zA-Z_][a-zA-Z0-9_]*", K_VARIABLE, STAY },
+    { SH_DQ,     "\\${[^}]*}?",              K_VARIABLE, STAY },
+    { SH_DQ,     "\\$",                      K_STRING,   STAY },
+    { SH_DQ,     "\"",                       K_STRING,   SH_NORMAL },
+    { SH_SQ,     "[^']+",                    K_STRING,   STAY },
+    { SH_SQ,     "'",                        K_STRING,   SH_NORMAL },
+};
+static const char* const sh_keywords[] = {
+    "if", "then", "else", "elif", "fi", "for", "while", "until", "do", "done",
+    "case", "esac", "in", "function", "return", "local", "export", "break",
+    "continue", "select", "echo", "cd", "exit", "set", "unset", "source",
+    "read", "printf", "test", NULL,
+};
+static const char* const sh_literals[] = { "true", "false", NULL };
+
+enum { JSON_NORMAL, JSON_STRING };
+static const Mode json_modes[] = {
+    { "normal", 1 }, { "string", 0 },
+};
+static const Rule json_rules[] = {
+    { JSON_NORMAL, "\"",                   K_STRING, JSON_STRING },
+    { JSON_NORMAL, "-?[0-9][0-9.eE+-]*",   K_NUMBER, STAY },
+    { JSON_NORMAL, "[a-zA-Z_][a-zA-Z0-9_]*", K_TEXT, STAY },
+    { JSON_NORMAL, "[ \t]+",               K_TEXT,   STAY },
+    { JSON_STRING, "[^\"\\\\]+",           K_STRING, STAY },
+    { JSON_STRING, "\\\\.?",               K_STRING, STAY },
+    { JSON_STRING, "\"",                   K_STRING, JSON_NORMAL },
+};
+static const char* const json_literals[] = { "true", "false", "null", NULL };
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+// Order must match HlLang in source/highlight.h
+static const Language s_languages[] = {
+    { "c",      c_modes,    COUNT(c_modes),    c_rules,    COUNT(c_rules),    c_keywords,  c_literals },
+    { "python", py_modes,   COUNT(py_modes),   py_rules,   COUNT(py_rules),   py_keywords, py_literals },
+    { "shell",  sh_modes,   COUNT(sh_modes),   sh_rules,   COUNT(sh_rules),   sh_keywords, sh_literals },
+    { "json",   json_modes, COUNT(json_modes), json_rules, COUNT(json_rules), NULL,        json_literals },
+};
+
+//---------------------------------------------------------------------------------
+// NFA construction
+//---------------------------------------------------------------------------------
+
+#define MAX_NFA     8192
+#define MAX_DFA     4096
+#define MAX_RULES   256
+#define MAX_CLASSES 256
+
+typedef enum { NS_SET, NS_EPS, NS_SPLIT, NS_ACCEPT } NKind;
+
+typedef struct {
+    NKind kind;
+    unsigned char set[32];
+    int out, out2;
+    int rule;
+} NState;
+
+typedef struct {
+    int start, end;    // `end` is an NS_EPS state whose `out` is still open
+} Frag;
+
+// Expanded rule list for one language, keywords first within each mode
+typedef struct {
+    int mode;
+    char pattern[64];
+    const char* kind;
+    int next;
+} FlatRule;
+
+static NState s_nfa[MAX_NFA];
+static int s_nfaCount;
+static FlatRule s_rules[MAX_RULES];
+static int s_ruleCount;
+
+static void die(const char* msg, const char* detail) {
+    fprintf(stderr, "mklexer: %s%s%s\n", msg, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+static int nfa_new(NKind kind) {
+    if (s_nfaCount == MAX_NFA) die("too many NFA states", NULL);
+    NState* s = &s_nfa[s_nfaCount];
+    memset(s, 0, sizeof(*s));
+    s->kind = kind;
+    s->out = s->out2 = -1;
+    s->rule = -1;
+    return s_nfaCount++;
+}
+
+static void set_add(unsigned char* set, int c) {
+    set[c >> 3] |= 1 << (c & 7);
+}
+
+static int set_has(const unsigned char* set, int c) {
+    return (set[c >> 3] >> (c & 7)) & 1;
+}
+
+static int parse_escape(const char** p) {
+    char c = *(*p)++;
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case '\0': die("dangling escape", NULL);
+    }
+    return (unsigned char)c;
+}
+
+static Frag frag_set(const unsigned char* set) {
+    Frag f;
+    f.start = nfa_new(NS_SET);
+    f.end = nfa_new(NS_EPS);
+    memcpy(s_nfa[f.start].set, set, 32);
+    s_nfa[f.start].out = f.end;
+    return f;
+}
+
+static Frag parse_atom(const char** p, const char* pattern) {
+    unsigned char set[32] = { 0 };
+    char c = *(*p)++;
+
+    if (c == '.') {
+        for (int i = 0; i < 256; i++) if (i != '\n') set_add(set, i);
+    } else if (c == '\\') {
+        set_add(set, parse_escape(p));
+    } else if (c == '[') {
+        int negate = 0;
+        if (**p == '^') {
+            negate = 1;
+            (*p)++;
+        }
+        while (**p && **p != ']') {
+            int lo = **p == '\\' ? ((*p)++, parse_escape(p)) : (unsigned char)*(*p)++;
+            int hi = lo;
+            if (**p == '-' && (*p)[1] && (*p)[1] != ']') {
+                (*p)++;
+                hi = **p == '\\' ? ((*p)++, parse_escape(p)) : (unsigned char)*(*p)++;
+            }
+            for (int i = lo; i <= hi; i++) set_add(set, i);
+        }
+        if (**p != ']') die("unterminated set", pattern);
+        (*p)++;
+        if (negate) {
+            for (int i = 0; i < 32; i++) set[i] = ~set[i];
+        }
+    } else {
+        set_add(set, (unsigned char)c);
+    }
+    return frag_set(set);
+}
+
+static Frag parse_pattern(const char* pattern) {
+    const char* p = pattern;
+    Frag result = { -1, -1 };
+
+    while (*p) {
+        Frag atom = parse_atom(&p, pattern);
+
+        if (*p == '*' || *p == '+' || *p == '?') {
+            char op = *p++;
+            int end = nfa_new(NS_EPS);
+            int split = nfa_new(NS_SPLIT);
+            s_nfa[split].out = atom.start;
+            s_nfa[split].out2 = end;
+            if (op == '?') {
+                s_nfa[atom.end].out = end;
+                atom.start = split;
+            } else {
+                s_nfa[atom.end].out = split;
+                if (op == '*') atom.start = split;
+            }
+            atom.end = end;
+        }
+
+        if (result.start < 0) {
+            result = atom;
+        } else {
+            s_nfa[result.end].out = atom.start;
+            result.end = atom.end;
+        }
+    }
+    if (result.start < 0) die("empty pattern", NULL);
+    return result;
+}
+
+static void add_rule(int mode, const char* pattern, const char* kind, int next) {
+    if (s_ruleCount == MAX_RULES) die("too many rules", NULL);
+    FlatRule* r = &s_rules[s_ruleCount++];
+    r->mode = mode;
+    snprintf(r->pattern, sizeof(r->pattern), "%s", pattern);
+    r->kind = kind;
+    r->next = next;
+}
+
+static void flatten_rules(const Language* lang) {
+    s_ruleCount = 0;
+    for (int m = 0; m < lang->modeCount; m++) {
+        // Words go first so they win ties against the identifier rule
+        if (m == 0) {
+            for (int i = 0; lang->keywords && lang->keywords[i]; i++) {
+                add_rule(0, lang->keywords[i], K_KEYWORD, STAY);
+            }
+            for (int i = 0; lang->literals && lang->literals[i]; i++) {
+                add_rule(0, lang->literals[i], K_LITERAL, STAY);
+            }
+        }
+        for (int i = 0; i < lang->ruleCount; i++) {
+            if (lang->rules[i].mode == m) {
+                add_rule(m, lang->rules[i].pattern, lang->rules[i].kind, lang->rules[i].next);
+            }
+        }
+    }
+}
+
+// One NFA per mode: a chain of splits into every rule of that mode
+static int build_mode_nfa(int mode) {
+    int start = -1;
+    for (int r = s_ruleCount - 1; r >= 0; r--) {
+        if (s_rules[r].mode != mode) continue;
+
+        Frag f = parse_pattern(s_rules[r].pattern);
+        int accept = nfa_new(NS_ACCEPT);
+        s_nfa[accept].rule = r;
+        s_nfa[f.end].out = accept;
+
+        if (start < 0) {
+            start = f.start;
+        } else {
+            int split = nfa_new(NS_SPLIT);
+            s_nfa[split].out = f.start;
+            s_nfa[split].out2 = start;
+            start = split;
+        }
+    }
+    if (start < 0) die("mode without rules", NULL);
+    return start;
+}
+
+//---------------------------------------------------------------------------------
+// Subset construction
+//---------------------------------------------------------------------------------
+
+typedef struct {
+    int count;
+    int* states;     // Sorted NS_SET / NS_ACCEPT states
+    int accept;      // Rule index + 1, 0 if not accepting
+} DState;
+
+static DState s_dfa[MAX_DFA];
+static int s_dfaCount;
+static int s_next[MAX_DFA][MAX_CLASSES];
+static int s_classOf[256];
+static int s_classRep[MAX_CLASSES];
+static int s_classCount;
+
+static int s_mark[MAX_NFA];
+static int s_markGen;
+
+static void closure_add(int s, int* list, int* count) {
+    if (s < 0 || s_mark[s] == s_markGen) return;
+    s_mark[s] = s_markGen;
+    switch (s_nfa[s].kind) {
+        case NS_EPS:
+            closure_add(s_nfa[s].out, list, count);
+            break;
+        case NS_SPLIT:
+            closure_add(s_nfa[s].out, list, count);
+            closure_add(s_nfa[s].out2, list, count);
+            break;
+        default:
+            list[(*count)++] = s;
+            break;
+    }
+}
+
+static int cmp_int(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// Returns the DFA state for the given NFA state list, creating it if new
+static int dfa_intern(int* list, int count) {
+    if (count == 0) return 0;
+    qsort(list, count, sizeof(int), cmp_int);
+
+    for (int d = 1; d < s_dfaCount; d++) {
+        if (s_dfa[d].count == count && memcmp(s_dfa[d].states, list, count * sizeof(int)) == 0) {
+            return d;
+        }
+    }
+    if (s_dfaCount == MAX_DFA) die("too many DFA states", NULL);
+
+    DState* d = &s_dfa[s_dfaCount];
+    d->count = count;
+    d->states = malloc(count * sizeof(int));
+    if (!d->states) die("out of memory", NULL);
+    memcpy(d->states, list, count * sizeof(int));
+    d->accept = 0;
+    for (int i = 0; i < count; i++) {
+        const NState* n = &s_nfa[list[i]];
+        if (n->kind == NS_ACCEPT && (d->accept == 0 || n->rule + 1 < d->accept)) {
+            d->accept = n->rule + 1;
+        }
+    }
+    return s_dfaCount++;
+}
+
+// Bytes that every set treats alike share one class
+static void build_classes(void) {
+    static unsigned char sig[256][MAX_NFA / 8];
+    size_t sigLen = (s_nfaCount + 7) / 8;
+
+    memset(sig, 0, sizeof(sig));
+    for (int s = 0; s < s_nfaCount; s++) {
+        if (s_nfa[s].kind != NS_SET) continue;
+        for (int c = 0; c < 256; c++) {
+            if (set_has(s_nfa[s].set, c)) sig[c][s >> 3] |= 1 << (s & 7);
+        }
+    }
+
+    s_classCount = 0;
+    for (int c = 0; c < 256; c++) {
+        int cls = -1;
+        for (int k = 0; k < s_classCount && cls < 0; k++) {
+            if (memcmp(sig[c], sig[s_classRep[k]], sigLen) == 0) cls = k;
+        }
+        if (cls < 0) {
+            if (s_classCount == MAX_CLASSES) die("too many classes", NULL);
+            cls = s_classCount;
+            s_classRep[s_classCount++] = c;
+        }
+        s_classOf[c] = cls;
+    }
+}
+
+static void determinize(void) {
+    int* list = malloc(MAX_NFA * sizeof(int));
+    if (!list) die("out of memory", NULL);
+
+    for (int d = 1; d < s_dfaCount; d++) {
+        for (int cls = 0; cls < s_classCount; cls++) {
+            int rep = s_classRep[cls];
+            int count = 0;
+            s_markGen++;
+            for (int i = 0; i < s_dfa[d].count; i++) {
+                const NState* n = &s_nfa[s_dfa[d].states[i]];
+                if (n->kind == NS_SET && set_has(n->set, rep)) {
+                    closure_add(n->out, list, &count);
+                }
+            }
+            s_next[d][cls] = dfa_intern(list, count);
+        }
+    }
+    free(list);
+}
+
+//---------------------------------------------------------------------------------
+// Output
+//---------------------------------------------------------------------------------
+static void emit_language(FILE* out, const Language* lang) {
+    int starts[16];
+    int* list = malloc(MAX_NFA * sizeof(int));
+    if (!list || lang->modeCount > 16) die("bad language", lang->name);
+
+    s_nfaCount = 0;
+    s_dfaCount = 1;   // State 0 is the dead state
+    flatten_rules(lang);
+
+    int nfaStarts[16];
+    for (int m = 0; m < lang->modeCount; m++) {
+        nfaStarts[m] = build_mode_nfa(m);
+    }
+    build_classes();
+    for (int m = 0; m < lang->modeCount; m++) {
+        int count = 0;
+        s_markGen++;
+        closure_add(nfaStarts[m], list, &count);
+        starts[m] = dfa_intern(list, count);
+    }
+    determinize();
+    free(list);
+
+    const char* n = lang->name;
+    fprintf(out, "// %s: %d rules, %d modes, %d states, %d classes\n",
+            n, s_ruleCount, lang->modeCount, s_dfaCount, s_classCount);
+
+    fprintf(out, "static const u8 lex_%s_class[256] = {", n);
+    for (int c = 0; c < 256; c++) {
+        fprintf(out, "%s%d,", c % 16 ? " " : "\n    ", s_classOf[c]);
+    }
+    fprintf(out, "\n};\n");
+
+    fprintf(out, "static const u16 lex_%s_next[%d][%d] = {\n", n, s_dfaCount, s_classCount);
+    for (int d = 0; d < s_dfaCount; d++) {
+        fprintf(out, "    {");
+        for (int cls = 0; cls < s_classCount; cls++) {
+            fprintf(out, "%s%d", cls ? "," : "", d ? s_next[d][cls] : 0);
+        }
+        fprintf(out, "},\n");
+    }
+    fprintf(out, "};\n");
+
+    fprintf(out, "static const u8 lex_%s_accept[%d] = {", n, s_dfaCount);
+    for (int d = 0; d < s_dfaCount; d++) {
+        fprintf(out, "%s%d,", d % 16 ? " " : "\n    ", s_dfa[d].accept);
+    }
+    fprintf(out, "\n};\n");
+
+    fprintf(out, "static const LexRule lex_%s_rules[%d] = {\n", n, s_ruleCount + 1);
+    fprintf(out, "    { HL_TEXT, LEX_STAY },\n");
+    for (int r = 0; r < s_ruleCount; r++) {
+        char next[16];
+        if (s_rules[r].next == STAY) {
+            snprintf(next, sizeof(next), "LEX_STAY");
+        } else {
+            snprintf(next, sizeof(next), "%d", s_rules[r].next);
+        }
+        fprintf(out, "    { %s, %s },  // %s\n", s_rules[r].kind, next, s_rules[r].pattern);
+    }
+    fprintf(out, "};\n");
+
+    fprintf(out, "static const LexMode lex_%s_modes[%d] = {\n", n, lang->modeCount);
+    for (int m = 0; m < lang->modeCount; m++) {
+        fprintf(out, "    { %d, %d },  // %s\n", starts[m], lang->modes[m].multiline, lang->modes[m].name);
+    }
+    fprintf(out, "};\n\n");
+
+    for (int d = 1; d < s_dfaCount; d++) free(s_dfa[d].states);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s lexer_tables.h\n", argv[0]);
+        return 1;
+    }
+
+    FILE* out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by tools/mklexer.c - do not edit.\n\n");
+    for (int i = 0; i < COUNT(s_languages); i++) {
+        emit_language(out, &s_languages[i]);
+    }
+
+    fprintf(out, "static const LexTables lex_tables[%d] = {\n", COUNT(s_languages));
+    for (int i = 0; i < COUNT(s_languages); i++) {
+        const char* n = s_languages[i].name;
+        fprintf(out, "    { lex_%s_class, &lex_%s_next[0][0], sizeof(lex_%s_next[0]) / sizeof(u16),\n"
+                     "      lex_%s_accept, lex_%s_rules, lex_%s_modes },\n", n, n, n, n, n, n);
+    }
+    fprintf(out, "};\n");
+
+    fclose(out);
+    return 0;
+}